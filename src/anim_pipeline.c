@@ -0,0 +1,436 @@
+/*
+ * anim_pipeline.c - Pipelined animation: read, regrid and colourise threads
+ *
+ * A fixed set of frames circulates through four single-producer/single-
+ * consumer rings:
+ *
+ *   free -> [read] -> read_out -> [regrid] -> regrid_out -> [colour] -> ready
+ *     ^                                                                 |
+ *     +--------------------- UI thread (anim_pipeline_next) <-----------+
+ *
+ * Each ring has exactly one thread pushing and one popping, so head and
+ * tail are plain atomics with acquire/release ordering and no locks. The
+ * UI thread only swaps a finished frame's buffers into the view, so the
+ * frame rate is bounded by the slowest stage rather than their sum.
+ */
+
+#include "anim_pipeline.h"
+#include "view.h"
+#include "regrid.h"
+#include "colormaps.h"
+#include "frame_stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Idle back-off of a stage with nothing to do */
+#define ANIM_IDLE_MIN_NS   50000L   /* 50 us */
+#define ANIM_IDLE_MAX_NS 2000000L   /* 2 ms */
+
+#define ANIM_MAX_FRAMES 64
+
+typedef struct {
+    size_t          time_index;
+    double          t_start;        /* When the read stage picked it up */
+    float          *raw_data;       /* [n_points] */
+    float          *regridded_data; /* [data_ny * data_nx] */
+    unsigned char  *color_pixels;   /* [data_ny * data_nx * 3], RGB frames only */
+    unsigned char  *pixels;         /* [display_ny * display_nx * 3], RGB frames only */
+    void           *native_pixels;  /* [display_ny * display_nx], native frames only */
+    USFrameStats   *stats;          /* Gathered by the colour stage */
+} AnimFrame;
+
+/* Bounded SPSC queue of frame pointers */
+typedef struct {
+    AnimFrame      *slots[ANIM_MAX_FRAMES];
+    size_t          mask;
+    /* Producer and consumer indices on separate cache lines */
+    _Alignas(64) atomic_size_t head;  /* Next slot to pop */
+    _Alignas(64) atomic_size_t tail;  /* Next slot to push */
+} AnimRing;
+
+typedef struct {
+    size_t          frames;
+    double          busy_total, busy_max;
+    double          queue_total;
+} StageCounters;
+
+typedef struct {
+    USAnimPipeline *anim;
+    AnimStage       stage;
+} StageArg;
+
+struct USAnimPipeline {
+    USView          snapshot;       /* View state the frames are rendered for */
+    unsigned long   generation;     /* view->generation when started */
+    USColormap     *cmap;
+    float           min_val, max_val, fill_value;
+    USColorLUT      lut;            /* Used when the view has a native format */
+    float           stats_min, stats_max;  /* Histogram range of every frame */
+    double         *row_weight;     /* [data_ny] own copy; the view frees its own on reconfiguration */
+    int             native;
+
+    AnimFrame       frames[ANIM_MAX_FRAMES];
+    int             n_frames;
+    AnimRing        rings[ANIM_N_STAGES + 1];  /* rings[s] feeds stage s; last is ready */
+    pthread_t       threads[ANIM_N_STAGES];
+    StageArg        args[ANIM_N_STAGES];
+    int             started[ANIM_N_STAGES];
+    size_t          next_time;      /* Read stage only */
+
+    atomic_int      stop;
+    atomic_int      failed;
+
+    pthread_mutex_t stats_lock;
+    StageCounters   counters[ANIM_N_STAGES];
+    size_t          frames_shown;
+    size_t          stalls;
+    double          latency_total;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void ring_init(AnimRing *ring, size_t capacity) {
+    ring->mask = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+static int ring_push(AnimRing *ring, AnimFrame *frame) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head > ring->mask) return 0;  /* Full */
+    ring->slots[tail & ring->mask] = frame;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static AnimFrame *ring_pop(AnimRing *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+    AnimFrame *frame = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return frame;
+}
+
+static size_t ring_depth(AnimRing *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return tail - head;
+}
+
+static void idle_wait(long *ns) {
+    struct timespec ts = { 0, *ns };
+    nanosleep(&ts, NULL);
+    *ns *= 2;
+    if (*ns > ANIM_IDLE_MAX_NS) *ns = ANIM_IDLE_MAX_NS;
+}
+
+/* Statistics of a regridded frame, rows south first like regridded_data */
+static void anim_frame_stats(const USAnimPipeline *anim, AnimFrame *frame) {
+    const USView *v = &anim->snapshot;
+    if (!frame->stats || !anim->row_weight) return;
+    frame_stats_begin(frame->stats, anim->stats_min, anim->stats_max, anim->fill_value);
+    for (size_t y = 0; y < v->data_ny; y++) {
+        frame_stats_add_row(frame->stats, frame->regridded_data + y * v->data_nx, v->data_nx,
+                            anim->row_weight[y]);
+    }
+    frame_stats_finish(frame->stats);
+}
+
+/* Run one stage on a frame; returns 0 on success */
+static int run_stage(USAnimPipeline *anim, AnimStage stage, AnimFrame *frame) {
+    const USView *v = &anim->snapshot;
+
+    switch (stage) {
+        case ANIM_STAGE_READ:
+            frame->time_index = anim->next_time;
+            anim->next_time = (anim->next_time + 1) % v->n_times;
+            frame->t_start = now_seconds();
+            return view_fetch_slice(v, frame->time_index, v->depth_index, frame->raw_data);
+        case ANIM_STAGE_REGRID:
+            regrid_apply(v->regrid, frame->raw_data, anim->fill_value, frame->regridded_data);
+            return 0;
+        case ANIM_STAGE_COLOR:
+            if (anim->native) {
+                colormap_apply_native(&anim->lut, frame->regridded_data, v->data_nx,
+                                      v->data_ny, frame->native_pixels, v->scale_factor);
+                anim_frame_stats(anim, frame);
+                return 0;
+            }
+            colormap_apply(anim->cmap, frame->regridded_data, v->data_nx, v->data_ny,
+                           anim->min_val, anim->max_val, anim->fill_value,
+                           frame->color_pixels);
+            colormap_expand_pixels(frame->color_pixels, v->data_nx, v->data_ny,
+                                   frame->pixels, v->scale_factor);
+            anim_frame_stats(anim, frame);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static void *stage_worker(void *arg) {
+    StageArg *sa = (StageArg *)arg;
+    USAnimPipeline *anim = sa->anim;
+    AnimStage stage = sa->stage;
+    AnimRing *in = &anim->rings[stage];
+    AnimRing *out = &anim->rings[stage + 1];
+    long idle_ns = ANIM_IDLE_MIN_NS;
+
+    while (!atomic_load(&anim->stop)) {
+        size_t waiting = ring_depth(in);
+        AnimFrame *frame = ring_pop(in);
+        if (!frame) {
+            idle_wait(&idle_ns);
+            continue;
+        }
+        idle_ns = ANIM_IDLE_MIN_NS;
+
+        double t0 = now_seconds();
+        if (run_stage(anim, stage, frame) != 0) {
+            atomic_store(&anim->failed, 1);
+            break;
+        }
+        double busy = now_seconds() - t0;
+
+        pthread_mutex_lock(&anim->stats_lock);
+        StageCounters *c = &anim->counters[stage];
+        c->frames++;
+        c->busy_total += busy;
+        if (busy > c->busy_max) c->busy_max = busy;
+        c->queue_total += (double)waiting;
+        pthread_mutex_unlock(&anim->stats_lock);
+
+        /* Cannot fail: every ring holds all frames */
+        ring_push(out, frame);
+    }
+    return NULL;
+}
+
+static void free_frames(USAnimPipeline *anim) {
+    for (int f = 0; f < anim->n_frames; f++) {
+        free(anim->frames[f].raw_data);
+        free(anim->frames[f].regridded_data);
+        free(anim->frames[f].color_pixels);
+        free(anim->frames[f].pixels);
+        view_free_pixels(&anim->snapshot, anim->frames[f].native_pixels);
+        free(anim->frames[f].stats);
+    }
+    free(anim->row_weight);
+}
+
+USAnimPipeline *anim_pipeline_create(USView *view, int n_frames) {
+    if (!view || !view->variable || !view->regrid || !view->color_pixels) return NULL;
+    if (view->render_mode != RENDER_MODE_INTERPOLATE || view->n_times < 2) return NULL;
+    if (view->dirty) return NULL;
+    /* The read stage keeps off the files other threads use through the prefetcher */
+    if (!view->prefetch) return NULL;
+    if (n_frames < 2) n_frames = 2;
+    if (n_frames > ANIM_MAX_FRAMES) n_frames = ANIM_MAX_FRAMES;
+
+    /* Equalised and autoscaled colours depend on each frame, and RGB frames scale linearly */
+    if (view->color_norm.mode == COLOR_NORM_HISTEQ || view->autoscale) return NULL;
+    if (!view->native_pixels && view->color_norm.mode != COLOR_NORM_LINEAR) return NULL;
+
+    USColormap *cmap = colormap_get_current();
+    if (!cmap) return NULL;
+
+    USAnimPipeline *anim = calloc(1, sizeof(USAnimPipeline));
+    if (!anim) return NULL;
+    anim->snapshot = *view;
+    anim->generation = view->generation;
+    anim->cmap = cmap;
+    anim->min_val = view->variable->user_min;
+    anim->max_val = view->variable->user_max;
+    anim->fill_value = view->variable->fill_value;
+    view_get_stats_range(view, &anim->stats_min, &anim->stats_max);
+    if (view->frame_stats && view->row_weight) {
+        anim->row_weight = malloc(view->data_ny * sizeof(double));
+        if (anim->row_weight) {
+            memcpy(anim->row_weight, view->row_weight, view->data_ny * sizeof(double));
+        }
+    }
+    anim->snapshot.row_weight = NULL;
+    anim->native = view->native_pixels &&
+                   colormap_lut_build_norm(&anim->lut, cmap, view->native_format, anim->min_val,
+                                           anim->max_val, anim->fill_value,
+                                           &view->color_norm) == 0;
+    anim->n_frames = n_frames;
+    anim->next_time = (view->time_index + 1) % view->n_times;
+    atomic_init(&anim->stop, 0);
+    atomic_init(&anim->failed, 0);
+    pthread_mutex_init(&anim->stats_lock, NULL);
+
+    size_t n_data = view->data_nx * view->data_ny;
+    size_t n_display = view->display_nx * view->display_ny;
+    for (int f = 0; f < n_frames; f++) {
+        AnimFrame *frame = &anim->frames[f];
+        frame->raw_data = malloc(view->raw_data_size * sizeof(float));
+        frame->regridded_data = malloc(n_data * sizeof(float));
+        if (anim->row_weight) frame->stats = malloc(sizeof(USFrameStats));
+        if (anim->native) {
+            frame->native_pixels = view_alloc_pixels(view, n_display *
+                                                     colormap_pixel_bytes(view->native_format));
+        } else {
+            frame->color_pixels = malloc(n_data * 3);
+            frame->pixels = malloc(n_display * 3);
+        }
+        if (!frame->raw_data || !frame->regridded_data ||
+            (anim->native ? !frame->native_pixels : (!frame->color_pixels || !frame->pixels))) {
+            fprintf(stderr, "Failed to allocate animation frames\n");
+            free_frames(anim);
+            pthread_mutex_destroy(&anim->stats_lock);
+            free(anim);
+            return NULL;
+        }
+    }
+
+    size_t capacity = 1;
+    while (capacity < (size_t)n_frames) capacity <<= 1;
+    for (int r = 0; r <= ANIM_N_STAGES; r++) {
+        ring_init(&anim->rings[r], capacity);
+    }
+    for (int f = 0; f < n_frames; f++) {
+        ring_push(&anim->rings[ANIM_STAGE_READ], &anim->frames[f]);
+    }
+
+    for (int s = 0; s < ANIM_N_STAGES; s++) {
+        StageArg *sa = &anim->args[s];
+        sa->anim = anim;
+        sa->stage = (AnimStage)s;
+        anim->started[s] = (pthread_create(&anim->threads[s], NULL, stage_worker, sa) == 0);
+        if (!anim->started[s]) {
+            fprintf(stderr, "Failed to start animation thread\n");
+            anim_pipeline_free(anim);
+            return NULL;
+        }
+    }
+    return anim;
+}
+
+int anim_pipeline_next(USAnimPipeline *anim, USView *view) {
+    if (!anim || !view) return -1;
+    if (atomic_load(&anim->failed) || view->generation != anim->generation) return -1;
+
+    AnimRing *ready = &anim->rings[ANIM_N_STAGES];
+    AnimFrame *frame = ring_pop(ready);
+    if (!frame) {
+        pthread_mutex_lock(&anim->stats_lock);
+        anim->stalls++;
+        pthread_mutex_unlock(&anim->stats_lock);
+        return 0;
+    }
+
+    /* Hand the finished buffers to the view and recycle the old ones */
+    float *raw = view->raw_data;
+    float *regridded = view->regridded_data;
+    view->raw_data = frame->raw_data;
+    view->regridded_data = frame->regridded_data;
+    frame->raw_data = raw;
+    frame->regridded_data = regridded;
+    if (anim->native) {
+        void *native = view->native_pixels;
+        view->native_pixels = frame->native_pixels;
+        frame->native_pixels = native;
+    } else {
+        unsigned char *color = view->color_pixels;
+        unsigned char *pixels = view->pixels;
+        view->color_pixels = frame->color_pixels;
+        view->pixels = frame->pixels;
+        frame->color_pixels = color;
+        frame->pixels = pixels;
+    }
+
+    view->time_step = 1;
+    view->depth_step = 0;
+    view->time_index = frame->time_index;
+    view->dirty = 0;
+    view->data_valid = 1;
+    view->native_valid = anim->native;
+    view->rgb_stale = anim->native;     /* RGB is recoloured from regridded_data on demand */
+    view->regrid_stale = 0;
+    view->index_valid = 0;
+    if (anim->native && view->palette) {
+        *view->palette = anim->lut;
+        view->palette_valid = 1;
+    }
+    if (frame->stats) {
+        USFrameStats *stats = view->frame_stats;
+        view->frame_stats = frame->stats;
+        frame->stats = stats;
+        view->stats_valid = 1;
+    } else {
+        view->stats_valid = 0;
+    }
+
+    pthread_mutex_lock(&anim->stats_lock);
+    anim->frames_shown++;
+    anim->latency_total += now_seconds() - frame->t_start;
+    pthread_mutex_unlock(&anim->stats_lock);
+
+    ring_push(&anim->rings[ANIM_STAGE_READ], frame);
+    return 1;
+}
+
+void anim_pipeline_get_stats(USAnimPipeline *anim, AnimStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!anim) return;
+
+    pthread_mutex_lock(&anim->stats_lock);
+    for (int s = 0; s < ANIM_N_STAGES; s++) {
+        StageCounters *c = &anim->counters[s];
+        AnimStageStats *st = &stats->stage[s];
+        st->frames = c->frames;
+        if (c->frames > 0) {
+            st->busy_ms_avg = c->busy_total * 1e3 / (double)c->frames;
+            st->queue_avg = c->queue_total / (double)c->frames;
+        }
+        st->busy_ms_max = c->busy_max * 1e3;
+        st->queue_depth = ring_depth(&anim->rings[s]);
+    }
+    stats->frames_shown = anim->frames_shown;
+    stats->stalls = anim->stalls;
+    if (anim->frames_shown > 0) {
+        stats->latency_ms_avg = anim->latency_total * 1e3 / (double)anim->frames_shown;
+    }
+    pthread_mutex_unlock(&anim->stats_lock);
+    stats->ready_depth = ring_depth(&anim->rings[ANIM_N_STAGES]);
+}
+
+void anim_pipeline_format_stats(const AnimStats *stats, char *out, size_t outlen) {
+    static const char *names[ANIM_N_STAGES] = { "read", "regrid", "colour" };
+    if (!stats || !out || outlen == 0) return;
+
+    size_t len = (size_t)snprintf(out, outlen, "%zu frames", stats->frames_shown);
+    for (int s = 0; s < ANIM_N_STAGES && len < outlen; s++) {
+        const AnimStageStats *st = &stats->stage[s];
+        len += (size_t)snprintf(out + len, outlen - len, " | %s %.1f ms (max %.1f, q %.1f)",
+                                names[s], st->busy_ms_avg, st->busy_ms_max, st->queue_avg);
+    }
+    if (len < outlen) {
+        snprintf(out + len, outlen - len, " | latency %.1f ms, %zu stalls",
+                 stats->latency_ms_avg, stats->stalls);
+    }
+}
+
+void anim_pipeline_free(USAnimPipeline *anim) {
+    if (!anim) return;
+
+    atomic_store(&anim->stop, 1);
+    for (int s = 0; s < ANIM_N_STAGES; s++) {
+        if (anim->started[s]) pthread_join(anim->threads[s], NULL);
+    }
+    free_frames(anim);
+    pthread_mutex_destroy(&anim->stats_lock);
+    free(anim);
+}
@@ -0,0 +1,74 @@
+/*
+ * anim_pipeline.h - Pipelined animation: read, regrid and colourise threads
+ */
+
+#ifndef ANIM_PIPELINE_H
+#define ANIM_PIPELINE_H
+
+#include "ushow.defines.h"
+
+/* Default number of frames in flight */
+#define ANIM_PIPELINE_FRAMES 6
+
+/* Worker stages, in pipeline order */
+typedef enum {
+    ANIM_STAGE_READ = 0,
+    ANIM_STAGE_REGRID,
+    ANIM_STAGE_COLOR,
+    ANIM_N_STAGES
+} AnimStage;
+
+typedef struct {
+    size_t      frames;             /* Frames completed */
+    double      busy_ms_avg;        /* Mean time per frame */
+    double      busy_ms_max;
+    double      queue_avg;          /* Mean frames waiting at the input */
+    size_t      queue_depth;        /* Frames waiting at the input now */
+} AnimStageStats;
+
+typedef struct {
+    AnimStageStats stage[ANIM_N_STAGES];
+    size_t      frames_shown;
+    size_t      ready_depth;        /* Finished frames not yet shown */
+    size_t      stalls;             /* Requests that found no frame ready */
+    double      latency_ms_avg;     /* From start of read to display */
+} AnimStats;
+
+/*
+ * Start animating forward from the view's current time step. Each stage
+ * runs on its own thread and works on a different time step; frames are
+ * passed between them through single-producer/single-consumer rings.
+ * The view must be up to date (view_update() called) and have a
+ * prefetcher, whose prefetch_pause() keeps other threads' file reads
+ * apart from the read stage's. Returns NULL if the view cannot be
+ * pipelined (no prefetcher, polygon mode, single time step, histogram
+ * equalisation, or a non-linear norm without native pixels) or on
+ * allocation failure.
+ */
+USAnimPipeline *anim_pipeline_create(USView *view, int n_frames);
+
+/*
+ * Show the next frame if one is ready by swapping its buffers into the
+ * view and advancing view->time_index. Does not block.
+ * Returns 1 if a frame was taken, 0 if none is ready yet, and -1 if the
+ * pipeline failed or the view changed since it was started (colormap,
+ * range, position, ...); free it and fall back or start a new one.
+ */
+int anim_pipeline_next(USAnimPipeline *anim, USView *view);
+
+/*
+ * Read per-stage throughput, latency and queue depths.
+ */
+void anim_pipeline_get_stats(USAnimPipeline *anim, AnimStats *stats);
+
+/*
+ * Format stats as a single line for the console or status bar.
+ */
+void anim_pipeline_format_stats(const AnimStats *stats, char *out, size_t outlen);
+
+/*
+ * Stop the worker threads and free all frames.
+ */
+void anim_pipeline_free(USAnimPipeline *anim);
+
+#endif /* ANIM_PIPELINE_H */
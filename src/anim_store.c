@@ -0,0 +1,316 @@
+/*
+ * anim_store.c - Compressed in-memory store of a whole time axis
+ *
+ * Each slice is byte-shuffled (byte k of every value gathered into plane
+ * k, so the slowly varying sign/exponent bytes and fill-valued regions
+ * form long runs) and the planes are compressed as one block: with LZ4
+ * when the build has it (WITH_ZARR), otherwise with PackBits run-length
+ * coding. ANIM_STORE_U16 quantises to 16 bits per value first.
+ */
+
+#include "anim_store.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#ifdef HAVE_ZARR
+#include <lz4.h>
+#endif
+
+/* Quantised code marking a fill value */
+#define ANIM_U16_FILL   UINT16_MAX
+#define ANIM_U16_LEVELS (UINT16_MAX - 1)
+
+typedef struct {
+    unsigned char *data;            /* Compressed planes, NULL if not stored */
+    size_t      bytes;
+    float       q_min;              /* Quantisation offset and step (U16 mode) */
+    float       q_step;
+} AnimSlice;
+
+struct USAnimStore {
+    USSliceKey  key;                /* Time index unused */
+    size_t      n_times;
+    size_t      n_points;
+    AnimStoreMode mode;
+    float       fill_value;
+    size_t      value_bytes;        /* Bytes per value as stored (4 or 2) */
+    AnimSlice  *slices;
+    size_t      n_stored;
+    size_t      stored_bytes;
+    double      max_error;
+
+    /* Decode scratch, shared by lookups */
+    unsigned char *planes;
+    unsigned char *packed;
+    pthread_mutex_t lock;
+};
+
+/* ========== Byte planes ========== */
+
+static void shuffle(const unsigned char *in, size_t n, size_t width, unsigned char *out) {
+    for (size_t b = 0; b < width; b++) {
+        unsigned char *plane = out + b * n;
+        for (size_t i = 0; i < n; i++) plane[i] = in[i * width + b];
+    }
+}
+
+static void unshuffle(const unsigned char *in, size_t n, size_t width, unsigned char *out) {
+    for (size_t b = 0; b < width; b++) {
+        const unsigned char *plane = in + b * n;
+        for (size_t i = 0; i < n; i++) out[i * width + b] = plane[i];
+    }
+}
+
+/* ========== Block codec ========== */
+
+#ifdef HAVE_ZARR
+
+static size_t codec_bound(size_t n) {
+    return (size_t)LZ4_compressBound((int)n);
+}
+
+static size_t codec_encode(const unsigned char *in, size_t n, unsigned char *out, size_t cap) {
+    int len = LZ4_compress_default((const char *)in, (char *)out, (int)n, (int)cap);
+    return (len > 0) ? (size_t)len : 0;
+}
+
+static int codec_decode(const unsigned char *in, size_t len, unsigned char *out, size_t n) {
+    int got = LZ4_decompress_safe((const char *)in, (char *)out, (int)len, (int)n);
+    return (got == (int)n) ? 0 : -1;
+}
+
+#else
+
+/*
+ * PackBits: a header byte h < 128 is followed by h + 1 literal bytes;
+ * h > 128 means the next byte repeats 257 - h times (2..128).
+ */
+static size_t codec_bound(size_t n) {
+    return n + n / 128 + 1;
+}
+
+static size_t codec_encode(const unsigned char *in, size_t n, unsigned char *out, size_t cap) {
+    size_t o = 0, i = 0;
+    (void)cap;
+    while (i < n) {
+        size_t run = 1;
+        while (i + run < n && run < 128 && in[i + run] == in[i]) run++;
+        if (run >= 3) {
+            out[o++] = (unsigned char)(257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        /* Literals up to the next run of three */
+        size_t lit = 0;
+        while (i + lit < n && lit < 128) {
+            if (i + lit + 2 < n && in[i + lit] == in[i + lit + 1] &&
+                in[i + lit] == in[i + lit + 2]) break;
+            lit++;
+        }
+        out[o++] = (unsigned char)(lit - 1);
+        memcpy(out + o, in + i, lit);
+        o += lit;
+        i += lit;
+    }
+    return o;
+}
+
+static int codec_decode(const unsigned char *in, size_t len, unsigned char *out, size_t n) {
+    size_t i = 0, o = 0;
+    while (i < len) {
+        unsigned h = in[i++];
+        if (h < 128) {
+            size_t lit = h + 1;
+            if (i + lit > len || o + lit > n) return -1;
+            memcpy(out + o, in + i, lit);
+            i += lit;
+            o += lit;
+        } else if (h > 128) {
+            size_t run = 257 - h;
+            if (i >= len || o + run > n) return -1;
+            memset(out + o, in[i++], run);
+            o += run;
+        }
+    }
+    return (o == n) ? 0 : -1;
+}
+
+#endif
+
+/* ========== Quantisation ========== */
+
+static int value_valid(float v, float fill_value) {
+    return v != fill_value && fabsf(v) < 1e30f;
+}
+
+/* Quantise a slice to 16-bit codes; returns the largest rounding error */
+static double quantise(const float *data, size_t n, float fill_value,
+                       uint16_t *codes, float *q_min, float *q_step) {
+    float lo = 0.0f, hi = 0.0f;
+    int any = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!value_valid(data[i], fill_value)) continue;
+        if (!any || data[i] < lo) lo = data[i];
+        if (!any || data[i] > hi) hi = data[i];
+        any = 1;
+    }
+    float step = (hi > lo) ? (hi - lo) / (float)ANIM_U16_LEVELS : 1.0f;
+    *q_min = lo;
+    *q_step = step;
+
+    double max_err = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        if (!value_valid(data[i], fill_value)) {
+            codes[i] = ANIM_U16_FILL;
+            continue;
+        }
+        long q = lroundf((data[i] - lo) / step);
+        if (q < 0) q = 0;
+        if (q > ANIM_U16_LEVELS) q = ANIM_U16_LEVELS;
+        codes[i] = (uint16_t)q;
+        double err = fabs((double)(lo + (float)q * step) - (double)data[i]);
+        if (err > max_err) max_err = err;
+    }
+    return max_err;
+}
+
+/* ========== Store ========== */
+
+USAnimStore *anim_store_create(const USSliceKey *key, size_t n_times, size_t n_points,
+                               AnimStoreMode mode, float fill_value) {
+    if (!key || n_times == 0 || n_points == 0) return NULL;
+
+    USAnimStore *store = calloc(1, sizeof(USAnimStore));
+    if (!store) return NULL;
+    store->key = *key;
+    store->key.time_index = 0;
+    store->n_times = n_times;
+    store->n_points = n_points;
+    store->mode = mode;
+    store->fill_value = fill_value;
+    store->value_bytes = (mode == ANIM_STORE_U16) ? sizeof(uint16_t) : sizeof(float);
+
+    size_t raw = n_points * store->value_bytes;
+    store->slices = calloc(n_times, sizeof(AnimSlice));
+    store->planes = malloc(raw);
+    store->packed = malloc(raw);
+    if (!store->slices || !store->planes || !store->packed) {
+        fprintf(stderr, "Failed to allocate animation store\n");
+        free(store->slices);
+        free(store->planes);
+        free(store->packed);
+        free(store);
+        return NULL;
+    }
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+int anim_store_put(USAnimStore *store, size_t time_index, const float *data) {
+    if (!store || !data || time_index >= store->n_times) return -1;
+
+    size_t n = store->n_points;
+    size_t raw = n * store->value_bytes;
+    AnimSlice slice = {0};
+    const unsigned char *values = (const unsigned char *)data;
+
+    pthread_mutex_lock(&store->lock);
+    if (store->mode == ANIM_STORE_U16) {
+        uint16_t *codes = (uint16_t *)store->packed;
+        double err = quantise(data, n, store->fill_value, codes, &slice.q_min, &slice.q_step);
+        if (err > store->max_error) store->max_error = err;
+        values = store->packed;
+    }
+    shuffle(values, n, store->value_bytes, store->planes);
+
+    size_t cap = codec_bound(raw);
+    unsigned char *buf = malloc(cap);
+    size_t len = buf ? codec_encode(store->planes, raw, buf, cap) : 0;
+    if (len == 0) {
+        pthread_mutex_unlock(&store->lock);
+        free(buf);
+        fprintf(stderr, "Failed to compress animation slice %zu\n", time_index);
+        return -1;
+    }
+    unsigned char *shrunk = realloc(buf, len);
+    slice.data = shrunk ? shrunk : buf;
+    slice.bytes = len;
+
+    AnimSlice *old = &store->slices[time_index];
+    if (old->data) {
+        store->stored_bytes -= old->bytes;
+        free(old->data);
+    } else {
+        store->n_stored++;
+    }
+    *old = slice;
+    store->stored_bytes += len;
+    pthread_mutex_unlock(&store->lock);
+    return 0;
+}
+
+int anim_store_get(USAnimStore *store, const USSliceKey *key, float *out, size_t n) {
+    if (!store || !key || !out || n != store->n_points) return 0;
+    if (key->source != store->key.source || key->var != store->key.var ||
+        key->depth_index != store->key.depth_index ||
+        key->time_index >= store->n_times) return 0;
+
+    pthread_mutex_lock(&store->lock);
+    const AnimSlice *slice = &store->slices[key->time_index];
+    if (!slice->data) {
+        pthread_mutex_unlock(&store->lock);
+        return 0;
+    }
+
+    size_t raw = n * store->value_bytes;
+    if (codec_decode(slice->data, slice->bytes, store->planes, raw) != 0) {
+        pthread_mutex_unlock(&store->lock);
+        fprintf(stderr, "Corrupt animation slice %zu\n", key->time_index);
+        return 0;
+    }
+
+    if (store->mode == ANIM_STORE_U16) {
+        uint16_t *codes = (uint16_t *)store->packed;
+        unshuffle(store->planes, n, sizeof(uint16_t), store->packed);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = (codes[i] == ANIM_U16_FILL) ? store->fill_value :
+                     slice->q_min + (float)codes[i] * slice->q_step;
+        }
+    } else {
+        unshuffle(store->planes, n, sizeof(float), (unsigned char *)out);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return 1;
+}
+
+int anim_store_covers(const USAnimStore *store, const USSliceKey *key) {
+    return store && key && key->source == store->key.source && key->var == store->key.var &&
+           key->depth_index == store->key.depth_index && store->n_stored == store->n_times;
+}
+
+void anim_store_get_stats(const USAnimStore *store, USAnimStoreStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!store) return;
+    stats->n_times = store->n_times;
+    stats->n_stored = store->n_stored;
+    stats->raw_bytes = store->n_stored * store->n_points * sizeof(float);
+    stats->stored_bytes = store->stored_bytes;
+    stats->max_error = store->max_error;
+}
+
+void anim_store_free(USAnimStore *store) {
+    if (!store) return;
+    for (size_t t = 0; t < store->n_times; t++) free(store->slices[t].data);
+    free(store->slices);
+    free(store->planes);
+    free(store->packed);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
+}
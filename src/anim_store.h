@@ -0,0 +1,62 @@
+/*
+ * anim_store.h - Compressed in-memory store of a whole time axis
+ *
+ * Holds every time step of one variable at one depth, each slice
+ * compressed on its own so any step can be decoded without its
+ * neighbours. Lookups are safe to make from several threads once the
+ * store is filled; filling is single-threaded.
+ */
+
+#ifndef ANIM_STORE_H
+#define ANIM_STORE_H
+
+#include "ushow.defines.h"
+#include "slice_cache.h"
+
+/* Store counters */
+typedef struct {
+    size_t      n_times;        /* Time steps the store spans */
+    size_t      n_stored;       /* Time steps filled so far */
+    size_t      raw_bytes;      /* Size of the stored slices as floats */
+    size_t      stored_bytes;   /* Size after compression */
+    double      max_error;      /* Largest absolute decoding error (0 if lossless) */
+} USAnimStoreStats;
+
+/*
+ * Create an empty store for n_times slices of n_points values, matching
+ * key in everything but the time index. In ANIM_STORE_U16 mode valid
+ * values (not fill_value, finite magnitude below 1e30) are quantised to
+ * 16 bits against each slice's own range; everything else decodes to
+ * fill_value. Returns NULL on bad arguments or allocation failure.
+ */
+USAnimStore *anim_store_create(const USSliceKey *key, size_t n_times, size_t n_points,
+                               AnimStoreMode mode, float fill_value);
+
+/*
+ * Compress and store the slice for time_index, replacing any earlier one.
+ * Returns 0 on success, -1 on a bad index or allocation failure.
+ */
+int anim_store_put(USAnimStore *store, size_t time_index, const float *data);
+
+/*
+ * Decode the slice for key into out if the store holds it and it has n
+ * values. Returns 1 on a hit, 0 on a miss.
+ */
+int anim_store_get(USAnimStore *store, const USSliceKey *key, float *out, size_t n);
+
+/*
+ * Whether the store holds every time step for key's variable and depth.
+ */
+int anim_store_covers(const USAnimStore *store, const USSliceKey *key);
+
+/*
+ * Read the store's size and error counters.
+ */
+void anim_store_get_stats(const USAnimStore *store, USAnimStoreStats *stats);
+
+/*
+ * Free the store and all slices.
+ */
+void anim_store_free(USAnimStore *store);
+
+#endif /* ANIM_STORE_H */
@@ -8,8 +8,17 @@
 #include <string.h>
 #include <math.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(COLORMAP_NO_SIMD)
+#define COLORMAP_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
 #define N_COLORS 256
 
+/* Forced LUT kernels (COLORMAP_LUT_AUTO = runtime dispatch) */
+static ColormapLutKernel lut_kernel = COLORMAP_LUT_AUTO;
+
 /* Viridis colormap definition (approximation) */
 static void create_viridis_colormap(USColormap *cmap) {
     strcpy(cmap->name, "viridis");
@@ -269,6 +278,717 @@ void colormap_apply_scaled(const USColormap *cmap, const float *data,
     }
 }
 
+void colormap_expand_pixels(const unsigned char *src, size_t nx, size_t ny,
+                            unsigned char *dst, int scale) {
+    if (!src || !dst || scale < 1) return;
+
+    if (scale == 1) {
+        memcpy(dst, src, nx * ny * 3);
+        return;
+    }
+
+    size_t row_bytes = nx * scale * 3;
+
+    for (size_t y = 0; y < ny; y++) {
+        const unsigned char *in = src + y * nx * 3;
+        unsigned char *out = dst + y * scale * row_bytes;
+
+        /* Widen the first display row, then copy it for the rest of the block */
+        unsigned char *p = out;
+        for (size_t x = 0; x < nx; x++) {
+            for (int sx = 0; sx < scale; sx++) {
+                p[0] = in[x * 3 + 0];
+                p[1] = in[x * 3 + 1];
+                p[2] = in[x * 3 + 2];
+                p += 3;
+            }
+        }
+        for (int sy = 1; sy < scale; sy++) {
+            memcpy(out + sy * row_bytes, out, row_bytes);
+        }
+    }
+}
+
+size_t colormap_pixel_bytes(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_XRGB8888: return 4;
+        case PIXEL_FORMAT_RGB565:   return 2;
+        default:                    return 0;
+    }
+}
+
+uint32_t colormap_pack_pixel(PixelFormat format,
+                             unsigned char r, unsigned char g, unsigned char b) {
+    if (format == PIXEL_FORMAT_RGB565) {
+        return ((uint32_t)(r >> 3) << 11) | ((uint32_t)(g >> 2) << 5) | (b >> 3);
+    }
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+/* Float bit pattern as a signed integer, and back */
+static inline int32_t float_bits(float v) {
+    int32_t b;
+    memcpy(&b, &v, sizeof(b));
+    return b;
+}
+
+static inline float bits_float(int32_t b) {
+    float v;
+    memcpy(&v, &b, sizeof(v));
+    return v;
+}
+
+/*
+ * Signed log offset of v: the bit pattern of |v| above the floor, negated
+ * for negative v. Monotonic in v and 0 wherever |v| is at or below the
+ * floor; the bit pattern of a float grows linearly within each octave.
+ */
+static inline int32_t log_offset(const USColorLUT *lut, float v) {
+    int32_t bits = float_bits(v);
+    int32_t d = (bits & 0x7fffffff) - lut->floor_bits;
+    if (d < 0) d = 0;
+    return (bits < 0) ? -d : d;
+}
+
+/* Value at a log offset (inverse of log_offset() above the floor) */
+static float log_offset_value(const USColorLUT *lut, int32_t m) {
+    if (m == 0) return 0.0f;
+    float a = bits_float((m < 0 ? -m : m) + lut->floor_bits);
+    return (m < 0) ? -a : a;
+}
+
+/* Smallest value a log norm resolves: min, or COLOR_NORM_LOG_DECADES below max */
+static float log_norm_floor(float min_val, float max_val) {
+    return (min_val > 0.0f) ? min_val : max_val * powf(10.0f, -COLOR_NORM_LOG_DECADES);
+}
+
+static float symlog(float v, float linthresh) {
+    return copysignf(log1pf(fabsf(v) / linthresh), v);
+}
+
+/*
+ * Quantise by log offset over [lo, hi], with |v| <= floor as 0. Returns 0
+ * (and leaves linear quantisation) when the span is too narrow to need it.
+ */
+static int lut_setup_log(USColorLUT *lut, float floor, float lo, float hi) {
+    int32_t hi_bits = float_bits(fmaxf(fabsf(lo), fabsf(hi)));
+    int32_t floor_bits = float_bits(floor);
+    /* At most 64 octaves below the largest magnitude keeps offsets in 31 bits */
+    if (floor_bits < hi_bits - (1 << 29)) floor_bits = hi_bits - (1 << 29);
+    lut->floor_bits = floor_bits;
+    lut->base = log_offset(lut, lo);
+    lut->top = log_offset(lut, hi);
+    if (lut->top - lut->base < COLORMAP_LUT_SIZE) return 0;
+
+    int shift = 0;
+    while (((lut->top - lut->base) >> shift) > COLORMAP_LUT_SIZE - 1) shift++;
+    lut->shift = shift;
+    lut->n_steps = (float)((lut->top - lut->base) >> shift);
+    lut->log_quant = 1;
+    return 1;
+}
+
+/* Value entry k stands for: the centre of its interval, max for the last */
+static float lut_entry_value(const USColorLUT *lut, int k) {
+    int n_steps = (int)lut->n_steps;
+    if (k >= n_steps) return lut->min_val + lut->range;
+    if (lut->log_quant) {
+        int64_t m = (int64_t)lut->base + ((int64_t)k << lut->shift) +
+                    (((int64_t)1 << lut->shift) >> 1);
+        return log_offset_value(lut, (int32_t)m);
+    }
+    return lut->min_val + ((float)k + 0.5f) / lut->n_steps * lut->range;
+}
+
+/* Colormap position of v under the LUT's norm (histogram equalisation aside) */
+static float lut_norm_position(const USColorLUT *lut, float v) {
+    float lo = lut->min_val, hi = lut->min_val + lut->range;
+    float t;
+    switch (lut->norm.mode) {
+        case COLOR_NORM_LOG: {
+            float floor = log_norm_floor(lo, hi);
+            t = (v <= floor) ? 0.0f : logf(v / floor) / logf(hi / floor);
+            break;
+        }
+        case COLOR_NORM_SYMLOG: {
+            float s0 = symlog(lo, lut->norm.linthresh);
+            float s1 = symlog(hi, lut->norm.linthresh);
+            t = (symlog(v, lut->norm.linthresh) - s0) / (s1 - s0);
+            break;
+        }
+        case COLOR_NORM_POWER:
+            t = (v - lo) / lut->range;
+            t = powf(fminf(fmaxf(t, 0.0f), 1.0f), lut->norm.gamma);
+            break;
+        default:
+            t = (v - lo) / lut->range;
+            break;
+    }
+    return fminf(fmaxf(t, 0.0f), 1.0f);
+}
+
+/* Give entry k the colour at colormap position pos */
+static void lut_set_entry(USColorLUT *lut, const USColormap *cmap, int k, float pos) {
+    int idx = (int)(pos * (float)(cmap->n_colors - 1));
+    if (idx < 0) idx = 0;
+    if (idx >= cmap->n_colors) idx = cmap->n_colors - 1;
+    const USColor *c = &cmap->colors[idx];
+    lut->pos[k] = pos;
+    lut->colors[k] = colormap_pack_pixel(lut->format, c->r, c->g, c->b);
+}
+
+int colormap_lut_build(USColorLUT *lut, const USColormap *cmap, PixelFormat format,
+                       float min_val, float max_val, float fill_value) {
+    return colormap_lut_build_norm(lut, cmap, format, min_val, max_val, fill_value, NULL);
+}
+
+int colormap_lut_build_norm(USColorLUT *lut, const USColormap *cmap, PixelFormat format,
+                            float min_val, float max_val, float fill_value,
+                            const USColorNorm *norm) {
+    if (!lut || !cmap || !cmap->colors || cmap->n_colors < 1) return -1;
+    if (colormap_pixel_bytes(format) == 0) return -1;
+
+    float range = max_val - min_val;
+    if (range <= 0.0f) range = 1.0f;
+    float hi = min_val + range;
+    lut->format = format;
+    lut->min_val = min_val;
+    lut->range = range;
+    lut->fill_value = fill_value;
+    lut->log_quant = 0;
+    lut->floor_bits = lut->base = lut->top = 0;
+    lut->shift = 0;
+
+    USColorNorm n = { COLOR_NORM_LINEAR, 0.0f, 0.0f };
+    if (norm && norm->mode > COLOR_NORM_LINEAR && norm->mode < COLOR_NORM_COUNT) n = *norm;
+    if (n.mode == COLOR_NORM_LOG) {
+        if (hi <= 0.0f) {
+            n.mode = COLOR_NORM_LINEAR;     /* Nothing positive to show */
+        } else {
+            float floor = log_norm_floor(min_val, hi);
+            lut_setup_log(lut, floor, fmaxf(min_val, floor), hi);
+        }
+    } else if (n.mode == COLOR_NORM_SYMLOG) {
+        if (!(n.linthresh > 0.0f)) {
+            float extent = fmaxf(fabsf(min_val), fabsf(hi));
+            n.linthresh = (extent > 0.0f) ? extent * COLOR_NORM_SYMLOG_LINTHRESH : 1.0f;
+        }
+        /* Log spacing down to linthresh / 64; values nearer zero share an entry */
+        lut_setup_log(lut, n.linthresh / 64.0f, min_val, hi);
+    } else if (n.mode == COLOR_NORM_POWER) {
+        if (!(n.gamma > 0.0f)) n.gamma = COLOR_NORM_DEFAULT_GAMMA;
+    } else if (n.mode == COLOR_NORM_HISTEQ && min_val >= 0.0f) {
+        /* Skewed positive fields (precipitation, tracers) crowd the low end */
+        float floor = log_norm_floor(min_val, hi);
+        lut_setup_log(lut, floor, fmaxf(min_val, floor), hi);
+    }
+    lut->norm = n;
+
+    int n_colors = cmap->n_colors;
+    int n_steps = COLORMAP_LUT_SIZE - 1;
+    int per_color = 0;
+    if (lut->log_quant) {
+        n_steps = (int)lut->n_steps;
+    } else if (n_colors > 1 && n_colors <= COLORMAP_LUT_SIZE) {
+        /* Whole steps per colour: step k is colour floor(k / per_color) */
+        per_color = (COLORMAP_LUT_SIZE - 1) / (n_colors - 1);
+        n_steps = per_color * (n_colors - 1);
+    } else if (n_colors == 1) {
+        n_steps = 0;
+    }
+    lut->n_steps = (float)n_steps;
+
+    int linear = (n.mode == COLOR_NORM_LINEAR || n.mode == COLOR_NORM_HISTEQ);
+    for (int k = 0; k <= n_steps; k++) {
+        if (!linear) {
+            lut_set_entry(lut, cmap, k, lut_norm_position(lut, lut_entry_value(lut, k)));
+            continue;
+        }
+        /* Histogram equalisation starts out linear until colormap_lut_equalize() */
+        int idx = 0;
+        if (per_color > 0) {
+            idx = k / per_color;
+        } else if (n_steps > 0) {
+            idx = (int)((float)k / (float)n_steps * (float)(n_colors - 1));
+        }
+        const USColor *c = &cmap->colors[idx];
+        lut->pos[k] = (n_steps > 0) ? (float)k / (float)n_steps : 0.0f;
+        lut->colors[k] = colormap_pack_pixel(format, c->r, c->g, c->b);
+    }
+
+    lut->pos[COLORMAP_LUT_MISSING] = 0.0f;
+    lut->colors[COLORMAP_LUT_MISSING] = colormap_pack_pixel(format, 255, 255, 255);
+    return 0;
+}
+
+int colormap_lut_equalize(USColorLUT *lut, const USColormap *cmap, const uint32_t *hist) {
+    if (!lut || !cmap || !cmap->colors || cmap->n_colors < 1 || !hist) return -1;
+
+    int n_steps = (int)lut->n_steps;
+    double total = 0.0;
+    for (int k = 0; k <= n_steps; k++) total += hist[k];
+    if (total <= 0.0) return 0;     /* No valid cells: keep the linear colours */
+
+    /* Each entry sits at the middle of its share of the cumulative count */
+    double below = 0.0;
+    for (int k = 0; k <= n_steps; k++) {
+        lut_set_entry(lut, cmap, k, (float)((below + 0.5 * hist[k]) / total));
+        below += hist[k];
+    }
+    return 0;
+}
+
+static const char *const norm_names[COLOR_NORM_COUNT] = {
+    "linear", "log", "symlog", "gamma", "histeq"
+};
+
+const char *colormap_norm_name(ColorNormMode mode) {
+    return (mode >= 0 && mode < COLOR_NORM_COUNT) ? norm_names[mode] : norm_names[0];
+}
+
+int colormap_norm_parse(const char *name, ColorNormMode *mode) {
+    if (!name || !mode) return -1;
+    for (int m = 0; m < COLOR_NORM_COUNT; m++) {
+        if (strcmp(name, norm_names[m]) == 0) {
+            *mode = (ColorNormMode)m;
+            return 0;
+        }
+    }
+    if (strcmp(name, "power") == 0) {
+        *mode = COLOR_NORM_POWER;
+        return 0;
+    }
+    return -1;
+}
+
+/* LUT entry of one value, with the same rules as colormap_apply() */
+static inline uint16_t lut_index(const USColorLUT *lut, float v) {
+    float fill_value = lut->fill_value;
+    if (fabsf(v) > INVALID_DATA_THRESHOLD || v != v ||
+        fabsf(v - fill_value) < 1e-6f * fabsf(fill_value)) {
+        return COLORMAP_LUT_MISSING;
+    }
+
+    if (lut->log_quant) {
+        int32_t m = log_offset(lut, v);
+        if (m < lut->base) m = lut->base;
+        if (m > lut->top) m = lut->top;
+        return (uint16_t)((m - lut->base) >> lut->shift);
+    }
+
+    float t = (v - lut->min_val) / lut->range;
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+    return (uint16_t)(int)(t * lut->n_steps);
+}
+
+float colormap_lut_position(const USColorLUT *lut, float value) {
+    if (!lut) return -1.0f;
+    uint16_t k = lut_index(lut, value);
+    return (k == COLORMAP_LUT_MISSING) ? -1.0f : lut->pos[k];
+}
+
+typedef void (*LutIndexFn)(const USColorLUT *lut, const float *values, size_t n, uint16_t *out);
+typedef void (*LutPaintFn)(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out);
+
+static void lut_index_scalar(const USColorLUT *lut, const float *values, size_t n, uint16_t *out) {
+    for (size_t i = 0; i < n; i++) out[i] = lut_index(lut, values[i]);
+}
+
+static void lut_paint_scalar(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out) {
+    for (size_t i = 0; i < n; i++) out[i] = lut->colors[index[i]];
+}
+
+#ifdef COLORMAP_X86_SIMD
+/*
+ * The vector kernels do the scalar arithmetic lane by lane (a true divide,
+ * clamp, truncating convert, or the integer log offset), so their output
+ * is bit-identical to it.
+ */
+__attribute__((target("avx2")))
+static void lut_index_avx2(const USColorLUT *lut, const float *values, size_t n, uint16_t *out) {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 threshold = _mm256_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m256 fill = _mm256_set1_ps(lut->fill_value);
+    const __m256 tolerance = _mm256_set1_ps(1e-6f * fabsf(lut->fill_value));
+    const __m256 min_val = _mm256_set1_ps(lut->min_val);
+    const __m256 range = _mm256_set1_ps(lut->range);
+    const __m256 n_steps = _mm256_set1_ps(lut->n_steps);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i missing = _mm256_set1_epi32(COLORMAP_LUT_MISSING);
+    const __m256i abs_bits = _mm256_set1_epi32(0x7fffffff);
+    const __m256i floor_bits = _mm256_set1_epi32(lut->floor_bits);
+    const __m256i base = _mm256_set1_epi32(lut->base);
+    const __m256i top = _mm256_set1_epi32(lut->top);
+    const __m128i shift = _mm_cvtsi32_si128(lut->shift);
+    const __m256i zero_i = _mm256_setzero_si256();
+    const int log_quant = lut->log_quant;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(&values[i]);
+        __m256 bad = _mm256_or_ps(
+            _mm256_cmp_ps(_mm256_and_ps(v, abs_mask), threshold, _CMP_GT_OQ),
+            _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        bad = _mm256_or_ps(bad, _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(v, fill), abs_mask),
+                                              tolerance, _CMP_LT_OQ));
+
+        __m256i k;
+        if (log_quant) {
+            __m256i bits = _mm256_castps_si256(v);
+            __m256i d = _mm256_max_epi32(_mm256_sub_epi32(_mm256_and_si256(bits, abs_bits),
+                                                          floor_bits), zero_i);
+            __m256i m = _mm256_sign_epi32(d, bits);
+            m = _mm256_min_epi32(_mm256_max_epi32(m, base), top);
+            k = _mm256_srl_epi32(_mm256_sub_epi32(m, base), shift);
+        } else {
+            __m256 t = _mm256_div_ps(_mm256_sub_ps(v, min_val), range);
+            t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+            k = _mm256_cvttps_epi32(_mm256_mul_ps(t, n_steps));
+        }
+        k = _mm256_blendv_epi8(k, missing, _mm256_castps_si256(bad));
+
+        /* Entries fit in 16 bits: narrow the two 128-bit halves */
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(k),
+                                          _mm256_extracti128_si256(k, 1));
+        _mm_storeu_si128((__m128i *)&out[i], packed);
+    }
+    for (; i < n; i++) out[i] = lut_index(lut, values[i]);
+}
+
+__attribute__((target("avx2")))
+static void lut_paint_avx2(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i k = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&index[i]));
+        __m256i p = _mm256_i32gather_epi32((const int *)lut->colors, k, 4);
+        _mm256_storeu_si256((__m256i *)&out[i], p);
+    }
+    for (; i < n; i++) out[i] = lut->colors[index[i]];
+}
+
+__attribute__((target("avx512f")))
+static void lut_index_avx512(const USColorLUT *lut, const float *values, size_t n, uint16_t *out) {
+    const __m512 threshold = _mm512_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m512 fill = _mm512_set1_ps(lut->fill_value);
+    const __m512 tolerance = _mm512_set1_ps(1e-6f * fabsf(lut->fill_value));
+    const __m512 min_val = _mm512_set1_ps(lut->min_val);
+    const __m512 range = _mm512_set1_ps(lut->range);
+    const __m512 n_steps = _mm512_set1_ps(lut->n_steps);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512i missing = _mm512_set1_epi32(COLORMAP_LUT_MISSING);
+    const __m512i abs_bits = _mm512_set1_epi32(0x7fffffff);
+    const __m512i floor_bits = _mm512_set1_epi32(lut->floor_bits);
+    const __m512i base = _mm512_set1_epi32(lut->base);
+    const __m512i top = _mm512_set1_epi32(lut->top);
+    const __m128i shift = _mm_cvtsi32_si128(lut->shift);
+    const __m512i zero_i = _mm512_setzero_si512();
+    const int log_quant = lut->log_quant;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_loadu_ps(&values[i]);
+        __mmask16 bad = _mm512_cmp_ps_mask(_mm512_abs_ps(v), threshold, _CMP_GT_OQ) |
+                        _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q) |
+                        _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(v, fill)),
+                                           tolerance, _CMP_LT_OQ);
+
+        __m512i k;
+        if (log_quant) {
+            __m512i bits = _mm512_castps_si512(v);
+            __m512i d = _mm512_max_epi32(_mm512_sub_epi32(_mm512_and_si512(bits, abs_bits),
+                                                          floor_bits), zero_i);
+            __mmask16 neg = _mm512_cmplt_epi32_mask(bits, zero_i);
+            __m512i m = _mm512_mask_sub_epi32(d, neg, zero_i, d);
+            m = _mm512_min_epi32(_mm512_max_epi32(m, base), top);
+            k = _mm512_srl_epi32(_mm512_sub_epi32(m, base), shift);
+        } else {
+            __m512 t = _mm512_div_ps(_mm512_sub_ps(v, min_val), range);
+            t = _mm512_min_ps(_mm512_max_ps(t, zero), one);
+            k = _mm512_cvttps_epi32(_mm512_mul_ps(t, n_steps));
+        }
+        k = _mm512_mask_blend_epi32(bad, k, missing);
+        _mm256_storeu_si256((__m256i *)&out[i], _mm512_cvtepi32_epi16(k));
+    }
+    for (; i < n; i++) out[i] = lut_index(lut, values[i]);
+}
+
+__attribute__((target("avx512f")))
+static void lut_paint_avx512(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i k = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i *)&index[i]));
+        __m512i p = _mm512_i32gather_epi32(k, (const void *)lut->colors, 4);
+        _mm512_storeu_si512((void *)&out[i], p);
+    }
+    for (; i < n; i++) out[i] = lut->colors[index[i]];
+}
+#endif
+
+static int lut_kernel_supported(ColormapLutKernel kernel) {
+    switch (kernel) {
+        case COLORMAP_LUT_AUTO:
+        case COLORMAP_LUT_SCALAR:
+            return 1;
+#ifdef COLORMAP_X86_SIMD
+        case COLORMAP_LUT_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case COLORMAP_LUT_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return 0;
+    }
+}
+
+int colormap_set_lut_kernel(ColormapLutKernel kernel) {
+    if (!lut_kernel_supported(kernel)) return -1;
+    lut_kernel = kernel;
+    return 0;
+}
+
+/* The forced kernel, else the widest the CPU supports */
+static ColormapLutKernel select_lut_kernel(void) {
+    ColormapLutKernel kernel = lut_kernel;
+    if (kernel == COLORMAP_LUT_AUTO) {
+        kernel = lut_kernel_supported(COLORMAP_LUT_AVX512) ? COLORMAP_LUT_AVX512 :
+                 lut_kernel_supported(COLORMAP_LUT_AVX2) ? COLORMAP_LUT_AVX2 :
+                 COLORMAP_LUT_SCALAR;
+    }
+    return kernel;
+}
+
+static LutIndexFn select_lut_index(void) {
+#ifdef COLORMAP_X86_SIMD
+    switch (select_lut_kernel()) {
+        case COLORMAP_LUT_AVX512: return lut_index_avx512;
+        case COLORMAP_LUT_AVX2:   return lut_index_avx2;
+        default:                  break;
+    }
+#endif
+    return lut_index_scalar;
+}
+
+static LutPaintFn select_lut_paint(void) {
+#ifdef COLORMAP_X86_SIMD
+    switch (select_lut_kernel()) {
+        case COLORMAP_LUT_AVX512: return lut_paint_avx512;
+        case COLORMAP_LUT_AVX2:   return lut_paint_avx2;
+        default:                  break;
+    }
+#endif
+    return lut_paint_scalar;
+}
+
+void colormap_lut_index(const USColorLUT *lut, const float *values, size_t n, uint16_t *out) {
+    if (!lut || !values || !out) return;
+    select_lut_index()(lut, values, n, out);
+}
+
+void colormap_lut_paint(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out) {
+    if (!lut || !index || !out) return;
+    select_lut_paint()(lut, index, n, out);
+}
+
+/* Values handled per colormap_lut_map() step, through a stack index buffer */
+#define LUT_MAP_CHUNK 512
+
+void colormap_lut_map(const USColorLUT *lut, const float *values, size_t n, uint32_t *out) {
+    if (!lut || !values || !out) return;
+    LutIndexFn index_fn = select_lut_index();
+    LutPaintFn paint_fn = select_lut_paint();
+    uint16_t index[LUT_MAP_CHUNK];
+    for (size_t i = 0; i < n; i += LUT_MAP_CHUNK) {
+        size_t len = (n - i < LUT_MAP_CHUNK) ? n - i : LUT_MAP_CHUNK;
+        index_fn(lut, values + i, len, index);
+        paint_fn(lut, index, len, out + i);
+    }
+}
+
+void colormap_lut_index_hist(const USColorLUT *lut, const float *values, size_t n,
+                             uint16_t *out, uint32_t *hist) {
+    if (!lut || !values || !out) return;
+    LutIndexFn index_fn = select_lut_index();
+    if (!hist) {
+        index_fn(lut, values, n, out);
+        return;
+    }
+    /* Count each chunk while its entries are still in L1 */
+    for (size_t i = 0; i < n; i += LUT_MAP_CHUNK) {
+        size_t len = (n - i < LUT_MAP_CHUNK) ? n - i : LUT_MAP_CHUNK;
+        index_fn(lut, values + i, len, out + i);
+        for (size_t j = 0; j < len; j++) hist[out[i + j]]++;
+    }
+}
+
+float colormap_lut_value_at(const USColorLUT *lut, float pos) {
+    if (!lut) return 0.0f;
+    int n_steps = (int)lut->n_steps;
+    if (pos <= lut->pos[0]) return lut->min_val;
+
+    /* First entry at or past pos; positions never decrease */
+    int lo = 0, hi = n_steps;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (lut->pos[mid] < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lut_entry_value(lut, lo);
+}
+
+int colormap_lut_same_quant(const USColorLUT *a, const USColorLUT *b) {
+    if (!a || !b) return 0;
+    if (a->min_val != b->min_val || a->range != b->range || a->n_steps != b->n_steps ||
+        a->fill_value != b->fill_value || a->log_quant != b->log_quant) return 0;
+    return !a->log_quant || (a->floor_bits == b->floor_bits && a->base == b->base &&
+                             a->top == b->top && a->shift == b->shift);
+}
+
+int colormap_lut_remap(USColorLUT *palette, const USColorLUT *target, const USColorLUT *indexed) {
+    if (!palette || !target || !indexed) return -1;
+
+    /* Same quantisation: the target's own entries */
+    if (colormap_lut_same_quant(target, indexed)) {
+        if (palette != target) *palette = *target;
+        return 0;
+    }
+
+    /* Other fill values change which cells are missing; log steps and
+     * equalised colours do not survive a change of range */
+    if (target->fill_value != indexed->fill_value) return -1;
+    if (target->log_quant || indexed->log_quant || target->norm.mode == COLOR_NORM_HISTEQ) {
+        return -1;
+    }
+
+    float lo = indexed->min_val, hi = lo + indexed->range;
+    if (target->min_val < lo || target->min_val + target->range > hi) return -1;
+    if (target->range * COLORMAP_REMAP_MAX_ZOOM < indexed->range) return -1;
+
+    /* Colour each indexed step by its centre (the last step is max itself) */
+    int n_steps = (int)indexed->n_steps;
+    float step = indexed->range / (n_steps > 0 ? (float)n_steps : 1.0f);
+    for (int k = 0; k <= n_steps; k++) {
+        float v = (k == n_steps) ? hi : lo + ((float)k + 0.5f) * step;
+        uint16_t t = lut_index(target, v);
+        palette->colors[k] = target->colors[t];
+        palette->pos[k] = target->pos[t];
+    }
+    palette->colors[COLORMAP_LUT_MISSING] = target->colors[COLORMAP_LUT_MISSING];
+    palette->pos[COLORMAP_LUT_MISSING] = 0.0f;
+    palette->format = target->format;
+    palette->norm = target->norm;
+    palette->min_val = indexed->min_val;
+    palette->range = indexed->range;
+    palette->fill_value = indexed->fill_value;
+    palette->n_steps = indexed->n_steps;
+    palette->log_quant = 0;
+    palette->floor_bits = palette->base = palette->top = 0;
+    palette->shift = 0;
+    return 0;
+}
+
+void colormap_widen_native(const uint32_t *src, size_t n, PixelFormat format,
+                           int scale, void *dst) {
+    if (!src || !dst || scale < 1) return;
+
+    if (format == PIXEL_FORMAT_XRGB8888) {
+        uint32_t *out = (uint32_t *)dst;
+        if (scale == 1) {
+            if (out != src) memcpy(out, src, n * sizeof(uint32_t));
+            return;
+        }
+        for (size_t x = 0; x < n; x++) {
+            uint32_t p = src[x];
+            for (int sx = 0; sx < scale; sx++) *out++ = p;
+        }
+    } else {
+        uint16_t *out = (uint16_t *)dst;
+        for (size_t x = 0; x < n; x++) {
+            uint16_t p = (uint16_t)src[x];
+            for (int sx = 0; sx < scale; sx++) *out++ = p;
+        }
+    }
+}
+
+/*
+ * Fill each data_nx-wide row of a block image: fill(row y, out) writes its
+ * pixels as uint32_t, which are then widened into the first line of the
+ * scale block and copied to the others.
+ */
+typedef void (*RowFillFn)(const void *ctx, size_t y, uint32_t *out);
+
+static void emit_rows(RowFillFn fill, const void *ctx, PixelFormat format,
+                      size_t data_nx, size_t data_ny, void *pixels, int scale) {
+    size_t row_bytes = data_nx * scale * colormap_pixel_bytes(format);
+    if (row_bytes == 0) return;
+
+    /* 32-bit pixels at scale 1 are filled in place; others via one row */
+    int direct = (format == PIXEL_FORMAT_XRGB8888 && scale == 1);
+    uint32_t *row = direct ? NULL : malloc(data_nx * sizeof(uint32_t));
+    if (!direct && !row) return;
+
+    for (size_t y = 0; y < data_ny; y++) {
+        unsigned char *line = (unsigned char *)pixels + y * scale * row_bytes;
+        if (direct) {
+            fill(ctx, y, (uint32_t *)line);
+            continue;
+        }
+        fill(ctx, y, row);
+        colormap_widen_native(row, data_nx, format, scale, line);
+        for (int sy = 1; sy < scale; sy++) {
+            memcpy(line + sy * row_bytes, line, row_bytes);
+        }
+    }
+    free(row);
+}
+
+typedef struct {
+    const USColorLUT *lut;
+    const float *data;
+    const uint16_t *index;
+    size_t      nx, ny;
+} RowSource;
+
+static void fill_from_data(const void *ctx, size_t y, uint32_t *out) {
+    const RowSource *src = (const RowSource *)ctx;
+    /* Flip: screen top = north = last data row */
+    colormap_lut_map(src->lut, src->data + (src->ny - 1 - y) * src->nx, src->nx, out);
+}
+
+static void fill_from_index(const void *ctx, size_t y, uint32_t *out) {
+    const RowSource *src = (const RowSource *)ctx;
+    colormap_lut_paint(src->lut, src->index + y * src->nx, src->nx, out);
+}
+
+void colormap_apply_native(const USColorLUT *lut, const float *data,
+                           size_t data_nx, size_t data_ny, void *pixels, int scale) {
+    if (!lut || !data || !pixels || scale < 1) return;
+    RowSource src = { lut, data, NULL, data_nx, data_ny };
+    emit_rows(fill_from_data, &src, lut->format, data_nx, data_ny, pixels, scale);
+}
+
+void colormap_paint_native(const USColorLUT *palette, const uint16_t *index,
+                           size_t data_nx, size_t data_ny, void *pixels, int scale) {
+    if (!palette || !index || !pixels || scale < 1) return;
+    RowSource src = { palette, NULL, index, data_nx, data_ny };
+    emit_rows(fill_from_index, &src, palette->format, data_nx, data_ny, pixels, scale);
+}
+
+void colormap_paint_rgb(const USColorLUT *palette, const uint16_t *index, size_t n,
+                        unsigned char *pixels) {
+    if (!palette || !index || !pixels || palette->format != PIXEL_FORMAT_XRGB8888) return;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t p = palette->colors[index[i]];
+        pixels[i * 3 + 0] = (unsigned char)(p >> 16);
+        pixels[i * 3 + 1] = (unsigned char)(p >> 8);
+        pixels[i * 3 + 2] = (unsigned char)p;
+    }
+}
+
 void colormaps_cleanup(void) {
     for (int i = 0; i < n_colormaps; i++) {
         free(colormaps[i].colors);
@@ -66,6 +66,159 @@ void colormap_apply_scaled(const USColormap *cmap, const float *data,
                            float min_val, float max_val, float fill_value,
                            unsigned char *pixels, int scale);
 
+/*
+ * Magnify an RGB image by pixel replication.
+ * src: input RGB pixels [ny * nx * 3]
+ * dst: output RGB pixels [ny * scale * nx * scale * 3]
+ * Equivalent to colormap_apply_scaled() applied to the data that produced
+ * src with colormap_apply(), without recolouring.
+ */
+void colormap_expand_pixels(const unsigned char *src, size_t nx, size_t ny,
+                            unsigned char *dst, int scale);
+
+/*
+ * Bytes per pixel of a native pixel format (0 for PIXEL_FORMAT_NONE).
+ */
+size_t colormap_pixel_bytes(PixelFormat format);
+
+/*
+ * Pack a colour into a display-native pixel.
+ */
+uint32_t colormap_pack_pixel(PixelFormat format,
+                             unsigned char r, unsigned char g, unsigned char b);
+
+/* Normalisation defaults */
+#define COLOR_NORM_DEFAULT_GAMMA     0.5f   /* Power norm exponent */
+#define COLOR_NORM_LOG_DECADES       6.0f   /* Log norm depth when min <= 0 */
+#define COLOR_NORM_SYMLOG_LINTHRESH  1e-3f  /* Automatic linthresh, times max |limit| */
+
+/*
+ * Quantise cmap over [min_val, max_val] into lut, packed in format. Each
+ * colormap entry gets a whole number of LUT steps, so with 256 colours the
+ * result matches colormap_apply() except for values within rounding of a
+ * colour boundary. Returns 0 on success, -1 on bad arguments.
+ */
+int colormap_lut_build(USColorLUT *lut, const USColormap *cmap, PixelFormat format,
+                       float min_val, float max_val, float fill_value);
+
+/*
+ * colormap_lut_build() with a normalisation (NULL = linear). The norm is
+ * evaluated once per entry, at the entry's centre value: log and symlog
+ * entries are spaced in log |v| (over COLOR_NORM_LOG_DECADES below max
+ * when min <= 0, and logarithmic beyond linthresh / 64 for symlog), power
+ * keeps linear entries. A log norm with max <= 0 falls back to linear.
+ * Histogram equalisation spaces entries in log |v| too when min >= 0, and
+ * builds linear colours until colormap_lut_equalize() is given the
+ * entries' counts.
+ */
+int colormap_lut_build_norm(USColorLUT *lut, const USColormap *cmap, PixelFormat format,
+                            float min_val, float max_val, float fill_value,
+                            const USColorNorm *norm);
+
+/*
+ * Recolour lut so each entry sits at the middle of its share of the
+ * cumulative count in hist [COLORMAP_LUT_SIZE + 1] (as counted by
+ * colormap_lut_index_hist()). Returns 0 on success, -1 on bad arguments.
+ */
+int colormap_lut_equalize(USColorLUT *lut, const USColormap *cmap, const uint32_t *hist);
+
+/*
+ * Colormap position [0, 1] the LUT gives value, or -1 for missing data.
+ */
+float colormap_lut_position(const USColorLUT *lut, float value);
+
+/*
+ * Value of the first entry at colormap position pos or beyond (min_val at
+ * the bottom): the inverse of colormap_lut_position(), for labels.
+ */
+float colormap_lut_value_at(const USColorLUT *lut, float pos);
+
+/*
+ * Whether two LUTs put every value in the same entry.
+ */
+int colormap_lut_same_quant(const USColorLUT *a, const USColorLUT *b);
+
+/*
+ * Norm names for options and labels ("linear", "log", "symlog", "gamma",
+ * "histeq"). colormap_norm_parse() returns -1 for unknown names.
+ */
+const char *colormap_norm_name(ColorNormMode mode);
+int colormap_norm_parse(const char *name, ColorNormMode *mode);
+
+/*
+ * Map n values to native pixels (as uint32_t, whatever the format) with
+ * the missing-data rules of colormap_apply(). Vectorised where the CPU
+ * allows; every kernel gives identical output.
+ */
+void colormap_lut_map(const USColorLUT *lut, const float *values, size_t n, uint32_t *out);
+
+/*
+ * The two halves of colormap_lut_map(): quantise n values to LUT entries
+ * (COLORMAP_LUT_MISSING for missing data), and look entries up.
+ */
+void colormap_lut_index(const USColorLUT *lut, const float *values, size_t n, uint16_t *out);
+void colormap_lut_paint(const USColorLUT *lut, const uint16_t *index, size_t n, uint32_t *out);
+
+/*
+ * colormap_lut_index() that also adds each entry to hist
+ * [COLORMAP_LUT_SIZE + 1] (may be NULL) in the same pass.
+ */
+void colormap_lut_index_hist(const USColorLUT *lut, const float *values, size_t n,
+                             uint16_t *out, uint32_t *hist);
+
+/* How far inside the indexed range a palette remap may narrow it */
+#define COLORMAP_REMAP_MAX_ZOOM 4
+
+/*
+ * Build a palette that paints entries quantised with `indexed` the way
+ * `target` colours values. If both quantise alike this is target itself.
+ * Otherwise both must be linearly quantised, target not equalised, and
+ * target's range must lie inside the indexed one and span at least
+ * 1 / COLORMAP_REMAP_MAX_ZOOM of it; each indexed step then takes the
+ * colour of its centre value. palette must not alias target. Returns 0 on
+ * success, -1 if the entries must be quantised again.
+ */
+int colormap_lut_remap(USColorLUT *palette, const USColorLUT *target, const USColorLUT *indexed);
+
+/*
+ * Write one display line from n mapped pixels, each repeated scale times,
+ * as format-sized pixels into dst [n * scale].
+ */
+void colormap_widen_native(const uint32_t *src, size_t n, PixelFormat format,
+                           int scale, void *dst);
+
+/*
+ * Convert a data array straight to native pixels with scaling.
+ * data: input data [data_ny * data_nx]
+ * pixels: output [data_ny * scale * data_nx * scale] in lut->format
+ * Flips y like colormap_apply(); each scaled block's first line is
+ * widened and the rest are row copies.
+ */
+void colormap_apply_native(const USColorLUT *lut, const float *data,
+                           size_t data_nx, size_t data_ny, void *pixels, int scale);
+
+/*
+ * Paint an index image (rows north up, as colormap_apply_native() lays
+ * them out) into native pixels with scaling.
+ * index: [data_ny * data_nx] LUT entries
+ * pixels: output [data_ny * scale * data_nx * scale] in palette->format
+ */
+void colormap_paint_native(const USColorLUT *palette, const uint16_t *index,
+                           size_t data_nx, size_t data_ny, void *pixels, int scale);
+
+/*
+ * Paint n index image entries as RGB pixels [n * 3]. The palette must be
+ * built for PIXEL_FORMAT_XRGB8888.
+ */
+void colormap_paint_rgb(const USColorLUT *palette, const uint16_t *index, size_t n,
+                        unsigned char *pixels);
+
+/*
+ * Force the LUT kernels (for testing and benchmarks).
+ * Returns 0 on success, -1 if the CPU or build lacks it.
+ */
+int colormap_set_lut_kernel(ColormapLutKernel kernel);
+
 /*
  * Free colormap resources.
  */
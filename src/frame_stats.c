@@ -0,0 +1,352 @@
+/*
+ * frame_stats.c - Area-weighted statistics of a displayed frame
+ */
+
+#include "frame_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(FRAME_STATS_NO_SIMD)
+#define FRAME_STATS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Values per kernel call, through a stack bin buffer */
+#define STATS_CHUNK 512
+
+/* Fixed-point scale of the histogram weights: exact sums in any order */
+#define WEIGHT_ONE ((double)(1 << 20))
+
+#define MISSING_BIN FRAME_STATS_BINS
+
+/* Forced row kernel (FRAME_STATS_AUTO = runtime dispatch) */
+static FrameStatsKernel stats_kernel = FRAME_STATS_AUTO;
+
+/* Unweighted sums of one chunk, of (v - shift) over the valid values */
+typedef struct {
+    size_t  count;
+    double  sum, sum2;
+    float   min, max;
+} RowSums;
+
+typedef void (*RowKernelFn)(const USFrameStats *st, const float *values, size_t n,
+                            uint16_t *bin, RowSums *sums);
+
+void frame_stats_begin(USFrameStats *st, float hist_min, float hist_max, float fill_value) {
+    if (!st) return;
+    if (!(hist_max > hist_min)) hist_max = hist_min + 1.0f;
+    memset(st, 0, sizeof(*st));
+    st->hist_min = hist_min;
+    st->hist_max = hist_max;
+    st->fill_value = fill_value;
+    st->bin_scale = (float)FRAME_STATS_BINS / (hist_max - hist_min);
+    st->shift = 0.5 * ((double)hist_min + (double)hist_max);
+    st->min = INFINITY;
+    st->max = -INFINITY;
+}
+
+/* Histogram bin of one value, with the same rules as colormap_apply() */
+static inline uint16_t stats_bin(const USFrameStats *st, float v) {
+    float fill_value = st->fill_value;
+    if (fabsf(v) > INVALID_DATA_THRESHOLD || v != v ||
+        fabsf(v - fill_value) < 1e-6f * fabsf(fill_value)) {
+        return MISSING_BIN;
+    }
+    float t = (v - st->hist_min) * st->bin_scale;
+    if (t < 0.0f) t = 0.0f;
+    if (t > FRAME_STATS_BINS - 1) t = FRAME_STATS_BINS - 1;
+    return (uint16_t)(int)t;
+}
+
+static void row_scalar(const USFrameStats *st, const float *values, size_t n,
+                       uint16_t *bin, RowSums *sums) {
+    for (size_t i = 0; i < n; i++) {
+        float v = values[i];
+        bin[i] = stats_bin(st, v);
+        if (bin[i] == MISSING_BIN) continue;
+        double d = (double)v - st->shift;
+        sums->count++;
+        sums->sum += d;
+        sums->sum2 += d * d;
+        if (v < sums->min) sums->min = v;
+        if (v > sums->max) sums->max = v;
+    }
+}
+
+#ifdef FRAME_STATS_X86_SIMD
+/*
+ * The vector kernels find the same bins, count and min/max as the scalar
+ * one; only the order of the double-precision sums differs.
+ */
+__attribute__((target("avx2")))
+static void row_avx2(const USFrameStats *st, const float *values, size_t n,
+                     uint16_t *bin, RowSums *sums) {
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 threshold = _mm256_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m256 fill = _mm256_set1_ps(st->fill_value);
+    const __m256 tolerance = _mm256_set1_ps(1e-6f * fabsf(st->fill_value));
+    const __m256 hist_min = _mm256_set1_ps(st->hist_min);
+    const __m256 bin_scale = _mm256_set1_ps(st->bin_scale);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 last = _mm256_set1_ps(FRAME_STATS_BINS - 1);
+    const __m256 pos_inf = _mm256_set1_ps(INFINITY);
+    const __m256 neg_inf = _mm256_set1_ps(-INFINITY);
+    const __m256i missing = _mm256_set1_epi32(MISSING_BIN);
+    const __m256d shift = _mm256_set1_pd(st->shift);
+
+    __m256 vmin = pos_inf, vmax = neg_inf;
+    __m256d sum_lo = _mm256_setzero_pd(), sum_hi = _mm256_setzero_pd();
+    __m256d sq_lo = _mm256_setzero_pd(), sq_hi = _mm256_setzero_pd();
+    size_t n_bad = 0;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(&values[i]);
+        __m256 bad = _mm256_or_ps(
+            _mm256_cmp_ps(_mm256_and_ps(v, abs_mask), threshold, _CMP_GT_OQ),
+            _mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        bad = _mm256_or_ps(bad, _mm256_cmp_ps(_mm256_and_ps(_mm256_sub_ps(v, fill), abs_mask),
+                                              tolerance, _CMP_LT_OQ));
+        n_bad += (size_t)__builtin_popcount((unsigned)_mm256_movemask_ps(bad));
+
+        vmin = _mm256_min_ps(vmin, _mm256_blendv_ps(v, pos_inf, bad));
+        vmax = _mm256_max_ps(vmax, _mm256_blendv_ps(v, neg_inf, bad));
+
+        /* Widen to double; missing lanes are cleared bitwise, so NaN drops out too */
+        __m128i bad_bits = _mm256_castsi256_si128(_mm256_castps_si256(bad));
+        __m128i bad_bits_hi = _mm256_extracti128_si256(_mm256_castps_si256(bad), 1);
+        __m256d d_lo = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), shift);
+        __m256d d_hi = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), shift);
+        d_lo = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cvtepi32_epi64(bad_bits)), d_lo);
+        d_hi = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cvtepi32_epi64(bad_bits_hi)), d_hi);
+        sum_lo = _mm256_add_pd(sum_lo, d_lo);
+        sum_hi = _mm256_add_pd(sum_hi, d_hi);
+        sq_lo = _mm256_add_pd(sq_lo, _mm256_mul_pd(d_lo, d_lo));
+        sq_hi = _mm256_add_pd(sq_hi, _mm256_mul_pd(d_hi, d_hi));
+
+        __m256 t = _mm256_mul_ps(_mm256_sub_ps(v, hist_min), bin_scale);
+        t = _mm256_min_ps(_mm256_max_ps(t, zero), last);
+        __m256i k = _mm256_blendv_epi8(_mm256_cvttps_epi32(t), missing, _mm256_castps_si256(bad));
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(k),
+                                          _mm256_extracti128_si256(k, 1));
+        _mm_storeu_si128((__m128i *)&bin[i], packed);
+    }
+
+    double lane[4];
+    _mm256_storeu_pd(lane, _mm256_add_pd(sum_lo, sum_hi));
+    sums->sum += (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    _mm256_storeu_pd(lane, _mm256_add_pd(sq_lo, sq_hi));
+    sums->sum2 += (lane[0] + lane[1]) + (lane[2] + lane[3]);
+    float m[8];
+    _mm256_storeu_ps(m, vmin);
+    for (int j = 0; j < 8; j++) if (m[j] < sums->min) sums->min = m[j];
+    _mm256_storeu_ps(m, vmax);
+    for (int j = 0; j < 8; j++) if (m[j] > sums->max) sums->max = m[j];
+    sums->count += i - n_bad;
+
+    row_scalar(st, values + i, n - i, bin + i, sums);
+}
+
+__attribute__((target("avx512f")))
+static void row_avx512(const USFrameStats *st, const float *values, size_t n,
+                       uint16_t *bin, RowSums *sums) {
+    const __m512 threshold = _mm512_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m512 fill = _mm512_set1_ps(st->fill_value);
+    const __m512 tolerance = _mm512_set1_ps(1e-6f * fabsf(st->fill_value));
+    const __m512 hist_min = _mm512_set1_ps(st->hist_min);
+    const __m512 bin_scale = _mm512_set1_ps(st->bin_scale);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 last = _mm512_set1_ps(FRAME_STATS_BINS - 1);
+    const __m512i missing = _mm512_set1_epi32(MISSING_BIN);
+    const __m512d shift = _mm512_set1_pd(st->shift);
+
+    __m512 vmin = _mm512_set1_ps(INFINITY), vmax = _mm512_set1_ps(-INFINITY);
+    __m512d sum_lo = _mm512_setzero_pd(), sum_hi = _mm512_setzero_pd();
+    __m512d sq_lo = _mm512_setzero_pd(), sq_hi = _mm512_setzero_pd();
+    size_t n_good = 0;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 v = _mm512_loadu_ps(&values[i]);
+        __mmask16 bad = _mm512_cmp_ps_mask(_mm512_abs_ps(v), threshold, _CMP_GT_OQ) |
+                        _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q) |
+                        _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(v, fill)),
+                                           tolerance, _CMP_LT_OQ);
+        __mmask16 good = (__mmask16)~bad;
+        n_good += (size_t)__builtin_popcount((unsigned)good);
+
+        vmin = _mm512_mask_min_ps(vmin, good, vmin, v);
+        vmax = _mm512_mask_max_ps(vmax, good, vmax, v);
+
+        __mmask8 good_lo = (__mmask8)good, good_hi = (__mmask8)(good >> 8);
+        __m512d d_lo = _mm512_maskz_sub_pd(good_lo,
+            _mm512_cvtps_pd(_mm512_castps512_ps256(v)), shift);
+        __m512d d_hi = _mm512_maskz_sub_pd(good_hi,
+            _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))),
+            shift);
+        sum_lo = _mm512_add_pd(sum_lo, d_lo);
+        sum_hi = _mm512_add_pd(sum_hi, d_hi);
+        sq_lo = _mm512_add_pd(sq_lo, _mm512_mul_pd(d_lo, d_lo));
+        sq_hi = _mm512_add_pd(sq_hi, _mm512_mul_pd(d_hi, d_hi));
+
+        __m512 t = _mm512_mul_ps(_mm512_sub_ps(v, hist_min), bin_scale);
+        t = _mm512_min_ps(_mm512_max_ps(t, zero), last);
+        __m512i k = _mm512_mask_blend_epi32(bad, _mm512_cvttps_epi32(t), missing);
+        _mm256_storeu_si256((__m256i *)&bin[i], _mm512_cvtepi32_epi16(k));
+    }
+
+    sums->sum += _mm512_reduce_add_pd(_mm512_add_pd(sum_lo, sum_hi));
+    sums->sum2 += _mm512_reduce_add_pd(_mm512_add_pd(sq_lo, sq_hi));
+    float lo = _mm512_reduce_min_ps(vmin), hi = _mm512_reduce_max_ps(vmax);
+    if (lo < sums->min) sums->min = lo;
+    if (hi > sums->max) sums->max = hi;
+    sums->count += n_good;
+
+    row_scalar(st, values + i, n - i, bin + i, sums);
+}
+#endif
+
+static int stats_kernel_supported(FrameStatsKernel kernel) {
+    switch (kernel) {
+        case FRAME_STATS_AUTO:
+        case FRAME_STATS_SCALAR:
+            return 1;
+#ifdef FRAME_STATS_X86_SIMD
+        case FRAME_STATS_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case FRAME_STATS_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return 0;
+    }
+}
+
+int frame_stats_set_kernel(FrameStatsKernel kernel) {
+    if (!stats_kernel_supported(kernel)) return -1;
+    stats_kernel = kernel;
+    return 0;
+}
+
+/* The forced kernel, else the widest the CPU supports */
+static RowKernelFn select_row_kernel(void) {
+    FrameStatsKernel kernel = stats_kernel;
+    if (kernel == FRAME_STATS_AUTO) {
+        kernel = stats_kernel_supported(FRAME_STATS_AVX512) ? FRAME_STATS_AVX512 :
+                 stats_kernel_supported(FRAME_STATS_AVX2) ? FRAME_STATS_AVX2 :
+                 FRAME_STATS_SCALAR;
+    }
+#ifdef FRAME_STATS_X86_SIMD
+    switch (kernel) {
+        case FRAME_STATS_AVX512: return row_avx512;
+        case FRAME_STATS_AVX2:   return row_avx2;
+        default:                 break;
+    }
+#endif
+    return row_scalar;
+}
+
+void frame_stats_add_row(USFrameStats *st, const float *values, size_t n, double weight) {
+    if (!st || !values || n == 0) return;
+    if (weight < 0.0) weight = 0.0;
+    RowKernelFn kernel = select_row_kernel();
+    uint64_t w = (uint64_t)(weight * WEIGHT_ONE + 0.5);
+    uint16_t bin[STATS_CHUNK];
+
+    RowSums sums = {0, 0.0, 0.0, INFINITY, -INFINITY};
+    for (size_t i = 0; i < n; i += STATS_CHUNK) {
+        size_t len = (n - i < STATS_CHUNK) ? n - i : STATS_CHUNK;
+        kernel(st, values + i, len, bin, &sums);
+
+        /* Rotate through the copies so runs of one bin do not wait on each other */
+        size_t j = 0;
+        for (; j + FRAME_STATS_WAYS <= len; j += FRAME_STATS_WAYS) {
+            st->bins[0][bin[j]] += w;
+            st->bins[1][bin[j + 1]] += w;
+            st->bins[2][bin[j + 2]] += w;
+            st->bins[3][bin[j + 3]] += w;
+        }
+        for (; j < len; j++) st->bins[0][bin[j]] += w;
+    }
+
+    st->n_cells += n;
+    st->n_valid += sums.count;
+    st->total_w += weight * (double)n;
+    st->sum_w += weight * (double)sums.count;
+    st->sum_wd += weight * sums.sum;
+    st->sum_wd2 += weight * sums.sum2;
+    if (sums.min < st->min) st->min = sums.min;
+    if (sums.max > st->max) st->max = sums.max;
+}
+
+void frame_stats_finish(USFrameStats *st) {
+    if (!st) return;
+    uint64_t total = 0;
+    for (int b = 0; b < FRAME_STATS_BINS; b++) {
+        for (int k = 0; k < FRAME_STATS_WAYS; k++) total += st->bins[k][b];
+    }
+
+    st->valid = st->n_valid > 0 && st->sum_w > 0.0 && total > 0;
+    st->valid_fraction = (st->total_w > 0.0) ? st->sum_w / st->total_w : 0.0;
+    if (!st->valid) {
+        st->mean = st->std = 0.0;
+        memset(st->hist, 0, sizeof(st->hist));
+        return;
+    }
+
+    double mean = st->sum_wd / st->sum_w;
+    double var = st->sum_wd2 / st->sum_w - mean * mean;
+    st->mean = st->shift + mean;
+    st->std = (var > 0.0) ? sqrt(var) : 0.0;
+    for (int b = 0; b < FRAME_STATS_BINS; b++) {
+        uint64_t c = 0;
+        for (int k = 0; k < FRAME_STATS_WAYS; k++) c += st->bins[k][b];
+        st->hist[b] = (double)c / (double)total;
+    }
+}
+
+int frame_stats_percentile(const USFrameStats *st, double pct, float *value) {
+    if (!st || !st->valid || !value) return -1;
+    double target = pct / 100.0;
+    if (target < 0.0) target = 0.0;
+    if (target > 1.0) target = 1.0;
+
+    double cum = 0.0;
+    int b = 0;
+    for (; b < FRAME_STATS_BINS - 1; b++) {
+        if (cum + st->hist[b] >= target && st->hist[b] > 0.0) break;
+        cum += st->hist[b];
+    }
+    double frac = (st->hist[b] > 0.0) ? (target - cum) / st->hist[b] : 0.0;
+    if (frac < 0.0) frac = 0.0;
+    if (frac > 1.0) frac = 1.0;
+
+    /* The end bins also hold the values beyond the histogram range */
+    double lo = st->hist_min + b / (double)st->bin_scale;
+    double hi = lo + 1.0 / st->bin_scale;
+    if (b == 0 && st->min < lo) lo = st->min;
+    if (b == FRAME_STATS_BINS - 1 && st->max > hi) hi = st->max;
+    float v = (float)(lo + frac * (hi - lo));
+    if (v < st->min) v = st->min;
+    if (v > st->max) v = st->max;
+    *value = v;
+    return 0;
+}
+
+void frame_stats_format(const USFrameStats *st, char *buf, size_t size) {
+    if (!buf || size == 0) return;
+    if (!st) {
+        snprintf(buf, size, "-");
+        return;
+    }
+    if (!st->valid) {
+        snprintf(buf, size, "no valid data");
+        return;
+    }
+    snprintf(buf, size, "mean %.4g sd %.3g | %.4g .. %.4g | %.0f%% valid",
+             st->mean, st->std, st->min, st->max, st->valid_fraction * 100.0);
+}
@@ -0,0 +1,75 @@
+/*
+ * frame_stats.h - Area-weighted statistics of a displayed frame
+ *
+ * Accumulates the mean, standard deviation, min/max, valid fraction and a
+ * histogram of a regridded field one row at a time, so the view can feed
+ * each row while it is in cache from the colourise pass. Every row of a
+ * regular lon/lat grid covers the same latitude, so a row shares one area
+ * weight (cos(lat)); within a row the sums are plain and vectorised.
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include "ushow.defines.h"
+
+#define FRAME_STATS_BINS     1024
+#define FRAME_STATS_WAYS     4      /* Interleaved bin copies, so repeated bins do not stall */
+#define FRAME_STATS_LOW_PCT  2.0    /* Autoscale percentiles */
+#define FRAME_STATS_HIGH_PCT 98.0
+
+struct USFrameStats {
+    /* Results, set by frame_stats_finish() */
+    int         valid;              /* At least one valid value */
+    double      mean, std;          /* Area-weighted */
+    float       min, max;
+    double      valid_fraction;     /* Valid share of the frame's area */
+    size_t      n_valid, n_cells;
+    float       hist_min, hist_max; /* Histogram range; values outside count in the end bins */
+    double      hist[FRAME_STATS_BINS];  /* Area weight per bin, normalised to sum 1 */
+
+    /* Accumulators */
+    float       fill_value;
+    float       bin_scale;          /* Bins per unit value */
+    double      shift;              /* Subtracted before summing, against cancellation */
+    double      sum_w, sum_wd, sum_wd2, total_w;
+    uint64_t    bins[FRAME_STATS_WAYS][FRAME_STATS_BINS + 1];  /* Fixed-point weights; last: missing */
+};
+
+/*
+ * Start a frame whose histogram spans [hist_min, hist_max] (widened to a
+ * unit range if empty). Values are missing by the colormap_apply() rules.
+ */
+void frame_stats_begin(USFrameStats *st, float hist_min, float hist_max, float fill_value);
+
+/*
+ * Add n values of one row, each of area weight in [0, 1]. Vectorised
+ * where the CPU allows.
+ */
+void frame_stats_add_row(USFrameStats *st, const float *values, size_t n, double weight);
+
+/*
+ * Compute the results from the rows added.
+ */
+void frame_stats_finish(USFrameStats *st);
+
+/*
+ * Area-weighted percentile (0..100), interpolated within its histogram
+ * bin and clamped to [min, max]. Returns 0 on success, -1 if the frame
+ * had no valid values.
+ */
+int frame_stats_percentile(const USFrameStats *st, double pct, float *value);
+
+/*
+ * One-line summary ("mean 1.2 sd 0.3 | 0.1 .. 2.4 | 71% valid"), or "-"
+ * for no statistics (st NULL).
+ */
+void frame_stats_format(const USFrameStats *st, char *buf, size_t size);
+
+/*
+ * Force the row kernel (for testing and benchmarks).
+ * Returns 0 on success, -1 if the CPU or build lacks it.
+ */
+int frame_stats_set_kernel(FrameStatsKernel kernel);
+
+#endif /* FRAME_STATS_H */
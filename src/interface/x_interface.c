@@ -23,6 +23,9 @@
 #include <X11/Xaw/Viewport.h>
 #include <X11/Xaw/Simple.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -53,6 +56,7 @@ static Widget label_title = NULL;
 static Widget label_varname = NULL;
 static Widget label_dims = NULL;
 static Widget label_value = NULL;
+static Widget label_stats = NULL;
 
 /* Button boxes */
 static Widget buttonbox = NULL;
@@ -96,17 +100,35 @@ static Widget image_widget = NULL;
 
 /* Image data */
 static XImage *ximage = NULL;
+static int ximage_shm = 0;              /* ximage wraps a shared memory segment */
 static unsigned char *image_data = NULL;
 static size_t image_width = 0;
 static size_t image_height = 0;
 static GC image_gc = None;
 
+/*
+ * MIT-SHM segments handed out by x_alloc_pixels(). The server reads them
+ * directly, so frames colourised into one are shown without a copy
+ * through the X socket. Used from the UI thread only.
+ */
+typedef struct {
+    XShmSegmentInfo info;
+    size_t          bytes;
+} ShmSegment;
+
+static ShmSegment **shm_segments = NULL;
+static int n_shm_segments = 0;
+static int shm_state = 0;               /* 0: untried, 1: working, -1: unavailable or off */
+static int shm_error = 0;               /* Set by shm_error_handler() */
+
 /* Colorbar data */
 static XImage *cbar_ximage = NULL;
 static unsigned char *cbar_image_data = NULL;
 static GC cbar_gc = None;
 static float cbar_min_val = 0.0f;
 static float cbar_max_val = 1.0f;
+static float cbar_labels[X_COLORBAR_LABELS];  /* Values under the labels */
+static int cbar_have_labels = 0;                /* 0: evenly spaced values */
 
 /* Callbacks */
 static VarSelectCallback var_select_cb = NULL;
@@ -128,12 +150,21 @@ static ZoomCallback zoom_cb = NULL;
 typedef void (*SaveCallback)(void);
 static SaveCallback save_cb = NULL;
 
+typedef void (*LoadCallback)(void);
+static LoadCallback load_cb = NULL;
+
 typedef void (*DimNavCallback)(int dim_index, int direction);
 static DimNavCallback dim_nav_cb = NULL;
 
 typedef void (*RenderModeCallback)(void);
 static RenderModeCallback render_mode_cb = NULL;
 
+typedef void (*NormCallback)(void);
+static NormCallback norm_cb = NULL;
+
+typedef void (*AutoscaleCallback)(void);
+static AutoscaleCallback autoscale_cb = NULL;
+
 typedef void (*RangeButtonCallback)(void);
 static RangeButtonCallback range_button_cb = NULL;
 
@@ -142,6 +173,12 @@ static MouseClickCallback mouse_click_cb = NULL;
 /* Render mode button */
 static Widget render_mode_button = NULL;
 
+/* Colour norm button */
+static Widget norm_button = NULL;
+
+/* Range autoscale button */
+static Widget autoscale_button = NULL;
+
 /* State */
 static size_t current_n_times = 1;
 static size_t current_n_depths = 1;
@@ -229,11 +266,26 @@ static void save_callback_fn(Widget w, XtPointer client_data, XtPointer call_dat
     if (save_cb) save_cb();
 }
 
+static void load_callback_fn(Widget w, XtPointer client_data, XtPointer call_data) {
+    (void)w; (void)client_data; (void)call_data;
+    if (load_cb) load_cb();
+}
+
 static void render_mode_callback_fn(Widget w, XtPointer client_data, XtPointer call_data) {
     (void)w; (void)client_data; (void)call_data;
     if (render_mode_cb) render_mode_cb();
 }
 
+static void norm_callback_fn(Widget w, XtPointer client_data, XtPointer call_data) {
+    (void)w; (void)client_data; (void)call_data;
+    if (norm_cb) norm_cb();
+}
+
+static void autoscale_callback_fn(Widget w, XtPointer client_data, XtPointer call_data) {
+    (void)w; (void)client_data; (void)call_data;
+    if (autoscale_cb) autoscale_cb();
+}
+
 static void range_button_callback_fn(Widget w, XtPointer client_data, XtPointer call_data) {
     (void)w; (void)client_data; (void)call_data;
     if (range_button_cb) range_button_cb();
@@ -278,11 +330,12 @@ static void depth_scroll_callback(Widget w, XtPointer client_data, XtPointer cal
 
 /* ========== Event Handlers ========== */
 
+static void put_image(size_t width, size_t height);
+
 static void image_expose_callback(Widget w, XtPointer client_data, XEvent *event, Boolean *cont) {
-    (void)client_data; (void)cont;
+    (void)w; (void)client_data; (void)cont;
     if (event->type == Expose && ximage && image_gc != None) {
-        XPutImage(display, XtWindow(w), image_gc, ximage, 0, 0, 0, 0,
-                  image_width, image_height);
+        put_image(image_width, image_height);
     }
 }
 
@@ -321,10 +374,11 @@ static void draw_colorbar(Widget w) {
     XFontStruct *font = XQueryFont(display, XGContextFromGC(cbar_gc));
     int ascent = font ? font->ascent : 10;
 
-    const int n_labels = 5;
+    const int n_labels = X_COLORBAR_LABELS;
     for (int i = 0; i < n_labels; i++) {
         float t = (float)i / (float)(n_labels - 1);
-        float val = cbar_min_val + t * (cbar_max_val - cbar_min_val);
+        float val = cbar_have_labels ? cbar_labels[i] :
+                    cbar_min_val + t * (cbar_max_val - cbar_min_val);
         char buf[32];
         snprintf(buf, sizeof(buf), "%.4g", val);
 
@@ -359,6 +413,17 @@ static void timer_wrapper(XtPointer client_data, XtIntervalId *id) {
     if (timer_callback_fn) timer_callback_fn();
 }
 
+/* Repeating timer for background work, independent of the animation timer */
+static XtIntervalId poll_id = 0;
+static int poll_interval_ms = 0;
+static void (*poll_callback_fn)(void) = NULL;
+
+static void poll_wrapper(XtPointer client_data, XtIntervalId *id) {
+    (void)client_data; (void)id;
+    poll_id = XtAppAddTimeOut(app_context, poll_interval_ms, poll_wrapper, NULL);
+    if (poll_callback_fn) poll_callback_fn();
+}
+
 /* ========== Initialization ========== */
 
 /* Action procedure for backward navigation */
@@ -447,11 +512,22 @@ int x_init(int *argc, char **argv, const char **var_names, int n_vars,
         NULL
     );
 
+    /* Label 5: Area-weighted statistics of the frame */
+    label_stats = XtVaCreateManagedWidget(
+        "labelStats", labelWidgetClass, main_form,
+        XtNlabel, "Stats: -",
+        XtNwidth, LABEL_WIDTH,
+        XtNjustify, XtJustifyCenter,
+        XtNfromVert, label_value,
+        XtNborderWidth, 0,
+        NULL
+    );
+
     /* ===== Button Box 1: Animation controls ===== */
     buttonbox = XtVaCreateManagedWidget(
         "buttonbox", boxWidgetClass, main_form,
         XtNorientation, XtorientHorizontal,
-        XtNfromVert, label_value,
+        XtNfromVert, label_stats,
         XtNwidth, 580,
         NULL
     );
@@ -555,6 +631,22 @@ int x_init(int *argc, char **argv, const char **var_names, int n_vars,
         XtNwidth, BUTTON_WIDTH, NULL);
     XtAddCallback(btn, XtNcallback, save_callback_fn, NULL);
 
+    btn = XtVaCreateManagedWidget("Load", commandWidgetClass, optionbox,
+        XtNwidth, BUTTON_WIDTH, NULL);
+    XtAddCallback(btn, XtNcallback, load_callback_fn, NULL);
+
+    norm_button = XtVaCreateManagedWidget("Linear", commandWidgetClass, optionbox,
+        XtNwidth, BUTTON_WIDTH + 10,
+        XtNresize, False,
+        NULL);
+    XtAddCallback(norm_button, XtNcallback, norm_callback_fn, NULL);
+
+    autoscale_button = XtVaCreateManagedWidget("Fixed", commandWidgetClass, optionbox,
+        XtNwidth, BUTTON_WIDTH + 10,
+        XtNresize, False,
+        NULL);
+    XtAddCallback(autoscale_button, XtNcallback, autoscale_callback_fn, NULL);
+
     render_mode_button = XtVaCreateManagedWidget("Interp", commandWidgetClass, optionbox,
         XtNwidth, BUTTON_WIDTH + 10,
         XtNresize, False,
@@ -732,8 +824,11 @@ void x_set_mouse_callback(void (*cb)(int, int)) { mouse_motion_cb = cb; }
 void x_set_range_callback(void (*cb)(int)) { range_adjust_cb = cb; }
 void x_set_zoom_callback(void (*cb)(int)) { zoom_cb = cb; }
 void x_set_save_callback(void (*cb)(void)) { save_cb = cb; }
+void x_set_load_callback(void (*cb)(void)) { load_cb = cb; }
 void x_set_dim_nav_callback(DimNavCallback cb) { dim_nav_cb = cb; }
 void x_set_render_mode_callback(void (*cb)(void)) { render_mode_cb = cb; }
+void x_set_norm_callback(void (*cb)(void)) { norm_cb = cb; }
+void x_set_autoscale_callback(void (*cb)(void)) { autoscale_cb = cb; }
 void x_set_range_button_callback(void (*cb)(void)) { range_button_cb = cb; }
 void x_set_mouse_click_callback(MouseClickCallback cb) { mouse_click_cb = cb; }
 
@@ -747,6 +842,18 @@ void x_update_render_mode_label(const char *mode_name) {
     }
 }
 
+void x_update_norm_label(const char *norm_name) {
+    if (norm_button && norm_name) {
+        XtVaSetValues(norm_button, XtNlabel, norm_name, NULL);
+    }
+}
+
+void x_update_autoscale_label(const char *mode_name) {
+    if (autoscale_button && mode_name) {
+        XtVaSetValues(autoscale_button, XtNlabel, mode_name, NULL);
+    }
+}
+
 /* ========== Variable Selector ========== */
 
 void x_setup_var_selector(const char **var_names, int n_vars) {
@@ -1030,28 +1137,183 @@ void x_update_dim_current(int dim_index, size_t current_idx, double current_val)
     XtVaSetValues(diminfo_cur_buttons[dim_index], XtNlabel, buf, NULL);
 }
 
-/* ========== Update Functions ========== */
+/* ========== Shared Memory Images ========== */
 
-void x_update_image(const unsigned char *pixels, size_t width, size_t height) {
-    if (!display || !image_widget) return;
+static int shm_error_handler(Display *dpy, XErrorEvent *event) {
+    (void)dpy; (void)event;
+    shm_error = 1;
+    return 0;
+}
 
-    /* Check if we need to recreate the image */
-    if (width != image_width || height != image_height) {
-        if (ximage) {
-            ximage->data = NULL;
-            XDestroyImage(ximage);
-            ximage = NULL;
+/* Whether MIT-SHM can be tried: the extension is there and not switched off */
+static int shm_usable(void) {
+    if (shm_state == 0) {
+        shm_state = (display && XShmQueryExtension(display)) ? 1 : -1;
+        if (shm_state < 0) printf("MIT-SHM not available; images go through XPutImage\n");
+    }
+    return shm_state > 0;
+}
+
+static ShmSegment *find_segment(const void *data) {
+    for (int i = 0; i < n_shm_segments; i++) {
+        if (shm_segments[i]->info.shmaddr == (const char *)data) return shm_segments[i];
+    }
+    return NULL;
+}
+
+/*
+ * A segment the server has attached, or NULL. The attach fails with an X
+ * error when the server is on another host (ssh -X): that is trapped and
+ * turns MIT-SHM off for the session.
+ */
+static ShmSegment *create_segment(size_t bytes) {
+    ShmSegment **grown = realloc(shm_segments, (n_shm_segments + 1) * sizeof(*grown));
+    ShmSegment *seg = calloc(1, sizeof(ShmSegment));
+    if (grown) shm_segments = grown;
+    if (!grown || !seg) {
+        free(seg);
+        return NULL;
+    }
+
+    seg->bytes = bytes;
+    seg->info.shmid = shmget(IPC_PRIVATE, bytes, IPC_CREAT | 0600);
+    if (seg->info.shmid < 0) {
+        free(seg);
+        return NULL;
+    }
+    seg->info.shmaddr = shmat(seg->info.shmid, NULL, 0);
+    seg->info.readOnly = False;
+    if (seg->info.shmaddr == (char *)-1) {
+        shmctl(seg->info.shmid, IPC_RMID, NULL);
+        free(seg);
+        return NULL;
+    }
+
+    shm_error = 0;
+    XErrorHandler old_handler = XSetErrorHandler(shm_error_handler);
+    Status ok = XShmAttach(display, &seg->info);
+    XSync(display, False);
+    XSetErrorHandler(old_handler);
+    /* Removed once both sides detach, so nothing is left behind on a crash */
+    shmctl(seg->info.shmid, IPC_RMID, NULL);
+
+    if (!ok || shm_error) {
+        shmdt(seg->info.shmaddr);
+        free(seg);
+        shm_state = -1;
+        printf("MIT-SHM attach failed (remote display?); images go through XPutImage\n");
+        return NULL;
+    }
+
+    shm_segments[n_shm_segments++] = seg;
+    return seg;
+}
+
+void *x_alloc_pixels(size_t bytes) {
+    if (bytes > 0 && shm_usable()) {
+        ShmSegment *seg = create_segment(bytes);
+        if (seg) return seg->info.shmaddr;
+    }
+    return malloc(bytes);
+}
+
+/* Drop the image header without touching the pixels it wraps */
+static void destroy_image(void) {
+    if (!ximage) return;
+    ximage->data = NULL;
+    ximage->obdata = NULL;  /* XShmCreateImage() points it at our segment info */
+    XDestroyImage(ximage);
+    ximage = NULL;
+    ximage_shm = 0;
+}
+
+void x_free_pixels(void *pixels) {
+    if (!pixels) return;
+    if (ximage && ximage->data == (char *)pixels) destroy_image();
+
+    for (int i = 0; i < n_shm_segments; i++) {
+        ShmSegment *seg = shm_segments[i];
+        if (seg->info.shmaddr != (char *)pixels) continue;
+        XShmDetach(display, &seg->info);
+        XSync(display, False);
+        shmdt(seg->info.shmaddr);
+        free(seg);
+        shm_segments[i] = shm_segments[--n_shm_segments];
+        return;
+    }
+    free(pixels);
+}
+
+void x_set_shm(int enabled) {
+    if (!enabled) shm_state = -1;
+    else if (shm_state < 0) shm_state = 0;
+}
+
+/* Wrap packed rows of pixels in ximage, through their segment if they have one */
+static void wrap_image(void *data, size_t width, size_t height, int bytes_per_pixel) {
+    int screen = DefaultScreen(display);
+    Visual *visual = DefaultVisual(display, screen);
+    int depth = DefaultDepth(display, screen);
+    size_t row_bytes = width * bytes_per_pixel;
+
+    ShmSegment *seg = find_segment(data);
+    if (seg && seg->bytes >= height * row_bytes) {
+        ximage = XShmCreateImage(display, visual, depth, ZPixmap, (char *)data, &seg->info,
+                                 width, height);
+        if (ximage && (size_t)ximage->bytes_per_line == row_bytes &&
+            ximage->bits_per_pixel == bytes_per_pixel * 8) {
+            ximage_shm = 1;
+            return;
         }
-        free(image_data);
-        image_data = NULL;
+        destroy_image();  /* Server layout differs from ours */
+    }
+    ximage = XCreateImage(display, visual, depth, ZPixmap, 0, (char *)data, width, height,
+                          bytes_per_pixel * 8, (int)row_bytes);
+    ximage_shm = 0;
+}
+
+/* ========== Update Functions ========== */
+
+/* Drop the image on a size change and resize the widget to match */
+static void set_image_size(size_t width, size_t height) {
+    if (width == image_width && height == image_height) return;
 
-        image_width = width;
-        image_height = height;
+    destroy_image();
+    x_free_pixels(image_data);
+    image_data = NULL;
 
-        /* Resize widget and shell */
-        XtVaSetValues(image_widget, XtNwidth, width, XtNheight, height, NULL);
-        XtVaSetValues(image_shell, XtNwidth, width, XtNheight, height, NULL);
+    image_width = width;
+    image_height = height;
+
+    /* Resize widget and shell */
+    XtVaSetValues(image_widget, XtNwidth, width, XtNheight, height, NULL);
+    XtVaSetValues(image_shell, XtNwidth, width, XtNheight, height, NULL);
+}
+
+/* Forget an image that wraps a buffer other than data */
+static void release_image_unless(const void *data) {
+    if (ximage && ximage->data != (char *)data) destroy_image();
+}
+
+static void put_image(size_t width, size_t height) {
+    if (!ximage || !XtIsRealized(image_widget)) return;
+    if (ximage_shm) {
+        XShmPutImage(display, XtWindow(image_widget), image_gc, ximage, 0, 0, 0, 0,
+                     width, height, False);
+        /* The server reads the segment after the request: wait, so it is not drawn over */
+        XSync(display, False);
+    } else {
+        XPutImage(display, XtWindow(image_widget), image_gc, ximage, 0, 0, 0, 0,
+                  width, height);
+        XFlush(display);
     }
+}
+
+void x_update_image(const unsigned char *pixels, size_t width, size_t height) {
+    if (!display || !image_widget) return;
+
+    /* Check if we need to recreate the image */
+    set_image_size(width, height);
 
     /* Allocate image data buffer */
     int depth = DefaultDepth(display, DefaultScreen(display));
@@ -1059,12 +1321,12 @@ void x_update_image(const unsigned char *pixels, size_t width, size_t height) {
     size_t row_bytes = width * bytes_per_pixel;
 
     if (!image_data) {
-        image_data = malloc(height * row_bytes);
+        image_data = x_alloc_pixels(height * row_bytes);
+        if (!image_data) return;
     }
+    release_image_unless(image_data);
 
     /* Convert RGB to X11 format */
-    Visual *visual = DefaultVisual(display, DefaultScreen(display));
-
     for (size_t y = 0; y < height; y++) {
         for (size_t x = 0; x < width; x++) {
             size_t src_idx = (y * width + x) * 3;
@@ -1089,17 +1351,48 @@ void x_update_image(const unsigned char *pixels, size_t width, size_t height) {
     }
 
     /* Create XImage */
-    if (!ximage) {
-        ximage = XCreateImage(display, visual, depth, ZPixmap, 0,
-                              (char *)image_data, width, height, 32, 0);
-    }
+    if (!ximage) wrap_image(image_data, width, height, bytes_per_pixel);
 
     /* Draw to window */
-    if (ximage && XtIsRealized(image_widget)) {
-        XPutImage(display, XtWindow(image_widget), image_gc, ximage, 0, 0, 0, 0,
-                  width, height);
-        XFlush(display);
+    put_image(width, height);
+}
+
+PixelFormat x_get_pixel_format(void) {
+    if (!display) return PIXEL_FORMAT_NONE;
+
+    int screen = DefaultScreen(display);
+    Visual *visual = DefaultVisual(display, screen);
+    int depth = DefaultDepth(display, screen);
+
+    /* Only the layouts x_update_image() writes, in the client's byte order */
+    uint16_t one = 1;
+    int client_lsb = (*(const unsigned char *)&one == 1);
+    if ((ImageByteOrder(display) == LSBFirst) != client_lsb) return PIXEL_FORMAT_NONE;
+
+    if (depth >= 24 && visual->red_mask == 0xff0000 &&
+        visual->green_mask == 0x00ff00 && visual->blue_mask == 0x0000ff) {
+        return PIXEL_FORMAT_XRGB8888;
+    }
+    if (depth == 16 && visual->red_mask == 0xf800 &&
+        visual->green_mask == 0x07e0 && visual->blue_mask == 0x001f) {
+        return PIXEL_FORMAT_RGB565;
     }
+    return PIXEL_FORMAT_NONE;
+}
+
+void x_update_image_native(const void *data, PixelFormat format,
+                           size_t width, size_t height) {
+    if (!display || !image_widget || !data) return;
+
+    int bytes_per_pixel = (format == PIXEL_FORMAT_XRGB8888) ? 4 : 2;
+
+    set_image_size(width, height);
+    release_image_unless(data);
+
+    /* Wrap the caller's buffer; rows are packed with no padding */
+    if (!ximage) wrap_image((void *)data, width, height, bytes_per_pixel);
+
+    put_image(width, height);
 }
 
 void x_update_time(size_t time_idx, size_t n_times) {
@@ -1149,6 +1442,17 @@ void x_update_value_label(double lon, double lat, float value) {
     XtVaSetValues(label_value, XtNlabel, buf, NULL);
 }
 
+void x_update_stats_label(const char *text) {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "Stats: %s", text ? text : "-");
+    XtVaSetValues(label_stats, XtNlabel, buf, NULL);
+}
+
+void x_set_colorbar_labels(const float *values) {
+    cbar_have_labels = (values != NULL);
+    if (values) memcpy(cbar_labels, values, sizeof(cbar_labels));
+}
+
 void x_update_colorbar(float min_val, float max_val, size_t width) {
     (void)width;
     if (!display || !colorbar_widget) return;
@@ -1247,20 +1551,29 @@ void x_clear_timer(void) {
     timer_callback_fn = NULL;
 }
 
+void x_set_poll(int interval_ms, void (*callback)(void)) {
+    if (poll_id) {
+        XtRemoveTimeOut(poll_id);
+        poll_id = 0;
+    }
+    poll_callback_fn = callback;
+    poll_interval_ms = interval_ms;
+    if (callback) poll_id = XtAppAddTimeOut(app_context, interval_ms, poll_wrapper, NULL);
+}
+
 void x_main_loop(void) {
     XtAppMainLoop(app_context);
 }
 
 void x_cleanup(void) {
     x_clear_timer();
+    x_set_poll(0, NULL);
     timeseries_popup_cleanup();
     range_popup_cleanup();
 
-    if (ximage) {
-        ximage->data = NULL;
-        XDestroyImage(ximage);
-    }
-    free(image_data);
+    destroy_image();
+    x_free_pixels(image_data);
+    image_data = NULL;
 
     if (image_gc != None) XFreeGC(display, image_gc);
 
@@ -33,8 +33,11 @@ void x_set_mouse_callback(void (*cb)(int x, int y));
 void x_set_range_callback(void (*cb)(int action));  /* 0=min-, 1=min+, 2=max-, 3=max+ */
 void x_set_zoom_callback(void (*cb)(int delta));    /* +1=zoom in, -1=zoom out */
 void x_set_save_callback(void (*cb)(void));         /* save button pressed */
+void x_set_load_callback(void (*cb)(void));         /* load all time steps pressed */
 void x_set_render_mode_callback(void (*cb)(void));  /* toggle render mode */
 void x_set_range_button_callback(void (*cb)(void)); /* Range button pressed */
+void x_set_norm_callback(void (*cb)(void));        /* cycle colour norm */
+void x_set_autoscale_callback(void (*cb)(void));   /* toggle percentile autoscale */
 
 /* Mouse click callback for time series extraction */
 typedef void (*MouseClickCallback)(int x, int y);
@@ -50,6 +53,16 @@ void x_show_timeseries(const TSData *data);
  */
 void x_update_render_mode_label(const char *mode_name);
 
+/*
+ * Update colour norm button label.
+ */
+void x_update_norm_label(const char *norm_name);
+
+/*
+ * Update range autoscale button label.
+ */
+void x_update_autoscale_label(const char *mode_name);
+
 /*
  * Set up variable selector buttons.
  * var_names: array of variable names
@@ -87,6 +100,37 @@ void x_update_dim_current(int dim_index, size_t current_idx, double current_val)
  */
 void x_update_image(const unsigned char *pixels, size_t width, size_t height);
 
+/*
+ * Display-native pixel format the image can be fed in directly, or
+ * PIXEL_FORMAT_NONE if only RGB via x_update_image() is supported.
+ */
+PixelFormat x_get_pixel_format(void);
+
+/*
+ * Update display image from pixels already in the display's native
+ * format (from x_get_pixel_format()), without conversion. Buffers from
+ * x_alloc_pixels() go to the server through shared memory, others are
+ * copied over the X connection. data: [height * width] pixels, rows packed. It is kept for redrawing
+ * on expose and must stay valid until the next x_update_image*() call.
+ */
+void x_update_image_native(const void *data, PixelFormat format,
+                           size_t width, size_t height);
+
+/*
+ * Pixel buffers for x_update_image_native(): MIT-SHM segments the server
+ * reads without a copy through the X socket when the extension works on
+ * this display, else malloc'd memory (remote displays such as ssh -X fall
+ * back on the first failed attach). Release with x_free_pixels(), which
+ * also takes plain malloc'd buffers.
+ */
+void *x_alloc_pixels(size_t bytes);
+void x_free_pixels(void *pixels);
+
+/*
+ * Allow (default) or refuse MIT-SHM segments for buffers allocated later.
+ */
+void x_set_shm(int enabled);
+
 /*
  * Update time slider and label.
  */
@@ -105,6 +149,7 @@ void x_update_dim_label(const char *text);
 void x_update_range_label(float min_val, float max_val);
 void x_update_colormap_label(const char *name);
 void x_update_value_label(double lon, double lat, float value);
+void x_update_stats_label(const char *text);
 
 /*
  * Update colorbar with current colormap and value range.
@@ -112,6 +157,16 @@ void x_update_value_label(double lon, double lat, float value);
  */
 void x_update_colorbar(float min_val, float max_val, size_t height);
 
+/* Labels under the colorbar, evenly spaced from min to max */
+#define X_COLORBAR_LABELS 5
+
+/*
+ * Values to print under the colorbar labels [X_COLORBAR_LABELS], for
+ * non-linear norms; NULL for evenly spaced values. Takes effect with the
+ * next x_update_colorbar().
+ */
+void x_set_colorbar_labels(const float *values);
+
 /*
  * Show range popup dialog (modal).
  * Returns RANGE_POPUP_OK (1) or RANGE_POPUP_CANCEL (0).
@@ -132,6 +187,12 @@ void x_set_timer(int delay_ms, void (*callback)(void));
  */
 void x_clear_timer(void);
 
+/*
+ * Call callback every interval_ms until replaced; NULL stops polling.
+ * Runs alongside the animation timer.
+ */
+void x_set_poll(int interval_ms, void (*callback)(void));
+
 /*
  * Enter X11 event loop.
  */
@@ -1,8 +1,30 @@
 /*
  * kdtree.c - Simple KDTree implementation for 3D nearest-neighbor queries
  *
- * Uses median-split construction and recursive nearest-neighbor search.
- * Optimized for the case of building once and querying many times.
+ * Pointer-free layout: the tree is a complete binary tree stored implicitly
+ * in an array (children of node i are 2i+1 and 2i+2). Every inner node splits
+ * its point range at the median, so child ranges can be recomputed during
+ * descent and nodes only store the split plane. Points are reordered so each
+ * leaf is a contiguous bucket of at most KDTREE_LEAF_SIZE points that is
+ * scanned linearly.
+ *
+ * Construction partitions each range with quickselect (O(n log n) overall)
+ * and is reentrant. The top levels of large trees are built in parallel by
+ * a small work-stealing pool; the result does not depend on thread count.
+ *
+ * Queries walk the tree iteratively with a small explicit stack of deferred
+ * far subtrees. The bounded query seeds the pruning distance with the
+ * caller's radius, so queries far from any point stop near the root.
+ * The seeded query starts at the leaf of a neighbouring query's answer and
+ * walks outwards instead of descending from the root.
+ * The batch query sorts its queries along a Morton curve, seeds each bound
+ * from the previous answer and scans leaf buckets with AVX2/AVX-512 kernels
+ * chosen at run time. Coordinates are stored as separate x/y/z blocks to
+ * feed those kernels.
+ *
+ * Build with -DKDTREE_FLOAT32 to store coordinates in single precision,
+ * halving the footprint of the point arrays at the cost of ~1e-7 relative
+ * error in returned distances.
  */
 
 #include "kdtree.h"
@@ -10,183 +32,1090 @@
 #include <string.h>
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(KDTREE_FLOAT32) && !defined(KDTREE_NO_SIMD)
+#define KDTREE_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 #define KDTREE_DIM 3
 
-/* KDTree node */
-typedef struct KDNode {
-    size_t          idx;        /* Original point index */
-    double          point[KDTREE_DIM];
-    struct KDNode  *left;
-    struct KDNode  *right;
+/* Maximum number of points in a leaf bucket */
+#define KDTREE_LEAF_SIZE 16
+
+#ifdef KDTREE_FLOAT32
+typedef float kd_coord_t;
+#define KD_NEXT_UP(x) nextafterf((x), INFINITY)
+#else
+typedef double kd_coord_t;
+#define KD_NEXT_UP(x) nextafter((x), INFINITY)
+#endif
+
+/* Inner node: split plane only, point range is implied by position */
+typedef struct {
+    kd_coord_t  split;          /* Coordinate of the median point */
+    int         axis;           /* Split axis (0, 1, 2) */
 } KDNode;
 
 /* KDTree structure */
 struct KDTree {
-    KDNode     *root;
     size_t      n_points;
-    double     *points;         /* Copy of original points */
+    int         levels;         /* Depth of leaf level (0 = single leaf) */
+    KDNode     *nodes;          /* Inner nodes [2^levels - 1] */
+    kd_coord_t *coords;         /* Reordered coordinates, x then y then z blocks [3 * n_points] */
+    size_t     *indices;        /* Original index of each reordered point */
 };
 
-/* Comparison context for qsort */
+/* Coordinate of an indexed point along one axis */
+#define KEY(i) points[indices[(i)] * KDTREE_DIM + axis]
+
+/*
+ * Partial sort (quickselect) so that indices[k] holds the k-th smallest point
+ * along axis, with smaller-or-equal points before it and larger-or-equal
+ * points after it. Expected O(n).
+ */
+static void select_kth(const double *points, size_t *indices, size_t n,
+                       size_t k, int axis) {
+    ptrdiff_t lo = 0, hi = (ptrdiff_t)n - 1;
+    ptrdiff_t kk = (ptrdiff_t)k;
+
+    while (hi > lo) {
+        /* Median-of-three pivot, moved to the middle */
+        ptrdiff_t m = lo + (hi - lo) / 2;
+        size_t t;
+        if (KEY(m) < KEY(lo)) { t = indices[m]; indices[m] = indices[lo]; indices[lo] = t; }
+        if (KEY(hi) < KEY(lo)) { t = indices[hi]; indices[hi] = indices[lo]; indices[lo] = t; }
+        if (KEY(hi) < KEY(m)) { t = indices[hi]; indices[hi] = indices[m]; indices[m] = t; }
+        double pivot = KEY(m);
+
+        /* Hoare partition */
+        ptrdiff_t i = lo, j = hi;
+        while (i <= j) {
+            while (KEY(i) < pivot) i++;
+            while (KEY(j) > pivot) j--;
+            if (i <= j) {
+                t = indices[i]; indices[i] = indices[j]; indices[j] = t;
+                i++;
+                j--;
+            }
+        }
+
+        /* [lo, j] <= pivot, [i, hi] >= pivot, anything between equals pivot */
+        if (kk <= j) {
+            hi = j;
+        } else if (kk >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+}
+
+#undef KEY
+
+/* Axis with the largest extent over a range of points */
+static int widest_axis(const double *points, const size_t *indices, size_t n) {
+    double lo[KDTREE_DIM], hi[KDTREE_DIM];
+    for (int d = 0; d < KDTREE_DIM; d++) {
+        lo[d] = DBL_MAX;
+        hi[d] = -DBL_MAX;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const double *p = &points[indices[i] * KDTREE_DIM];
+        for (int d = 0; d < KDTREE_DIM; d++) {
+            if (p[d] < lo[d]) lo[d] = p[d];
+            if (p[d] > hi[d]) hi[d] = p[d];
+        }
+    }
+    int axis = 0;
+    for (int d = 1; d < KDTREE_DIM; d++) {
+        if (hi[d] - lo[d] > hi[axis] - lo[axis]) axis = d;
+    }
+    return axis;
+}
+
+/* Split one inner node: choose axis and partition its range at the median */
+static size_t split_node(KDTree *tree, const double *points, size_t *indices,
+                         size_t node, size_t begin, size_t end) {
+    size_t n = end - begin;
+    int axis = widest_axis(points, indices + begin, n);
+
+    select_kth(points, indices + begin, n, n / 2, axis);
+
+    size_t mid = begin + n / 2;
+    tree->nodes[node].axis = axis;
+    tree->nodes[node].split = (kd_coord_t)points[indices[mid] * KDTREE_DIM + axis];
+    return mid;
+}
+
+/* Build subtree serially: partition indices[begin, end) at the median */
+static void build_tree(KDTree *tree, const double *points, size_t *indices,
+                       size_t node, size_t begin, size_t end, int level) {
+    if (level == tree->levels) return;  /* Leaf bucket */
+
+    size_t mid = split_node(tree, points, indices, node, begin, end);
+
+    build_tree(tree, points, indices, 2 * node + 1, begin, mid, level + 1);
+    build_tree(tree, points, indices, 2 * node + 2, mid, end, level + 1);
+}
+
+/* ========== Parallel build ========== */
+
+/* Subtrees smaller than this are built serially by the thread that owns them */
+#define KDTREE_PARALLEL_CUTOFF 65536
+
+/* Maximum number of build threads */
+#define KDTREE_MAX_THREADS 64
+
+/* Forced build thread count (0 = one per CPU) */
+static int build_threads = 0;
+
+void kdtree_set_num_threads(int n_threads) {
+    build_threads = (n_threads > 0) ? n_threads : 0;
+}
+
 typedef struct {
-    const double *points;
-    int axis;
-} SortContext;
-
-static SortContext sort_ctx;
-
-/* Comparison function for sorting indices by coordinate */
-static int compare_by_axis(const void *a, const void *b) {
-    size_t ia = *(const size_t *)a;
-    size_t ib = *(const size_t *)b;
-    double va = sort_ctx.points[ia * KDTREE_DIM + sort_ctx.axis];
-    double vb = sort_ctx.points[ib * KDTREE_DIM + sort_ctx.axis];
-    if (va < vb) return -1;
-    if (va > vb) return 1;
+    size_t  node, begin, end;
+    int     level;
+} BuildTask;
+
+/* Per-thread task deque: owner pushes/pops at the tail, thieves take the head */
+typedef struct {
+    BuildTask      *tasks;
+    size_t          head, tail, cap;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct {
+    KDTree         *tree;
+    const double   *points;
+    size_t         *indices;
+    TaskDeque      *deques;
+    int             n_threads;
+    atomic_size_t   pending;        /* Tasks queued or in progress */
+} BuildPool;
+
+typedef struct {
+    BuildPool  *pool;
+    int         id;
+} BuildWorker;
+
+static int deque_push(TaskDeque *dq, const BuildTask *task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        /* Compact, then grow if still full */
+        if (dq->head > 0) {
+            memmove(dq->tasks, dq->tasks + dq->head,
+                    (dq->tail - dq->head) * sizeof(BuildTask));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        if (dq->tail == dq->cap) {
+            size_t new_cap = dq->cap ? dq->cap * 2 : 64;
+            BuildTask *grown = realloc(dq->tasks, new_cap * sizeof(BuildTask));
+            if (!grown) {
+                pthread_mutex_unlock(&dq->lock);
+                return -1;
+            }
+            dq->tasks = grown;
+            dq->cap = new_cap;
+        }
+    }
+    dq->tasks[dq->tail++] = *task;
+    pthread_mutex_unlock(&dq->lock);
     return 0;
 }
 
-/* Build KDTree recursively */
-static KDNode *build_tree(const double *points, size_t *indices,
-                          size_t n, int depth) {
-    if (n == 0) return NULL;
+static int deque_pop(TaskDeque *dq, BuildTask *task) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *task = dq->tasks[--dq->tail];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static int deque_steal(TaskDeque *dq, BuildTask *task) {
+    int found = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        *task = dq->tasks[dq->head++];
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
 
-    int axis = depth % KDTREE_DIM;
+/* Process one task: split large nodes, sharing one child with thieves */
+static void run_build_task(BuildPool *pool, int id, BuildTask task) {
+    KDTree *tree = pool->tree;
 
-    /* Sort indices by current axis */
-    sort_ctx.points = points;
-    sort_ctx.axis = axis;
-    qsort(indices, n, sizeof(size_t), compare_by_axis);
+    while (task.level < tree->levels &&
+           task.end - task.begin >= KDTREE_PARALLEL_CUTOFF) {
+        size_t mid = split_node(tree, pool->points, pool->indices,
+                                task.node, task.begin, task.end);
 
-    /* Find median */
-    size_t median = n / 2;
+        BuildTask right = { 2 * task.node + 2, mid, task.end, task.level + 1 };
+        atomic_fetch_add(&pool->pending, 1);
+        if (deque_push(&pool->deques[id], &right) != 0) {
+            /* Could not queue: build it here instead */
+            atomic_fetch_sub(&pool->pending, 1);
+            build_tree(tree, pool->points, pool->indices,
+                       right.node, right.begin, right.end, right.level);
+        }
 
-    /* Create node */
-    KDNode *node = malloc(sizeof(KDNode));
-    if (!node) return NULL;
+        task.node = 2 * task.node + 1;
+        task.end = mid;
+        task.level++;
+    }
 
-    node->idx = indices[median];
-    node->point[0] = points[node->idx * KDTREE_DIM + 0];
-    node->point[1] = points[node->idx * KDTREE_DIM + 1];
-    node->point[2] = points[node->idx * KDTREE_DIM + 2];
+    build_tree(tree, pool->points, pool->indices,
+               task.node, task.begin, task.end, task.level);
+}
 
-    /* Build subtrees */
-    node->left = build_tree(points, indices, median, depth + 1);
-    node->right = build_tree(points, indices + median + 1, n - median - 1, depth + 1);
+static void *build_worker(void *arg) {
+    BuildWorker *w = arg;
+    BuildPool *pool = w->pool;
+    unsigned int victim = (unsigned int)w->id;
 
-    return node;
+    while (atomic_load(&pool->pending) > 0) {
+        BuildTask task;
+        int found = deque_pop(&pool->deques[w->id], &task);
+
+        /* Own deque empty: try to steal from the others */
+        for (int k = 1; !found && k < pool->n_threads; k++) {
+            victim = (victim + 1) % (unsigned int)pool->n_threads;
+            if ((int)victim == w->id) continue;
+            found = deque_steal(&pool->deques[victim], &task);
+        }
+
+        if (!found) {
+            sched_yield();
+            continue;
+        }
+
+        run_build_task(pool, w->id, task);
+        atomic_fetch_sub(&pool->pending, 1);
+    }
+    return NULL;
+}
+
+static int build_num_threads(size_t n_points) {
+    long n_cpu = build_threads;
+    if (n_cpu <= 0) n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpu < 1) n_cpu = 1;
+    if (n_cpu > KDTREE_MAX_THREADS) n_cpu = KDTREE_MAX_THREADS;
+
+    /* No point in more threads than parallel subtrees */
+    size_t max_useful = n_points / KDTREE_PARALLEL_CUTOFF;
+    if (max_useful < 1) max_useful = 1;
+    if ((size_t)n_cpu > max_useful) n_cpu = (long)max_useful;
+    return (int)n_cpu;
+}
+
+/*
+ * Build the whole tree, splitting the top levels across a work-stealing
+ * pool. The calling thread acts as worker 0.
+ */
+static void build_tree_parallel(KDTree *tree, const double *points, size_t *indices) {
+    int n_threads = build_num_threads(tree->n_points);
+    if (n_threads <= 1) {
+        build_tree(tree, points, indices, 0, 0, tree->n_points, 0);
+        return;
+    }
+
+    BuildPool pool;
+    pool.tree = tree;
+    pool.points = points;
+    pool.indices = indices;
+    pool.n_threads = n_threads;
+    atomic_init(&pool.pending, 1);
+    pool.deques = calloc((size_t)n_threads, sizeof(TaskDeque));
+    BuildWorker *workers = calloc((size_t)n_threads, sizeof(BuildWorker));
+    pthread_t *threads = calloc((size_t)n_threads, sizeof(pthread_t));
+    if (!pool.deques || !workers || !threads) {
+        free(pool.deques);
+        free(workers);
+        free(threads);
+        build_tree(tree, points, indices, 0, 0, tree->n_points, 0);
+        return;
+    }
+
+    for (int t = 0; t < n_threads; t++) {
+        pthread_mutex_init(&pool.deques[t].lock, NULL);
+        workers[t].pool = &pool;
+        workers[t].id = t;
+    }
+
+    BuildTask root = { 0, 0, tree->n_points, 0 };
+    if (deque_push(&pool.deques[0], &root) != 0) {
+        atomic_store(&pool.pending, 0);
+        build_tree(tree, points, indices, 0, 0, tree->n_points, 0);
+    }
+
+    /* Workers that fail to start are simply absent; the rest do their share */
+    int started[KDTREE_MAX_THREADS] = {0};
+    for (int t = 1; t < n_threads; t++) {
+        started[t] = (pthread_create(&threads[t], NULL, build_worker, &workers[t]) == 0);
+    }
+    build_worker(&workers[0]);
+    for (int t = 1; t < n_threads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+
+    for (int t = 0; t < n_threads; t++) {
+        pthread_mutex_destroy(&pool.deques[t].lock);
+        free(pool.deques[t].tasks);
+    }
+    free(pool.deques);
+    free(workers);
+    free(threads);
 }
 
 KDTree *kdtree_create(const double *points, size_t n_points) {
     if (!points || n_points == 0) return NULL;
 
-    KDTree *tree = malloc(sizeof(KDTree));
+    KDTree *tree = calloc(1, sizeof(KDTree));
     if (!tree) return NULL;
 
     tree->n_points = n_points;
 
-    /* Copy points */
-    tree->points = malloc(n_points * KDTREE_DIM * sizeof(double));
-    if (!tree->points) {
-        free(tree);
-        return NULL;
+    /* Smallest depth at which every leaf holds at most KDTREE_LEAF_SIZE points */
+    tree->levels = 0;
+    while (((n_points - 1) >> tree->levels) + 1 > KDTREE_LEAF_SIZE) {
+        tree->levels++;
     }
-    memcpy(tree->points, points, n_points * KDTREE_DIM * sizeof(double));
 
-    /* Create index array */
-    size_t *indices = malloc(n_points * sizeof(size_t));
-    if (!indices) {
-        free(tree->points);
-        free(tree);
+    size_t n_nodes = ((size_t)1 << tree->levels) - 1;
+    tree->nodes = malloc((n_nodes > 0 ? n_nodes : 1) * sizeof(KDNode));
+    tree->coords = malloc(n_points * KDTREE_DIM * sizeof(kd_coord_t));
+    tree->indices = malloc(n_points * sizeof(size_t));
+    if (!tree->nodes || !tree->coords || !tree->indices) {
+        kdtree_free(tree);
         return NULL;
     }
+
     for (size_t i = 0; i < n_points; i++) {
-        indices[i] = i;
+        tree->indices[i] = i;
     }
 
     /* Build tree */
-    tree->root = build_tree(tree->points, indices, n_points, 0);
+    build_tree_parallel(tree, points, tree->indices);
 
-    free(indices);
-
-    if (!tree->root && n_points > 0) {
-        free(tree->points);
-        free(tree);
-        return NULL;
+    /* Store coordinates in tree order so leaf buckets are contiguous */
+    for (size_t i = 0; i < n_points; i++) {
+        const double *p = &points[tree->indices[i] * KDTREE_DIM];
+        tree->coords[i] = (kd_coord_t)p[0];
+        tree->coords[n_points + i] = (kd_coord_t)p[1];
+        tree->coords[2 * n_points + i] = (kd_coord_t)p[2];
     }
 
     return tree;
 }
 
-/* Squared Euclidean distance */
-static inline double dist_sq(const double *a, const double *b) {
-    double dx = a[0] - b[0];
-    double dy = a[1] - b[1];
-    double dz = a[2] - b[2];
-    return dx*dx + dy*dy + dz*dz;
+/* Deferred far subtree on the explicit search stack */
+typedef struct {
+    size_t      node, begin, end;
+    int         level;
+    kd_coord_t  plane_dist_sq;  /* Squared distance from query to split plane */
+} KDStackEntry;
+
+/* One deferred subtree per level at most; levels never exceed 64 */
+#define KDTREE_MAX_DEPTH 64
+
+/*
+ * Leaf kernels: update (*best_pos, *best_dist_sq) with the first point in
+ * [begin, end) strictly closer than the current best. All variants compute
+ * (dx*dx + dy*dy) + dz*dz in the same order without fused multiply-add,
+ * so they agree bit for bit. The scalar distance code carries the same
+ * fp-contract=off as the SIMD searches, so -march=native cannot fuse it.
+ */
+typedef void (*LeafScanFn)(const KDTree *tree, const kd_coord_t *query,
+                           size_t begin, size_t end,
+                           size_t *best_pos, kd_coord_t *best_dist_sq);
+
+__attribute__((optimize("fp-contract=off")))
+static inline void leaf_scan_scalar(const KDTree *tree, const kd_coord_t *query,
+                                    size_t begin, size_t end,
+                                    size_t *best_pos, kd_coord_t *best_dist_sq) {
+    const kd_coord_t *xs = tree->coords;
+    const kd_coord_t *ys = xs + tree->n_points;
+    const kd_coord_t *zs = ys + tree->n_points;
+    for (size_t i = begin; i < end; i++) {
+        kd_coord_t dx = xs[i] - query[0];
+        kd_coord_t dy = ys[i] - query[1];
+        kd_coord_t dz = zs[i] - query[2];
+        kd_coord_t d = dx*dx + dy*dy + dz*dz;
+        if (d < *best_dist_sq) {
+            *best_dist_sq = d;
+            *best_pos = i;
+        }
+    }
 }
 
-/* Recursive nearest neighbor search */
-static void search_nearest(const KDNode *node, const double *query,
-                           int depth, size_t *best_idx, double *best_dist_sq) {
-    if (!node) return;
+/* Scalar leaf scan that also flags points at exactly the best distance */
+__attribute__((optimize("fp-contract=off")))
+static inline void leaf_scan_ties(const KDTree *tree, const kd_coord_t *query,
+                                  size_t begin, size_t end, size_t *best_pos,
+                                  kd_coord_t *best_dist_sq, int *tie) {
+    const kd_coord_t *xs = tree->coords;
+    const kd_coord_t *ys = xs + tree->n_points;
+    const kd_coord_t *zs = ys + tree->n_points;
+    for (size_t i = begin; i < end; i++) {
+        kd_coord_t dx = xs[i] - query[0];
+        kd_coord_t dy = ys[i] - query[1];
+        kd_coord_t dz = zs[i] - query[2];
+        kd_coord_t d = dx*dx + dy*dy + dz*dz;
+        if (d < *best_dist_sq) {
+            *best_dist_sq = d;
+            *best_pos = i;
+            *tie = 0;
+        } else if (d == *best_dist_sq) {
+            *tie = 1;
+        }
+    }
+}
+
+/*
+ * Iterative nearest neighbor search from subtree `start`, with `top`
+ * subtrees already deferred on `stack`. *best_dist_sq is the initial
+ * pruning bound (INFINITY for an unbounded query); subtrees whose split
+ * plane is not closer than the current bound are never entered.
+ *
+ * The result is the first point in traversal order at the minimum distance
+ * for any initial bound above the minimum, so the batch query can seed the
+ * bound from a neighbouring answer without changing results.
+ *
+ * With tie != NULL, subtrees exactly at the bound are still visited and
+ * *tie reports whether the minimum is attained by more than one point, for
+ * callers whose traversal order differs from the root-first search.
+ */
+static inline __attribute__((always_inline))
+void search_nearest_impl(const KDTree *tree, const kd_coord_t *query,
+                         KDStackEntry *stack, int top, KDStackEntry start,
+                         size_t *best_pos, kd_coord_t *best_dist_sq,
+                         LeafScanFn scan, int *tie) {
+    size_t node = start.node, begin = start.begin, end = start.end;
+    int level = start.level;
+
+    for (;;) {
+        /* Descend towards the query, deferring the far child of each node */
+        while (level < tree->levels) {
+            const KDNode *n = &tree->nodes[node];
+            size_t mid = begin + (end - begin) / 2;
+            kd_coord_t diff = query[n->axis] - n->split;
+            kd_coord_t diff_sq = diff * diff;
+            int reach = tie ? (diff_sq <= *best_dist_sq) : (diff_sq < *best_dist_sq);
+            level++;
+            if (diff < 0) {
+                if (reach) {
+                    KDStackEntry e = {2 * node + 2, mid, end, level, diff_sq};
+                    stack[top++] = e;
+                }
+                node = 2 * node + 1;
+                end = mid;
+            } else {
+                if (reach) {
+                    KDStackEntry e = {2 * node + 1, begin, mid, level, diff_sq};
+                    stack[top++] = e;
+                }
+                node = 2 * node + 2;
+                begin = mid;
+            }
+        }
+
+        if (tie) {
+            leaf_scan_ties(tree, query, begin, end, best_pos, best_dist_sq, tie);
+        } else {
+            scan(tree, query, begin, end, best_pos, best_dist_sq);
+        }
 
-    /* Check current node */
-    double d = dist_sq(node->point, query);
-    if (d < *best_dist_sq) {
-        *best_dist_sq = d;
-        *best_idx = node->idx;
+        /* Resume at the next deferred subtree that can still hold a closer point */
+        const KDStackEntry *e;
+        for (;;) {
+            if (top == 0) return;
+            e = &stack[--top];
+            if (tie ? (e->plane_dist_sq <= *best_dist_sq)
+                    : (e->plane_dist_sq < *best_dist_sq)) break;
+        }
+        node = e->node;
+        begin = e->begin;
+        end = e->end;
+        level = e->level;
     }
+}
 
-    /* Determine which subtree to search first */
-    int axis = depth % KDTREE_DIM;
-    double diff = query[axis] - node->point[axis];
+/* Whole tree, as the starting subtree of a root-first search */
+#define KD_ROOT(tree) ((KDStackEntry){0, 0, (tree)->n_points, 0, 0})
 
-    KDNode *first = (diff < 0) ? node->left : node->right;
-    KDNode *second = (diff < 0) ? node->right : node->left;
+__attribute__((optimize("fp-contract=off")))
+static void search_nearest(const KDTree *tree, const kd_coord_t *query,
+                           size_t *best_pos, kd_coord_t *best_dist_sq) {
+    KDStackEntry stack[KDTREE_MAX_DEPTH];
+    search_nearest_impl(tree, query, stack, 0, KD_ROOT(tree),
+                        best_pos, best_dist_sq, leaf_scan_scalar, NULL);
+}
 
-    /* Search closer subtree first */
-    search_nearest(first, query, depth + 1, best_idx, best_dist_sq);
+/*
+ * Walking search: start at the leaf holding seed_pos instead of the leaf
+ * holding the query. The path to that leaf follows from the position alone,
+ * so node loads do not depend on comparisons. Every sibling subtree along
+ * the path is deferred with the distance to its split plane (zero when the
+ * query lies on the sibling's side), deepest on top, and the normal search
+ * loop finishes from there. Neighbouring queries share most of their
+ * answer, so after the seed leaf nearly every sibling is pruned.
+ * Returns: 1 if the minimum is attained by a single point, 0 on a tie
+ */
+__attribute__((optimize("fp-contract=off")))
+static int walk_nearest(const KDTree *tree, const kd_coord_t *query, size_t seed_pos,
+                        size_t *best_pos, kd_coord_t *best_dist_sq) {
+    KDStackEntry stack[KDTREE_MAX_DEPTH];
+    size_t node = 0, begin = 0, end = tree->n_points;
+    int level = 0;
 
-    /* Check if we need to search the other subtree */
-    if (diff * diff < *best_dist_sq) {
-        search_nearest(second, query, depth + 1, best_idx, best_dist_sq);
+    while (level < tree->levels) {
+        const KDNode *n = &tree->nodes[node];
+        size_t mid = begin + (end - begin) / 2;
+        int seed_right = (seed_pos >= mid);
+        kd_coord_t diff = query[n->axis] - n->split;
+        kd_coord_t plane = ((diff >= 0) == seed_right) ? diff * diff : 0;
+        level++;
+        if (seed_right) {
+            stack[level - 1] = (KDStackEntry){2 * node + 1, begin, mid, level, plane};
+            node = 2 * node + 2;
+            begin = mid;
+        } else {
+            stack[level - 1] = (KDStackEntry){2 * node + 2, mid, end, level, plane};
+            node = 2 * node + 1;
+            end = mid;
+        }
     }
+
+    int tie = 0;
+    KDStackEntry leaf = {node, begin, end, level, 0};
+    search_nearest_impl(tree, query, stack, level, leaf,
+                        best_pos, best_dist_sq, leaf_scan_scalar, &tie);
+    return !tie;
+}
+
+#ifdef KDTREE_X86_SIMD
+/* Pick the winner from precomputed leaf distances, as the scalar loop would */
+static inline __attribute__((always_inline))
+void leaf_select(const double *d, double dmin, size_t begin, size_t n,
+                 size_t *best_pos, double *best_dist_sq) {
+    if (!(dmin < *best_dist_sq)) return;
+    for (size_t j = 0; j < n; j++) {
+        if (d[j] < *best_dist_sq) {
+            *best_dist_sq = d[j];
+            *best_pos = begin + j;
+        }
+    }
+}
+
+static inline __attribute__((always_inline, target("avx2")))
+void leaf_scan_avx2(const KDTree *tree, const double *query,
+                    size_t begin, size_t end,
+                    size_t *best_pos, double *best_dist_sq) {
+    const double *xs = tree->coords + begin;
+    const double *ys = xs + tree->n_points;
+    const double *zs = ys + tree->n_points;
+    size_t n = end - begin;
+    double d[KDTREE_LEAF_SIZE];
+
+    __m256d qx = _mm256_set1_pd(query[0]);
+    __m256d qy = _mm256_set1_pd(query[1]);
+    __m256d qz = _mm256_set1_pd(query[2]);
+    __m256d vmin = _mm256_set1_pd(INFINITY);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), qx);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), qy);
+        __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(zs + i), qz);
+        __m256d dd = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                                 _mm256_mul_pd(dy, dy)),
+                                   _mm256_mul_pd(dz, dz));
+        _mm256_storeu_pd(d + i, dd);
+        vmin = _mm256_min_pd(vmin, dd);
+    }
+    __m128d m2 = _mm_min_pd(_mm256_castpd256_pd128(vmin), _mm256_extractf128_pd(vmin, 1));
+    double dmin = _mm_cvtsd_f64(_mm_min_sd(m2, _mm_unpackhi_pd(m2, m2)));
+    for (; i < n; i++) {
+        double dx = xs[i] - query[0];
+        double dy = ys[i] - query[1];
+        double dz = zs[i] - query[2];
+        d[i] = dx*dx + dy*dy + dz*dz;
+        if (d[i] < dmin) dmin = d[i];
+    }
+    leaf_select(d, dmin, begin, n, best_pos, best_dist_sq);
+}
+
+static inline __attribute__((always_inline, target("avx512f")))
+void leaf_scan_avx512(const KDTree *tree, const double *query,
+                      size_t begin, size_t end,
+                      size_t *best_pos, double *best_dist_sq) {
+    const double *xs = tree->coords + begin;
+    const double *ys = xs + tree->n_points;
+    const double *zs = ys + tree->n_points;
+    size_t n = end - begin;
+    double d[KDTREE_LEAF_SIZE];
+
+    __m512d qx = _mm512_set1_pd(query[0]);
+    __m512d qy = _mm512_set1_pd(query[1]);
+    __m512d qz = _mm512_set1_pd(query[2]);
+    __m512d vmin = _mm512_set1_pd(INFINITY);
+    for (size_t i = 0; i < n; i += 8) {
+        /* Masked tail: inactive lanes are neither stored nor part of the min */
+        __mmask8 m = (n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, xs + i), qx);
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, ys + i), qy);
+        __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, zs + i), qz);
+        __m512d dd = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx),
+                                                 _mm512_mul_pd(dy, dy)),
+                                   _mm512_mul_pd(dz, dz));
+        _mm512_mask_storeu_pd(d + i, m, dd);
+        vmin = _mm512_mask_min_pd(vmin, m, vmin, dd);
+    }
+    leaf_select(d, _mm512_reduce_min_pd(vmin), begin, n, best_pos, best_dist_sq);
+}
+
+__attribute__((target("avx2"), optimize("fp-contract=off")))
+static void search_nearest_avx2(const KDTree *tree, const double *query,
+                                size_t *best_pos, double *best_dist_sq) {
+    KDStackEntry stack[KDTREE_MAX_DEPTH];
+    search_nearest_impl(tree, query, stack, 0, KD_ROOT(tree),
+                        best_pos, best_dist_sq, leaf_scan_avx2, NULL);
+}
+
+__attribute__((target("avx512f"), optimize("fp-contract=off")))
+static void search_nearest_avx512(const KDTree *tree, const double *query,
+                                  size_t *best_pos, double *best_dist_sq) {
+    KDStackEntry stack[KDTREE_MAX_DEPTH];
+    search_nearest_impl(tree, query, stack, 0, KD_ROOT(tree),
+                        best_pos, best_dist_sq, leaf_scan_avx512, NULL);
+}
+#endif
+
+typedef void (*SearchNearestFn)(const KDTree *tree, const kd_coord_t *query,
+                                size_t *best_pos, kd_coord_t *best_dist_sq);
+
+/* Search specialised for the widest leaf kernel the running CPU supports */
+static SearchNearestFn select_search_nearest(void) {
+#ifdef KDTREE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return search_nearest_avx512;
+    if (__builtin_cpu_supports("avx2")) return search_nearest_avx2;
+#endif
+    return search_nearest;
 }
 
 void kdtree_query_nearest(const KDTree *tree, const double *query,
                           size_t *nn_idx, double *nn_dist) {
-    if (!tree || !tree->root || !query || !nn_idx || !nn_dist) {
+    if (!tree || !query || !nn_idx || !nn_dist) {
         if (nn_idx) *nn_idx = 0;
         if (nn_dist) *nn_dist = DBL_MAX;
         return;
     }
 
-    *nn_dist = DBL_MAX;
-    *nn_idx = 0;
+    kd_coord_t q[KDTREE_DIM] = {
+        (kd_coord_t)query[0], (kd_coord_t)query[1], (kd_coord_t)query[2]
+    };
+    size_t best_pos = 0;
+    kd_coord_t best_dist_sq = (kd_coord_t)INFINITY;
 
-    search_nearest(tree->root, query, 0, nn_idx, nn_dist);
+    search_nearest(tree, q, &best_pos, &best_dist_sq);
 
     /* Return actual distance (not squared) */
-    *nn_dist = sqrt(*nn_dist);
+    *nn_idx = tree->indices[best_pos];
+    *nn_dist = sqrt((double)best_dist_sq);
+}
+
+/*
+ * Initial pruning bound for a radius query. Slightly widened so rounding in
+ * the squared distance cannot reject a point exactly at max_dist; callers
+ * compare the true distance afterwards.
+ */
+static inline kd_coord_t radius_bound_sq(double max_dist) {
+    return (kd_coord_t)(max_dist * max_dist * (1.0 + 1e-6));
+}
+
+int kdtree_query_nearest_within(const KDTree *tree, const double *query,
+                                double max_dist, size_t *nn_idx, double *nn_dist) {
+    if (!tree || !query || !nn_idx || !nn_dist || !(max_dist >= 0.0)) return 0;
+
+    kd_coord_t q[KDTREE_DIM] = {
+        (kd_coord_t)query[0], (kd_coord_t)query[1], (kd_coord_t)query[2]
+    };
+    size_t best_pos = SIZE_MAX;
+    kd_coord_t best_dist_sq = radius_bound_sq(max_dist);
+
+    search_nearest(tree, q, &best_pos, &best_dist_sq);
+
+    if (best_pos == SIZE_MAX) return 0;
+    double dist = sqrt((double)best_dist_sq);
+    if (dist > max_dist) return 0;
+
+    *nn_idx = tree->indices[best_pos];
+    *nn_dist = dist;
+    return 1;
+}
+
+/* Squared distance from query to the point at tree position pos */
+__attribute__((optimize("fp-contract=off")))
+static inline kd_coord_t point_dist_sq(const KDTree *tree, size_t pos,
+                                       const kd_coord_t *query) {
+    kd_coord_t dx = tree->coords[pos] - query[0];
+    kd_coord_t dy = tree->coords[tree->n_points + pos] - query[1];
+    kd_coord_t dz = tree->coords[2 * tree->n_points + pos] - query[2];
+    return dx*dx + dy*dy + dz*dz;
+}
+
+/*
+ * Starting bound from a nearby point: its distance nudged up, so the point
+ * itself still counts as strictly closer. Any bound above the minimum
+ * leaves the answer unchanged.
+ */
+static inline kd_coord_t seed_bound_sq(const KDTree *tree, size_t pos,
+                                       const kd_coord_t *query) {
+    kd_coord_t d = point_dist_sq(tree, pos, query);
+    return KD_NEXT_UP(d + d * (kd_coord_t)1e-6);
+}
+
+int kdtree_query_nearest_seeded(const KDTree *tree, const double *query,
+                                double max_dist, size_t *hint,
+                                size_t *nn_idx, double *nn_dist) {
+    if (!tree || !query || !hint || !nn_idx || !nn_dist || !(max_dist >= 0.0)) return 0;
+
+    kd_coord_t q[KDTREE_DIM] = {
+        (kd_coord_t)query[0], (kd_coord_t)query[1], (kd_coord_t)query[2]
+    };
+    kd_coord_t bound_sq = radius_bound_sq(max_dist);
+    size_t best_pos = SIZE_MAX;
+    kd_coord_t best_dist_sq = bound_sq;
+
+    int walked = 0;
+    if (*hint < tree->n_points) {
+        kd_coord_t seed = seed_bound_sq(tree, *hint, q);
+        if (seed < best_dist_sq) best_dist_sq = seed;
+        walked = walk_nearest(tree, q, *hint, &best_pos, &best_dist_sq);
+    }
+    if (!walked) {
+        /* Cold start, or a tie that the root-first order has to break */
+        best_pos = SIZE_MAX;
+        best_dist_sq = bound_sq;
+        search_nearest(tree, q, &best_pos, &best_dist_sq);
+    }
+
+    if (best_pos == SIZE_MAX) return 0;
+    double dist = sqrt((double)best_dist_sq);
+    if (dist > max_dist) return 0;
+
+    *nn_idx = tree->indices[best_pos];
+    *nn_dist = dist;
+    *hint = best_pos;
+    return 1;
+}
+
+/* Spread the low 10 bits of v so that they occupy every third bit */
+static uint32_t spread_bits3(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | v << 16) & 0x030000ff;
+    v = (v | v << 8)  & 0x0300f00f;
+    v = (v | v << 4)  & 0x030c30c3;
+    v = (v | v << 2)  & 0x09249249;
+    return v;
+}
+
+/*
+ * Morton keys use 10 bits per axis: a 1024^3 lattice over the query
+ * bounding box is far finer than a leaf bucket, and a 30-bit key sorts
+ * in three radix passes.
+ */
+#define MORTON_AXIS_CELLS 1024
+#define MORTON_RADIX_BITS 10
+#define MORTON_RADIX_PASSES 3
+
+/*
+ * Order queries along a Morton (Z-order) curve over their bounding box so
+ * consecutive queries land in the same leaves.
+ * Returns: permutation of [0, n) (caller frees), or NULL on allocation failure
+ */
+static size_t *morton_order(const double *queries, size_t n) {
+    uint32_t *keys = malloc(2 * n * sizeof(uint32_t));
+    size_t *perm = malloc(2 * n * sizeof(size_t));
+    if (!keys || !perm) {
+        free(keys);
+        free(perm);
+        return NULL;
+    }
+
+    double lo[KDTREE_DIM], scale[KDTREE_DIM];
+    for (int a = 0; a < KDTREE_DIM; a++) {
+        double mn = INFINITY, mx = -INFINITY;
+        for (size_t i = 0; i < n; i++) {
+            double v = queries[i * KDTREE_DIM + a];
+            if (v < mn) mn = v;
+            if (v > mx) mx = v;
+        }
+        lo[a] = mn;
+        scale[a] = (mx > mn) ? (MORTON_AXIS_CELLS - 1) / (mx - mn) : 0.0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t key = 0;
+        for (int a = 0; a < KDTREE_DIM; a++) {
+            double t = (queries[i * KDTREE_DIM + a] - lo[a]) * scale[a];
+            uint32_t cell = (t > 0.0) ? (uint32_t)t : 0;  /* NaN maps to 0 */
+            key |= spread_bits3(cell) << a;
+        }
+        keys[i] = key;
+        perm[i] = i;
+    }
+
+    /* LSD radix sort of (key, index) pairs; stable, so ties keep input order */
+    uint32_t *ksrc = keys, *kdst = keys + n;
+    size_t *psrc = perm, *pdst = perm + n;
+    for (int pass = 0; pass < MORTON_RADIX_PASSES; pass++) {
+        int shift = pass * MORTON_RADIX_BITS;
+        size_t count[1 << MORTON_RADIX_BITS] = {0};
+        for (size_t i = 0; i < n; i++) {
+            count[(ksrc[i] >> shift) & ((1 << MORTON_RADIX_BITS) - 1)]++;
+        }
+        size_t sum = 0;
+        for (size_t b = 0; b < (1 << MORTON_RADIX_BITS); b++) {
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t b = (ksrc[i] >> shift) & ((1 << MORTON_RADIX_BITS) - 1);
+            kdst[count[b]] = ksrc[i];
+            pdst[count[b]++] = psrc[i];
+        }
+        uint32_t *kt = ksrc; ksrc = kdst; kdst = kt;
+        size_t *pt = psrc; psrc = pdst; pdst = pt;
+    }
+
+    /* Odd pass count: the sorted permutation ends up in the second half */
+    memmove(perm, psrc, n * sizeof(size_t));
+    free(keys);
+    return perm;
+}
+
+size_t kdtree_query_nearest_batch(const KDTree *tree, const double *queries,
+                                  size_t n_queries, double max_dist,
+                                  size_t *nn_idx, double *nn_dist) {
+    if (!tree || !queries || !nn_idx || !nn_dist || !(max_dist >= 0.0)) return 0;
+
+    SearchNearestFn search = select_search_nearest();
+    size_t *order = morton_order(queries, n_queries);  /* NULL: input order */
+    kd_coord_t bound_sq = radius_bound_sq(max_dist);
+
+    size_t prev_pos = SIZE_MAX;
+    size_t found = 0;
+    for (size_t k = 0; k < n_queries; k++) {
+        size_t qi = order ? order[k] : k;
+        const double *query = &queries[qi * KDTREE_DIM];
+        kd_coord_t q[KDTREE_DIM] = {
+            (kd_coord_t)query[0], (kd_coord_t)query[1], (kd_coord_t)query[2]
+        };
+
+        size_t best_pos = SIZE_MAX;
+        kd_coord_t best_dist_sq = bound_sq;
+
+        /* Consecutive queries usually share their answer: a tight starting bound */
+        if (prev_pos != SIZE_MAX) {
+            kd_coord_t seed = seed_bound_sq(tree, prev_pos, q);
+            if (seed < best_dist_sq) best_dist_sq = seed;
+        }
+
+        search(tree, q, &best_pos, &best_dist_sq);
+
+        double dist = (best_pos != SIZE_MAX) ? sqrt((double)best_dist_sq) : INFINITY;
+        if (dist <= max_dist) {
+            nn_idx[qi] = tree->indices[best_pos];
+            nn_dist[qi] = dist;
+            prev_pos = best_pos;
+            found++;
+        } else {
+            nn_idx[qi] = 0;
+            nn_dist[qi] = DBL_MAX;
+        }
+    }
+
+    free(order);
+    return found;
+}
+
+/* Bounded max-heap of the k best candidates (root = current worst) */
+typedef struct {
+    size_t     *pos;            /* Positions in reordered arrays */
+    kd_coord_t *dist_sq;
+    size_t      size, cap;
+} KNNHeap;
+
+static void heap_sift_down(KNNHeap *h, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->size && h->dist_sq[l] > h->dist_sq[m]) m = l;
+        if (r < h->size && h->dist_sq[r] > h->dist_sq[m]) m = r;
+        if (m == i) return;
+        kd_coord_t td = h->dist_sq[i]; h->dist_sq[i] = h->dist_sq[m]; h->dist_sq[m] = td;
+        size_t tp = h->pos[i]; h->pos[i] = h->pos[m]; h->pos[m] = tp;
+        i = m;
+    }
+}
+
+static void heap_offer(KNNHeap *h, size_t pos, kd_coord_t d) {
+    if (h->size < h->cap) {
+        /* Sift up */
+        size_t i = h->size++;
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (h->dist_sq[parent] >= d) break;
+            h->dist_sq[i] = h->dist_sq[parent];
+            h->pos[i] = h->pos[parent];
+            i = parent;
+        }
+        h->dist_sq[i] = d;
+        h->pos[i] = pos;
+    } else if (d < h->dist_sq[0]) {
+        h->dist_sq[0] = d;
+        h->pos[0] = pos;
+        heap_sift_down(h, 0);
+    }
 }
 
-/* Free tree recursively */
-static void free_node(KDNode *node) {
-    if (!node) return;
-    free_node(node->left);
-    free_node(node->right);
-    free(node);
+/* Pruning bound: worst kept distance once the heap is full */
+static inline kd_coord_t heap_bound(const KNNHeap *h) {
+    return (h->size < h->cap) ? (kd_coord_t)INFINITY : h->dist_sq[0];
+}
+
+/* Iterative k-nearest-neighbor search, same traversal as search_nearest */
+__attribute__((optimize("fp-contract=off")))
+static void search_knn(const KDTree *tree, const kd_coord_t *query, KNNHeap *heap) {
+    KDStackEntry stack[KDTREE_MAX_DEPTH];
+    int top = 0;
+    size_t node = 0, begin = 0, end = tree->n_points;
+    int level = 0;
+
+    for (;;) {
+        while (level < tree->levels) {
+            const KDNode *n = &tree->nodes[node];
+            size_t mid = begin + (end - begin) / 2;
+            kd_coord_t diff = query[n->axis] - n->split;
+            kd_coord_t diff_sq = diff * diff;
+            level++;
+            if (diff < 0) {
+                if (diff_sq < heap_bound(heap)) {
+                    KDStackEntry e = {2 * node + 2, mid, end, level, diff_sq};
+                    stack[top++] = e;
+                }
+                node = 2 * node + 1;
+                end = mid;
+            } else {
+                if (diff_sq < heap_bound(heap)) {
+                    KDStackEntry e = {2 * node + 1, begin, mid, level, diff_sq};
+                    stack[top++] = e;
+                }
+                node = 2 * node + 2;
+                begin = mid;
+            }
+        }
+
+        const kd_coord_t *xs = tree->coords;
+        const kd_coord_t *ys = xs + tree->n_points;
+        const kd_coord_t *zs = ys + tree->n_points;
+        for (size_t i = begin; i < end; i++) {
+            kd_coord_t dx = xs[i] - query[0];
+            kd_coord_t dy = ys[i] - query[1];
+            kd_coord_t dz = zs[i] - query[2];
+            kd_coord_t d = dx*dx + dy*dy + dz*dz;
+            if (d < heap_bound(heap)) heap_offer(heap, i, d);
+        }
+
+        const KDStackEntry *e;
+        do {
+            if (top == 0) return;
+            e = &stack[--top];
+        } while (e->plane_dist_sq >= heap_bound(heap));
+        node = e->node;
+        begin = e->begin;
+        end = e->end;
+        level = e->level;
+    }
+}
+
+/* Largest k whose heap lives on the stack; larger k is heap-allocated */
+#define KDTREE_KNN_STACK 32
+
+size_t kdtree_query_knn(const KDTree *tree, const double *query, size_t k,
+                        size_t *nn_idx, double *nn_dist) {
+    if (!tree || !query || !nn_idx || !nn_dist || k == 0) return 0;
+    if (k > tree->n_points) k = tree->n_points;
+
+    /* Small k (every IDW query) keeps the heap on the stack */
+    size_t stack_pos[KDTREE_KNN_STACK];
+    kd_coord_t stack_dist_sq[KDTREE_KNN_STACK];
+    KNNHeap heap;
+    heap.size = 0;
+    heap.cap = k;
+    if (k <= KDTREE_KNN_STACK) {
+        heap.pos = stack_pos;
+        heap.dist_sq = stack_dist_sq;
+    } else {
+        heap.pos = malloc(k * sizeof(size_t));
+        heap.dist_sq = malloc(k * sizeof(kd_coord_t));
+        if (!heap.pos || !heap.dist_sq) {
+            free(heap.pos);
+            free(heap.dist_sq);
+            return 0;
+        }
+    }
+
+    kd_coord_t q[KDTREE_DIM] = {
+        (kd_coord_t)query[0], (kd_coord_t)query[1], (kd_coord_t)query[2]
+    };
+    search_knn(tree, q, &heap);
+
+    /* Pop worst-first into the tail so output is sorted nearest-first */
+    size_t found = heap.size;
+    while (heap.size > 0) {
+        size_t out = heap.size - 1;
+        nn_idx[out] = tree->indices[heap.pos[0]];
+        nn_dist[out] = sqrt((double)heap.dist_sq[0]);
+        heap.size--;
+        heap.dist_sq[0] = heap.dist_sq[heap.size];
+        heap.pos[0] = heap.pos[heap.size];
+        heap_sift_down(&heap, 0);
+    }
+
+    if (heap.pos != stack_pos) {
+        free(heap.pos);
+        free(heap.dist_sq);
+    }
+    return found;
 }
 
 void kdtree_free(KDTree *tree) {
     if (!tree) return;
-    free_node(tree->root);
-    free(tree->points);
+    free(tree->nodes);
+    free(tree->coords);
+    free(tree->indices);
     free(tree);
 }
 
+const size_t *kdtree_point_order(const KDTree *tree) {
+    return tree ? tree->indices : NULL;
+}
+
 size_t kdtree_size(const KDTree *tree) {
     return tree ? tree->n_points : 0;
 }
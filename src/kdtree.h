@@ -2,6 +2,8 @@
  * kdtree.h - Simple KDTree for 3D nearest-neighbor queries
  *
  * Optimized for single nearest-neighbor queries on unit sphere coordinates.
+ * The tree is stored as flat arrays (no per-node allocations) with points
+ * grouped into small contiguous leaf buckets.
  */
 
 #ifndef KDTREE_H
@@ -29,6 +31,68 @@ KDTree *kdtree_create(const double *points, size_t n_points);
 void kdtree_query_nearest(const KDTree *tree, const double *query,
                           size_t *nn_idx, double *nn_dist);
 
+/*
+ * Query nearest neighbor no farther than max_dist.
+ * Subtrees beyond max_dist are never visited, so queries in empty regions
+ * terminate early.
+ * tree: KDTree handle
+ * query: query point [x, y, z]
+ * max_dist: search radius (Euclidean, inclusive)
+ * nn_idx: output nearest neighbor index (untouched if none found)
+ * nn_dist: output distance to nearest neighbor (untouched if none found)
+ * Returns: 1 if a neighbor was found within max_dist, 0 otherwise
+ */
+int kdtree_query_nearest_within(const KDTree *tree, const double *query,
+                                double max_dist, size_t *nn_idx, double *nn_dist);
+
+/* Search hint for a seeded query without a previous answer */
+#define KDTREE_NO_HINT ((size_t)-1)
+
+/*
+ * Query nearest neighbor no farther than max_dist, starting from the answer
+ * to a previous nearby query ("walking" search). Meant for sweeps over
+ * neighbouring targets such as lattice rows: the search starts at the leaf
+ * of the previous answer with its distance as the bound, so most queries
+ * prune almost immediately. Results are identical to
+ * kdtree_query_nearest_within.
+ * hint: in/out search state; set to KDTREE_NO_HINT for a cold start and
+ *       pass it back unchanged for the next query (updated on success)
+ * Other arguments and return value as for kdtree_query_nearest_within.
+ */
+int kdtree_query_nearest_seeded(const KDTree *tree, const double *query,
+                                double max_dist, size_t *hint,
+                                size_t *nn_idx, double *nn_dist);
+
+/*
+ * Query nearest neighbors for many points at once.
+ * Queries are processed in Morton order and leaf buckets are scanned with
+ * SIMD kernels where the CPU supports them; each result is identical to
+ * kdtree_query_nearest_within on the same query.
+ * tree: KDTree handle
+ * queries: query points [n_queries * 3]
+ * n_queries: number of query points
+ * max_dist: search radius (Euclidean, inclusive; INFINITY for unbounded)
+ * nn_idx: output nearest neighbor indices [n_queries] (0 if none found)
+ * nn_dist: output distances [n_queries] (DBL_MAX if none found)
+ * Returns: number of queries with a neighbor within max_dist
+ */
+size_t kdtree_query_nearest_batch(const KDTree *tree, const double *queries,
+                                  size_t n_queries, double max_dist,
+                                  size_t *nn_idx, double *nn_dist);
+
+/*
+ * Query the k nearest neighbors.
+ * tree: KDTree handle
+ * query: query point [x, y, z]
+ * k: number of neighbors requested
+ * nn_idx: output neighbor indices [k], nearest first
+ * nn_dist: output distances [k] (Euclidean, not squared)
+ * Returns: number of neighbors found (min(k, n_points)), 0 on error
+ * Allocation-free for k up to 32.
+ */
+size_t kdtree_query_knn(const KDTree *tree, const double *query, size_t k,
+                        size_t *nn_idx, double *nn_dist);
+
 /*
  * Free KDTree and all associated memory.
  */
@@ -39,4 +103,17 @@ void kdtree_free(KDTree *tree);
  */
 size_t kdtree_size(const KDTree *tree);
 
+/*
+ * Original index of each point in tree order [n_points]. Two trees over
+ * the same points with equal orders have the same layout.
+ */
+const size_t *kdtree_point_order(const KDTree *tree);
+
+/*
+ * Set the number of threads used by subsequent builds. Only trees large
+ * enough to split into parallel subtrees use more than one; the layout
+ * does not depend on the thread count. n_threads <= 0 selects one per CPU.
+ */
+void kdtree_set_num_threads(int n_threads);
+
 #endif /* KDTREE_H */
@@ -0,0 +1,931 @@
+/*
+ * poly_raster.c - Polygon-mode rendering of mesh elements
+ *
+ * The mesh does not change between frames, so which elements show at each
+ * display pixel is worked out once per (mesh, display size) into a
+ * coverage map. A frame is then one colour per slot and a gather over the
+ * pixels.
+ *
+ * Larger elements are scan converted by a tile-binned rasteriser: elements
+ * are binned by the 64x64 screen tiles their bounding box touches, and
+ * tiles are filled in parallel, each walking its elements in mesh order
+ * with incremental integer edge functions. A pixel belongs to exactly one
+ * tile, so the map does not depend on the thread count. With smooth
+ * shading the rasteriser also keeps each pixel's triangle nodes and
+ * barycentric weights, and frames interpolate node values per pixel.
+ *
+ * Elements smaller than a pixel are not scan converted: they are binned
+ * into the pixel holding their centroid and shown aggregated (mean or
+ * largest element), so on fine meshes both the build and the frames scale
+ * with the display rather than the mesh. A per-mesh hierarchy groups the
+ * elements into octaves of size, so whole levels can be binned without
+ * looking at their vertices.
+ *
+ * Each pixel stores a slot; a slot is a list of mesh nodes whose mean is
+ * shown there, so a lone element shows the mean of its own nodes and an
+ * aggregate reads each node in the pixel once. Pixels showing a single
+ * element share that element's slot.
+ */
+
+#include "poly_raster.h"
+#include "colormaps.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* Maximum number of render threads */
+#define POLY_MAX_THREADS 64
+
+/* Work units handed to a thread at a time */
+#define POLY_SLOT_CHUNK 16384
+#define POLY_ROW_BAND   16
+
+/* Screen tile edge in pixels */
+#define POLY_TILE 64
+
+/* Sub-pixel bits of snapped vertex coordinates */
+#define POLY_SUBPIXEL_BITS 8
+#define POLY_SUBPIXEL      (1 << POLY_SUBPIXEL_BITS)
+
+/* Largest display edge the rasteriser takes */
+#define POLY_MAX_DISPLAY   (1 << 20)
+
+/* Coverage map entries: no element, or interpolated from shade[] */
+#define POLY_NO_SLOT (-1)
+#define POLY_SHADED  (-2)
+
+/* Element size octaves in the hierarchy; the last one takes everything smaller */
+#define POLY_LOD_LEVELS 32
+
+struct USPolyLod {
+    const USMesh *mesh;
+    size_t      n_elements;         /* Mesh element count when built */
+    float      *cx, *cy;            /* Centroid lon/lat per element */
+    float      *dlon, *dlat;        /* Bounding box extent per element (degrees) */
+    int32_t    *order;              /* Drawable elements by level, ascending within a level */
+    size_t      level_start[POLY_LOD_LEVELS + 1];
+};
+
+/* Triangle under a smooth-shaded pixel and the weights of its nodes */
+typedef struct {
+    int32_t     node[3];
+    float       w1, w2;             /* Weights of node[1], node[2]; node[0] takes the rest */
+} PolyShade;
+
+struct USPolyCoverage {
+    const USMesh *mesh;
+    const USPolyLod *lod;           /* Hierarchy used, NULL if every element was drawn */
+    PolyLodMode mode;
+    PolyShading shading;
+    size_t      width, height;
+    size_t      n_elements;         /* Mesh element count when built */
+    int32_t    *pixel_slot;         /* Slot per pixel [height * width], or POLY_NO_SLOT/POLY_SHADED */
+    PolyShade  *shade;              /* Per pixel [height * width] when smooth shaded, else NULL */
+    size_t     *slot_start;         /* Slot s lists slot_nodes[slot_start[s] .. slot_start[s+1]) */
+    int32_t    *slot_nodes;
+    size_t      n_slots;
+    size_t      n_aggregated;       /* Elements binned rather than scan converted */
+    uint32_t   *slot_color;         /* Per-frame colour of each slot, 0x00RRGGBB */
+};
+
+/* Render thread count (0 = one per CPU) */
+static int raster_threads = 0;
+
+void poly_raster_set_num_threads(int n_threads) {
+    raster_threads = (n_threads > 0) ? n_threads : 0;
+}
+
+/* ========== Screen coordinates ========== */
+
+/* Convert lon/lat to pixel coordinates */
+static void lonlat_to_pixel(double lon, double lat, size_t width, size_t height,
+                            int *px, int *py) {
+    /* Simple equirectangular projection: lon [-180,180] -> [0,width], lat [-90,90] -> [height,0] */
+    *px = (int)((lon + 180.0) / 360.0 * (double)width);
+    *py = (int)((90.0 - lat) / 180.0 * (double)height);
+}
+
+/* Clamp value to range */
+static inline int clamp_int(int v, int lo, int hi) {
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+
+/* Whether an element can be drawn: nodes in range and not spanning the dateline */
+static int element_drawable(const USMesh *mesh, const int *nodes) {
+    double min_lon = 0.0, max_lon = 0.0;
+    for (int v = 0; v < mesh->n_vertices; v++) {
+        int node_idx = nodes[v];
+        if (node_idx < 0 || (size_t)node_idx >= mesh->n_points) return 0;
+        double lon = mesh->lon[node_idx];
+        if (v == 0 || lon < min_lon) min_lon = lon;
+        if (v == 0 || lon > max_lon) max_lon = lon;
+    }
+    return (max_lon - min_lon) <= 180.0;
+}
+
+/* ========== Element size hierarchy ========== */
+
+/* Octave of an element's size as a fraction of the globe */
+static int lod_level(float dlon, float dlat) {
+    float key = fmaxf(dlon / 360.0f, dlat / 180.0f);
+    if (!(key > 0.0f)) return POLY_LOD_LEVELS - 1;
+    /* key = f * 2^exp with f in [0.5, 1), so key lies in octave -exp */
+    int exp;
+    frexpf(key, &exp);
+    int level = -exp;
+    if (level < 0) level = 0;
+    if (level >= POLY_LOD_LEVELS) level = POLY_LOD_LEVELS - 1;
+    return level;
+}
+
+USPolyLod *poly_lod_build(const USMesh *mesh) {
+    if (!mesh || !mesh->elem_nodes || mesh->n_elements == 0) return NULL;
+    if (mesh->n_elements > INT32_MAX) {
+        fprintf(stderr, "Mesh too large for polygon hierarchy\n");
+        return NULL;
+    }
+
+    size_t n = mesh->n_elements;
+    USPolyLod *lod = calloc(1, sizeof(USPolyLod));
+    if (!lod) return NULL;
+    lod->mesh = mesh;
+    lod->n_elements = n;
+    lod->cx = malloc(n * sizeof(float));
+    lod->cy = malloc(n * sizeof(float));
+    lod->dlon = malloc(n * sizeof(float));
+    lod->dlat = malloc(n * sizeof(float));
+    lod->order = malloc(n * sizeof(int32_t));
+    uint8_t *level = malloc(n);
+    if (!lod->cx || !lod->cy || !lod->dlon || !lod->dlat || !lod->order || !level) {
+        fprintf(stderr, "Failed to allocate polygon hierarchy\n");
+        free(level);
+        poly_lod_free(lod);
+        return NULL;
+    }
+
+    size_t count[POLY_LOD_LEVELS] = {0};
+    for (size_t e = 0; e < n; e++) {
+        const int *nodes = &mesh->elem_nodes[e * mesh->n_vertices];
+        if (!element_drawable(mesh, nodes)) {
+            level[e] = UINT8_MAX;
+            continue;
+        }
+        double lon_min = 0.0, lon_max = 0.0, lat_min = 0.0, lat_max = 0.0;
+        double lon_sum = 0.0, lat_sum = 0.0;
+        for (int v = 0; v < mesh->n_vertices; v++) {
+            double lon = mesh->lon[nodes[v]], lat = mesh->lat[nodes[v]];
+            if (v == 0 || lon < lon_min) lon_min = lon;
+            if (v == 0 || lon > lon_max) lon_max = lon;
+            if (v == 0 || lat < lat_min) lat_min = lat;
+            if (v == 0 || lat > lat_max) lat_max = lat;
+            lon_sum += lon;
+            lat_sum += lat;
+        }
+        lod->cx[e] = (float)(lon_sum / mesh->n_vertices);
+        lod->cy[e] = (float)(lat_sum / mesh->n_vertices);
+        lod->dlon[e] = (float)(lon_max - lon_min);
+        lod->dlat[e] = (float)(lat_max - lat_min);
+        level[e] = (uint8_t)lod_level(lod->dlon[e], lod->dlat[e]);
+        count[level[e]]++;
+    }
+
+    /* Counting sort keeps element order within each level */
+    lod->level_start[0] = 0;
+    for (int k = 0; k < POLY_LOD_LEVELS; k++) {
+        lod->level_start[k + 1] = lod->level_start[k] + count[k];
+    }
+    size_t fill[POLY_LOD_LEVELS];
+    memcpy(fill, lod->level_start, sizeof(fill));
+    for (size_t e = 0; e < n; e++) {
+        if (level[e] != UINT8_MAX) lod->order[fill[level[e]]++] = (int32_t)e;
+    }
+    free(level);
+    return lod;
+}
+
+int poly_lod_matches(const USPolyLod *lod, const USMesh *mesh) {
+    return lod && lod->mesh == mesh && lod->n_elements == mesh->n_elements;
+}
+
+void poly_lod_free(USPolyLod *lod) {
+    if (!lod) return;
+    free(lod->cx);
+    free(lod->cy);
+    free(lod->dlon);
+    free(lod->dlat);
+    free(lod->order);
+    free(lod);
+}
+
+/* ========== Threading ========== */
+
+/* Shared state of one parallel loop over [0, n_items) in chunks */
+typedef struct {
+    void      (*fn)(void *ctx, size_t begin, size_t end);
+    void       *ctx;
+    size_t      n_items;
+    size_t      chunk;
+    atomic_size_t next;
+} PolyLoop;
+
+static void *loop_worker(void *arg) {
+    PolyLoop *loop = arg;
+    size_t begin;
+    while ((begin = atomic_fetch_add(&loop->next, loop->chunk)) < loop->n_items) {
+        size_t end = begin + loop->chunk;
+        if (end > loop->n_items) end = loop->n_items;
+        loop->fn(loop->ctx, begin, end);
+    }
+    return NULL;
+}
+
+/*
+ * Run fn over [0, n_items) in chunks handed out dynamically to a pool of
+ * threads. The calling thread takes part. Each item is processed exactly
+ * once, so results do not depend on the thread count.
+ */
+static void parallel_for(size_t n_items, size_t chunk,
+                         void (*fn)(void *ctx, size_t begin, size_t end), void *ctx) {
+    PolyLoop loop;
+    loop.fn = fn;
+    loop.ctx = ctx;
+    loop.n_items = n_items;
+    loop.chunk = chunk;
+    atomic_init(&loop.next, 0);
+
+    long n_threads = raster_threads;
+    if (n_threads <= 0) n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > POLY_MAX_THREADS) n_threads = POLY_MAX_THREADS;
+    size_t n_chunks = (n_items + chunk - 1) / chunk;
+    if ((size_t)n_threads > n_chunks) n_threads = (long)n_chunks;
+
+    pthread_t threads[POLY_MAX_THREADS];
+    int started[POLY_MAX_THREADS] = {0};
+    /* Threads that fail to start are simply absent; the rest do their share */
+    for (long t = 1; t < n_threads; t++) {
+        started[t] = (pthread_create(&threads[t], NULL, loop_worker, &loop) == 0);
+    }
+    loop_worker(&loop);
+    for (long t = 1; t < n_threads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+}
+
+/* ========== Tile rasteriser ========== */
+
+/* Vertex snapped to 1/POLY_SUBPIXEL of a pixel */
+typedef struct {
+    int64_t     x, y;
+} FixPoint;
+
+/* Round to the nearest integer, halves away from zero */
+static inline int32_t round_to_int(double v) {
+    return (int32_t)(v >= 0.0 ? v + 0.5 : v - 0.5);
+}
+
+/* Sub-pixel screen coordinates of every mesh node */
+typedef struct {
+    const USMesh *mesh;
+    size_t      width, height;
+    int32_t    *x, *y;
+} NodeSnap;
+
+static void snap_nodes(void *ctx, size_t begin, size_t end) {
+    NodeSnap *ns = ctx;
+    double sx = (double)ns->width / 360.0 * POLY_SUBPIXEL;
+    double sy = (double)ns->height / 180.0 * POLY_SUBPIXEL;
+    for (size_t k = begin; k < end; k++) {
+        ns->x[k] = round_to_int((ns->mesh->lon[k] + 180.0) * sx);
+        ns->y[k] = round_to_int((90.0 - ns->mesh->lat[k]) * sy);
+    }
+}
+
+/* An element's snapped vertices */
+static inline void element_vertices(const NodeSnap *ns, size_t e, FixPoint *pts) {
+    const int *nodes = &ns->mesh->elem_nodes[e * ns->mesh->n_vertices];
+    for (int v = 0; v < ns->mesh->n_vertices; v++) {
+        pts[v].x = ns->x[nodes[v]];
+        pts[v].y = ns->y[nodes[v]];
+    }
+}
+
+/* Floor of v / POLY_SUBPIXEL */
+static inline int64_t fix_floor(int64_t v) {
+    return (v >= 0) ? v / POLY_SUBPIXEL : -((-v + POLY_SUBPIXEL - 1) / POLY_SUBPIXEL);
+}
+
+/*
+ * Pixels whose centres lie within [lo, hi] along one axis, clipped to
+ * [0, limit). Returns 0 if there are none.
+ */
+static int centre_span(int64_t lo, int64_t hi, size_t limit, int *first, int *last) {
+    /* Pixel p has its centre at p * POLY_SUBPIXEL + POLY_SUBPIXEL / 2 */
+    int64_t a = -fix_floor(POLY_SUBPIXEL / 2 - lo);
+    int64_t b = fix_floor(hi - POLY_SUBPIXEL / 2);
+    if (a < 0) a = 0;
+    if (b > (int64_t)limit - 1) b = (int64_t)limit - 1;
+    if (a > b) return 0;
+    *first = (int)a;
+    *last = (int)b;
+    return 1;
+}
+
+/* Pixel box of the centres inside a polygon's bounds; returns 0 if empty */
+static int pixel_box(const FixPoint *pts, int n, size_t width, size_t height,
+                     int *x0, int *x1, int *y0, int *y1) {
+    int64_t min_x = pts[0].x, max_x = pts[0].x, min_y = pts[0].y, max_y = pts[0].y;
+    for (int v = 1; v < n; v++) {
+        if (pts[v].x < min_x) min_x = pts[v].x;
+        if (pts[v].x > max_x) max_x = pts[v].x;
+        if (pts[v].y < min_y) min_y = pts[v].y;
+        if (pts[v].y > max_y) max_y = pts[v].y;
+    }
+    return centre_span(min_x, max_x, width, x0, x1) &&
+           centre_span(min_y, max_y, height, y0, y1);
+}
+
+/* Edge function of the directed edge a -> b at (px, py), exact in 64 bits */
+static inline int64_t edge_eval(FixPoint a, FixPoint b, int64_t px, int64_t py) {
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+/*
+ * Tie-break for pixel centres exactly on an edge. An edge shared by two
+ * triangles is walked in opposite directions, and exactly one of those
+ * owns it, so shared edges are drawn once with no gaps.
+ */
+static inline int edge_owns(FixPoint a, FixPoint b) {
+    return (b.y < a.y) || (b.y == a.y && b.x > a.x);
+}
+
+typedef struct {
+    const NodeSnap *snap;
+    size_t      width, height;
+    size_t      tiles_x;
+    const size_t *tile_start;       /* Tile t lists tile_elems[tile_start[t] .. tile_start[t+1]) */
+    const int32_t *tile_elems;
+    int32_t    *ids;                /* Winning element per pixel */
+    PolyShade  *shade;              /* Winning triangle weights per pixel, or NULL */
+} PolyTiles;
+
+/* Fill one triangle of element e, clipped to a tile's pixel window */
+static void raster_triangle(const PolyTiles *pt, FixPoint a, FixPoint b, FixPoint c,
+                            int32_t na, int32_t nb, int32_t nc, int32_t e,
+                            int wx0, int wx1, int wy0, int wy1) {
+    int64_t area = edge_eval(a, b, c.x, c.y);
+    if (area == 0) return;
+    if (area < 0) {
+        /* Make the winding consistent so inside is where all edges are >= 0 */
+        FixPoint t = b; b = c; c = t;
+        int32_t tn = nb; nb = nc; nc = tn;
+        area = -area;
+    }
+
+    FixPoint tri[3] = {a, b, c};
+    int x0, x1, y0, y1;
+    if (!pixel_box(tri, 3, pt->width, pt->height, &x0, &x1, &y0, &y1)) return;
+    if (x0 < wx0) x0 = wx0;
+    if (x1 > wx1) x1 = wx1;
+    if (y0 < wy0) y0 = wy0;
+    if (y1 > wy1) y1 = wy1;
+    if (x0 > x1 || y0 > y1) return;
+
+    /* Edge i is opposite vertex i and steps by a constant per pixel */
+    int own0 = edge_owns(b, c), own1 = edge_owns(c, a), own2 = edge_owns(a, b);
+    int64_t dx0 = (b.y - c.y) * POLY_SUBPIXEL;
+    int64_t dx1 = (c.y - a.y) * POLY_SUBPIXEL;
+    int64_t dx2 = (a.y - b.y) * POLY_SUBPIXEL;
+    int64_t sx = (int64_t)x0 * POLY_SUBPIXEL + POLY_SUBPIXEL / 2;
+    double inv_area = 1.0 / (double)area;
+
+    for (int y = y0; y <= y1; y++) {
+        int64_t sy = (int64_t)y * POLY_SUBPIXEL + POLY_SUBPIXEL / 2;
+        int64_t e0 = edge_eval(b, c, sx, sy);
+        int64_t e1 = edge_eval(c, a, sx, sy);
+        int64_t e2 = edge_eval(a, b, sx, sy);
+        int32_t *row = pt->ids + (size_t)y * pt->width;
+        PolyShade *shade_row = pt->shade ? pt->shade + (size_t)y * pt->width : NULL;
+
+        for (int x = x0; x <= x1; x++, e0 += dx0, e1 += dx1, e2 += dx2) {
+            if ((e0 < 0 || (e0 == 0 && !own0)) ||
+                (e1 < 0 || (e1 == 0 && !own1)) ||
+                (e2 < 0 || (e2 == 0 && !own2))) continue;
+            row[x] = e;
+            if (shade_row) {
+                shade_row[x].node[0] = na;
+                shade_row[x].node[1] = nb;
+                shade_row[x].node[2] = nc;
+                shade_row[x].w1 = (float)((double)e1 * inv_area);
+                shade_row[x].w2 = (float)((double)e2 * inv_area);
+            }
+        }
+    }
+}
+
+/* Rasterise a range of tiles, each drawing its elements in mesh order */
+static void raster_tiles(void *ctx, size_t begin, size_t end) {
+    const PolyTiles *pt = ctx;
+    const USMesh *mesh = pt->snap->mesh;
+
+    for (size_t t = begin; t < end; t++) {
+        int wx0 = (int)((t % pt->tiles_x) * POLY_TILE);
+        int wy0 = (int)((t / pt->tiles_x) * POLY_TILE);
+        int wx1 = wx0 + POLY_TILE - 1;
+        int wy1 = wy0 + POLY_TILE - 1;
+
+        for (size_t j = pt->tile_start[t]; j < pt->tile_start[t + 1]; j++) {
+            int32_t e = pt->tile_elems[j];
+            const int *nodes = &mesh->elem_nodes[(size_t)e * mesh->n_vertices];
+            FixPoint pts[4];
+            element_vertices(pt->snap, (size_t)e, pts);
+            raster_triangle(pt, pts[0], pts[1], pts[2], nodes[0], nodes[1], nodes[2], e,
+                            wx0, wx1, wy0, wy1);
+            /* If quad (4 vertices), render second triangle */
+            if (mesh->n_vertices == 4) {
+                raster_triangle(pt, pts[0], pts[2], pts[3], nodes[0], nodes[2], nodes[3], e,
+                                wx0, wx1, wy0, wy1);
+            }
+        }
+    }
+}
+
+/*
+ * Rasterise the listed elements (in mesh order) into ids, and into shade
+ * if not NULL: snap the nodes to the sub-pixel grid, bin the elements by
+ * the tiles their pixel box touches, then fill the tiles in parallel.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int raster_elements(const USMesh *mesh, const int32_t *elems, size_t n_elems,
+                           size_t width, size_t height, int32_t *ids, PolyShade *shade) {
+    NodeSnap ns;
+    ns.mesh = mesh;
+    ns.width = width;
+    ns.height = height;
+    ns.x = malloc(mesh->n_points * sizeof(int32_t));
+    ns.y = malloc(mesh->n_points * sizeof(int32_t));
+    if (!ns.x || !ns.y) {
+        free(ns.x);
+        free(ns.y);
+        return -1;
+    }
+    parallel_for(mesh->n_points, POLY_SLOT_CHUNK, snap_nodes, &ns);
+
+    PolyTiles pt;
+    pt.snap = &ns;
+    pt.width = width;
+    pt.height = height;
+    pt.tiles_x = (width + POLY_TILE - 1) / POLY_TILE;
+    pt.ids = ids;
+    pt.shade = shade;
+    size_t n_tiles = pt.tiles_x * ((height + POLY_TILE - 1) / POLY_TILE);
+
+    /* Count per tile, prefix sum, then fill; lists stay in mesh order */
+    size_t *tile_start = calloc(n_tiles + 1, sizeof(size_t));
+    int32_t *tile_elems = NULL;
+    if (!tile_start) goto fail;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t j = 0; j < n_elems; j++) {
+            FixPoint pts[4];
+            int x0, x1, y0, y1;
+            element_vertices(&ns, (size_t)elems[j], pts);
+            if (!pixel_box(pts, mesh->n_vertices, width, height, &x0, &x1, &y0, &y1)) continue;
+            for (int ty = y0 / POLY_TILE; ty <= y1 / POLY_TILE; ty++) {
+                for (int tx = x0 / POLY_TILE; tx <= x1 / POLY_TILE; tx++) {
+                    size_t t = (size_t)ty * pt.tiles_x + (size_t)tx;
+                    if (pass == 0) {
+                        tile_start[t + 1]++;
+                    } else {
+                        /* tile_start[t] runs ahead while filling, ending at the next tile's start */
+                        tile_elems[tile_start[t]++] = elems[j];
+                    }
+                }
+            }
+        }
+        if (pass == 0) {
+            for (size_t t = 0; t < n_tiles; t++) tile_start[t + 1] += tile_start[t];
+            tile_elems = malloc((tile_start[n_tiles] ? tile_start[n_tiles] : 1) * sizeof(int32_t));
+            if (!tile_elems) goto fail;
+        }
+    }
+    for (size_t t = n_tiles; t > 0; t--) tile_start[t] = tile_start[t - 1];
+    tile_start[0] = 0;
+
+    pt.tile_start = tile_start;
+    pt.tile_elems = tile_elems;
+    parallel_for(n_tiles, 1, raster_tiles, &pt);
+
+    free(tile_start);
+    free(tile_elems);
+    free(ns.x);
+    free(ns.y);
+    return 0;
+
+fail:
+    free(tile_start);
+    free(tile_elems);
+    free(ns.x);
+    free(ns.y);
+    return -1;
+}
+
+/* ========== Coverage map ========== */
+
+/* Whether an element is at least a pixel across, so worth scan converting */
+static int element_needs_raster(const USPolyLod *lod, size_t e, size_t width, size_t height) {
+    return lod->dlon[e] * (double)width / 360.0 >= 1.0 ||
+           lod->dlat[e] * (double)height / 180.0 >= 1.0;
+}
+
+/* Growable slot node lists */
+typedef struct {
+    size_t     *start;
+    int32_t    *nodes;
+    size_t      n_slots, cap_slots;
+    size_t      n_nodes, cap_nodes;
+} SlotLists;
+
+static int slots_open(SlotLists *sl) {
+    if (sl->n_slots + 2 > sl->cap_slots) {
+        size_t cap = sl->cap_slots ? sl->cap_slots * 2 : 1024;
+        size_t *grown = realloc(sl->start, cap * sizeof(size_t));
+        if (!grown) return -1;
+        sl->start = grown;
+        sl->cap_slots = cap;
+    }
+    sl->start[sl->n_slots] = sl->n_nodes;
+    sl->n_slots++;
+    sl->start[sl->n_slots] = sl->n_nodes;
+    return (int)(sl->n_slots - 1);
+}
+
+/* Add an element's nodes to the open slot, skipping nodes already marked for it */
+static int slots_add(SlotLists *sl, const USMesh *mesh, int32_t e,
+                     int32_t *node_mark, int32_t mark) {
+    if (sl->n_nodes + (size_t)mesh->n_vertices > sl->cap_nodes) {
+        size_t cap = sl->cap_nodes ? sl->cap_nodes * 2 : 4096;
+        int32_t *grown = realloc(sl->nodes, cap * sizeof(int32_t));
+        if (!grown) return -1;
+        sl->nodes = grown;
+        sl->cap_nodes = cap;
+    }
+    const int *nodes = &mesh->elem_nodes[(size_t)e * mesh->n_vertices];
+    for (int v = 0; v < mesh->n_vertices; v++) {
+        if (node_mark) {
+            if (node_mark[nodes[v]] == mark) continue;
+            node_mark[nodes[v]] = mark;
+        }
+        sl->nodes[sl->n_nodes++] = nodes[v];
+    }
+    sl->start[sl->n_slots] = sl->n_nodes;
+    return 0;
+}
+
+/* Pixel holding a point, clamped to the image */
+static size_t point_pixel(double lon, double lat, size_t width, size_t height) {
+    int px, py;
+    lonlat_to_pixel(lon, lat, width, height, &px, &py);
+    px = clamp_int(px, 0, (int)width - 1);
+    py = clamp_int(py, 0, (int)height - 1);
+    return (size_t)py * width + (size_t)px;
+}
+
+USPolyCoverage *poly_coverage_build(const USMesh *mesh, const USPolyLod *lod,
+                                    size_t width, size_t height, PolyLodMode mode,
+                                    PolyShading shading) {
+    if (!mesh || !mesh->elem_nodes || mesh->n_elements == 0 ||
+        width == 0 || height == 0) return NULL;
+    /* Snapped coordinates of nodes up to a globe off screen must fit in 32 bits */
+    if (mesh->n_elements > INT32_MAX || width > POLY_MAX_DISPLAY || height > POLY_MAX_DISPLAY ||
+        width * height > INT32_MAX) {
+        fprintf(stderr, "Mesh or display too large for polygon coverage\n");
+        return NULL;
+    }
+    if (lod && !poly_lod_matches(lod, mesh)) lod = NULL;
+
+    USPolyCoverage *cov = calloc(1, sizeof(USPolyCoverage));
+    if (!cov) return NULL;
+    cov->mesh = mesh;
+    cov->lod = lod;
+    cov->mode = mode;
+    cov->shading = shading;
+    cov->width = width;
+    cov->height = height;
+    cov->n_elements = mesh->n_elements;
+
+    size_t n_pixels = width * height;
+    int32_t *raster = malloc(n_pixels * sizeof(int32_t));
+    PolyShade *shade = (shading == POLY_SHADE_SMOOTH) ?
+                       malloc(n_pixels * sizeof(PolyShade)) : NULL;
+    int32_t *elem_slot = malloc(mesh->n_elements * sizeof(int32_t));
+    int32_t *drawn = malloc(mesh->n_elements * sizeof(int32_t));
+    int32_t *binned = lod ? malloc(mesh->n_elements * sizeof(int32_t)) : NULL;
+    uint32_t *bin_start = lod ? calloc(n_pixels + 1, sizeof(uint32_t)) : NULL;
+    int32_t *node_mark = (lod && mode == POLY_LOD_MEAN) ?
+                         malloc(mesh->n_points * sizeof(int32_t)) : NULL;
+    int32_t *bin_elems = NULL;
+    SlotLists sl = {0};
+    if (!raster || !elem_slot || !drawn || (shading == POLY_SHADE_SMOOTH && !shade) ||
+        (lod && (!binned || !bin_start || (mode == POLY_LOD_MEAN && !node_mark)))) goto fail;
+
+    if (node_mark) {
+        for (size_t k = 0; k < mesh->n_points; k++) node_mark[k] = POLY_NO_SLOT;
+    }
+
+    for (size_t i = 0; i < n_pixels; i++) raster[i] = POLY_NO_SLOT;
+    for (size_t e = 0; e < mesh->n_elements; e++) elem_slot[e] = POLY_NO_SLOT;
+
+    size_t n_drawn = 0, n_binned = 0;
+    if (!lod) {
+        /* No hierarchy: scan-convert everything */
+        for (size_t e = 0; e < mesh->n_elements; e++) {
+            if (element_drawable(mesh, &mesh->elem_nodes[e * mesh->n_vertices])) {
+                drawn[n_drawn++] = (int32_t)e;
+            }
+        }
+    } else {
+        /* Levels from k_sub on are below a pixel in both directions */
+        size_t m = (width > height) ? width : height;
+        int k_sub = 0;
+        while (k_sub < POLY_LOD_LEVELS && ((size_t)1 << k_sub) < m) k_sub++;
+
+        /* Coarser levels, merged back into element order so later elements win overlaps */
+        size_t cursor[POLY_LOD_LEVELS];
+        for (int k = 0; k < k_sub; k++) cursor[k] = lod->level_start[k];
+        for (;;) {
+            int best = -1;
+            for (int k = 0; k < k_sub; k++) {
+                if (cursor[k] < lod->level_start[k + 1] &&
+                    (best < 0 || lod->order[cursor[k]] < lod->order[cursor[best]])) best = k;
+            }
+            if (best < 0) break;
+            int32_t e = lod->order[cursor[best]++];
+            if (element_needs_raster(lod, (size_t)e, width, height)) {
+                drawn[n_drawn++] = e;
+            } else {
+                binned[n_binned++] = e;
+            }
+        }
+        for (size_t i = lod->level_start[k_sub < POLY_LOD_LEVELS ? k_sub : POLY_LOD_LEVELS];
+             i < lod->level_start[POLY_LOD_LEVELS]; i++) {
+            binned[n_binned++] = lod->order[i];
+        }
+
+        /* Bin by centroid pixel: count, prefix sum, fill */
+        for (size_t j = 0; j < n_binned; j++) {
+            int32_t e = binned[j];
+            bin_start[point_pixel(lod->cx[e], lod->cy[e], width, height) + 1]++;
+        }
+        for (size_t i = 0; i < n_pixels; i++) bin_start[i + 1] += bin_start[i];
+        bin_elems = malloc((n_binned ? n_binned : 1) * sizeof(int32_t));
+        if (!bin_elems) goto fail;
+        for (size_t j = 0; j < n_binned; j++) {
+            int32_t e = binned[j];
+            size_t pix = point_pixel(lod->cx[e], lod->cy[e], width, height);
+            /* bin_start[pix] runs ahead while filling and ends at the next pixel's start */
+            bin_elems[bin_start[pix]++] = e;
+        }
+        for (size_t i = n_pixels; i > 0; i--) bin_start[i] = bin_start[i - 1];
+        bin_start[0] = 0;
+    }
+    cov->n_aggregated = n_binned;
+
+    if (raster_elements(mesh, drawn, n_drawn, width, height, raster, shade) != 0) goto fail;
+
+    /* Turn each pixel's contributors into a slot */
+    for (size_t i = 0; i < n_pixels; i++) {
+        int32_t r = raster[i];
+        size_t b0 = bin_start ? bin_start[i] : 0;
+        size_t b1 = bin_start ? bin_start[i + 1] : 0;
+
+        int32_t single = POLY_NO_SLOT;
+        if (b0 == b1) {
+            single = r;
+        } else if (mode == POLY_LOD_DOMINANT || (b1 - b0 == 1 && r == POLY_NO_SLOT)) {
+            /* A scan-converted element is at least a pixel across, so it dominates */
+            single = r;
+            if (single == POLY_NO_SLOT) {
+                float best = -1.0f;
+                for (size_t j = b0; j < b1; j++) {
+                    int32_t e = bin_elems[j];
+                    float size = fmaxf(lod->dlon[e] / 360.0f, lod->dlat[e] / 180.0f);
+                    if (size > best) {
+                        best = size;
+                        single = e;
+                    }
+                }
+            }
+        } else {
+            /* Mean over the distinct nodes of everything in the pixel */
+            int slot = slots_open(&sl);
+            if (slot < 0) goto fail;
+            for (size_t j = b0; j < b1; j++) {
+                if (slots_add(&sl, mesh, bin_elems[j], node_mark, slot) != 0) goto fail;
+            }
+            if (r != POLY_NO_SLOT && slots_add(&sl, mesh, r, node_mark, slot) != 0) goto fail;
+            raster[i] = slot;
+            continue;
+        }
+
+        if (single == POLY_NO_SLOT) {
+            raster[i] = POLY_NO_SLOT;
+            continue;
+        }
+        if (shade && single == r) {
+            /* Interpolated per frame from the weights the rasteriser left */
+            raster[i] = POLY_SHADED;
+            continue;
+        }
+        if (elem_slot[single] == POLY_NO_SLOT) {
+            int slot = slots_open(&sl);
+            if (slot < 0 || slots_add(&sl, mesh, single, NULL, 0) != 0) goto fail;
+            elem_slot[single] = slot;
+        }
+        raster[i] = elem_slot[single];
+    }
+
+    free(elem_slot);
+    free(drawn);
+    free(binned);
+    free(bin_start);
+    free(node_mark);
+    free(bin_elems);
+
+    cov->pixel_slot = raster;
+    cov->shade = shade;
+    cov->n_slots = sl.n_slots;
+    cov->slot_start = sl.start;
+    cov->slot_nodes = sl.nodes;
+    cov->slot_color = malloc((sl.n_slots ? sl.n_slots : 1) * sizeof(uint32_t));
+    if (!cov->slot_color) {
+        fprintf(stderr, "Failed to allocate polygon coverage\n");
+        poly_coverage_free(cov);
+        return NULL;
+    }
+
+    printf("Polygon coverage: %zu slots for %zu elements at %zux%zu (%zu aggregated)\n",
+           cov->n_slots, mesh->n_elements, width, height, cov->n_aggregated);
+    return cov;
+
+fail:
+    fprintf(stderr, "Failed to allocate polygon coverage\n");
+    free(raster);
+    free(shade);
+    free(elem_slot);
+    free(drawn);
+    free(binned);
+    free(bin_start);
+    free(node_mark);
+    free(bin_elems);
+    free(sl.start);
+    free(sl.nodes);
+    free(cov);
+    return NULL;
+}
+
+int poly_coverage_matches(const USPolyCoverage *cov, const USMesh *mesh,
+                          const USPolyLod *lod, size_t width, size_t height,
+                          PolyLodMode mode, PolyShading shading) {
+    if (lod && !poly_lod_matches(lod, mesh)) lod = NULL;
+    return cov && cov->mesh == mesh && cov->n_elements == mesh->n_elements &&
+           cov->lod == lod && cov->mode == mode && cov->shading == shading &&
+           cov->width == width && cov->height == height;
+}
+
+size_t poly_coverage_visible(const USPolyCoverage *cov) {
+    return cov ? cov->n_slots : 0;
+}
+
+size_t poly_coverage_aggregated(const USPolyCoverage *cov) {
+    return cov ? cov->n_aggregated : 0;
+}
+
+void poly_coverage_free(USPolyCoverage *cov) {
+    if (!cov) return;
+    free(cov->pixel_slot);
+    free(cov->shade);
+    free(cov->slot_start);
+    free(cov->slot_nodes);
+    free(cov->slot_color);
+    free(cov);
+}
+
+/* ========== Per-frame rendering ========== */
+
+typedef struct {
+    USPolyCoverage   *cov;
+    const float      *raw_data;
+    float             fill_value;
+    const USColormap *cmap;
+    float             min_val, range;
+    unsigned char    *pixels;
+} PolyFrame;
+
+/* Colour a range of slots by the mean of their valid node values */
+static void color_slots(void *ctx, size_t begin, size_t end) {
+    PolyFrame *frame = ctx;
+    const USPolyCoverage *cov = frame->cov;
+
+    for (size_t s = begin; s < end; s++) {
+        float sum_val = 0.0f;
+        int n_valid_vals = 0;
+        for (size_t j = cov->slot_start[s]; j < cov->slot_start[s + 1]; j++) {
+            float value = frame->raw_data[cov->slot_nodes[j]];
+            /* Check for fill value */
+            if (value != frame->fill_value && fabsf(value) < 1e30f) {
+                sum_val += value;
+                n_valid_vals++;
+            }
+        }
+
+        if (n_valid_vals == 0) {
+            cov->slot_color[s] = 0;  /* Not drawn: background */
+            continue;
+        }
+
+        float t = (sum_val / (float)n_valid_vals - frame->min_val) / frame->range;
+        if (t < 0.0f) t = 0.0f;
+        if (t > 1.0f) t = 1.0f;
+
+        unsigned char r, g, b;
+        colormap_map_value(frame->cmap, t, &r, &g, &b);
+        cov->slot_color[s] = ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+    }
+}
+
+/* Colour of a smooth-shaded pixel, from its triangle's node values */
+static uint32_t shade_pixel(const PolyFrame *frame, const PolyShade *sh) {
+    float value[3];
+    float sum_val = 0.0f;
+    int n_valid_vals = 0;
+    for (int v = 0; v < 3; v++) {
+        value[v] = frame->raw_data[sh->node[v]];
+        if (value[v] != frame->fill_value && fabsf(value[v]) < 1e30f) {
+            sum_val += value[v];
+            n_valid_vals++;
+        }
+    }
+    if (n_valid_vals == 0) return 0;
+
+    /* A triangle with fill-valued nodes falls back to the mean of the rest */
+    float mean = (n_valid_vals == 3) ?
+                 value[0] + sh->w1 * (value[1] - value[0]) + sh->w2 * (value[2] - value[0]) :
+                 sum_val / (float)n_valid_vals;
+    float t = (mean - frame->min_val) / frame->range;
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+
+    unsigned char r, g, b;
+    colormap_map_value(frame->cmap, t, &r, &g, &b);
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+/* Fill a band of image rows from the coverage map */
+static void gather_rows(void *ctx, size_t begin, size_t end) {
+    PolyFrame *frame = ctx;
+    const USPolyCoverage *cov = frame->cov;
+
+    for (size_t i = begin * cov->width; i < end * cov->width; i++) {
+        int32_t s = cov->pixel_slot[i];
+        uint32_t c;
+        if (s >= 0) {
+            c = cov->slot_color[s];
+        } else if (s == POLY_SHADED) {
+            c = shade_pixel(frame, &cov->shade[i]);
+        } else {
+            c = 0;
+        }
+        frame->pixels[i * 3 + 0] = (unsigned char)(c >> 16);
+        frame->pixels[i * 3 + 1] = (unsigned char)(c >> 8);
+        frame->pixels[i * 3 + 2] = (unsigned char)c;
+    }
+}
+
+int poly_coverage_render(USPolyCoverage *cov, const float *raw_data, float fill_value,
+                         const USColormap *cmap, float min_val, float max_val,
+                         unsigned char *pixels) {
+    if (!cov || !raw_data || !cmap || !pixels) return -1;
+
+    PolyFrame frame;
+    frame.cov = cov;
+    frame.raw_data = raw_data;
+    frame.fill_value = fill_value;
+    frame.cmap = cmap;
+    frame.min_val = min_val;
+    frame.range = max_val - min_val;
+    if (frame.range <= 0.0f) frame.range = 1.0f;
+    frame.pixels = pixels;
+
+    if (cov->n_slots > 0) {
+        parallel_for(cov->n_slots, POLY_SLOT_CHUNK, color_slots, &frame);
+    }
+    parallel_for(cov->height, POLY_ROW_BAND, gather_rows, &frame);
+    return 0;
+}
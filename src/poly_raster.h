@@ -0,0 +1,88 @@
+/*
+ * poly_raster.h - Polygon-mode rendering of mesh elements
+ */
+
+#ifndef POLY_RASTER_H
+#define POLY_RASTER_H
+
+#include "ushow.defines.h"
+
+/*
+ * Precompute the per-mesh element hierarchy: centroid and extent of each
+ * drawable element, grouped into octaves of size. Returns NULL if the
+ * mesh has no elements or on allocation failure.
+ */
+USPolyLod *poly_lod_build(const USMesh *mesh);
+
+/*
+ * Whether lod was built for this mesh.
+ */
+int poly_lod_matches(const USPolyLod *lod, const USMesh *mesh);
+
+/*
+ * Free an element hierarchy.
+ */
+void poly_lod_free(USPolyLod *lod);
+
+/*
+ * Work out which elements show at each display pixel, for an
+ * equirectangular image of the given size. Elements at least a pixel
+ * across are scan converted, in parallel over screen tiles, covering the
+ * pixels whose centres they contain; where they overlap the last one
+ * wins, and the map does not depend on the thread count. With
+ * POLY_SHADE_SMOOTH each such pixel also keeps the weights to interpolate
+ * its triangle's node values. With a hierarchy, smaller elements are binned into the pixel
+ * holding their centroid instead and shown as the mean of everything in
+ * that pixel (POLY_LOD_MEAN) or as its largest element (POLY_LOD_DOMINANT).
+ * Without one (lod NULL) every element is scan converted. Elements with
+ * out-of-range nodes or spanning the dateline are left out. Returns NULL
+ * if the mesh has no elements or on allocation failure.
+ */
+USPolyCoverage *poly_coverage_build(const USMesh *mesh, const USPolyLod *lod,
+                                    size_t width, size_t height, PolyLodMode mode,
+                                    PolyShading shading);
+
+/*
+ * Whether cov was built for this mesh, hierarchy, display size, mode and
+ * shading.
+ */
+int poly_coverage_matches(const USPolyCoverage *cov, const USMesh *mesh,
+                          const USPolyLod *lod, size_t width, size_t height,
+                          PolyLodMode mode, PolyShading shading);
+
+/*
+ * Colour each element by the mean of its valid node values, each pixel by
+ * the mean over its elements, and fill the RGB image [height * width * 3]
+ * from the coverage map. Smooth-shaded pixels interpolate their triangle's
+ * node values instead, falling back to the mean of the valid ones when a
+ * node holds the fill value. Pixels with no element, or whose elements
+ * have no valid node this frame, are black. Work is split across threads by element and by row band.
+ * Returns 0 on success, -1 on error.
+ */
+int poly_coverage_render(USPolyCoverage *cov, const float *raw_data, float fill_value,
+                         const USColormap *cmap, float min_val, float max_val,
+                         unsigned char *pixels);
+
+/*
+ * Number of flat-coloured slots (single elements or pixel aggregates) in
+ * the coverage map; smooth-shaded pixels are not counted.
+ */
+size_t poly_coverage_visible(const USPolyCoverage *cov);
+
+/*
+ * Number of elements binned by centroid rather than scan converted.
+ */
+size_t poly_coverage_aggregated(const USPolyCoverage *cov);
+
+/*
+ * Free a coverage map.
+ */
+void poly_coverage_free(USPolyCoverage *cov);
+
+/*
+ * Set the number of threads used for rendering (0 = one per CPU, the
+ * default). The image does not depend on the thread count.
+ */
+void poly_raster_set_num_threads(int n_threads);
+
+#endif /* POLY_RASTER_H */
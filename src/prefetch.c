@@ -0,0 +1,289 @@
+/*
+ * prefetch.c - Background read-ahead of data slices into the slice cache
+ *
+ * A single worker thread reads the slices the view is expected to ask for
+ * next, so that animation and dimension stepping find them in the slice
+ * cache instead of waiting on file I/O. Virtual time indices are used for
+ * file sets, so read-ahead continues across file boundaries.
+ *
+ * When there is nothing to read ahead, the worker feeds an attached range
+ * scan one slice at a time, checking for new read-ahead requests between
+ * slices so the scan never delays stepping by more than one read.
+ *
+ * The file readers are not thread-safe. The worker holds io_lock for the
+ * duration of each slice read, and any other thread touching the files
+ * takes it through prefetch_pause().
+ */
+
+#include "prefetch.h"
+#include "slice_cache.h"
+#include "range_scan.h"
+#include "view.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/* What the view looked like when the prediction was made */
+typedef struct {
+    USVar      *var;
+    USFileSet  *fileset;
+    size_t      n_points;
+    size_t      time_index, depth_index;
+    size_t      n_times, n_depths;
+    int         time_step, depth_step;
+} PrefetchRequest;
+
+struct USPrefetcher {
+    USSliceCache   *cache;
+    int             n_ahead;
+    pthread_t       thread;
+
+    pthread_mutex_t lock;           /* Guards the fields below */
+    pthread_cond_t  wake;
+    PrefetchRequest request;
+    unsigned long   generation;     /* Bumped whenever queued work goes stale */
+    int             pending;
+    int             stop;
+    size_t          n_read;
+    USRangeScan    *scan;           /* Range scan to run when idle, or NULL */
+    int             io_waiters;     /* Threads blocked in prefetch_pause() */
+
+    pthread_mutex_t io_lock;        /* Held while reading from the data files */
+};
+
+/* Slice k steps ahead of the request; returns 0 when there is none */
+static int predict_slice(const PrefetchRequest *req, int k, size_t *t, size_t *d) {
+    if (req->time_step != 0 && req->n_times > 1) {
+        long long n = (long long)req->n_times;
+        long long tt = ((long long)req->time_index + (long long)k * req->time_step) % n;
+        if (tt < 0) tt += n;
+        if ((size_t)tt == req->time_index) return 0;  /* Wrapped back to the start */
+        *t = (size_t)tt;
+        *d = req->depth_index;
+        return 1;
+    }
+    if (req->depth_step != 0) {
+        long long dd = (long long)req->depth_index + (long long)k * req->depth_step;
+        if (dd < 0 || dd >= (long long)req->n_depths) return 0;
+        *t = req->time_index;
+        *d = (size_t)dd;
+        return 1;
+    }
+    return 0;
+}
+
+static int still_current(USPrefetcher *pf, unsigned long generation) {
+    pthread_mutex_lock(&pf->lock);
+    int current = (pf->generation == generation && !pf->stop);
+    pthread_mutex_unlock(&pf->lock);
+    return current;
+}
+
+/* Read the predicted slices of one request that are not cached yet */
+static void prefetch_request(USPrefetcher *pf, const PrefetchRequest *req,
+                             unsigned long generation, float **buf, size_t *buf_n) {
+    if (!req->var || req->n_points == 0) return;
+
+    if (*buf_n < req->n_points) {
+        float *grown = realloc(*buf, req->n_points * sizeof(float));
+        if (!grown) return;
+        *buf = grown;
+        *buf_n = req->n_points;
+    }
+
+    /* Leave at least half the cache for slices already visited */
+    USSliceCacheStats st;
+    slice_cache_get_stats(pf->cache, &st);
+    size_t slice_bytes = req->n_points * sizeof(float);
+    size_t n_ahead = st.budget_bytes / 2 / slice_bytes;
+    if (n_ahead > (size_t)pf->n_ahead) n_ahead = (size_t)pf->n_ahead;
+
+    for (size_t k = 1; k <= n_ahead; k++) {
+        size_t t, d;
+        if (!predict_slice(req, (int)k, &t, &d)) break;
+
+        USSliceKey key = slice_key_make(req->var, req->fileset, t, d);
+        if (slice_cache_peek(pf->cache, &key, NULL, req->n_points)) continue;
+
+        pthread_mutex_lock(&pf->io_lock);
+        if (!still_current(pf, generation)) {
+            pthread_mutex_unlock(&pf->io_lock);
+            break;
+        }
+        int rc = view_read_var_slice(req->var, req->fileset, t, d, *buf);
+        if (rc == 0) {
+            /* Store before releasing the files so a waiting reader finds it */
+            slice_cache_put(pf->cache, &key, *buf, req->n_points);
+        }
+        pthread_mutex_unlock(&pf->io_lock);
+        if (rc != 0) break;
+
+        pthread_mutex_lock(&pf->lock);
+        pf->n_read++;
+        pthread_mutex_unlock(&pf->lock);
+    }
+}
+
+/* Read and accumulate the next slice of a range scan */
+static void scan_step(USPrefetcher *pf, USRangeScan *scan, float **buf, size_t *buf_n) {
+    size_t n_points = range_scan_n_points(scan);
+    if (*buf_n < n_points) {
+        float *grown = realloc(*buf, n_points * sizeof(float));
+        if (!grown) {
+            range_scan_abort(scan);
+            return;
+        }
+        *buf = grown;
+        *buf_n = n_points;
+    }
+
+    pthread_mutex_lock(&pf->io_lock);
+    /* Detached while we waited for the files: the scan may be gone */
+    pthread_mutex_lock(&pf->lock);
+    int attached = (pf->scan == scan);
+    pthread_mutex_unlock(&pf->lock);
+
+    size_t t, d;
+    if (attached && range_scan_next(scan, &t, &d)) {
+        if (view_read_var_slice(range_scan_var(scan), range_scan_fileset(scan), t, d, *buf) == 0) {
+            range_scan_add(scan, t, d, *buf);
+        } else {
+            range_scan_abort(scan);
+        }
+    }
+    pthread_mutex_unlock(&pf->io_lock);
+}
+
+static void *prefetch_worker(void *arg) {
+    USPrefetcher *pf = (USPrefetcher *)arg;
+    float *buf = NULL;
+    size_t buf_n = 0;
+
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->stop) {
+        if (!pf->pending) {
+            /* Let paused threads have the files before the next slice */
+            USRangeScan *scan = pf->scan;
+            if (scan && pf->io_waiters == 0 && !range_scan_done(scan)) {
+                pthread_mutex_unlock(&pf->lock);
+                scan_step(pf, scan, &buf, &buf_n);
+                pthread_mutex_lock(&pf->lock);
+                continue;
+            }
+            pthread_cond_wait(&pf->wake, &pf->lock);
+            continue;
+        }
+        PrefetchRequest req = pf->request;
+        unsigned long generation = pf->generation;
+        pf->pending = 0;
+        pthread_mutex_unlock(&pf->lock);
+
+        prefetch_request(pf, &req, generation, &buf, &buf_n);
+
+        pthread_mutex_lock(&pf->lock);
+    }
+    pthread_mutex_unlock(&pf->lock);
+
+    free(buf);
+    return NULL;
+}
+
+USPrefetcher *prefetch_create(USSliceCache *cache, int n_ahead) {
+    if (n_ahead < 0) return NULL;
+
+    USPrefetcher *pf = calloc(1, sizeof(USPrefetcher));
+    if (!pf) return NULL;
+    pf->cache = cache;
+    pf->n_ahead = n_ahead;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->wake, NULL);
+    pthread_mutex_init(&pf->io_lock, NULL);
+
+    if (pthread_create(&pf->thread, NULL, prefetch_worker, pf) != 0) {
+        fprintf(stderr, "Failed to start prefetch thread\n");
+        pthread_mutex_destroy(&pf->io_lock);
+        pthread_cond_destroy(&pf->wake);
+        pthread_mutex_destroy(&pf->lock);
+        free(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+void prefetch_schedule(USPrefetcher *pf, const USView *view) {
+    if (!pf || !view || !view->variable) return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->request.var = view->variable;
+    pf->request.fileset = view->fileset;
+    pf->request.n_points = view->raw_data_size;
+    pf->request.time_index = view->time_index;
+    pf->request.depth_index = view->depth_index;
+    pf->request.n_times = view->n_times;
+    pf->request.n_depths = view->n_depths;
+    pf->request.time_step = view->time_step;
+    pf->request.depth_step = view->depth_step;
+    pf->generation++;
+    pf->pending = 1;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_pause(USPrefetcher *pf) {
+    if (!pf) return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->generation++;
+    pf->pending = 0;
+    pf->io_waiters++;
+    pthread_mutex_unlock(&pf->lock);
+
+    /* Waits for a read in progress to finish */
+    pthread_mutex_lock(&pf->io_lock);
+
+    pthread_mutex_lock(&pf->lock);
+    pf->io_waiters--;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+}
+
+void prefetch_resume(USPrefetcher *pf) {
+    if (!pf) return;
+    pthread_mutex_unlock(&pf->io_lock);
+}
+
+void prefetch_set_range_scan(USPrefetcher *pf, USRangeScan *scan) {
+    if (!pf) return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->scan = scan;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+
+    /* A slice of the earlier scan may be in flight; wait for it */
+    pthread_mutex_lock(&pf->io_lock);
+    pthread_mutex_unlock(&pf->io_lock);
+}
+
+size_t prefetch_get_count(USPrefetcher *pf) {
+    if (!pf) return 0;
+    pthread_mutex_lock(&pf->lock);
+    size_t n = pf->n_read;
+    pthread_mutex_unlock(&pf->lock);
+    return n;
+}
+
+void prefetch_free(USPrefetcher *pf) {
+    if (!pf) return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = 1;
+    pthread_cond_signal(&pf->wake);
+    pthread_mutex_unlock(&pf->lock);
+    pthread_join(pf->thread, NULL);
+
+    pthread_mutex_destroy(&pf->io_lock);
+    pthread_cond_destroy(&pf->wake);
+    pthread_mutex_destroy(&pf->lock);
+    free(pf);
+}
@@ -0,0 +1,57 @@
+/*
+ * prefetch.h - Background read-ahead of data slices into the slice cache
+ *
+ * The same worker runs an attached range scan whenever it has no
+ * read-ahead to do.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "ushow.defines.h"
+
+/*
+ * Start a worker thread that reads up to n_ahead slices ahead of the view
+ * into cache. With n_ahead 0 or a NULL cache there is no read-ahead and
+ * the worker only runs range scans. Returns NULL if n_ahead < 0 or the
+ * thread could not be started.
+ */
+USPrefetcher *prefetch_create(USSliceCache *cache, int n_ahead);
+
+/*
+ * Predict the next slices from the view's position and direction of travel
+ * (view->time_step / view->depth_step) and queue them, replacing any
+ * earlier prediction. Time wraps around like the animation loop; depth
+ * stops at the first or last level.
+ */
+void prefetch_schedule(USPrefetcher *pf, const USView *view);
+
+/*
+ * Drop queued work and keep the worker off the data files until
+ * prefetch_resume(). Wrap any file access from another thread in
+ * these, since the file readers are not thread-safe. Not reentrant.
+ * Both are no-ops if pf is NULL.
+ */
+void prefetch_pause(USPrefetcher *pf);
+void prefetch_resume(USPrefetcher *pf);
+
+/*
+ * Run scan on the worker, one slice at a time between read-ahead requests,
+ * until it is done; NULL detaches the current scan. Replaces any earlier
+ * scan, which is not freed. Returns once the worker has let go of the
+ * earlier scan, so it may then be freed. Must not be called between
+ * prefetch_pause() and prefetch_resume().
+ */
+void prefetch_set_range_scan(USPrefetcher *pf, USRangeScan *scan);
+
+/*
+ * Number of slices read ahead so far.
+ */
+size_t prefetch_get_count(USPrefetcher *pf);
+
+/*
+ * Stop the worker and free the prefetcher.
+ */
+void prefetch_free(USPrefetcher *pf);
+
+#endif /* PREFETCH_H */
@@ -0,0 +1,352 @@
+/*
+ * range_scan.c - Exact data range of a variable over all slices
+ *
+ * The sidecar is a short text file, range-<key>.txt, in the cache
+ * directory. The key hashes the variable name, its shape and the path,
+ * size and modification time of every file it is read from, so touching
+ * or replacing a file starts a fresh scan. Values are written with nine
+ * significant digits, which round-trip floats exactly.
+ */
+
+#include "range_scan.h"
+#include "regrid_cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define RANGE_SIDECAR_MAGIC   "ushow-range"
+#define RANGE_SIDECAR_VERSION 1
+
+struct USRangeScan {
+    USVar      *var;
+    USFileSet  *fileset;
+    size_t      n_times, n_depths, n_points;
+    float       fill_value;
+
+    size_t     *time_order;         /* Times in scan order */
+    size_t      n_slices;
+
+    pthread_mutex_t lock;           /* Guards the fields below */
+    size_t      n_done;             /* Slices accumulated (position in scan order) */
+    int         aborted;
+    int         valid;
+    float       min, max;
+    float      *depth_min;          /* Per-depth range [n_depths] */
+    float      *depth_max;
+    unsigned char *depth_valid;
+
+    char        sidecar[4096];      /* Sidecar path, "" if not cached */
+};
+
+/* ========== Sidecar key ========== */
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t n) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint64_t hash_u64(uint64_t h, uint64_t v) {
+    return hash_bytes(h, &v, sizeof(v));
+}
+
+/* Hash one data file's identity; returns -1 if it cannot be stat'ed */
+static int hash_file(uint64_t *h, const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return -1;
+
+    char resolved[PATH_MAX];
+    const char *path = realpath(filename, resolved) ? resolved : filename;
+    *h = hash_bytes(*h, path, strlen(path) + 1);
+    *h = hash_u64(*h, (uint64_t)st.st_size);
+    *h = hash_u64(*h, (uint64_t)st.st_mtime);
+    return 0;
+}
+
+static int sidecar_key(const USRangeScan *scan, uint64_t *key) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = hash_bytes(h, scan->var->name, strlen(scan->var->name) + 1);
+    h = hash_u64(h, scan->n_times);
+    h = hash_u64(h, scan->n_depths);
+    h = hash_u64(h, scan->n_points);
+
+    if (scan->fileset) {
+        for (int i = 0; i < scan->fileset->n_files; i++) {
+            if (hash_file(&h, scan->fileset->files[i]->filename) != 0) return -1;
+        }
+    } else {
+        if (!scan->var->file || hash_file(&h, scan->var->file->filename) != 0) return -1;
+    }
+    *key = h;
+    return 0;
+}
+
+/* ========== Sidecar file ========== */
+
+/* Load a finished scan; returns 0 if the sidecar matched */
+static int sidecar_load(USRangeScan *scan) {
+    FILE *fp = fopen(scan->sidecar, "r");
+    if (!fp) return -1;
+
+    char magic[32], name[MAX_NAME_LEN];
+    int version, valid;
+    size_t n_times, n_depths, n_points;
+    float mn, mx;
+    int ok = fscanf(fp, "%31s %d", magic, &version) == 2 &&
+             strcmp(magic, RANGE_SIDECAR_MAGIC) == 0 && version == RANGE_SIDECAR_VERSION &&
+             fscanf(fp, " var %255s", name) == 1 && strcmp(name, scan->var->name) == 0 &&
+             fscanf(fp, " shape %zu %zu %zu", &n_times, &n_depths, &n_points) == 3 &&
+             n_times == scan->n_times && n_depths == scan->n_depths &&
+             n_points == scan->n_points &&
+             fscanf(fp, " range %d %g %g", &valid, &mn, &mx) == 3;
+
+    for (size_t d = 0; ok && d < scan->n_depths; d++) {
+        size_t idx;
+        int dvalid;
+        float dmn, dmx;
+        ok = fscanf(fp, " depth %zu %d %g %g", &idx, &dvalid, &dmn, &dmx) == 4 && idx == d;
+        if (ok) {
+            scan->depth_valid[d] = (unsigned char)(dvalid != 0);
+            scan->depth_min[d] = dmn;
+            scan->depth_max[d] = dmx;
+        }
+    }
+    fclose(fp);
+    if (!ok) return -1;
+
+    scan->valid = valid;
+    scan->min = mn;
+    scan->max = mx;
+    scan->n_done = scan->n_slices;
+    return 0;
+}
+
+/* Write a finished scan under a temporary name and rename it into place */
+static void sidecar_save(const USRangeScan *scan) {
+    char dir[4096];
+    const char *slash = strrchr(scan->sidecar, '/');
+    size_t dir_len = slash ? (size_t)(slash - scan->sidecar) : 0;
+    if (dir_len == 0 || dir_len >= sizeof(dir)) return;
+    memcpy(dir, scan->sidecar, dir_len);
+    dir[dir_len] = '\0';
+    if (regrid_cache_make_dir(dir) != 0) return;
+
+    char tmp[4096 + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", scan->sidecar, (long)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+
+    fprintf(fp, "%s %d\n", RANGE_SIDECAR_MAGIC, RANGE_SIDECAR_VERSION);
+    fprintf(fp, "var %s\n", scan->var->name);
+    fprintf(fp, "shape %zu %zu %zu\n", scan->n_times, scan->n_depths, scan->n_points);
+    fprintf(fp, "range %d %.9g %.9g\n", scan->valid, scan->min, scan->max);
+    for (size_t d = 0; d < scan->n_depths; d++) {
+        fprintf(fp, "depth %zu %d %.9g %.9g\n", d, scan->depth_valid[d],
+                scan->depth_min[d], scan->depth_max[d]);
+    }
+    if (fclose(fp) != 0 || rename(tmp, scan->sidecar) != 0) {
+        unlink(tmp);
+    }
+}
+
+/* ========== Scan ========== */
+
+/* Times in bit-reversed order: 0, middle, quarters, eighths, ... */
+static void coarse_to_fine(size_t *order, size_t n) {
+    int bits = 0;
+    while (((size_t)1 << bits) < n) bits++;
+
+    size_t k = 0;
+    for (size_t i = 0; k < n; i++) {
+        size_t r = 0;
+        for (int b = 0; b < bits; b++) {
+            if (i & ((size_t)1 << b)) r |= (size_t)1 << (bits - 1 - b);
+        }
+        if (r < n) order[k++] = r;
+    }
+}
+
+USRangeScan *range_scan_create(USVar *var, USFileSet *fileset, size_t n_times,
+                               size_t n_depths, size_t n_points, const char *cache_dir) {
+    if (!var || n_times == 0 || n_depths == 0 || n_points == 0) return NULL;
+
+    USRangeScan *scan = calloc(1, sizeof(USRangeScan));
+    if (!scan) return NULL;
+    pthread_mutex_init(&scan->lock, NULL);
+    scan->var = var;
+    scan->fileset = fileset;
+    scan->n_times = n_times;
+    scan->n_depths = n_depths;
+    scan->n_points = n_points;
+    scan->fill_value = var->fill_value;
+    scan->n_slices = n_times * n_depths;
+    scan->min = 1e30f;
+    scan->max = -1e30f;
+
+    scan->time_order = malloc(n_times * sizeof(size_t));
+    scan->depth_min = malloc(n_depths * sizeof(float));
+    scan->depth_max = malloc(n_depths * sizeof(float));
+    scan->depth_valid = calloc(n_depths, 1);
+    if (!scan->time_order || !scan->depth_min || !scan->depth_max || !scan->depth_valid) {
+        fprintf(stderr, "Failed to allocate range scan\n");
+        range_scan_free(scan);
+        return NULL;
+    }
+    coarse_to_fine(scan->time_order, n_times);
+    for (size_t d = 0; d < n_depths; d++) {
+        scan->depth_min[d] = 1e30f;
+        scan->depth_max[d] = -1e30f;
+    }
+
+    uint64_t key;
+    if (cache_dir && cache_dir[0] && sidecar_key(scan, &key) == 0) {
+        int n = snprintf(scan->sidecar, sizeof(scan->sidecar), "%s/range-%016llx.txt",
+                         cache_dir, (unsigned long long)key);
+        if (n <= 0 || (size_t)n >= sizeof(scan->sidecar)) {
+            scan->sidecar[0] = '\0';
+        } else if (sidecar_load(scan) != 0) {
+            /* Missing or stale: discard anything partially parsed */
+            for (size_t d = 0; d < n_depths; d++) {
+                scan->depth_valid[d] = 0;
+                scan->depth_min[d] = 1e30f;
+                scan->depth_max[d] = -1e30f;
+            }
+        }
+    }
+    return scan;
+}
+
+int range_scan_next(const USRangeScan *scan, size_t *time_idx, size_t *depth_idx) {
+    if (!scan) return 0;
+    USRangeScan *s = (USRangeScan *)scan;
+    pthread_mutex_lock(&s->lock);
+    size_t k = s->n_done;
+    int more = !s->aborted && k < s->n_slices;
+    pthread_mutex_unlock(&s->lock);
+    if (!more) return 0;
+
+    *time_idx = scan->time_order[k / scan->n_depths];
+    *depth_idx = k % scan->n_depths;
+    return 1;
+}
+
+int range_scan_add(USRangeScan *scan, size_t time_idx, size_t depth_idx, const float *data) {
+    size_t t, d;
+    if (!scan || !data || !range_scan_next(scan, &t, &d) || t != time_idx || d != depth_idx) {
+        return -1;
+    }
+
+    /* Accumulate outside the lock; only this caller advances the scan */
+    float fill = scan->fill_value;
+    float mn = 1e30f, mx = -1e30f;
+    for (size_t i = 0; i < scan->n_points; i++) {
+        float v = data[i];
+        if (fabsf(v) > INVALID_DATA_THRESHOLD) continue;
+        if (fabsf(v - fill) < 1e-6f * fabsf(fill)) continue;
+        if (v < mn) mn = v;
+        if (v > mx) mx = v;
+    }
+
+    pthread_mutex_lock(&scan->lock);
+    if (mn <= mx) {
+        if (!scan->valid || mn < scan->min) scan->min = mn;
+        if (!scan->valid || mx > scan->max) scan->max = mx;
+        scan->valid = 1;
+        if (!scan->depth_valid[d] || mn < scan->depth_min[d]) scan->depth_min[d] = mn;
+        if (!scan->depth_valid[d] || mx > scan->depth_max[d]) scan->depth_max[d] = mx;
+        scan->depth_valid[d] = 1;
+    }
+    scan->n_done++;
+    int finished = (scan->n_done == scan->n_slices);
+    pthread_mutex_unlock(&scan->lock);
+
+    if (finished && scan->sidecar[0]) sidecar_save(scan);
+    return 0;
+}
+
+void range_scan_abort(USRangeScan *scan) {
+    if (!scan) return;
+    pthread_mutex_lock(&scan->lock);
+    scan->aborted = 1;
+    pthread_mutex_unlock(&scan->lock);
+}
+
+int range_scan_done(const USRangeScan *scan) {
+    if (!scan) return 1;
+    USRangeScan *s = (USRangeScan *)scan;
+    pthread_mutex_lock(&s->lock);
+    int done = s->aborted || s->n_done == s->n_slices;
+    pthread_mutex_unlock(&s->lock);
+    return done;
+}
+
+int range_scan_complete(const USRangeScan *scan) {
+    if (!scan) return 0;
+    USRangeScan *s = (USRangeScan *)scan;
+    pthread_mutex_lock(&s->lock);
+    int complete = !s->aborted && s->n_done == s->n_slices;
+    pthread_mutex_unlock(&s->lock);
+    return complete;
+}
+
+USVar *range_scan_var(const USRangeScan *scan) {
+    return scan ? scan->var : NULL;
+}
+
+USFileSet *range_scan_fileset(const USRangeScan *scan) {
+    return scan ? scan->fileset : NULL;
+}
+
+size_t range_scan_n_points(const USRangeScan *scan) {
+    return scan ? scan->n_points : 0;
+}
+
+void range_scan_get_stats(const USRangeScan *scan, USRangeScanStats *stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!scan) return;
+
+    USRangeScan *s = (USRangeScan *)scan;
+    pthread_mutex_lock(&s->lock);
+    stats->n_slices = s->n_slices;
+    stats->n_done = s->n_done;
+    stats->valid = s->valid;
+    stats->min = s->min;
+    stats->max = s->max;
+    pthread_mutex_unlock(&s->lock);
+}
+
+int range_scan_get_depth(const USRangeScan *scan, size_t depth_idx, float *min_val, float *max_val) {
+    if (!scan || depth_idx >= scan->n_depths) return -1;
+
+    USRangeScan *s = (USRangeScan *)scan;
+    pthread_mutex_lock(&s->lock);
+    /* Depth d of the last time in scan order is slice n_slices - n_depths + d */
+    int ok = !s->aborted && s->n_done > s->n_slices - s->n_depths + depth_idx &&
+             s->depth_valid[depth_idx];
+    if (ok) {
+        *min_val = s->depth_min[depth_idx];
+        *max_val = s->depth_max[depth_idx];
+    }
+    pthread_mutex_unlock(&s->lock);
+    return ok ? 0 : -1;
+}
+
+void range_scan_free(USRangeScan *scan) {
+    if (!scan) return;
+    pthread_mutex_destroy(&scan->lock);
+    free(scan->time_order);
+    free(scan->depth_min);
+    free(scan->depth_max);
+    free(scan->depth_valid);
+    free(scan);
+}
@@ -0,0 +1,91 @@
+/*
+ * range_scan.h - Exact data range of a variable over all slices
+ *
+ * Accumulates the minimum and maximum of every (time, depth) slice of one
+ * variable, overall and per depth level, and keeps the finished result in
+ * a small sidecar file in the cache directory so later sessions get it
+ * without reading the data again. The scan itself does no file I/O: the
+ * caller reads the slice named by range_scan_next() and hands it to
+ * range_scan_add() (the prefetcher's worker does this in the background).
+ * All functions may be called from different threads.
+ */
+
+#ifndef RANGE_SCAN_H
+#define RANGE_SCAN_H
+
+#include "ushow.defines.h"
+
+/* Progress counters */
+typedef struct {
+    size_t      n_slices;       /* (time, depth) slices in the variable */
+    size_t      n_done;         /* Slices accumulated so far */
+    int         valid;          /* min/max hold at least one valid value */
+    float       min, max;       /* Range of the slices done so far */
+} USRangeScanStats;
+
+/*
+ * Start a scan of var over n_times x n_depths slices of n_points values.
+ * Time indices are virtual if fileset is non-NULL. If cache_dir (may be
+ * NULL) holds a sidecar for the same variable and files, with the files'
+ * sizes and modification times unchanged, the scan starts out complete.
+ * Returns NULL on bad arguments or allocation failure.
+ */
+USRangeScan *range_scan_create(USVar *var, USFileSet *fileset, size_t n_times,
+                               size_t n_depths, size_t n_points, const char *cache_dir);
+
+/*
+ * The next slice to read. Times are visited coarse to fine (bit-reversed:
+ * first, middle, quarters, eighths, ...) with all depths of each time, so
+ * the running range covers the whole record early. Returns 0 when every
+ * slice has been handed out or the scan was aborted.
+ */
+int range_scan_next(const USRangeScan *scan, size_t *time_idx, size_t *depth_idx);
+
+/*
+ * Accumulate the slice returned by range_scan_next(); values are skipped
+ * like netcdf_estimate_range() does (fill value, magnitude above
+ * INVALID_DATA_THRESHOLD, NaN). Writes the sidecar after the last slice.
+ * Returns 0 on success, -1 if the slice is not the one expected.
+ */
+int range_scan_add(USRangeScan *scan, size_t time_idx, size_t depth_idx, const float *data);
+
+/*
+ * Mark the scan as failed (for example after a read error): it reports
+ * done, keeps its partial range and writes no sidecar.
+ */
+void range_scan_abort(USRangeScan *scan);
+
+/*
+ * Whether every slice has been accumulated (or the scan was aborted).
+ */
+int range_scan_done(const USRangeScan *scan);
+
+/*
+ * Whether the scan finished every slice (from the data or the sidecar).
+ */
+int range_scan_complete(const USRangeScan *scan);
+
+/*
+ * The variable and file set being scanned.
+ */
+USVar *range_scan_var(const USRangeScan *scan);
+USFileSet *range_scan_fileset(const USRangeScan *scan);
+size_t range_scan_n_points(const USRangeScan *scan);
+
+/*
+ * Read the running range and progress.
+ */
+void range_scan_get_stats(const USRangeScan *scan, USRangeScanStats *stats);
+
+/*
+ * Exact range of one depth level. Returns 0 once every time step at that
+ * depth has been scanned and held valid data, -1 otherwise.
+ */
+int range_scan_get_depth(const USRangeScan *scan, size_t depth_idx, float *min_val, float *max_val);
+
+/*
+ * Free the scan.
+ */
+void range_scan_free(USRangeScan *scan);
+
+#endif /* RANGE_SCAN_H */
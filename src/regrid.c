@@ -7,17 +7,347 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
-USRegrid *regrid_create(USMesh *mesh, double resolution, double influence_radius_m) {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    !defined(REGRID_WIDE_INDEX) && !defined(REGRID_NO_SIMD)
+#define REGRID_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* Target rows per tile: the unit of work handed to a thread and of batched queries */
+#define REGRID_TILE_ROWS 8
+
+/* Maximum number of regrid build threads */
+#define REGRID_MAX_THREADS 64
+
+/* Distance below which a source point is treated as coincident (chord units) */
+#define IDW_COINCIDENT_CHORD 1e-12
+
+/* Nearest-neighbor query strategy for the next regrid build */
+static RegridQueryStrategy query_strategy = REGRID_QUERY_WALK;
+
+/* Build thread count for the next regrid build (0 = one per CPU) */
+static int build_threads = 0;
+
+/* Keep per-cell nearest-neighbor distances after the build */
+static int store_distances = 0;
+
+/* Forced regrid_apply kernel (REGRID_APPLY_AUTO = runtime dispatch) */
+static RegridApplyKernel apply_kernel = REGRID_APPLY_AUTO;
+
+void regrid_set_query_strategy(RegridQueryStrategy strategy) {
+    query_strategy = strategy;
+}
+
+void regrid_set_num_threads(int n_threads) {
+    build_threads = (n_threads > 0) ? n_threads : 0;
+}
+
+void regrid_set_store_distances(int store) {
+    store_distances = store ? 1 : 0;
+}
+
+/*
+ * Nearest source within the influence radius for a band of target rows
+ * (index 0 and DBL_MAX distance where there is none).
+ * The walking sweep starts each row from the answer of the cell above
+ * (*row_hint) and every other cell from its left-hand neighbour.
+ */
+static void query_band(const USRegrid *regrid, const double *queries,
+                       size_t n_rows, size_t *row_hint,
+                       size_t *nn_idx, double *nn_dist) {
+    size_t nx = regrid->target_nx;
+    double radius = regrid->influence_radius_chord;
+
+    if (query_strategy == REGRID_QUERY_BATCH) {
+        kdtree_query_nearest_batch(regrid->kdtree, queries, n_rows * nx, radius,
+                                   nn_idx, nn_dist);
+        return;
+    }
+
+    for (size_t r = 0; r < n_rows; r++) {
+        size_t hint = *row_hint;
+        for (size_t i = 0; i < nx; i++) {
+            size_t t = r * nx + i;
+            int found;
+            if (query_strategy == REGRID_QUERY_WALK) {
+                found = kdtree_query_nearest_seeded(regrid->kdtree, &queries[t * 3], radius,
+                                                    &hint, &nn_idx[t], &nn_dist[t]);
+                if (i == 0 && found) *row_hint = hint;
+            } else {
+                found = kdtree_query_nearest_within(regrid->kdtree, &queries[t * 3], radius,
+                                                    &nn_idx[t], &nn_dist[t]);
+            }
+            if (!found) {
+                nn_idx[t] = 0;
+                nn_dist[t] = DBL_MAX;
+            }
+        }
+    }
+}
+
+/*
+ * Compute normalized inverse-distance-squared weights for one target point.
+ * Neighbors beyond the influence radius get weight 0; a coincident neighbor
+ * takes all the weight.
+ */
+static void compute_idw_weights(const double *dist, size_t n_found, int k,
+                                double radius, float *weights) {
+    for (int j = 0; j < k; j++) weights[j] = 0.0f;
+    if (n_found == 0 || dist[0] > radius) return;
+
+    if (dist[0] < IDW_COINCIDENT_CHORD) {
+        weights[0] = 1.0f;
+        return;
+    }
+
+    double w[MAX_IDW_NEIGHBORS];
+    double sum = 0.0;
+    for (size_t j = 0; j < n_found; j++) {
+        w[j] = (dist[j] <= radius) ? 1.0 / (dist[j] * dist[j]) : 0.0;
+        sum += w[j];
+    }
+    for (size_t j = 0; j < n_found; j++) {
+        weights[j] = (float)(w[j] / sum);
+    }
+}
+
+/* Shared state of a tiled regrid build */
+typedef struct {
+    USRegrid        *regrid;
+    size_t           n_tiles;
+    atomic_size_t    next_tile;     /* Next tile to hand out */
+    atomic_size_t    valid_count;
+    pthread_mutex_t  progress_lock;
+    size_t           rows_done;     /* Guarded by progress_lock */
+    size_t           next_report;   /* Row count of the next progress line */
+} RegridBuild;
+
+/* Per-thread scratch for one tile of TILE_ROWS * nx cells */
+typedef struct {
+    RegridBuild *build;
+    double      *queries;           /* Cartesian targets [n * 3] */
+    size_t      *nn_idx;            /* KDTree answers before narrowing to RegridIndex */
+    double      *nn_dist;
+} RegridWorker;
+
+/*
+ * Fill nearest-neighbor (and IDW) entries for target rows [j0, j1).
+ * Every cell depends only on its own query, so tiles can be computed in any
+ * order and on any thread with identical results.
+ * Returns the number of valid cells.
+ */
+static size_t compute_tile(USRegrid *regrid, size_t j0, size_t j1, RegridWorker *worker) {
+    double *queries = worker->queries;
+    size_t *nn_idx = worker->nn_idx;
+    double *nn_dist = worker->nn_dist;
+    size_t nx = regrid->target_nx;
+    size_t k = (size_t)regrid->n_neighbors;
+    size_t tile_start = j0 * nx;
+    size_t tile_n = (j1 - j0) * nx;
+    size_t row_hint = KDTREE_NO_HINT;
+    size_t valid_count = 0;
+
+    /* Convert target points to Cartesian */
+    for (size_t j = j0; j < j1; j++) {
+        double lat = regrid->target_lat_min + (j + 0.5) * regrid->target_dlat;
+        for (size_t i = 0; i < nx; i++) {
+            double lon = regrid->target_lon_min + (i + 0.5) * regrid->target_dlon;
+            double *q = &queries[((j - j0) * nx + i) * 3];
+            lonlat_to_cartesian(lon, lat, &q[0], &q[1], &q[2]);
+        }
+    }
+
+    /* Nearest neighbor within the influence radius (DBL_MAX distance if none) */
+    query_band(regrid, queries, j1 - j0, &row_hint, nn_idx, nn_dist);
+
+    /*
+     * Validity bits are gathered per 64-bit word and merged with an atomic OR:
+     * the first and last words of a tile may be shared with neighbouring tiles.
+     */
+    uint64_t bits = 0;
+    size_t word = tile_start >> 6;
+
+    for (size_t t = 0; t < tile_n; t++) {
+        size_t target_idx = tile_start + t;
+        int in_radius = nn_dist[t] <= regrid->influence_radius_chord;
+        size_t knn_idx[MAX_IDW_NEIGHBORS];
+        double knn_dist[MAX_IDW_NEIGHBORS];
+        size_t n_found = 0;
+
+        /* IDW cells need their neighbors too; a failed query leaves the cell invalid */
+        if (in_radius && regrid->method == REGRID_IDW) {
+            n_found = kdtree_query_knn(regrid->kdtree, &queries[t * 3], k,
+                                       knn_idx, knn_dist);
+            if (n_found == 0) in_radius = 0;
+        }
+
+        if ((target_idx >> 6) != word) {
+            if (bits) __atomic_fetch_or(&regrid->valid_bits[word], bits, __ATOMIC_RELAXED);
+            bits = 0;
+            word = target_idx >> 6;
+        }
+        regrid->nn_indices[target_idx] = (RegridIndex)nn_idx[t];
+        if (regrid->nn_distances) {
+            regrid->nn_distances[target_idx] = in_radius ? (float)nn_dist[t] : FLT_MAX;
+        }
+        if (in_radius) {
+            bits |= (uint64_t)1 << (target_idx & 63);
+            valid_count++;
+        }
+
+        if (regrid->method != REGRID_IDW) continue;
+
+        RegridIndex *cell_idx = &regrid->idw_indices[target_idx * k];
+        float *cell_w = &regrid->idw_weights[target_idx * k];
+        if (!in_radius) {
+            for (size_t m = 0; m < k; m++) {
+                cell_idx[m] = 0;
+                cell_w[m] = 0.0f;
+            }
+            continue;
+        }
+
+        compute_idw_weights(knn_dist, n_found, (int)k,
+                            regrid->influence_radius_chord, cell_w);
+        /* Unused slots point at the nearest source with zero weight */
+        for (size_t m = 0; m < k; m++) {
+            cell_idx[m] = (RegridIndex)knn_idx[(m < n_found) ? m : 0];
+        }
+    }
+    if (bits) __atomic_fetch_or(&regrid->valid_bits[word], bits, __ATOMIC_RELAXED);
+
+    return valid_count;
+}
+
+/* Count finished rows and print progress roughly every 10% */
+static void report_progress(RegridBuild *build, size_t rows) {
+    size_t ny = build->regrid->target_ny;
+    pthread_mutex_lock(&build->progress_lock);
+    build->rows_done += rows;
+    if (build->rows_done >= build->next_report) {
+        printf("  Progress: %zu/%zu rows (%.1f%%)\n",
+               build->rows_done, ny, 100.0 * build->rows_done / ny);
+        while (build->next_report <= build->rows_done) {
+            build->next_report += (ny + 9) / 10;
+        }
+    }
+    pthread_mutex_unlock(&build->progress_lock);
+}
+
+/* Take tiles until none are left; polar and empty tiles finish early */
+static void *tile_worker(void *arg) {
+    RegridWorker *worker = arg;
+    RegridBuild *build = worker->build;
+    USRegrid *regrid = build->regrid;
+    size_t tile;
+
+    while ((tile = atomic_fetch_add(&build->next_tile, 1)) < build->n_tiles) {
+        size_t j0 = tile * REGRID_TILE_ROWS;
+        size_t j1 = j0 + REGRID_TILE_ROWS;
+        if (j1 > regrid->target_ny) j1 = regrid->target_ny;
+
+        size_t valid = compute_tile(regrid, j0, j1, worker);
+        atomic_fetch_add(&build->valid_count, valid);
+        report_progress(build, j1 - j0);
+    }
+    return NULL;
+}
+
+static int regrid_num_threads(size_t n_tiles) {
+    long n_cpu = build_threads;
+    if (n_cpu <= 0) n_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpu < 1) n_cpu = 1;
+    if (n_cpu > REGRID_MAX_THREADS) n_cpu = REGRID_MAX_THREADS;
+    if ((size_t)n_cpu > n_tiles) n_cpu = (long)n_tiles;
+    return (int)n_cpu;
+}
+
+/*
+ * Compute all target cells on a pool of threads handing out row tiles
+ * dynamically. The calling thread acts as worker 0.
+ * Returns the number of valid cells, or SIZE_MAX on allocation failure.
+ */
+static size_t compute_tiles_parallel(USRegrid *regrid) {
+    RegridBuild build;
+    build.regrid = regrid;
+    build.n_tiles = (regrid->target_ny + REGRID_TILE_ROWS - 1) / REGRID_TILE_ROWS;
+    atomic_init(&build.next_tile, 0);
+    atomic_init(&build.valid_count, 0);
+    build.rows_done = 0;
+    build.next_report = (regrid->target_ny + 9) / 10;
+
+    int n_threads = regrid_num_threads(build.n_tiles);
+    if (n_threads < 1) return 0;
+
+    size_t tile_cells = REGRID_TILE_ROWS * regrid->target_nx;
+    RegridWorker workers[REGRID_MAX_THREADS];
+    pthread_t threads[REGRID_MAX_THREADS];
+    int started[REGRID_MAX_THREADS] = {0};
+    int n_workers = 0;
+
+    for (; n_workers < n_threads; n_workers++) {
+        RegridWorker *w = &workers[n_workers];
+        w->build = &build;
+        w->queries = malloc(tile_cells * 3 * sizeof(double));
+        w->nn_idx = malloc(tile_cells * sizeof(size_t));
+        w->nn_dist = malloc(tile_cells * sizeof(double));
+        if (!w->queries || !w->nn_idx || !w->nn_dist) {
+            free(w->queries);
+            free(w->nn_idx);
+            free(w->nn_dist);
+            break;
+        }
+    }
+    if (n_workers == 0) return SIZE_MAX;
+
+    if (n_workers > 1) {
+        printf("Using %d threads\n", n_workers);
+    }
+
+    pthread_mutex_init(&build.progress_lock, NULL);
+    /* Workers that fail to start are simply absent; the rest do their share */
+    for (int t = 1; t < n_workers; t++) {
+        started[t] = (pthread_create(&threads[t], NULL, tile_worker, &workers[t]) == 0);
+    }
+    tile_worker(&workers[0]);
+    for (int t = 1; t < n_workers; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&build.progress_lock);
+
+    for (int t = 0; t < n_workers; t++) {
+        free(workers[t].queries);
+        free(workers[t].nn_idx);
+        free(workers[t].nn_dist);
+    }
+    return atomic_load(&build.valid_count);
+}
+
+static USRegrid *regrid_build(USMesh *mesh, double resolution, double influence_radius_m,
+                              RegridMethod method, int n_neighbors) {
     if (!mesh || !mesh->xyz || mesh->n_points == 0) {
         fprintf(stderr, "Invalid mesh for regridding\n");
         return NULL;
     }
+    if (mesh->n_points - 1 > REGRID_INDEX_MAX) {
+        fprintf(stderr, "Mesh has too many points for 32-bit regrid indices "
+                        "(rebuild with -DREGRID_WIDE_INDEX)\n");
+        return NULL;
+    }
 
     USRegrid *regrid = calloc(1, sizeof(USRegrid));
     if (!regrid) return NULL;
 
     /* Store parameters */
+    regrid->method = method;
+    regrid->n_neighbors = (method == REGRID_IDW) ? n_neighbors : 1;
     regrid->influence_radius_meters = influence_radius_m;
     regrid->influence_radius_chord = meters_to_chord(influence_radius_m);
     regrid->source_n_points = mesh->n_points;
@@ -42,15 +372,29 @@ USRegrid *regrid_create(USMesh *mesh, double resolution, double influence_radius
            influence_radius_m, regrid->influence_radius_chord);
 
     /* Allocate interpolation arrays */
-    regrid->nn_indices = malloc(n_target * sizeof(size_t));
-    regrid->nn_distances = malloc(n_target * sizeof(double));
-    regrid->valid_mask = calloc(n_target, sizeof(unsigned char));
+    regrid->nn_indices = malloc(n_target * sizeof(RegridIndex));
+    regrid->valid_bits = calloc(REGRID_BIT_WORDS(n_target), sizeof(uint64_t));
+    if (store_distances) {
+        regrid->nn_distances = malloc(n_target * sizeof(float));
+    }
 
-    if (!regrid->nn_indices || !regrid->nn_distances || !regrid->valid_mask) {
+    if (!regrid->nn_indices || !regrid->valid_bits ||
+        (store_distances && !regrid->nn_distances)) {
         regrid_free(regrid);
         return NULL;
     }
 
+    if (method == REGRID_IDW) {
+        size_t k = (size_t)regrid->n_neighbors;
+        printf("Inverse-distance weighting: %zu neighbors\n", k);
+        regrid->idw_indices = malloc(n_target * k * sizeof(RegridIndex));
+        regrid->idw_weights = malloc(n_target * k * sizeof(float));
+        if (!regrid->idw_indices || !regrid->idw_weights) {
+            regrid_free(regrid);
+            return NULL;
+        }
+    }
+
     /* Build KDTree from source mesh Cartesian coordinates */
     printf("Building KDTree from %zu source points...\n", mesh->n_points);
     regrid->kdtree = kdtree_create(mesh->xyz, mesh->n_points);
@@ -60,69 +404,235 @@ USRegrid *regrid_create(USMesh *mesh, double resolution, double influence_radius
         return NULL;
     }
 
-    /* Query nearest neighbors for each target point */
+    /* Query nearest neighbors for each target point, one tile of rows at a time */
     printf("Computing nearest neighbors for %zu target points...\n", n_target);
-    double query[3];
-    size_t valid_count = 0;
+    size_t valid_count = compute_tiles_parallel(regrid);
+    if (valid_count == SIZE_MAX) {
+        regrid_free(regrid);
+        return NULL;
+    }
 
-    for (size_t j = 0; j < regrid->target_ny; j++) {
-        double lat = regrid->target_lat_min + (j + 0.5) * regrid->target_dlat;
+    printf("Regrid created: %zu/%zu valid target points (%.1f%%)\n",
+           valid_count, n_target, 100.0 * valid_count / n_target);
 
-        for (size_t i = 0; i < regrid->target_nx; i++) {
-            double lon = regrid->target_lon_min + (i + 0.5) * regrid->target_dlon;
-            size_t target_idx = j * regrid->target_nx + i;
+    return regrid;
+}
 
-            /* Convert target point to Cartesian */
-            lonlat_to_cartesian(lon, lat, &query[0], &query[1], &query[2]);
+USRegrid *regrid_create(USMesh *mesh, double resolution, double influence_radius_m) {
+    return regrid_build(mesh, resolution, influence_radius_m, REGRID_NEAREST, 1);
+}
 
-            /* Find nearest neighbor */
-            size_t nn_idx;
-            double nn_dist;
-            kdtree_query_nearest(regrid->kdtree, query, &nn_idx, &nn_dist);
+USRegrid *regrid_create_idw(USMesh *mesh, double resolution, double influence_radius_m,
+                            int n_neighbors) {
+    if (n_neighbors < 1 || n_neighbors > MAX_IDW_NEIGHBORS) {
+        fprintf(stderr, "IDW neighbor count must be between 1 and %d\n", MAX_IDW_NEIGHBORS);
+        return NULL;
+    }
+    return regrid_build(mesh, resolution, influence_radius_m, REGRID_IDW, n_neighbors);
+}
 
-            regrid->nn_indices[target_idx] = nn_idx;
-            regrid->nn_distances[target_idx] = nn_dist;
+/* Weighted gather: fixed k taps per cell, invalid sources drop out */
+static void regrid_apply_idw(const USRegrid *regrid, const float *source_data,
+                             float fill_value, float *target_data) {
+    size_t n_target = regrid->target_nx * regrid->target_ny;
+    size_t k = (size_t)regrid->n_neighbors;
 
-            /* Check if within influence radius */
-            if (nn_dist <= regrid->influence_radius_chord) {
-                regrid->valid_mask[target_idx] = 1;
-                valid_count++;
-            }
+    for (size_t i = 0; i < n_target; i++) {
+        const RegridIndex *idx = &regrid->idw_indices[i * k];
+        const float *w = &regrid->idw_weights[i * k];
+        float acc = 0.0f;
+        float wsum = 0.0f;
+
+        for (size_t j = 0; j < k; j++) {
+            float v = source_data[idx[j]];
+            int ok = fabsf(v) < INVALID_DATA_THRESHOLD;
+            float wj = ok ? w[j] : 0.0f;
+            acc += wj * (ok ? v : 0.0f);
+            wsum += wj;
         }
 
-        /* Progress indicator */
-        if ((j + 1) % 30 == 0 || j == regrid->target_ny - 1) {
-            printf("  Progress: %zu/%zu rows (%.1f%%)\n",
-                   j + 1, regrid->target_ny,
-                   100.0 * (j + 1) / regrid->target_ny);
+        target_data[i] = (wsum > 0.0f) ? acc / wsum : fill_value;
+    }
+}
+
+/*
+ * Nearest-neighbor gather kernels. Each writes source_data[nn_indices[i]]
+ * for the first n cells where the cell is valid and the value is not a fill
+ * value, and fill_value elsewhere, without branching per cell. The result is
+ * bit-identical across kernels.
+ */
+typedef void (*ApplyNearestFn)(const USRegrid *regrid, const float *source_data,
+                               float fill_value, float *target_data, size_t n);
+
+static void apply_nearest_scalar(const USRegrid *regrid, const float *source_data,
+                                 float fill_value, float *target_data, size_t n) {
+    const RegridIndex *idx = regrid->nn_indices;
+
+    for (size_t w = 0; w < REGRID_BIT_WORDS(n); w++) {
+        uint64_t bits = regrid->valid_bits[w];
+        size_t end = (w + 1) * 64 < n ? (w + 1) * 64 : n;
+        for (size_t i = w * 64; i < end; i++, bits >>= 1) {
+            /* Invalid cells hold index 0, so the load is always in bounds */
+            float value = source_data[idx[i]];
+            int ok = (int)(bits & 1) & (fabsf(value) < INVALID_DATA_THRESHOLD);
+            target_data[i] = ok ? value : fill_value;
         }
     }
+}
 
-    printf("Regrid created: %zu/%zu valid target points (%.1f%%)\n",
-           valid_count, n_target, 100.0 * valid_count / n_target);
+#ifdef REGRID_X86_SIMD
+/* Outputs larger than this bypass the cache with streaming stores */
+#define REGRID_STREAM_BYTES (8u << 20)
 
-    return regrid;
+/* Validity bits of cells i..i+15 for any i with i + 16 <= n */
+static inline uint32_t valid_bits16(const uint64_t *bits, size_t i) {
+    unsigned shift = (unsigned)(i & 63);
+    uint64_t v = bits[i >> 6] >> shift;
+    if (shift > 48) v |= bits[(i >> 6) + 1] << (64 - shift);
+    return (uint32_t)v & 0xffff;
+}
+
+/* Scalar cells [begin, end), as in apply_nearest_scalar */
+static inline void apply_nearest_cells(const USRegrid *regrid, const float *source_data,
+                                       float fill_value, float *target_data,
+                                       size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        float value = source_data[regrid->nn_indices[i]];
+        int ok = regrid_cell_valid(regrid, i) & (fabsf(value) < INVALID_DATA_THRESHOLD);
+        target_data[i] = ok ? value : fill_value;
+    }
+}
+
+/* First cell at which target_data is aligned to `align` bytes (at most n) */
+static size_t aligned_start(const float *target_data, size_t align, size_t n) {
+    size_t mis = (size_t)((uintptr_t)target_data & (align - 1));
+    size_t head = mis ? (align - mis) / sizeof(float) : 0;
+    if (mis % sizeof(float)) head = n;  /* Never aligns: all scalar */
+    return head < n ? head : n;
+}
+
+__attribute__((target("avx2")))
+static void apply_nearest_avx2(const USRegrid *regrid, const float *source_data,
+                               float fill_value, float *target_data, size_t n) {
+    const RegridIndex *idx = regrid->nn_indices;
+    const __m256i lane_bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 threshold = _mm256_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m256 fill = _mm256_set1_ps(fill_value);
+    int stream = n * sizeof(float) > REGRID_STREAM_BYTES;
+
+    size_t i = aligned_start(target_data, 32, n);
+    apply_nearest_cells(regrid, source_data, fill_value, target_data, 0, i);
+
+    for (; i + 16 <= n; i += 8) {
+        uint32_t byte = valid_bits16(regrid->valid_bits, i) & 0xff;
+        __m256 out = fill;
+        if (byte) {
+            __m256i sel = _mm256_and_si256(_mm256_set1_epi32((int)byte), lane_bit);
+            __m256 valid = _mm256_castsi256_ps(_mm256_cmpeq_epi32(sel, lane_bit));
+            __m256i vidx = _mm256_loadu_si256((const __m256i *)&idx[i]);
+            __m256 v = _mm256_mask_i32gather_ps(fill, source_data, vidx, valid, 4);
+            __m256 ok = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_and_ps(v, abs_mask),
+                                                           threshold, _CMP_LT_OQ));
+            out = _mm256_blendv_ps(fill, v, ok);
+        }
+        if (stream) _mm256_stream_ps(&target_data[i], out);
+        else _mm256_store_ps(&target_data[i], out);
+    }
+    if (stream) _mm_sfence();
+
+    apply_nearest_cells(regrid, source_data, fill_value, target_data, i, n);
+}
+
+__attribute__((target("avx512f")))
+static void apply_nearest_avx512(const USRegrid *regrid, const float *source_data,
+                                 float fill_value, float *target_data, size_t n) {
+    const RegridIndex *idx = regrid->nn_indices;
+    const __m512 threshold = _mm512_set1_ps(INVALID_DATA_THRESHOLD);
+    const __m512 fill = _mm512_set1_ps(fill_value);
+    int stream = n * sizeof(float) > REGRID_STREAM_BYTES;
+
+    size_t i = aligned_start(target_data, 64, n);
+    apply_nearest_cells(regrid, source_data, fill_value, target_data, 0, i);
+
+    for (; i + 16 <= n; i += 16) {
+        __mmask16 valid = (__mmask16)valid_bits16(regrid->valid_bits, i);
+        __m512 out = fill;
+        if (valid) {
+            __m512i vidx = _mm512_loadu_si512((const void *)&idx[i]);
+            __m512 v = _mm512_mask_i32gather_ps(fill, valid, vidx, source_data, 4);
+            __mmask16 ok = _mm512_mask_cmp_ps_mask(valid, _mm512_abs_ps(v), threshold,
+                                                   _CMP_LT_OQ);
+            out = _mm512_mask_blend_ps(ok, fill, v);
+        }
+        if (stream) _mm512_stream_ps(&target_data[i], out);
+        else _mm512_store_ps(&target_data[i], out);
+    }
+    if (stream) _mm_sfence();
+
+    apply_nearest_cells(regrid, source_data, fill_value, target_data, i, n);
+}
+
+/* Hardware gathers take signed 32-bit offsets */
+static int simd_gather_ok(const USRegrid *regrid) {
+    return regrid->source_n_points <= (size_t)INT32_MAX;
+}
+#endif
+
+static int kernel_supported(RegridApplyKernel kernel) {
+    switch (kernel) {
+        case REGRID_APPLY_AUTO:
+        case REGRID_APPLY_SCALAR:
+            return 1;
+#ifdef REGRID_X86_SIMD
+        case REGRID_APPLY_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case REGRID_APPLY_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return 0;
+    }
+}
+
+int regrid_set_apply_kernel(RegridApplyKernel kernel) {
+    if (!kernel_supported(kernel)) return -1;
+    apply_kernel = kernel;
+    return 0;
+}
+
+/* Kernel for this map: the forced one, else the widest the CPU supports */
+static ApplyNearestFn select_apply_nearest(const USRegrid *regrid) {
+#ifdef REGRID_X86_SIMD
+    if (simd_gather_ok(regrid)) {
+        RegridApplyKernel kernel = apply_kernel;
+        if (kernel == REGRID_APPLY_AUTO) {
+            kernel = kernel_supported(REGRID_APPLY_AVX512) ? REGRID_APPLY_AVX512 :
+                     kernel_supported(REGRID_APPLY_AVX2) ? REGRID_APPLY_AVX2 :
+                     REGRID_APPLY_SCALAR;
+        }
+        if (kernel == REGRID_APPLY_AVX512) return apply_nearest_avx512;
+        if (kernel == REGRID_APPLY_AVX2) return apply_nearest_avx2;
+    }
+#else
+    (void)regrid;
+#endif
+    return apply_nearest_scalar;
 }
 
 void regrid_apply(const USRegrid *regrid, const float *source_data,
                   float fill_value, float *target_data) {
     if (!regrid || !source_data || !target_data) return;
 
-    size_t n_target = regrid->target_nx * regrid->target_ny;
-
-    for (size_t i = 0; i < n_target; i++) {
-        if (regrid->valid_mask[i]) {
-            float value = source_data[regrid->nn_indices[i]];
-            /* Check for source fill value (very large values) */
-            if (fabsf(value) < INVALID_DATA_THRESHOLD) {
-                target_data[i] = value;
-            } else {
-                target_data[i] = fill_value;
-            }
-        } else {
-            target_data[i] = fill_value;
-        }
+    if (regrid->method == REGRID_IDW) {
+        regrid_apply_idw(regrid, source_data, fill_value, target_data);
+        return;
     }
+
+    size_t n_target = regrid->target_nx * regrid->target_ny;
+    select_apply_nearest(regrid)(regrid, source_data, fill_value, target_data, n_target);
 }
 
 void regrid_get_target_dims(const USRegrid *regrid, size_t *nx, size_t *ny) {
@@ -145,8 +655,16 @@ void regrid_get_lonlat(const USRegrid *regrid, size_t ix, size_t iy,
 void regrid_free(USRegrid *regrid) {
     if (!regrid) return;
     kdtree_free(regrid->kdtree);
+    if (regrid->cache_map) {
+        /* Arrays point into the cache file mapping */
+        munmap(regrid->cache_map, regrid->cache_map_size);
+        free(regrid);
+        return;
+    }
     free(regrid->nn_indices);
     free(regrid->nn_distances);
-    free(regrid->valid_mask);
+    free(regrid->valid_bits);
+    free(regrid->idw_indices);
+    free(regrid->idw_weights);
     free(regrid);
 }
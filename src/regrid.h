@@ -18,6 +18,53 @@
  */
 USRegrid *regrid_create(USMesh *mesh, double resolution, double influence_radius_m);
 
+/*
+ * Create regridding structure using inverse-distance weighting.
+ * Each target point blends its n_neighbors nearest source points that lie
+ * within the influence radius, weighted by 1/distance^2.
+ *
+ * n_neighbors: neighbors per target point (1..MAX_IDW_NEIGHBORS)
+ */
+USRegrid *regrid_create_idw(USMesh *mesh, double resolution, double influence_radius_m,
+                            int n_neighbors);
+
+/*
+ * Select how subsequent regrid_create/regrid_create_idw calls query the
+ * KDTree for nearest neighbors. All strategies give identical results and
+ * differ only in build time; the default is REGRID_QUERY_WALK, the
+ * fastest in tests/bench_regrid.
+ */
+void regrid_set_query_strategy(RegridQueryStrategy strategy);
+
+/*
+ * Set the number of threads used by subsequent regrid builds.
+ * Target rows are split into tiles handed out dynamically; the result does
+ * not depend on the thread count. n_threads <= 0 selects one per CPU.
+ */
+void regrid_set_num_threads(int n_threads);
+
+/*
+ * Keep per-cell nearest-neighbor distances (as float) in subsequent builds.
+ * Off by default: nothing after the build reads them.
+ */
+void regrid_set_store_distances(int store);
+
+/*
+ * Force the regrid_apply kernel for nearest-neighbor maps (for testing and
+ * benchmarks). Returns 0 on success, -1 if the CPU or build lacks it.
+ */
+int regrid_set_apply_kernel(RegridApplyKernel kernel);
+
+/* Number of 64-bit words in a validity bitset of n cells */
+#define REGRID_BIT_WORDS(n) (((n) + 63) / 64)
+
+/*
+ * Whether target point idx has a source point within the influence radius.
+ */
+static inline int regrid_cell_valid(const USRegrid *regrid, size_t idx) {
+    return (int)((regrid->valid_bits[idx >> 6] >> (idx & 63)) & 1);
+}
+
 /*
  * Apply regridding to data.
  * source_data: input data [mesh->n_points]
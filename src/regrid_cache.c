@@ -0,0 +1,357 @@
+/*
+ * regrid_cache.c - Persistent on-disk cache of regrid maps
+ *
+ * A cache file holds everything regrid_apply needs (nearest-neighbor
+ * indices, validity bits, IDW taps, distances if kept) plus the target grid
+ * parameters. Files are named by a key derived from a fingerprint of the
+ * mesh coordinates and the regrid parameters, and are mapped read-only on
+ * load, so a repeat launch on the same mesh never builds a KDTree.
+ *
+ * The layout is native (byte order, index width); the header records
+ * enough to reject files written by a different build or machine.
+ */
+
+#include "regrid_cache.h"
+#include "regrid.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REGRID_CACHE_MAGIC    "USRGRID"
+#define REGRID_CACHE_VERSION  2
+
+/* Alignment of each array inside the file */
+#define REGRID_CACHE_ALIGN    64
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t index_size;            /* sizeof(RegridIndex) of the writer */
+    int32_t  method;
+    int32_t  n_neighbors;
+    uint32_t has_distances;         /* nn_distances stored */
+    uint64_t mesh_fingerprint;
+    uint64_t source_n_points;
+    double   resolution;
+    double   influence_radius_m;
+    double   influence_radius_chord;
+    uint64_t target_nx, target_ny;
+    double   lon_min, lon_max, lat_min, lat_max;
+    double   dlon, dlat;
+    uint64_t off_nn_indices;
+    uint64_t off_valid_bits;
+    uint64_t off_nn_distances;      /* 0 unless has_distances */
+    uint64_t off_idw_indices;       /* 0 unless REGRID_IDW */
+    uint64_t off_idw_weights;
+    uint64_t file_size;
+} RegridCacheHeader;
+
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_words(uint64_t h, const double *values, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t w;
+        memcpy(&w, &values[i], sizeof(w));
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+uint64_t regrid_cache_mesh_fingerprint(const USMesh *mesh) {
+    if (!mesh) return 0;
+    uint64_t h = mix64(0x75736877ULL ^ (uint64_t)mesh->n_points);
+    if (mesh->lon) h = hash_words(h, mesh->lon, mesh->n_points);
+    h = mix64(h);
+    if (mesh->lat) h = hash_words(h, mesh->lat, mesh->n_points);
+    return mix64(h);
+}
+
+/* Cache key: mesh fingerprint plus everything that changes the map */
+static uint64_t cache_key(uint64_t fingerprint, size_t n_points, double resolution,
+                          double influence_radius_m, int n_neighbors) {
+    double params[2] = { resolution, influence_radius_m };
+    uint64_t h = mix64(fingerprint ^ (uint64_t)n_points);
+    h = hash_words(h, params, 2);
+    h ^= (uint64_t)(n_neighbors + 1) * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t)REGRID_CACHE_VERSION << 56;
+    return mix64(h);
+}
+
+static int cache_path(char *path, size_t size, const char *cache_dir, uint64_t key) {
+    int n = snprintf(path, size, "%s/regrid-%016llx.bin", cache_dir, (unsigned long long)key);
+    return (n > 0 && (size_t)n < size) ? 0 : -1;
+}
+
+const char *regrid_cache_default_dir(void) {
+    static char dir[4096];
+    const char *env = getenv("USHOW_CACHE_DIR");
+    if (env && env[0]) return env;
+
+    int n = -1;
+    env = getenv("XDG_CACHE_HOME");
+    if (env && env[0]) {
+        n = snprintf(dir, sizeof(dir), "%s/ushow", env);
+    } else if ((env = getenv("HOME")) && env[0]) {
+        n = snprintf(dir, sizeof(dir), "%s/.cache/ushow", env);
+    }
+    return (n > 0 && (size_t)n < sizeof(dir)) ? dir : NULL;
+}
+
+int regrid_cache_make_dir(const char *dir) {
+    char path[4096];
+    size_t len = strlen(dir);
+    if (len == 0 || len >= sizeof(path)) return -1;
+    memcpy(path, dir, len + 1);
+
+    for (char *p = path + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char c = *p;
+            *p = '\0';
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+            *p = c;
+            if (c == '\0') break;
+        }
+    }
+    return 0;
+}
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + REGRID_CACHE_ALIGN - 1) & ~(uint64_t)(REGRID_CACHE_ALIGN - 1);
+}
+
+/* Lay out the arrays after the header; returns the total file size */
+static uint64_t layout_arrays(RegridCacheHeader *hdr) {
+    uint64_t n = hdr->target_nx * hdr->target_ny;
+    uint64_t k = (uint64_t)hdr->n_neighbors;
+    uint64_t off = align_up(sizeof(RegridCacheHeader));
+
+    hdr->off_nn_indices = off;
+    off = align_up(off + n * sizeof(RegridIndex));
+    hdr->off_valid_bits = off;
+    off = align_up(off + REGRID_BIT_WORDS(n) * sizeof(uint64_t));
+    hdr->off_nn_distances = 0;
+    if (hdr->has_distances) {
+        hdr->off_nn_distances = off;
+        off = align_up(off + n * sizeof(float));
+    }
+    hdr->off_idw_indices = 0;
+    hdr->off_idw_weights = 0;
+    if (hdr->method == REGRID_IDW) {
+        hdr->off_idw_indices = off;
+        off = align_up(off + n * k * sizeof(RegridIndex));
+        hdr->off_idw_weights = off;
+        off = align_up(off + n * k * sizeof(float));
+    }
+    return off;
+}
+
+static int write_at(int fd, uint64_t offset, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t w = pwrite(fd, p, size, (off_t)offset);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        offset += (uint64_t)w;
+        size -= (size_t)w;
+    }
+    return 0;
+}
+
+int regrid_cache_save(const USRegrid *regrid, const USMesh *mesh, double resolution,
+                      const char *cache_dir) {
+    if (!regrid || !mesh || !cache_dir || !regrid->nn_indices) return -1;
+    if (regrid->cache_map) return 0;  /* Already backed by a cache file */
+
+    if (regrid_cache_make_dir(cache_dir) != 0) {
+        fprintf(stderr, "Cannot create cache directory %s: %s\n", cache_dir, strerror(errno));
+        return -1;
+    }
+
+    RegridCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REGRID_CACHE_MAGIC, sizeof(REGRID_CACHE_MAGIC));
+    hdr.version = REGRID_CACHE_VERSION;
+    hdr.header_size = sizeof(RegridCacheHeader);
+    hdr.index_size = sizeof(RegridIndex);
+    hdr.method = regrid->method;
+    hdr.n_neighbors = (regrid->method == REGRID_IDW) ? regrid->n_neighbors : 0;
+    hdr.has_distances = (regrid->nn_distances != NULL);
+    hdr.mesh_fingerprint = regrid_cache_mesh_fingerprint(mesh);
+    hdr.source_n_points = mesh->n_points;
+    hdr.resolution = resolution;
+    hdr.influence_radius_m = regrid->influence_radius_meters;
+    hdr.influence_radius_chord = regrid->influence_radius_chord;
+    hdr.target_nx = regrid->target_nx;
+    hdr.target_ny = regrid->target_ny;
+    hdr.lon_min = regrid->target_lon_min;
+    hdr.lon_max = regrid->target_lon_max;
+    hdr.lat_min = regrid->target_lat_min;
+    hdr.lat_max = regrid->target_lat_max;
+    hdr.dlon = regrid->target_dlon;
+    hdr.dlat = regrid->target_dlat;
+    hdr.file_size = layout_arrays(&hdr);
+
+    uint64_t key = cache_key(hdr.mesh_fingerprint, mesh->n_points, resolution,
+                             hdr.influence_radius_m, hdr.n_neighbors);
+    char path[4096], tmp_path[4200];
+    if (cache_path(path, sizeof(path), cache_dir, key) != 0) return -1;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%ld", path, (long)getpid());
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot write regrid cache %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    size_t n = regrid->target_nx * regrid->target_ny;
+    size_t k = (size_t)hdr.n_neighbors;
+    int err = 0;
+    err |= write_at(fd, hdr.off_nn_indices, regrid->nn_indices, n * sizeof(RegridIndex));
+    err |= write_at(fd, hdr.off_valid_bits, regrid->valid_bits,
+                    REGRID_BIT_WORDS(n) * sizeof(uint64_t));
+    if (hdr.has_distances) {
+        err |= write_at(fd, hdr.off_nn_distances, regrid->nn_distances, n * sizeof(float));
+    }
+    if (hdr.method == REGRID_IDW) {
+        err |= write_at(fd, hdr.off_idw_indices, regrid->idw_indices,
+                        n * k * sizeof(RegridIndex));
+        err |= write_at(fd, hdr.off_idw_weights, regrid->idw_weights, n * k * sizeof(float));
+    }
+    if (!err && ftruncate(fd, (off_t)hdr.file_size) != 0) err = -1;
+    /* Header last: a torn write never looks like a valid file */
+    if (!err) err = write_at(fd, 0, &hdr, sizeof(hdr));
+    if (close(fd) != 0) err = -1;
+
+    if (err || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to write regrid cache %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+
+    printf("Saved regrid cache: %s\n", path);
+    return 0;
+}
+
+USRegrid *regrid_cache_load(const USMesh *mesh, double resolution, double influence_radius_m,
+                            int n_neighbors, const char *cache_dir) {
+    if (!mesh || !cache_dir || mesh->n_points == 0) return NULL;
+
+    uint64_t fingerprint = regrid_cache_mesh_fingerprint(mesh);
+    uint64_t key = cache_key(fingerprint, mesh->n_points, resolution,
+                             influence_radius_m, n_neighbors);
+    char path[4096];
+    if (cache_path(path, sizeof(path), cache_dir, key) != 0) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(RegridCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t map_size = (size_t)st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    /* Validate the header against the request and the file size */
+    RegridCacheHeader hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    RegridCacheHeader expect = hdr;
+    int ok = memcmp(hdr.magic, REGRID_CACHE_MAGIC, sizeof(REGRID_CACHE_MAGIC)) == 0 &&
+             hdr.version == REGRID_CACHE_VERSION &&
+             hdr.header_size == sizeof(RegridCacheHeader) &&
+             hdr.index_size == sizeof(RegridIndex) &&
+             hdr.has_distances <= 1 &&
+             hdr.mesh_fingerprint == fingerprint &&
+             hdr.source_n_points == mesh->n_points &&
+             hdr.resolution == resolution &&
+             hdr.influence_radius_m == influence_radius_m &&
+             hdr.n_neighbors == n_neighbors &&
+             hdr.method == ((n_neighbors > 0) ? REGRID_IDW : REGRID_NEAREST) &&
+             hdr.target_nx > 0 && hdr.target_ny > 0 &&
+             hdr.target_nx <= SIZE_MAX / hdr.target_ny &&
+             hdr.file_size == map_size;
+    if (ok) {
+        ok = layout_arrays(&expect) == map_size &&
+             memcmp(&expect, &hdr, sizeof(hdr)) == 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Ignoring stale regrid cache %s\n", path);
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    USRegrid *regrid = calloc(1, sizeof(USRegrid));
+    if (!regrid) {
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    char *base = map;
+    regrid->cache_map = map;
+    regrid->cache_map_size = map_size;
+    regrid->method = (RegridMethod)hdr.method;
+    regrid->n_neighbors = (hdr.method == REGRID_IDW) ? hdr.n_neighbors : 1;
+    regrid->influence_radius_meters = hdr.influence_radius_m;
+    regrid->influence_radius_chord = hdr.influence_radius_chord;
+    regrid->source_n_points = (size_t)hdr.source_n_points;
+    regrid->target_nx = (size_t)hdr.target_nx;
+    regrid->target_ny = (size_t)hdr.target_ny;
+    regrid->target_lon_min = hdr.lon_min;
+    regrid->target_lon_max = hdr.lon_max;
+    regrid->target_lat_min = hdr.lat_min;
+    regrid->target_lat_max = hdr.lat_max;
+    regrid->target_dlon = hdr.dlon;
+    regrid->target_dlat = hdr.dlat;
+    regrid->nn_indices = (RegridIndex *)(base + hdr.off_nn_indices);
+    regrid->valid_bits = (uint64_t *)(base + hdr.off_valid_bits);
+    if (hdr.has_distances) {
+        regrid->nn_distances = (float *)(base + hdr.off_nn_distances);
+    }
+    if (hdr.method == REGRID_IDW) {
+        regrid->idw_indices = (RegridIndex *)(base + hdr.off_idw_indices);
+        regrid->idw_weights = (float *)(base + hdr.off_idw_weights);
+    }
+
+    printf("Loaded regrid cache: %s (%zu x %zu target grid)\n",
+           path, regrid->target_nx, regrid->target_ny);
+    return regrid;
+}
+
+USRegrid *regrid_create_cached(USMesh *mesh, double resolution, double influence_radius_m,
+                               int n_neighbors, const char *cache_dir) {
+    if (cache_dir) {
+        USRegrid *cached = regrid_cache_load(mesh, resolution, influence_radius_m,
+                                             n_neighbors, cache_dir);
+        if (cached) return cached;
+    }
+
+    USRegrid *regrid = (n_neighbors > 0)
+        ? regrid_create_idw(mesh, resolution, influence_radius_m, n_neighbors)
+        : regrid_create(mesh, resolution, influence_radius_m);
+
+    /* A failed save only costs the next launch a rebuild */
+    if (regrid && cache_dir) {
+        regrid_cache_save(regrid, mesh, resolution, cache_dir);
+    }
+    return regrid;
+}
@@ -0,0 +1,56 @@
+/*
+ * regrid_cache.h - Persistent on-disk cache of regrid maps
+ */
+
+#ifndef REGRID_CACHE_H
+#define REGRID_CACHE_H
+
+#include "ushow.defines.h"
+#include <stdint.h>
+
+/*
+ * Default cache directory: $USHOW_CACHE_DIR, else $XDG_CACHE_HOME/ushow,
+ * else $HOME/.cache/ushow. Returns NULL if none can be determined.
+ * The returned string is static and must not be freed.
+ */
+const char *regrid_cache_default_dir(void);
+
+/*
+ * Create dir and any missing parents (mkdir -p), also used for the range
+ * scan sidecars. Returns 0 on success, -1 on error.
+ */
+int regrid_cache_make_dir(const char *dir);
+
+/*
+ * Fingerprint of the mesh coordinates (lon/lat values and point count).
+ */
+uint64_t regrid_cache_mesh_fingerprint(const USMesh *mesh);
+
+/*
+ * Load a regrid map from cache_dir if one was saved for the same mesh and
+ * parameters. The arrays are mapped read-only from the cache file and no
+ * KDTree is built. Returns NULL if there is no usable cache entry.
+ *
+ * n_neighbors: IDW neighbor count, 0 for nearest neighbor
+ */
+USRegrid *regrid_cache_load(const USMesh *mesh, double resolution, double influence_radius_m,
+                            int n_neighbors, const char *cache_dir);
+
+/*
+ * Write a regrid map built for mesh to cache_dir (created if missing).
+ * The file is written under a temporary name and renamed into place.
+ * Returns 0 on success, -1 on error.
+ */
+int regrid_cache_save(const USRegrid *regrid, const USMesh *mesh, double resolution,
+                      const char *cache_dir);
+
+/*
+ * Load a regrid map from cache_dir, or build it and store it there.
+ * cache_dir may be NULL to always build without caching.
+ *
+ * n_neighbors: IDW neighbor count, 0 for nearest neighbor
+ */
+USRegrid *regrid_create_cached(USMesh *mesh, double resolution, double influence_radius_m,
+                               int n_neighbors, const char *cache_dir);
+
+#endif /* REGRID_CACHE_H */
@@ -0,0 +1,226 @@
+/*
+ * slice_cache.c - In-memory LRU cache of decoded data slices
+ *
+ * Entries live in a chained hash table for lookup and on a doubly linked
+ * list in recency order; the tail of the list is evicted first whenever a
+ * new slice would take the cache over its byte budget.
+ */
+
+#include "slice_cache.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+/* Initial number of hash buckets (power of two) */
+#define SLICE_CACHE_MIN_BUCKETS 64
+
+typedef struct SliceEntry {
+    USSliceKey          key;
+    size_t              n;          /* Number of values */
+    struct SliceEntry  *hash_next;  /* Bucket chain */
+    struct SliceEntry  *prev;       /* Towards most recently used */
+    struct SliceEntry  *next;       /* Towards least recently used */
+    float               data[];
+} SliceEntry;
+
+struct USSliceCache {
+    SliceEntry        **buckets;
+    size_t              n_buckets;
+    SliceEntry         *head;       /* Most recently used */
+    SliceEntry         *tail;       /* Least recently used */
+    USSliceCacheStats   stats;
+    pthread_mutex_t     lock;
+};
+
+static size_t entry_bytes(size_t n) {
+    return sizeof(SliceEntry) + n * sizeof(float);
+}
+
+static size_t key_hash(const USSliceKey *key) {
+    /* FNV-1a over the key fields */
+    uint64_t h = 1469598103934665603ULL;
+    uint64_t words[4] = {
+        (uint64_t)(uintptr_t)key->source,
+        (uint64_t)(uintptr_t)key->var,
+        (uint64_t)key->time_index,
+        (uint64_t)key->depth_index
+    };
+    for (int w = 0; w < 4; w++) {
+        for (int b = 0; b < 8; b++) {
+            h ^= (words[w] >> (b * 8)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    }
+    return (size_t)h;
+}
+
+static int key_equal(const USSliceKey *a, const USSliceKey *b) {
+    return a->source == b->source && a->var == b->var &&
+           a->time_index == b->time_index && a->depth_index == b->depth_index;
+}
+
+static SliceEntry **bucket_for(USSliceCache *cache, const USSliceKey *key) {
+    return &cache->buckets[key_hash(key) & (cache->n_buckets - 1)];
+}
+
+static SliceEntry *find_entry(USSliceCache *cache, const USSliceKey *key) {
+    for (SliceEntry *e = *bucket_for(cache, key); e; e = e->hash_next) {
+        if (key_equal(&e->key, key)) return e;
+    }
+    return NULL;
+}
+
+static void lru_unlink(USSliceCache *cache, SliceEntry *e) {
+    if (e->prev) e->prev->next = e->next; else cache->head = e->next;
+    if (e->next) e->next->prev = e->prev; else cache->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(USSliceCache *cache, SliceEntry *e) {
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head) cache->head->prev = e;
+    cache->head = e;
+    if (!cache->tail) cache->tail = e;
+}
+
+/* Remove an entry from both structures and free it */
+static void remove_entry(USSliceCache *cache, SliceEntry *e) {
+    SliceEntry **link = bucket_for(cache, &e->key);
+    while (*link != e) link = &(*link)->hash_next;
+    *link = e->hash_next;
+
+    lru_unlink(cache, e);
+    cache->stats.n_entries--;
+    cache->stats.bytes_used -= entry_bytes(e->n);
+    free(e);
+}
+
+/* Double the bucket count once entries outnumber buckets */
+static void maybe_grow(USSliceCache *cache) {
+    if (cache->stats.n_entries < cache->n_buckets) return;
+
+    size_t n_buckets = cache->n_buckets * 2;
+    SliceEntry **buckets = calloc(n_buckets, sizeof(SliceEntry *));
+    if (!buckets) return;  /* Keep the longer chains */
+
+    for (size_t b = 0; b < cache->n_buckets; b++) {
+        SliceEntry *e = cache->buckets[b];
+        while (e) {
+            SliceEntry *next = e->hash_next;
+            size_t nb = key_hash(&e->key) & (n_buckets - 1);
+            e->hash_next = buckets[nb];
+            buckets[nb] = e;
+            e = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->n_buckets = n_buckets;
+}
+
+USSliceCache *slice_cache_create(size_t budget_bytes) {
+    if (budget_bytes == 0) return NULL;
+
+    USSliceCache *cache = calloc(1, sizeof(USSliceCache));
+    if (!cache) return NULL;
+
+    cache->n_buckets = SLICE_CACHE_MIN_BUCKETS;
+    cache->buckets = calloc(cache->n_buckets, sizeof(SliceEntry *));
+    if (!cache->buckets) {
+        free(cache);
+        return NULL;
+    }
+    cache->stats.budget_bytes = budget_bytes;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+/* Copy out a cached slice and mark it most recently used */
+static int lookup(USSliceCache *cache, const USSliceKey *key, float *out, size_t n,
+                  int counted) {
+    pthread_mutex_lock(&cache->lock);
+    SliceEntry *e = find_entry(cache, key);
+    int hit = (e && e->n == n);
+    if (hit) {
+        if (out) memcpy(out, e->data, n * sizeof(float));
+        lru_unlink(cache, e);
+        lru_push_front(cache, e);
+    }
+    if (counted) {
+        if (hit) cache->stats.hits++; else cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+int slice_cache_get(USSliceCache *cache, const USSliceKey *key, float *out, size_t n) {
+    if (!cache || !key || !out) return 0;
+    return lookup(cache, key, out, n, 1);
+}
+
+int slice_cache_peek(USSliceCache *cache, const USSliceKey *key, float *out, size_t n) {
+    if (!cache || !key) return 0;
+    return lookup(cache, key, out, n, 0);
+}
+
+int slice_cache_put(USSliceCache *cache, const USSliceKey *key, const float *data, size_t n) {
+    if (!cache || !key || !data) return -1;
+
+    size_t bytes = entry_bytes(n);
+    if (bytes > cache->stats.budget_bytes) return -1;
+
+    /* Copy outside the lock so readers are not held up */
+    SliceEntry *e = malloc(bytes);
+    if (!e) return -1;
+    e->key = *key;
+    e->n = n;
+    memcpy(e->data, data, n * sizeof(float));
+
+    pthread_mutex_lock(&cache->lock);
+    SliceEntry *old = find_entry(cache, key);
+    if (old) remove_entry(cache, old);
+
+    while (cache->tail && cache->stats.bytes_used + bytes > cache->stats.budget_bytes) {
+        remove_entry(cache, cache->tail);
+        cache->stats.evictions++;
+    }
+
+    SliceEntry **bucket = bucket_for(cache, key);
+    e->hash_next = *bucket;
+    *bucket = e;
+    lru_push_front(cache, e);
+    cache->stats.n_entries++;
+    cache->stats.bytes_used += bytes;
+
+    maybe_grow(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+void slice_cache_clear(USSliceCache *cache) {
+    if (!cache) return;
+    pthread_mutex_lock(&cache->lock);
+    while (cache->head) remove_entry(cache, cache->head);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void slice_cache_get_stats(USSliceCache *cache, USSliceCacheStats *stats) {
+    if (!stats) return;
+    if (!cache) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void slice_cache_free(USSliceCache *cache) {
+    if (!cache) return;
+    slice_cache_clear(cache);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
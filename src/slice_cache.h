@@ -0,0 +1,82 @@
+/*
+ * slice_cache.h - In-memory LRU cache of decoded data slices
+ *
+ * All functions are safe to call concurrently from several threads.
+ */
+
+#ifndef SLICE_CACHE_H
+#define SLICE_CACHE_H
+
+#include "ushow.defines.h"
+
+/* Identifies one 2D slice of a variable */
+typedef struct {
+    const void  *source;        /* USFile or USFileSet the slice is read from */
+    const USVar *var;
+    size_t       time_index;    /* Virtual time index if source is a fileset */
+    size_t       depth_index;
+} USSliceKey;
+
+/* Key of a slice read through fileset if non-NULL, else var's own file */
+static inline USSliceKey slice_key_make(const USVar *var, const USFileSet *fileset,
+                                        size_t time_index, size_t depth_index) {
+    USSliceKey key;
+    key.source = fileset ? (const void *)fileset : (const void *)var->file;
+    key.var = var;
+    key.time_index = time_index;
+    key.depth_index = depth_index;
+    return key;
+}
+
+/* Cache counters */
+typedef struct {
+    size_t      hits;
+    size_t      misses;
+    size_t      evictions;
+    size_t      n_entries;
+    size_t      bytes_used;
+    size_t      budget_bytes;
+} USSliceCacheStats;
+
+/*
+ * Create a cache holding at most budget_bytes of slice data.
+ * Returns NULL on allocation failure or if budget_bytes is 0.
+ */
+USSliceCache *slice_cache_create(size_t budget_bytes);
+
+/*
+ * Copy the slice for key into out if it is cached and has n values.
+ * Marks the entry most recently used.
+ * Returns 1 on a hit, 0 on a miss.
+ */
+int slice_cache_get(USSliceCache *cache, const USSliceKey *key, float *out, size_t n);
+
+/*
+ * As slice_cache_get(), but without counting a hit or miss (for lookups
+ * that are not user requests). out may be NULL to only test presence.
+ */
+int slice_cache_peek(USSliceCache *cache, const USSliceKey *key, float *out, size_t n);
+
+/*
+ * Store a copy of an n-value slice under key, evicting least recently used
+ * entries to stay within the budget. Replaces any existing entry for key.
+ * Returns 0 on success, -1 if the slice could not be stored.
+ */
+int slice_cache_put(USSliceCache *cache, const USSliceKey *key, const float *data, size_t n);
+
+/*
+ * Drop all cached slices. Counters are kept.
+ */
+void slice_cache_clear(USSliceCache *cache);
+
+/*
+ * Read the hit/miss counters and current occupancy.
+ */
+void slice_cache_get_stats(USSliceCache *cache, USSliceCacheStats *stats);
+
+/*
+ * Free the cache and all cached slices.
+ */
+void slice_cache_free(USSliceCache *cache);
+
+#endif /* SLICE_CACHE_H */
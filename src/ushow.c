@@ -7,6 +7,10 @@
 #include "ushow.defines.h"
 #include "mesh.h"
 #include "regrid.h"
+#include "regrid_cache.h"
+#include "slice_cache.h"
+#include "prefetch.h"
+#include "anim_pipeline.h"
 #include "file_netcdf.h"
 #ifdef HAVE_ZARR
 #include "file_zarr.h"
@@ -15,6 +19,7 @@
 #include "file_grib.h"
 #endif
 #include "colormaps.h"
+#include "frame_stats.h"
 #include "view.h"
 #include "interface/x_interface.h"
 
@@ -33,6 +38,9 @@ static USFileSet *zarr_fileset = NULL;  /* Multi-file zarr set */
 static USMesh *mesh = NULL;
 static USRegrid *regrid = NULL;
 static USView *view = NULL;
+static USSliceCache *slice_cache = NULL;
+static USPrefetcher *prefetcher = NULL;
+static USAnimPipeline *anim = NULL;
 static USVar *variables = NULL;
 static USVar *current_var = NULL;
 static int n_variables = 0;
@@ -45,7 +53,9 @@ static USOptions options = {
     .debug = 0,
     .influence_radius = DEFAULT_INFLUENCE_RADIUS_M,
     .target_resolution = DEFAULT_RESOLUTION,
-    .frame_delay_ms = 200
+    .frame_delay_ms = 200,
+    .slice_cache_mb = DEFAULT_SLICE_CACHE_MB,
+    .prefetch_slices = DEFAULT_PREFETCH_SLICES
 };
 
 /* Forward declarations */
@@ -56,6 +66,25 @@ static void update_dim_label(void);
 static int format_time_from_units(char *out, size_t outlen, double value, const char *units);
 static void on_mouse_click(int px, int py);
 
+/*
+ * Stop pipelined playback and report its per-stage statistics. Called
+ * before every change to the view, so no worker still reads state the
+ * change frees; animation_tick() starts a new pipeline on the next frame.
+ */
+static void stop_pipeline(void) {
+    if (!anim) return;
+
+    AnimStats st;
+    anim_pipeline_get_stats(anim, &st);
+    if (st.frames_shown > 0) {
+        char line[512];
+        anim_pipeline_format_stats(&st, line, sizeof(line));
+        printf("Animation pipeline: %s\n", line);
+    }
+    anim_pipeline_free(anim);
+    anim = NULL;
+}
+
 /* Callbacks */
 static void on_var_select(int var_index) {
     /* Find variable by index */
@@ -67,6 +96,7 @@ static void on_var_select(int var_index) {
 
     USVar *prev_var = current_var;
     current_var = var;
+    stop_pipeline();
     view_set_variable(view, var, mesh, regrid);
 
     /* Update UI */
@@ -87,6 +117,7 @@ static void on_var_select(int var_index) {
         }
     }
     /* Use fileset dimension info if available (includes virtual time) */
+    prefetch_pause(prefetcher);
 #ifdef HAVE_ZARR
     if (zarr_fileset) {
         current_dim_info = zarr_get_dim_info_fileset(zarr_fileset, var, &n_current_dims);
@@ -106,6 +137,7 @@ static void on_var_select(int var_index) {
     } else {
         current_dim_info = netcdf_get_dim_info(var, &n_current_dims);
     }
+    prefetch_resume(prefetcher);
     if (!current_dim_info || n_current_dims == 0) {
         int count = 0;
         if (var->time_dim_id >= 0) count++;
@@ -148,6 +180,7 @@ static void on_var_select(int var_index) {
 
 static void on_time_change(size_t time_idx) {
     if (!view || !current_var) return;
+    stop_pipeline();
     view_set_time(view, time_idx);
     x_update_time(view->time_index, view->n_times);
     update_dim_info_current();
@@ -157,6 +190,7 @@ static void on_time_change(size_t time_idx) {
 
 static void on_depth_change(size_t depth_idx) {
     if (!view || !current_var) return;
+    stop_pipeline();
     view_set_depth(view, depth_idx);
     x_update_depth(view->depth_index, view->n_depths);
     update_dim_info_current();
@@ -165,6 +199,10 @@ static void on_depth_change(size_t depth_idx) {
 }
 
 static void on_animation(int direction) {
+    if (direction != 2) {
+        stop_pipeline();
+    }
+
     if (direction == 0) {
         /* Pause */
         animating = 0;
@@ -212,7 +250,9 @@ static void on_colormap_change(void) {
     colormap_next();
     USColormap *cmap = colormap_get_current();
     if (cmap) {
+        stop_pipeline();
         x_update_colormap_label(cmap->name);
+        view_invalidate(view, VIEW_DIRTY_COLOR);
         update_display();
     }
 }
@@ -221,7 +261,9 @@ static void on_colormap_back(void) {
     colormap_prev();
     USColormap *cmap = colormap_get_current();
     if (cmap) {
+        stop_pipeline();
         x_update_colormap_label(cmap->name);
+        view_invalidate(view, VIEW_DIRTY_COLOR);
         update_display();
     }
 }
@@ -243,8 +285,7 @@ static void on_mouse_motion(int px, int py) {
     regrid_get_lonlat(view->regrid, data_x, src_y, &lon, &lat);
 
     /* Get data value */
-    size_t idx = src_y * view->data_nx + data_x;
-    float value = view->regridded_data[idx];
+    float value = view_get_value(view, data_x, src_y);
 
     /* Update display */
     x_update_value_label(lon, lat, value);
@@ -252,6 +293,7 @@ static void on_mouse_motion(int px, int py) {
 
 static void on_mouse_click(int px, int py) {
     if (!view || !view->regrid || !view->regridded_data || !current_var) return;
+    stop_pipeline();
 
     /* Polygon-only mode: no regrid → no pixel-to-node mapping */
     if (view->render_mode == RENDER_MODE_POLYGON) {
@@ -275,12 +317,12 @@ static void on_mouse_click(int px, int py) {
     /* Flip Y for display */
     size_t src_y = view->data_ny - 1 - data_y;
 
-    /* Check valid mask */
+    /* Check validity bit */
     size_t grid_idx = src_y * view->data_nx + data_x;
-    if (!view->regrid->valid_mask[grid_idx]) return;
+    if (!regrid_cell_valid(view->regrid, grid_idx)) return;
 
     /* Get source mesh node index from nn_indices */
-    size_t node_idx = view->regrid->nn_indices[grid_idx];
+    size_t node_idx = (size_t)view->regrid->nn_indices[grid_idx];
 
     /* Get lon/lat for display */
     double lon, lat;
@@ -295,6 +337,7 @@ static void on_mouse_click(int px, int py) {
     size_t n_out = 0;
     int rc;
 
+    prefetch_pause(prefetcher);
 #ifdef HAVE_ZARR
     if (zarr_fileset) {
         rc = zarr_read_timeseries_fileset(zarr_fileset, current_var, node_idx,
@@ -320,6 +363,7 @@ static void on_mouse_click(int px, int py) {
         rc = netcdf_read_timeseries(current_var, node_idx, view->depth_index,
                                     &times, &values, &valid, &n_out);
     }
+    prefetch_resume(prefetcher);
 
     if (rc != 0 || n_out == 0) {
         printf("Failed to read time series\n");
@@ -387,8 +431,27 @@ static void on_mouse_click(int px, int py) {
     free(valid);
 }
 
+/* Autoscale button labels, off and on */
+static const char *const autoscale_labels[2] = { "Fixed", "2-98%" };
+
+static void set_autoscale(int enabled) {
+    stop_pipeline();
+    view_set_autoscale(view, enabled);
+    x_update_autoscale_label(autoscale_labels[view->autoscale]);
+}
+
+static void on_autoscale_toggle(void) {
+    if (!view) return;
+    set_autoscale(!view->autoscale);
+    printf("Range: %s\n", view->autoscale ? "per-frame 2-98 percentile" : "fixed");
+    update_display();
+}
+
 static void on_range_adjust(int action) {
     if (!current_var) return;
+    stop_pipeline();
+    /* A range set by hand stays put */
+    if (view->autoscale) set_autoscale(0);
 
     float range = current_var->user_max - current_var->user_min;
     float step = range * 0.1f;  /* 10% adjustment */
@@ -416,6 +479,7 @@ static void on_range_adjust(int action) {
     }
 
     x_update_range_label(current_var->user_min, current_var->user_max);
+    view_invalidate(view, VIEW_DIRTY_COLOR);
     update_display();
 }
 
@@ -423,6 +487,7 @@ static void on_zoom(int delta) {
     if (!view) return;
 
     int new_scale = view->scale_factor + delta;
+    stop_pipeline();
     if (view_set_scale(view, new_scale) == 0) {
         printf("Zoom: %dx\n", view->scale_factor);
         update_display();
@@ -455,13 +520,54 @@ static void on_range_button(void) {
         &new_min, &new_max);
 
     if (result == 1) {  /* RANGE_POPUP_OK */
+        stop_pipeline();
+        if (view->autoscale) set_autoscale(0);
         current_var->user_min = new_min;
         current_var->user_max = new_max;
         x_update_range_label(current_var->user_min, current_var->user_max);
+        view_invalidate(view, VIEW_DIRTY_COLOR);
         update_display();
     }
 }
 
+static void on_load_animation(void) {
+    if (!view) return;
+
+    /* Playback resumes from the store once the load is done */
+    int was_animating = animating;
+    on_animation(0);
+    view_load_animation(view, options.anim_store);
+    if (was_animating) on_animation(2);
+}
+
+/* Show range scan progress as it arrives */
+static void on_range_poll(void) {
+    unsigned long generation = view ? view->generation : 0;
+    if (!view_poll_range(view) || !current_var) return;
+    if (view->generation != generation) stop_pipeline();
+    x_update_range_label(current_var->user_min, current_var->user_max);
+    if (!animating) update_display();
+}
+
+/* Norm button labels, by ColorNormMode */
+static const char *const norm_labels[COLOR_NORM_COUNT] = {
+    "Linear", "Log", "Symlog", "Gamma", "HistEq"
+};
+
+static void on_norm_cycle(void) {
+    if (!view) return;
+    USColorNorm norm = view->color_norm;
+    norm.mode = (ColorNormMode)((norm.mode + 1) % COLOR_NORM_COUNT);
+    stop_pipeline();
+    view_set_color_norm(view, &norm);
+    x_update_norm_label(norm_labels[norm.mode]);
+    printf("Colour norm: %s\n", colormap_norm_name(norm.mode));
+    if (view->render_mode == RENDER_MODE_POLYGON) {
+        printf("Polygon mode scales linearly; the norm applies in interpolate mode\n");
+    }
+    update_display();
+}
+
 static void on_render_mode_toggle(void) {
     if (!view) return;
     
@@ -471,6 +577,7 @@ static void on_render_mode_toggle(void) {
         return;
     }
     
+    stop_pipeline();
     int result = view_toggle_render_mode(view);
     if (result >= 0) {
         const char *mode_name = (result == RENDER_MODE_POLYGON) ? "Polygon" : "Interp";
@@ -688,6 +795,7 @@ static void on_dim_nav(int dim_index, int direction) {
     if (dim_index < 0 || dim_index >= n_current_dims) return;
 
     USDimInfo *di = &current_dim_info[dim_index];
+    stop_pipeline();
 
     /* Determine which dimension this is and navigate it */
     if (current_var->time_dim_id >= 0 &&
@@ -718,15 +826,33 @@ static void on_dim_nav(int dim_index, int direction) {
 static void animation_tick(void) {
     if (!animating || !view) return;
 
-    int result = view_step_time(view, 1);
-    if (result < 0) {
-        /* Reached end, loop back to start */
-        view_set_time(view, 0);
+    /* Read, regrid and colour on worker threads; this thread only blits */
+    if (!anim && !options.no_pipeline) {
+        anim = anim_pipeline_create(view, ANIM_PIPELINE_FRAMES);
+    }
+    int shown = 0;
+    if (anim) {
+        shown = anim_pipeline_next(anim, view);
+        if (shown < 0) {
+            /* View changed under the pipeline: step directly, restart next tick */
+            stop_pipeline();
+        }
     }
 
-    x_update_time(view->time_index, view->n_times);
-    update_dim_label();
-    update_display();
+    if (!anim) {
+        int result = view_step_time(view, 1);
+        if (result < 0) {
+            /* Reached end, loop back to start */
+            view_set_time(view, 0);
+        }
+        shown = 1;
+    }
+
+    if (shown > 0) {
+        x_update_time(view->time_index, view->n_times);
+        update_dim_label();
+        update_display();
+    }
 
     /* Schedule next tick */
     if (animating) {
@@ -739,18 +865,48 @@ static void update_display(void) {
 
     view_update(view);
 
+    char stats[128];
+    frame_stats_format(view_get_stats(view), stats, sizeof(stats));
+    x_update_stats_label(stats);
+    if (view->autoscale && current_var) {
+        x_update_range_label(current_var->user_min, current_var->user_max);
+    }
+
     size_t width, height;
-    unsigned char *pixels = view_get_pixels(view, &width, &height);
-    if (pixels) {
-        x_update_image(pixels, width, height);
+    const void *native = view_get_native_pixels(view, &width, &height);
+    unsigned char *pixels = native ? NULL : view_get_pixels(view, &width, &height);
+    if (native || pixels) {
+        if (native) {
+            x_update_image_native(native, view->native_format, width, height);
+        } else {
+            x_update_image(pixels, width, height);
+        }
 
-        /* Update colorbar (256 pixels wide, horizontal) */
+        /* Update colorbar (256 pixels wide, horizontal), labelled through the norm */
         if (current_var) {
+            float labels[X_COLORBAR_LABELS];
+            for (int i = 0; i < X_COLORBAR_LABELS; i++) {
+                labels[i] = view_color_value(view, (float)i / (X_COLORBAR_LABELS - 1));
+            }
+            x_set_colorbar_labels(labels);
             x_update_colorbar(current_var->user_min, current_var->user_max, 256);
         }
     }
 }
 
+/* Print slice cache effectiveness on exit */
+static void report_slice_cache(void) {
+    if (!slice_cache) return;
+    USSliceCacheStats st;
+    slice_cache_get_stats(slice_cache, &st);
+    printf("Slice cache: %zu hits, %zu misses, %zu evictions (%zu slices, %.1f of %.1f MB)\n",
+           st.hits, st.misses, st.evictions, st.n_entries,
+           st.bytes_used / 1048576.0, st.budget_bytes / 1048576.0);
+    if (prefetcher) {
+        printf("Prefetched %zu slices\n", prefetch_get_count(prefetcher));
+    }
+}
+
 static void print_usage(const char *prog) {
     fprintf(stderr, "Usage: %s [options] <data_file.nc|data.grib|data.zarr> [file2 ...]\n\n", prog);
     fprintf(stderr, "Multi-file: Files are concatenated along time dimension.\n");
@@ -759,8 +915,27 @@ static void print_usage(const char *prog) {
     fprintf(stderr, "  -m, --mesh <file>      Mesh file with coordinates\n");
     fprintf(stderr, "  -r, --resolution <deg> Target grid resolution (default: 1.0)\n");
     fprintf(stderr, "  -i, --influence <m>    Influence radius in meters (default: 200000)\n");
+    fprintf(stderr, "  -k, --idw <n>          Inverse-distance weighting of n neighbors (default: nearest)\n");
     fprintf(stderr, "  -d, --delay <ms>       Animation frame delay (default: 200)\n");
     fprintf(stderr, "  -p, --polygon-only     Skip regridding, use polygon mode only (faster)\n");
+    fprintf(stderr, "      --cache-dir <dir>  Regrid cache directory (default: ~/.cache/ushow)\n");
+    fprintf(stderr, "      --no-cache         Always rebuild the regrid map\n");
+    fprintf(stderr, "      --cache-mb <n>     Memory for revisited time steps (default: %d, 0 = off)\n",
+            DEFAULT_SLICE_CACHE_MB);
+    fprintf(stderr, "      --prefetch <n>     Slices to read ahead while stepping (default: %d, 0 = off)\n",
+            DEFAULT_PREFETCH_SLICES);
+    fprintf(stderr, "      --no-pipeline      Animate without the threaded read/regrid/colour pipeline\n");
+    fprintf(stderr, "      --no-fused         Always colourise through the RGB buffer\n");
+    fprintf(stderr, "      --poly-lod <mode>  Sub-pixel elements in polygon mode: mean, dominant (default: mean)\n");
+    fprintf(stderr, "      --poly-shading <s> Polygon colouring: flat, smooth (default: flat)\n");
+    fprintf(stderr, "      --anim-store <m>   Compression for Load: lossless, u16 (default: lossless)\n");
+    fprintf(stderr, "      --no-range-scan    Keep the sampled range estimate instead of scanning all slices\n");
+    fprintf(stderr, "      --norm <mode>      Colour scaling: linear, log, symlog, gamma, histeq (default: linear)\n");
+    fprintf(stderr, "      --gamma <g>        Exponent of the gamma norm (default: %g)\n",
+            (double)COLOR_NORM_DEFAULT_GAMMA);
+    fprintf(stderr, "      --linthresh <v>    Linear half-width of the symlog norm (default: 1e-3 of max |limit|)\n");
+    fprintf(stderr, "      --autoscale        Set the range to each frame's 2-98 percentiles\n");
+    fprintf(stderr, "      --no-shm           Send images over the X connection, not MIT-SHM\n");
     fprintf(stderr, "  -h, --help             Show this help\n");
     fprintf(stderr, "\nExamples:\n");
     fprintf(stderr, "  %s data.nc                           # Single file\n", prog);
@@ -779,14 +954,30 @@ int main(int argc, char *argv[]) {
         {"mesh",         required_argument, 0, 'm'},
         {"resolution",   required_argument, 0, 'r'},
         {"influence",    required_argument, 0, 'i'},
+        {"idw",          required_argument, 0, 'k'},
         {"delay",        required_argument, 0, 'd'},
         {"polygon-only", no_argument,       0, 'p'},
+        {"cache-dir",    required_argument, 0, 1000},
+        {"no-cache",     no_argument,       0, 1001},
+        {"cache-mb",     required_argument, 0, 1002},
+        {"prefetch",     required_argument, 0, 1003},
+        {"no-pipeline",  no_argument,       0, 1004},
+        {"no-fused",     no_argument,       0, 1005},
+        {"poly-lod",     required_argument, 0, 1006},
+        {"poly-shading", required_argument, 0, 1007},
+        {"anim-store",   required_argument, 0, 1008},
+        {"no-range-scan", no_argument,      0, 1009},
+        {"norm",         required_argument, 0, 1010},
+        {"gamma",        required_argument, 0, 1011},
+        {"linthresh",    required_argument, 0, 1012},
+        {"autoscale",    no_argument,       0, 1013},
+        {"no-shm",       no_argument,       0, 1014},
         {"help",         no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "m:r:i:d:ph", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "m:r:i:k:d:ph", long_options, NULL)) != -1) {
         switch (opt) {
             case 'm':
                 mesh_filename = optarg;
@@ -798,12 +989,104 @@ int main(int argc, char *argv[]) {
             case 'i':
                 options.influence_radius = atof(optarg);
                 break;
+            case 'k':
+                options.idw_neighbors = atoi(optarg);
+                if (options.idw_neighbors < 0 || options.idw_neighbors > MAX_IDW_NEIGHBORS) {
+                    fprintf(stderr, "Error: --idw must be between 0 and %d\n", MAX_IDW_NEIGHBORS);
+                    return 1;
+                }
+                break;
             case 'd':
                 options.frame_delay_ms = atoi(optarg);
                 break;
             case 'p':
                 options.polygon_only = 1;
                 break;
+            case 1000:
+                strncpy(options.cache_dir, optarg, MAX_NAME_LEN - 1);
+                break;
+            case 1001:
+                options.no_cache = 1;
+                break;
+            case 1002:
+                options.slice_cache_mb = atoi(optarg);
+                if (options.slice_cache_mb < 0) {
+                    fprintf(stderr, "Error: --cache-mb must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 1003:
+                options.prefetch_slices = atoi(optarg);
+                if (options.prefetch_slices < 0) {
+                    fprintf(stderr, "Error: --prefetch must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 1004:
+                options.no_pipeline = 1;
+                break;
+            case 1005:
+                options.no_fused = 1;
+                break;
+            case 1006:
+                if (strcmp(optarg, "mean") == 0) {
+                    options.poly_lod = POLY_LOD_MEAN;
+                } else if (strcmp(optarg, "dominant") == 0) {
+                    options.poly_lod = POLY_LOD_DOMINANT;
+                } else {
+                    fprintf(stderr, "Error: --poly-lod must be mean or dominant\n");
+                    return 1;
+                }
+                break;
+            case 1007:
+                if (strcmp(optarg, "flat") == 0) {
+                    options.poly_shading = POLY_SHADE_FLAT;
+                } else if (strcmp(optarg, "smooth") == 0) {
+                    options.poly_shading = POLY_SHADE_SMOOTH;
+                } else {
+                    fprintf(stderr, "Error: --poly-shading must be flat or smooth\n");
+                    return 1;
+                }
+                break;
+            case 1008:
+                if (strcmp(optarg, "lossless") == 0) {
+                    options.anim_store = ANIM_STORE_LOSSLESS;
+                } else if (strcmp(optarg, "u16") == 0) {
+                    options.anim_store = ANIM_STORE_U16;
+                } else {
+                    fprintf(stderr, "Error: --anim-store must be lossless or u16\n");
+                    return 1;
+                }
+                break;
+            case 1009:
+                options.no_range_scan = 1;
+                break;
+            case 1010:
+                if (colormap_norm_parse(optarg, &options.color_norm.mode) != 0) {
+                    fprintf(stderr, "Error: --norm must be linear, log, symlog, gamma or histeq\n");
+                    return 1;
+                }
+                break;
+            case 1011:
+                options.color_norm.gamma = (float)atof(optarg);
+                if (!(options.color_norm.gamma > 0.0f)) {
+                    fprintf(stderr, "Error: --gamma must be positive\n");
+                    return 1;
+                }
+                break;
+            case 1012:
+                options.color_norm.linthresh = (float)atof(optarg);
+                if (!(options.color_norm.linthresh > 0.0f)) {
+                    fprintf(stderr, "Error: --linthresh must be positive\n");
+                    return 1;
+                }
+                break;
+            case 1013:
+                options.autoscale = 1;
+                break;
+            case 1014:
+                options.no_shm = 1;
+                break;
             case 'h':
             default:
                 print_usage(argv[0]);
@@ -851,6 +1134,9 @@ int main(int argc, char *argv[]) {
     if (mesh_filename) printf("Mesh file: %s\n", mesh_filename);
     printf("Resolution: %.2f degrees\n", options.target_resolution);
     printf("Influence radius: %.0f m\n", options.influence_radius);
+    if (options.idw_neighbors > 0) {
+        printf("Interpolation: inverse-distance weighting (%d neighbors)\n", options.idw_neighbors);
+    }
     printf("\n");
 
     /* Initialize colormaps */
@@ -1044,7 +1330,12 @@ int main(int argc, char *argv[]) {
     /* Create regridding structure (skip if polygon-only mode) */
     if (!options.polygon_only) {
         printf("Creating regrid structure...\n");
-        regrid = regrid_create(mesh, options.target_resolution, options.influence_radius);
+        const char *cache_dir = NULL;
+        if (!options.no_cache) {
+            cache_dir = options.cache_dir[0] ? options.cache_dir : regrid_cache_default_dir();
+        }
+        regrid = regrid_create_cached(mesh, options.target_resolution, options.influence_radius,
+                                      options.idw_neighbors, cache_dir);
         if (!regrid) {
             fprintf(stderr, "Failed to create regrid\n");
             mesh_free(mesh);
@@ -1240,8 +1531,11 @@ int main(int argc, char *argv[]) {
     x_set_range_callback(on_range_adjust);
     x_set_zoom_callback(on_zoom);
     x_set_save_callback(on_save);
+    x_set_load_callback(on_load_animation);
     x_set_dim_nav_callback(on_dim_nav);
     x_set_render_mode_callback(on_render_mode_toggle);
+    x_set_norm_callback(on_norm_cycle);
+    x_set_autoscale_callback(on_autoscale_toggle);
     x_set_range_button_callback(on_range_button);
     x_set_mouse_click_callback(on_mouse_click);
 
@@ -1258,6 +1552,46 @@ int main(int argc, char *argv[]) {
     }
 #endif
 
+    /* Keep decoded slices for revisiting time steps */
+    if (options.slice_cache_mb > 0) {
+        slice_cache = slice_cache_create((size_t)options.slice_cache_mb << 20);
+        view_set_slice_cache(view, slice_cache);
+    }
+
+    /*
+     * Read ahead into the slice cache so playback is not bound by I/O; the
+     * same worker scans for exact data ranges when idle
+     */
+    if ((slice_cache && options.prefetch_slices > 0) || !options.no_range_scan) {
+        prefetcher = prefetch_create(slice_cache, options.prefetch_slices);
+        view_set_prefetcher(view, prefetcher);
+    }
+    if (!options.no_range_scan) {
+        const char *cache_dir = NULL;
+        if (!options.no_cache) {
+            cache_dir = options.cache_dir[0] ? options.cache_dir : regrid_cache_default_dir();
+        }
+        view_set_range_scan(view, 1, cache_dir);
+        x_set_poll(500, on_range_poll);
+    }
+
+    /* Colourise straight into display pixels where the visual allows it,
+     * in shared memory the server reads without a copy */
+    if (options.no_shm) {
+        x_set_shm(0);
+    } else {
+        view_set_pixel_allocator(view, x_alloc_pixels, x_free_pixels);
+    }
+    if (!options.no_fused) {
+        view_set_native_format(view, x_get_pixel_format());
+    }
+
+    view->poly_lod_mode = options.poly_lod;
+    view->poly_shading = options.poly_shading;
+    view_set_color_norm(view, &options.color_norm);
+    x_update_norm_label(norm_labels[options.color_norm.mode]);
+    set_autoscale(options.autoscale);
+
     /* Set polygon-only mode if requested */
     if (options.polygon_only) {
         view->render_mode = RENDER_MODE_POLYGON;
@@ -1292,7 +1626,11 @@ int main(int argc, char *argv[]) {
             netcdf_free_dim_info(current_dim_info, n_current_dims);
         }
     }
+    stop_pipeline();
+    report_slice_cache();
+    prefetch_free(prefetcher);
     view_free(view);
+    slice_cache_free(slice_cache);
     regrid_free(regrid);
     mesh_free(mesh);
 #ifdef HAVE_GRIB
@@ -8,6 +8,7 @@
 #define USHOW_DEFINES_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 /* Constants */
 #define EARTH_RADIUS_M      6371000.0
@@ -22,6 +23,15 @@
 /* Default influence radius for interpolation (meters) */
 #define DEFAULT_INFLUENCE_RADIUS_M  200000.0  /* 200 km */
 
+/* Maximum neighbors per target point for inverse-distance weighting */
+#define MAX_IDW_NEIGHBORS   16
+
+/* Default memory budget for decoded slices kept for revisiting (MB) */
+#define DEFAULT_SLICE_CACHE_MB  256
+
+/* Default number of slices read ahead of the current one */
+#define DEFAULT_PREFETCH_SLICES 4
+
 /* Fill value for missing data */
 #define DEFAULT_FILL_VALUE  1.0e20f
 
@@ -60,6 +70,14 @@ typedef struct USFileSet USFileSet;
 typedef struct USMesh USMesh;
 typedef struct USRegrid USRegrid;
 typedef struct USView USView;
+typedef struct USSliceCache USSliceCache;
+typedef struct USPrefetcher USPrefetcher;
+typedef struct USAnimStore USAnimStore;
+typedef struct USRangeScan USRangeScan;
+typedef struct USAnimPipeline USAnimPipeline;
+typedef struct USPolyCoverage USPolyCoverage;
+typedef struct USPolyLod USPolyLod;
+typedef struct USFrameStats USFrameStats;
 typedef struct KDTree KDTree;
 
 /* Mesh/coordinate structure - unified coordinate system */
@@ -90,6 +108,39 @@ struct USMesh {
     char       *lat_varname;
 };
 
+/*
+ * Source point index stored in regrid tables. 32 bits cover every mesh
+ * below 2^32 points; build with -DREGRID_WIDE_INDEX for larger ones.
+ */
+#ifdef REGRID_WIDE_INDEX
+typedef uint64_t RegridIndex;
+#define REGRID_INDEX_MAX UINT64_MAX
+#else
+typedef uint32_t RegridIndex;
+#define REGRID_INDEX_MAX UINT32_MAX
+#endif
+
+/* Regridding method */
+typedef enum {
+    REGRID_NEAREST = 0,             /* Default: nearest source point */
+    REGRID_IDW                      /* Inverse-distance weighting of k neighbors */
+} RegridMethod;
+
+/* How regrid_create finds each target cell's nearest source point */
+typedef enum {
+    REGRID_QUERY_BATCH = 0,         /* Morton-ordered batches of rows */
+    REGRID_QUERY_WALK,              /* Default: row sweeps seeded by the neighbouring cell */
+    REGRID_QUERY_COLD               /* Independent bounded query per cell */
+} RegridQueryStrategy;
+
+/* Kernel used by regrid_apply for nearest-neighbor maps */
+typedef enum {
+    REGRID_APPLY_AUTO = 0,          /* Default: widest kernel the CPU supports */
+    REGRID_APPLY_SCALAR,
+    REGRID_APPLY_AVX2,              /* 8-lane masked gather */
+    REGRID_APPLY_AVX512             /* 16-lane masked gather */
+} RegridApplyKernel;
+
 /* KDTree regridding structure */
 struct USRegrid {
     /* KDTree handle */
@@ -102,9 +153,16 @@ struct USRegrid {
     double      target_dlon, target_dlat;
 
     /* Precomputed interpolation indices */
-    size_t     *nn_indices;         /* Nearest neighbor index for each target point */
-    double     *nn_distances;       /* Distance to nearest neighbor (chord units) */
-    unsigned char *valid_mask;      /* 1 if point is valid, 0 otherwise */
+    RegridIndex *nn_indices;        /* Nearest neighbor index for each target point */
+    uint64_t   *valid_bits;         /* Bit i set if target point i is valid [ceil(n/64)] */
+    float      *nn_distances;       /* Distance to nearest neighbor (chord units, FLT_MAX
+                                       if none in radius); NULL unless requested */
+
+    /* Inverse-distance weighting (REGRID_IDW only) */
+    RegridMethod method;
+    int         n_neighbors;        /* Neighbors per target point (k) */
+    RegridIndex *idw_indices;       /* Source indices [n_target * k] */
+    float      *idw_weights;        /* Normalized weights [n_target * k], 0 = unused */
 
     /* Influence radius (chord distance on unit sphere) */
     double      influence_radius_chord;
@@ -112,6 +170,10 @@ struct USRegrid {
 
     /* Source mesh reference */
     size_t      source_n_points;
+
+    /* Read-only mapping of a regrid cache file backing the arrays (NULL if heap) */
+    void       *cache_map;
+    size_t      cache_map_size;
 };
 
 /* Variable structure */
@@ -138,6 +200,7 @@ struct USVar {
     float       user_min, user_max;
     float       fill_value;
     int         range_set;
+    int         range_exact;        /* global_min/max cover every slice */
 
     /* File association */
     USFile     *file;
@@ -200,21 +263,129 @@ typedef enum {
     RENDER_MODE_POLYGON             /* Render actual mesh polygons */
 } RenderMode;
 
+/* How polygon mode shows elements smaller than a display pixel */
+typedef enum {
+    POLY_LOD_MEAN = 0,              /* Default: mean of the elements in the pixel */
+    POLY_LOD_DOMINANT               /* Largest element in the pixel */
+} PolyLodMode;
+
+/* How polygon mode colours the inside of an element */
+typedef enum {
+    POLY_SHADE_FLAT = 0,            /* Default: mean of the element's node values */
+    POLY_SHADE_SMOOTH               /* Node values interpolated across each triangle */
+} PolyShading;
+
+/* How the in-memory animation store keeps slices */
+typedef enum {
+    ANIM_STORE_LOSSLESS = 0,        /* Default: exact float bits, byte-shuffled and compressed */
+    ANIM_STORE_U16                  /* 16-bit quantised against each slice's range */
+} AnimStoreMode;
+
+/* Display-native pixel formats the colouriser can write */
+typedef enum {
+    PIXEL_FORMAT_NONE = 0,          /* RGB buffer only */
+    PIXEL_FORMAT_XRGB8888,          /* 32-bit 0x00RRGGBB */
+    PIXEL_FORMAT_RGB565             /* 16-bit 5:6:5 */
+} PixelFormat;
+
+/* Kernel used by the colour LUT functions (colormap_lut_map and its halves) */
+typedef enum {
+    COLORMAP_LUT_AUTO = 0,          /* Default: widest kernel the CPU supports */
+    COLORMAP_LUT_SCALAR,
+    COLORMAP_LUT_AVX2,              /* 8-lane gather from the LUT */
+    COLORMAP_LUT_AVX512             /* 16-lane gather from the LUT */
+} ColormapLutKernel;
+
+/* How data values are normalised onto the colormap */
+typedef enum {
+    COLOR_NORM_LINEAR = 0,          /* Default: (v - min) / (max - min) */
+    COLOR_NORM_LOG,                 /* log(v / min) / log(max / min); v <= 0 at the bottom */
+    COLOR_NORM_SYMLOG,              /* Linear within +-linthresh, logarithmic beyond */
+    COLOR_NORM_POWER,               /* Linear position raised to gamma */
+    COLOR_NORM_HISTEQ,              /* Equal share of the cells per colour */
+    COLOR_NORM_COUNT
+} ColorNormMode;
+
+typedef struct {
+    ColorNormMode mode;
+    float       gamma;              /* COLOR_NORM_POWER exponent (0 = default 0.5) */
+    float       linthresh;          /* COLOR_NORM_SYMLOG linear half-width (0 = automatic) */
+} USColorNorm;
+
+/* Kernel used by frame_stats_add_row */
+typedef enum {
+    FRAME_STATS_AUTO = 0,           /* Default: widest kernel the CPU supports */
+    FRAME_STATS_SCALAR,
+    FRAME_STATS_AVX2,               /* 8 values per step, double-precision sums */
+    FRAME_STATS_AVX512              /* 16 values per step */
+} FrameStatsKernel;
+
+/* Entries in a quantised colour lookup table, plus one for missing data */
+#define COLORMAP_LUT_SIZE 4096
+#define COLORMAP_LUT_MISSING COLORMAP_LUT_SIZE
+
+/*
+ * A colormap quantised over a data range and packed in a display-native
+ * pixel format (see colormap_lut_build_norm()). With linear quantisation
+ * entry k covers normalised values [k, k + 1) / n_steps and value 1 maps
+ * to entry n_steps. Log and symlog quantise the float bit pattern of |v|
+ * instead, which is piecewise linear in log2 |v|, so every mode costs the
+ * same per value. The entry index of each value is what a view keeps as
+ * its index image; the norm only decides the colour of each entry.
+ */
+typedef struct {
+    PixelFormat format;
+    USColorNorm norm;               /* Resolved: linthresh and gamma filled in */
+    float       min_val;
+    float       range;              /* max - min, 1 if empty */
+    float       fill_value;
+    float       n_steps;            /* Highest entry in use */
+    int         log_quant;          /* Entries are spaced in log |v| (below) */
+    int32_t     floor_bits;         /* Bit patterns of |v| at or below this count as 0 */
+    int32_t     base, top;          /* Signed offsets from floor_bits of min and max */
+    int         shift;              /* Entry = (offset - base) >> shift */
+    float       pos[COLORMAP_LUT_SIZE + 1];     /* Colormap position [0, 1] of each entry */
+    uint32_t    colors[COLORMAP_LUT_SIZE + 1];  /* Last: missing data (white) */
+} USColorLUT;
+
+/*
+ * View pipeline stages still to be recomputed by view_update(). Each stage
+ * implies the ones after it: new data must be regridded, a regridded field
+ * colourised, and a colourised image expanded to the display scale.
+ */
+#define VIEW_DIRTY_DATA     0x1     /* Re-read the raw slice */
+#define VIEW_DIRTY_REGRID   0x2     /* Re-apply the regrid to raw_data */
+#define VIEW_DIRTY_COLOR    0x4     /* Re-colourise regridded_data */
+#define VIEW_DIRTY_SCALE    0x8     /* Re-expand color_pixels to pixels */
+#define VIEW_DIRTY_ALL      0xf
+
 /* Current view state */
 struct USView {
     USVar      *variable;           /* Current variable being displayed */
     USMesh     *mesh;               /* Current mesh/coordinates */
     USRegrid   *regrid;             /* Current regridding setup */
     USFileSet  *fileset;            /* Multi-file set (NULL for single file) */
+    USSliceCache *slice_cache;      /* Decoded slice cache (NULL = uncached, not owned) */
+    USPrefetcher *prefetch;         /* Read-ahead worker (NULL = none, not owned) */
+    USAnimStore *anim_store;        /* Compressed time axis of one variable/depth (owned) */
+    USRangeScan *range_scan;        /* Exact range scan of the variable (owned) */
+    int         range_scan_enabled; /* Scan ranges on the prefetcher's worker */
+    const char *range_cache_dir;    /* Where scans keep sidecars (NULL = nowhere) */
 
     /* Render mode */
     RenderMode  render_mode;        /* Interpolate or polygon rendering */
+    USPolyCoverage *poly_coverage;  /* Pixel-to-element map for polygon mode (owned) */
+    USPolyLod  *poly_lod;           /* Element size hierarchy of the mesh (owned) */
+    PolyLodMode poly_lod_mode;      /* Sub-pixel element aggregation */
+    PolyShading poly_shading;       /* Flat or interpolated element colour */
 
     /* Current position in data space */
     size_t      time_index;         /* Current time step (virtual if fileset) */
     size_t      depth_index;        /* Current depth level */
     size_t      n_times;            /* Total time steps (virtual if fileset) */
     size_t      n_depths;           /* Total depth levels */
+    int         time_step;          /* Last time move (direction of travel), 0 if depth moved */
+    int         depth_step;         /* Last depth move, 0 if time moved */
 
     /* Raw data buffer (1D, unstructured representation) */
     float      *raw_data;           /* [n_points] */
@@ -226,13 +397,48 @@ struct USView {
     /* Data grid dimensions (from regrid) */
     size_t      data_nx, data_ny;
 
+    /* Colourised data grid before scaling (north up) */
+    unsigned char *color_pixels;    /* [data_ny * data_nx * 3] RGB */
+
+    /* Colour LUT entry of every data cell (north up), so colormap and range
+     * changes repaint through a palette instead of renormalising */
+    uint16_t   *index_image;        /* [data_ny * data_nx] */
+    USColorLUT *index_lut;          /* Quantisation index_image was built with */
+    int         index_valid;        /* index_image matches the current data */
+
     /* Pixel buffer for display (scaled) */
     unsigned char *pixels;          /* [display_ny * display_nx * 3] RGB */
     size_t      display_nx, display_ny;
     int         scale_factor;       /* Display magnification */
 
+    /* Native path: colourise straight to display pixels (fused for nearest-neighbour) */
+    PixelFormat native_format;      /* PIXEL_FORMAT_NONE = disabled */
+    void       *native_pixels;      /* [display_ny * display_nx] in native_format */
+    RegridIndex *pixel_src;         /* Source index per data cell, north up */
+    const USRegrid *pixel_src_regrid; /* Regrid pixel_src was built from */
+    int         native_valid;       /* native_pixels holds the current frame */
+    int         rgb_stale;          /* Last frame was native; RGB buffers are behind */
+    int         regrid_stale;       /* Last frame was fused; regridded_data is behind too */
+    void     *(*pixel_alloc)(size_t bytes);  /* Native buffer allocator (NULL = malloc) */
+    void      (*pixel_free)(void *pixels);
+
+    /* Colour normalisation */
+    USColorNorm color_norm;         /* Mapping of values onto the colormap */
+    USColorLUT *palette;            /* Palette of the last frame painted from index_image */
+    int         palette_valid;      /* palette holds a painted frame's colours */
+    uint32_t   *index_hist;         /* [COLORMAP_LUT_SIZE + 1] entry counts of index_image */
+    int         index_hist_valid;   /* index_hist was counted with index_image */
+
+    /* Frame statistics, gathered while quantising */
+    double     *row_weight;         /* [data_ny] cos(lat) area weight of each regridded row */
+    USFrameStats *frame_stats;      /* Statistics of the current frame */
+    int         stats_valid;        /* frame_stats describes the current frame */
+    int         autoscale;          /* Range follows each frame's percentiles */
+
     /* Data status */
     int         data_valid;
+    unsigned    dirty;              /* VIEW_DIRTY_* stages to recompute */
+    unsigned long generation;       /* Bumped by every view_invalidate() */
 
     /* Animation state */
     int         animating;
@@ -244,9 +450,23 @@ typedef struct {
     int         debug;
     double      influence_radius;   /* Regrid influence radius in meters */
     double      target_resolution;  /* Target grid resolution in degrees */
+    int         idw_neighbors;      /* IDW neighbor count (0 = nearest neighbor) */
     char        mesh_file[MAX_NAME_LEN];  /* Separate mesh file path */
     int         frame_delay_ms;     /* Animation speed */
     int         polygon_only;       /* Skip regridding, polygon mode only */
+    PolyLodMode poly_lod;           /* Sub-pixel element aggregation in polygon mode */
+    PolyShading poly_shading;       /* Element shading in polygon mode */
+    char        cache_dir[MAX_NAME_LEN];  /* Regrid cache directory ("" = default) */
+    int         no_cache;           /* Always rebuild regrid, never read/write cache */
+    int         slice_cache_mb;     /* Decoded slice cache budget (0 = disabled) */
+    int         prefetch_slices;    /* Slices to read ahead (0 = disabled) */
+    AnimStoreMode anim_store;       /* Compression of whole-animation loads */
+    int         no_pipeline;        /* Animate frame by frame on the UI thread */
+    int         no_range_scan;      /* Keep the sampled range estimate */
+    int         no_fused;           /* Always go through the RGB buffer */
+    USColorNorm color_norm;         /* Initial colour normalisation */
+    int         autoscale;          /* Start with per-frame percentile autoscale */
+    int         no_shm;             /* Send images through the X socket, not MIT-SHM */
 } USOptions;
 
 /* Dimension info for display */
@@ -8,6 +8,10 @@
 #include "ushow.defines.h"
 #include "mesh.h"
 #include "regrid.h"
+#include "regrid_cache.h"
+#include "slice_cache.h"
+#include "prefetch.h"
+#include "anim_pipeline.h"
 #include "file_netcdf.h"
 #ifdef HAVE_ZARR
 #include "file_zarr.h"
@@ -16,6 +20,7 @@
 #include "file_grib.h"
 #endif
 #include "colormaps.h"
+#include "frame_stats.h"
 #include "view.h"
 #include "term_render_mode.h"
 
@@ -33,7 +38,7 @@
 #include <signal.h>
 #include <unistd.h>
 
-#define HEADER_LINES 5
+#define HEADER_LINES 6
 #define MIN_DRAW_COLS 20
 #define MIN_DRAW_ROWS 6
 #define DEFAULT_GLYPH_RAMP " .:-=+*#%@"
@@ -53,6 +58,10 @@ static USFileSet *zarr_fileset = NULL;
 static USMesh *mesh = NULL;
 static USRegrid *regrid = NULL;
 static USView *view = NULL;
+static USSliceCache *slice_cache = NULL;
+static USPrefetcher *prefetcher = NULL;
+static USAnimPipeline *anim = NULL;
+static char anim_report[512] = "";
 static USVar *variables = NULL;
 static USVar *current_var = NULL;
 static USVar **var_array = NULL;
@@ -65,21 +74,34 @@ static int n_current_dims = 0;
 typedef struct {
     double influence_radius;
     double target_resolution;
+    int idw_neighbors;   /* 0 = nearest neighbor */
     int frame_delay_ms;
     int color_mode;      /* -1 auto, 0 off, 1 on */
     int render_mode;     /* TERM_RENDER_* */
     char mesh_file[MAX_NAME_LEN];
     char glyph_ramp[128];
+    char cache_dir[MAX_NAME_LEN];  /* Regrid cache directory ("" = default) */
+    int no_cache;        /* Always rebuild regrid, never read/write cache */
+    int slice_cache_mb;  /* Decoded slice cache budget (0 = disabled) */
+    int prefetch_slices; /* Slices to read ahead (0 = disabled) */
+    int no_pipeline;     /* Animate frame by frame on the main thread */
+    AnimStoreMode anim_store;  /* Compression of whole-animation loads */
+    int no_range_scan;   /* Keep the sampled range estimate */
+    USColorNorm color_norm;  /* Mapping of values onto the colormap */
+    int autoscale;       /* Range follows each frame's 2-98 percentiles */
 } UTermOptions;
 
 static UTermOptions options = {
     .influence_radius = DEFAULT_INFLUENCE_RADIUS_M,
     .target_resolution = DEFAULT_RESOLUTION,
+    .idw_neighbors = 0,
     .frame_delay_ms = 200,
     .color_mode = -1,
     .render_mode = TERM_RENDER_ASCII,
     .mesh_file = "",
-    .glyph_ramp = DEFAULT_GLYPH_RAMP
+    .glyph_ramp = DEFAULT_GLYPH_RAMP,
+    .slice_cache_mb = DEFAULT_SLICE_CACHE_MB,
+    .prefetch_slices = DEFAULT_PREFETCH_SLICES
 };
 
 /* Terminal mode */
@@ -169,12 +191,6 @@ static int is_missing_value(float v, float fill_value) {
     return 0;
 }
 
-static float clamp01(float v) {
-    if (v < 0.0f) return 0.0f;
-    if (v > 1.0f) return 1.0f;
-    return v;
-}
-
 static void cycle_render_mode(void) {
     options.render_mode = term_cycle_render_mode(options.render_mode);
 }
@@ -197,7 +213,7 @@ static void print_utf8_codepoint(unsigned int cp) {
 }
 
 static int sample_field(size_t sx, size_t sy, size_t sub_cols, size_t sub_rows,
-                        float range, float *norm_out) {
+                        float *norm_out) {
     if (!view || !current_var || sub_cols == 0 || sub_rows == 0 || !norm_out) return 1;
 
     size_t data_x = (size_t)(((double)sx + 0.5) * (double)view->data_nx / (double)sub_cols);
@@ -211,29 +227,97 @@ static int sample_field(size_t sx, size_t sy, size_t sub_cols, size_t sub_rows,
 
     if (is_missing_value(v, current_var->fill_value)) return 1;
 
-    *norm_out = clamp01((v - current_var->user_min) / range);
+    /* Through the view's palette, so non-linear norms match the image */
+    float t = view_color_position(view, v);
+    if (t < 0.0f) return 1;
+    *norm_out = t;
     return 0;
 }
 
+/* Print slice cache effectiveness on exit */
+static void report_slice_cache(void) {
+    if (!slice_cache) return;
+    USSliceCacheStats st;
+    slice_cache_get_stats(slice_cache, &st);
+    printf("Slice cache: %zu hits, %zu misses, %zu evictions (%zu slices, %.1f of %.1f MB)\n",
+           st.hits, st.misses, st.evictions, st.n_entries,
+           st.bytes_used / 1048576.0, st.budget_bytes / 1048576.0);
+    if (prefetcher) {
+        printf("Prefetched %zu slices\n", prefetch_get_count(prefetcher));
+    }
+    if (anim_report[0]) {
+        printf("Animation pipeline: %s\n", anim_report);
+    }
+}
+
+/*
+ * Stop pipelined playback, keeping its statistics for the exit report.
+ * Called before every change to the view, so no worker still reads state
+ * the change frees; step_animation() starts a new pipeline.
+ */
+static void stop_pipeline(void) {
+    if (!anim) return;
+
+    AnimStats st;
+    anim_pipeline_get_stats(anim, &st);
+    if (st.frames_shown > 0) {
+        anim_pipeline_format_stats(&st, anim_report, sizeof(anim_report));
+    }
+    anim_pipeline_free(anim);
+    anim = NULL;
+}
+
+/* Advance playback by one frame, through the pipeline when possible */
+static void step_animation(void) {
+    if (!anim && !options.no_pipeline) {
+        anim = anim_pipeline_create(view, ANIM_PIPELINE_FRAMES);
+    }
+    if (anim) {
+        /* Keep the current frame if the next one is not ready yet */
+        if (anim_pipeline_next(anim, view) >= 0) return;
+        /* View changed under the pipeline: step directly, restart next frame */
+        stop_pipeline();
+    }
+    if (view_step_time(view, 1) < 0) {
+        view_set_time(view, 0);
+    }
+}
+
 static void print_usage(const char *prog) {
     fprintf(stderr, "Usage: %s [options] <data_file.nc|data.grib|data.zarr> [file2 ...]\n\n", prog);
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  -m, --mesh <file>      Mesh file with coordinates\n");
     fprintf(stderr, "  -r, --resolution <deg> Target grid resolution (default: 1.0)\n");
     fprintf(stderr, "  -i, --influence <m>    Influence radius in meters (default: 200000)\n");
+    fprintf(stderr, "  -k, --idw <n>          Inverse-distance weighting of n neighbors (default: nearest)\n");
     fprintf(stderr, "  -d, --delay <ms>       Animation frame delay in ms (default: 200)\n");
     fprintf(stderr, "      --chars <ramp>     Glyph ramp, e.g. \" .:-=+*#%%@\"\n");
     fprintf(stderr, "      --render <mode>    Render mode: ascii | half | braille\n");
     fprintf(stderr, "      --color            Force ANSI color output\n");
     fprintf(stderr, "      --no-color         Disable ANSI colors\n");
+    fprintf(stderr, "      --cache-dir <dir>  Regrid cache directory (default: ~/.cache/ushow)\n");
+    fprintf(stderr, "      --no-cache         Always rebuild the regrid map\n");
+    fprintf(stderr, "      --cache-mb <n>     Memory for revisited time steps (default: %d, 0 = off)\n",
+            DEFAULT_SLICE_CACHE_MB);
+    fprintf(stderr, "      --prefetch <n>     Slices to read ahead while stepping (default: %d, 0 = off)\n",
+            DEFAULT_PREFETCH_SLICES);
+    fprintf(stderr, "      --no-pipeline      Animate without the threaded read/regrid/colour pipeline\n");
+    fprintf(stderr, "      --anim-store <m>   Compression for L loads: lossless, u16 (default: lossless)\n");
+    fprintf(stderr, "      --no-range-scan    Keep the sampled range estimate instead of scanning all slices\n");
+    fprintf(stderr, "      --norm <mode>      Colour scaling: linear, log, symlog, gamma, histeq (default: linear)\n");
+    fprintf(stderr, "      --gamma <g>        Exponent of the gamma norm (default: %g)\n",
+            (double)COLOR_NORM_DEFAULT_GAMMA);
+    fprintf(stderr, "      --linthresh <v>    Linear half-width of the symlog norm (default: 1e-3 of max |limit|)\n");
+    fprintf(stderr, "      --autoscale        Set the range to each frame's 2-98 percentiles\n");
     fprintf(stderr, "  -h, --help             Show this help\n\n");
 
     fprintf(stderr, "Keys:\n");
     fprintf(stderr, "  q quit | space pause/resume | j/k time -/+ | u/i depth -/+\n");
     fprintf(stderr, "  n/p next/prev variable | c/C next/prev colormap\n");
-    fprintf(stderr, "  m cycle render mode (ascii/half/braille)\n");
+    fprintf(stderr, "  m cycle render mode (ascii/half/braille) | N cycle colour norm\n");
     fprintf(stderr, "  [ / ] adjust min down/up | { / } adjust max down/up\n");
-    fprintf(stderr, "  r reset range | s save PPM | ? toggle help\n");
+    fprintf(stderr, "  r reset range | R range of this depth | a 2-98%% autoscale | s save PPM\n");
+    fprintf(stderr, "  L load all time steps into memory | ? toggle help\n");
 }
 
 static int collect_variables(USVar *head) {
@@ -257,6 +341,7 @@ static int set_variable_index(int idx) {
     if (!view || !mesh || !regrid || !var_array) return -1;
     if (idx < 0 || idx >= n_variables) return -1;
 
+    stop_pipeline();
     current_var_index = idx;
     current_var = var_array[idx];
 
@@ -278,6 +363,7 @@ static int set_variable_index(int idx) {
         n_current_dims = 0;
     }
 
+    prefetch_pause(prefetcher);
 #ifdef HAVE_ZARR
     if (zarr_fileset) {
         current_dim_info = zarr_get_dim_info_fileset(zarr_fileset, current_var, &n_current_dims);
@@ -297,6 +383,7 @@ static int set_variable_index(int idx) {
     } else {
         current_dim_info = netcdf_get_dim_info(current_var, &n_current_dims);
     }
+    prefetch_resume(prefetcher);
 
     if (view_set_variable(view, current_var, mesh, regrid) != 0) {
         return -1;
@@ -307,6 +394,7 @@ static int set_variable_index(int idx) {
 
 static void adjust_range(int action) {
     if (!current_var) return;
+    view_set_autoscale(view, 0);  /* A range set by hand stays put */
 
     float range = current_var->user_max - current_var->user_min;
     float step = range * 0.1f;
@@ -335,14 +423,25 @@ static void adjust_range(int action) {
             break;
     }
 
-    view->data_valid = 0;
+    view_invalidate(view, VIEW_DIRTY_COLOR);
 }
 
 static void reset_range(void) {
     if (!current_var) return;
+    view_set_autoscale(view, 0);
     current_var->user_min = current_var->global_min;
     current_var->user_max = current_var->global_max;
-    view->data_valid = 0;
+    view_invalidate(view, VIEW_DIRTY_COLOR);
+}
+
+static void reset_range_depth(void) {
+    if (!current_var) return;
+    float dmin, dmax;
+    if (view_get_depth_range(view, &dmin, &dmax) != 0) return;
+    view_set_autoscale(view, 0);
+    current_var->user_min = dmin;
+    current_var->user_max = dmax;
+    view_invalidate(view, VIEW_DIRTY_COLOR);
 }
 
 static void save_frame(void) {
@@ -500,33 +599,29 @@ static void render_frame(int show_help, int animating) {
            view->depth_index + 1, view->n_depths,
            animating ? "anim" : "paused");
 
-    if (cmap) {
-        printf("cmap: %s | range: %.6g .. %.6g | color: %s | render: %s\n",
-               cmap->name, current_var->user_min, current_var->user_max,
-               use_color ? "on" : "off", term_render_mode_name(options.render_mode));
-    } else {
-        printf("cmap: none | range: %.6g .. %.6g | color: %s | render: %s\n",
-               current_var->user_min, current_var->user_max,
-               use_color ? "on" : "off", term_render_mode_name(options.render_mode));
-    }
+    printf("cmap: %s | range: %.6g .. %.6g %s%s | color: %s | render: %s\n",
+           cmap ? cmap->name : "none", current_var->user_min, current_var->user_max,
+           colormap_norm_name(view->color_norm.mode), view->autoscale ? " (2-98%)" : "",
+           use_color ? "on" : "off", term_render_mode_name(options.render_mode));
+
+    char stats[128];
+    frame_stats_format(view_get_stats(view), stats, sizeof(stats));
+    printf("stats: %s\n", stats);
 
     printf("keys: q quit | n/p var | j/k time | u/i depth | space play/pause | c/C cmap | m mode\n");
     if (show_help) {
-        printf("      [ ] min-/min+  { } max-/max+  r reset range  s save ppm\n");
+        printf("      [ ] min-/min+  { } max-/max+  r/R reset range (all/depth)  a autoscale  N norm  s save ppm  L load all steps\n");
     } else {
         printf("      ? more help\n");
     }
 
-    float range = current_var->user_max - current_var->user_min;
-    if (range <= 0.0f) range = 1.0f;
-
     if (options.render_mode == TERM_RENDER_ASCII) {
         for (int row = 0; row < draw_rows; row++) {
             int last_r = -1, last_g = -1, last_b = -1;
 
             for (int col = 0; col < draw_cols; col++) {
                 float t = 0.0f;
-                if (sample_field((size_t)col, (size_t)row, (size_t)draw_cols, (size_t)draw_rows, range, &t) != 0) {
+                if (sample_field((size_t)col, (size_t)row, (size_t)draw_cols, (size_t)draw_rows, &t) != 0) {
                     if (use_color && (last_r != -1 || last_g != -1 || last_b != -1)) {
                         printf("\x1b[0m");
                         last_r = last_g = last_b = -1;
@@ -566,8 +661,8 @@ static void render_frame(int show_help, int animating) {
 
             for (int col = 0; col < draw_cols; col++) {
                 float top = 0.0f, bot = 0.0f;
-                int top_miss = sample_field((size_t)col, (size_t)(row * 2), (size_t)draw_cols, (size_t)(draw_rows * 2), range, &top);
-                int bot_miss = sample_field((size_t)col, (size_t)(row * 2 + 1), (size_t)draw_cols, (size_t)(draw_rows * 2), range, &bot);
+                int top_miss = sample_field((size_t)col, (size_t)(row * 2), (size_t)draw_cols, (size_t)(draw_rows * 2), &top);
+                int bot_miss = sample_field((size_t)col, (size_t)(row * 2 + 1), (size_t)draw_cols, (size_t)(draw_rows * 2), &bot);
 
                 if (top_miss && bot_miss) {
                     if (use_color && (last_fr != -1 || last_br != -1)) {
@@ -645,7 +740,7 @@ static void render_frame(int show_help, int animating) {
                         float t = 0.0f;
                         size_t sx = (size_t)(col * 2 + dx);
                         size_t sy = (size_t)(row * 4 + dy);
-                        if (sample_field(sx, sy, (size_t)(draw_cols * 2), (size_t)(draw_rows * 4), range, &t) != 0) {
+                        if (sample_field(sx, sy, (size_t)(draw_cols * 2), (size_t)(draw_rows * 4), &t) != 0) {
                             continue;
                         }
 
@@ -819,6 +914,11 @@ static int open_data_files(int n_data_files, const char **data_filenames) {
 }
 
 static void cleanup_all(void) {
+    /* Stop reading ahead before the files and variables go away */
+    stop_pipeline();
+    prefetch_free(prefetcher);
+    prefetcher = NULL;
+
     if (current_dim_info) {
 #ifdef HAVE_GRIB
         if (current_var && current_var->file && current_var->file->file_type == FILE_TYPE_GRIB) {
@@ -851,6 +951,9 @@ static void cleanup_all(void) {
     view_free(view);
     view = NULL;
 
+    slice_cache_free(slice_cache);
+    slice_cache = NULL;
+
     regrid_free(regrid);
     regrid = NULL;
 
@@ -892,17 +995,29 @@ static int parse_options(int argc, char **argv, int *first_data_arg) {
         {"mesh", required_argument, 0, 'm'},
         {"resolution", required_argument, 0, 'r'},
         {"influence", required_argument, 0, 'i'},
+        {"idw", required_argument, 0, 'k'},
         {"delay", required_argument, 0, 'd'},
         {"chars", required_argument, 0, 1000},
         {"render", required_argument, 0, 1003},
         {"color", no_argument, 0, 1001},
         {"no-color", no_argument, 0, 1002},
+        {"cache-dir", required_argument, 0, 1004},
+        {"no-cache", no_argument, 0, 1005},
+        {"cache-mb", required_argument, 0, 1006},
+        {"prefetch", required_argument, 0, 1007},
+        {"no-pipeline", no_argument, 0, 1008},
+        {"anim-store", required_argument, 0, 1009},
+        {"no-range-scan", no_argument, 0, 1010},
+        {"norm", required_argument, 0, 1011},
+        {"gamma", required_argument, 0, 1012},
+        {"linthresh", required_argument, 0, 1013},
+        {"autoscale", no_argument, 0, 1014},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "m:r:i:d:h", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "m:r:i:k:d:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'm':
                 strncpy(options.mesh_file, optarg, MAX_NAME_LEN - 1);
@@ -914,6 +1029,13 @@ static int parse_options(int argc, char **argv, int *first_data_arg) {
             case 'i':
                 options.influence_radius = atof(optarg);
                 break;
+            case 'k':
+                options.idw_neighbors = atoi(optarg);
+                if (options.idw_neighbors < 0 || options.idw_neighbors > MAX_IDW_NEIGHBORS) {
+                    fprintf(stderr, "Invalid --idw value: %s (use 0..%d)\n", optarg, MAX_IDW_NEIGHBORS);
+                    return -1;
+                }
+                break;
             case 'd':
                 options.frame_delay_ms = atoi(optarg);
                 if (options.frame_delay_ms < 10) options.frame_delay_ms = 10;
@@ -940,6 +1062,67 @@ static int parse_options(int argc, char **argv, int *first_data_arg) {
             case 1002:
                 options.color_mode = 0;
                 break;
+            case 1004:
+                strncpy(options.cache_dir, optarg, sizeof(options.cache_dir) - 1);
+                options.cache_dir[sizeof(options.cache_dir) - 1] = '\0';
+                break;
+            case 1005:
+                options.no_cache = 1;
+                break;
+            case 1006:
+                options.slice_cache_mb = atoi(optarg);
+                if (options.slice_cache_mb < 0) {
+                    fprintf(stderr, "Invalid --cache-mb value: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 1007:
+                options.prefetch_slices = atoi(optarg);
+                if (options.prefetch_slices < 0) {
+                    fprintf(stderr, "Invalid --prefetch value: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 1008:
+                options.no_pipeline = 1;
+                break;
+            case 1009:
+                if (strcmp(optarg, "lossless") == 0) {
+                    options.anim_store = ANIM_STORE_LOSSLESS;
+                } else if (strcmp(optarg, "u16") == 0) {
+                    options.anim_store = ANIM_STORE_U16;
+                } else {
+                    fprintf(stderr, "Invalid --anim-store value: %s (use lossless|u16)\n", optarg);
+                    return -1;
+                }
+                break;
+            case 1010:
+                options.no_range_scan = 1;
+                break;
+            case 1011:
+                if (colormap_norm_parse(optarg, &options.color_norm.mode) != 0) {
+                    fprintf(stderr, "Invalid --norm value: %s (use linear|log|symlog|gamma|histeq)\n",
+                            optarg);
+                    return -1;
+                }
+                break;
+            case 1012:
+                options.color_norm.gamma = (float)atof(optarg);
+                if (!(options.color_norm.gamma > 0.0f)) {
+                    fprintf(stderr, "Invalid --gamma value: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 1013:
+                options.color_norm.linthresh = (float)atof(optarg);
+                if (!(options.color_norm.linthresh > 0.0f)) {
+                    fprintf(stderr, "Invalid --linthresh value: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 1014:
+                options.autoscale = 1;
+                break;
             default:
                 print_usage(argv[0]);
                 return -1;
@@ -994,7 +1177,12 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    regrid = regrid_create(mesh, options.target_resolution, options.influence_radius);
+    const char *cache_dir = NULL;
+    if (!options.no_cache) {
+        cache_dir = options.cache_dir[0] ? options.cache_dir : regrid_cache_default_dir();
+    }
+    regrid = regrid_create_cached(mesh, options.target_resolution, options.influence_radius,
+                                  options.idw_neighbors, cache_dir);
     if (!regrid) {
         fprintf(stderr, "Failed to create regrid structure\n");
         cleanup_all();
@@ -1039,10 +1227,28 @@ int main(int argc, char *argv[]) {
     }
 
     if (fileset) view_set_fileset(view, fileset);
+    view_set_color_norm(view, &options.color_norm);
+    view_set_autoscale(view, options.autoscale);
 #ifdef HAVE_ZARR
     if (zarr_fileset) view_set_fileset(view, zarr_fileset);
 #endif
 
+    if (options.slice_cache_mb > 0) {
+        slice_cache = slice_cache_create((size_t)options.slice_cache_mb << 20);
+        view_set_slice_cache(view, slice_cache);
+    }
+    if ((slice_cache && options.prefetch_slices > 0) || !options.no_range_scan) {
+        prefetcher = prefetch_create(slice_cache, options.prefetch_slices);
+        view_set_prefetcher(view, prefetcher);
+    }
+    if (!options.no_range_scan) {
+        const char *range_dir = NULL;
+        if (!options.no_cache) {
+            range_dir = options.cache_dir[0] ? options.cache_dir : regrid_cache_default_dir();
+        }
+        view_set_range_scan(view, 1, range_dir);
+    }
+
     if (set_variable_index(0) != 0) {
         fprintf(stderr, "Failed to set initial variable\n");
         cleanup_all();
@@ -1086,6 +1292,9 @@ int main(int argc, char *argv[]) {
             if (n == 1) {
                 int changed = 0;
 
+                /* Every key but play/pause, save, help and quit changes the view */
+                if (ch != ' ' && ch != 's' && ch != '?' && ch != 'q') stop_pipeline();
+
                 if (ch == '\033') {
                     /* Basic arrow key support: ESC [ A/B/C/D */
                     unsigned char seq[2];
@@ -1107,6 +1316,7 @@ int main(int argc, char *argv[]) {
                             break;
                         case ' ':
                             animating = !animating;
+                            if (!animating) stop_pipeline();
                             next_frame_time = now_seconds() + (double)options.frame_delay_ms / 1000.0;
                             changed = 1;
                             break;
@@ -1142,18 +1352,29 @@ int main(int argc, char *argv[]) {
                             break;
                         case 'c':
                             colormap_next();
-                            view->data_valid = 0;
+                            view_invalidate(view, VIEW_DIRTY_COLOR);
                             changed = 1;
                             break;
                         case 'C':
                             colormap_prev();
-                            view->data_valid = 0;
+                            view_invalidate(view, VIEW_DIRTY_COLOR);
                             changed = 1;
                             break;
                         case 'm':
                             cycle_render_mode();
                             changed = 1;
                             break;
+                        case 'N': {
+                            USColorNorm norm = view->color_norm;
+                            norm.mode = (ColorNormMode)((norm.mode + 1) % COLOR_NORM_COUNT);
+                            view_set_color_norm(view, &norm);
+                            changed = 1;
+                            break;
+                        }
+                        case 'a':
+                            view_set_autoscale(view, !view->autoscale);
+                            changed = 1;
+                            break;
                         case '[':
                             adjust_range(0);
                             changed = 1;
@@ -1174,10 +1395,18 @@ int main(int argc, char *argv[]) {
                             reset_range();
                             changed = 1;
                             break;
+                        case 'R':
+                            reset_range_depth();
+                            changed = 1;
+                            break;
                         case 's':
                             save_frame();
                             changed = 1;
                             break;
+                        case 'L':
+                            view_load_animation(view, options.anim_store);
+                            changed = 1;
+                            break;
                         case '?':
                             show_help = !show_help;
                             changed = 1;
@@ -1199,12 +1428,17 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        /* Exact range refinements show on the next frame while animating */
+        unsigned long generation = view->generation;
+        if (view_poll_range(view)) {
+            if (view->generation != generation) stop_pipeline();
+            if (!animating) render_frame(show_help, animating);
+        }
+
         if (animating) {
             now = now_seconds();
             if (now >= next_frame_time) {
-                if (view_step_time(view, 1) < 0) {
-                    view_set_time(view, 0);
-                }
+                step_animation();
                 render_frame(show_help, animating);
                 next_frame_time = now + (double)options.frame_delay_ms / 1000.0;
             }
@@ -1212,6 +1446,9 @@ int main(int argc, char *argv[]) {
     }
 
     printf("\x1b[H\x1b[2J");
+    disable_raw_mode();
+    stop_pipeline();
+    report_slice_cache();
     cleanup_all();
     return 0;
 }
@@ -12,28 +12,227 @@
 #endif
 #include "regrid.h"
 #include "colormaps.h"
+#include "slice_cache.h"
+#include "prefetch.h"
+#include "poly_raster.h"
+#include "anim_store.h"
+#include "range_scan.h"
+#include "frame_stats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 /* Default scale factor for display */
 #define DEFAULT_SCALE_FACTOR 2
 
+/* pixel_src entry for a data cell with no source point in range */
+#define PIXEL_SRC_NONE REGRID_INDEX_MAX
+
 USView *view_create(void) {
     USView *view = calloc(1, sizeof(USView));
     if (!view) return NULL;
     view->frame_delay_ms = 200;  /* Default animation speed */
     view->scale_factor = DEFAULT_SCALE_FACTOR;
+    view->dirty = VIEW_DIRTY_ALL;
     return view;
 }
 
+void view_invalidate(USView *view, unsigned stages) {
+    if (!view) return;
+    if (stages & VIEW_DIRTY_ALL) view->generation++;
+    view->dirty |= stages & VIEW_DIRTY_ALL;
+    if (view->dirty) view->data_valid = 0;
+}
+
 void view_set_fileset(USView *view, USFileSet *fileset) {
     if (view) {
         view->fileset = fileset;
     }
 }
 
+void view_set_slice_cache(USView *view, USSliceCache *cache) {
+    if (view) {
+        view->slice_cache = cache;
+    }
+}
+
+void view_set_prefetcher(USView *view, USPrefetcher *pf) {
+    if (view) {
+        view->prefetch = pf;
+    }
+}
+
+void view_set_range_scan(USView *view, int enabled, const char *cache_dir) {
+    if (view) {
+        view->range_scan_enabled = enabled;
+        view->range_cache_dir = cache_dir;
+    }
+}
+
+/* Start scanning var unless already scanning it; a finished sidecar applies at once */
+static void view_start_range_scan(USView *view, USVar *var) {
+    if (view->range_scan && range_scan_var(view->range_scan) == var) return;
+
+    /* The previous variable's scan is dropped, finished or not */
+    if (view->range_scan) {
+        prefetch_set_range_scan(view->prefetch, NULL);
+        range_scan_free(view->range_scan);
+        view->range_scan = NULL;
+    }
+    if (!view->range_scan_enabled || !view->prefetch) return;
+
+    view->range_scan = range_scan_create(var, view->fileset, view->n_times, view->n_depths,
+                                         view->raw_data_size, view->range_cache_dir);
+    if (!view->range_scan || !range_scan_complete(view->range_scan) || var->range_exact) return;
+
+    USRangeScanStats st;
+    range_scan_get_stats(view->range_scan, &st);
+    if (st.valid) {
+        var->global_min = st.min;
+        var->global_max = st.max;
+        if (!var->range_set) {
+            var->user_min = var->global_min;
+            var->user_max = var->global_max;
+            var->range_set = 1;
+        }
+        printf("Cached range for %s: [%.4f, %.4f]\n", var->name, st.min, st.max);
+    }
+    var->range_exact = 1;
+}
+
+int view_poll_range(USView *view) {
+    if (!view || !view->variable || !view->range_scan) return 0;
+    USVar *var = view->variable;
+    if (var->range_exact || range_scan_var(view->range_scan) != var) return 0;
+
+    USRangeScanStats st;
+    range_scan_get_stats(view->range_scan, &st);
+    int complete = range_scan_complete(view->range_scan);
+    if (complete) {
+        var->range_exact = 1;
+        if (st.valid) {
+            printf("Exact range for %s: [%.4f, %.4f] over %zu slices\n",
+                   var->name, st.min, st.max, st.n_slices);
+        }
+    }
+    if (!st.valid) return 0;
+
+    /* Until the scan is complete the sampled estimate still counts */
+    float new_min = st.min, new_max = st.max;
+    if (!complete) {
+        if (var->global_min < new_min) new_min = var->global_min;
+        if (var->global_max > new_max) new_max = var->global_max;
+    }
+    if (new_min == var->global_min && new_max == var->global_max) return 0;
+
+    if (var->user_min == var->global_min && var->user_max == var->global_max) {
+        var->user_min = new_min;
+        var->user_max = new_max;
+        view_invalidate(view, VIEW_DIRTY_COLOR);
+    }
+    var->global_min = new_min;
+    var->global_max = new_max;
+    return 1;
+}
+
+int view_get_depth_range(const USView *view, float *min_val, float *max_val) {
+    if (!view || !view->variable || range_scan_var(view->range_scan) != view->variable) return -1;
+    return range_scan_get_depth(view->range_scan, view->depth_index, min_val, max_val);
+}
+
+void *view_alloc_pixels(const USView *view, size_t bytes) {
+    return (view && view->pixel_alloc) ? view->pixel_alloc(bytes) : malloc(bytes);
+}
+
+void view_free_pixels(const USView *view, void *pixels) {
+    if (view && view->pixel_free) {
+        if (pixels) view->pixel_free(pixels);
+    } else {
+        free(pixels);
+    }
+}
+
+/* (Re)allocate the native pixel buffer for the current display size */
+static int view_alloc_native(USView *view) {
+    view_free_pixels(view, view->native_pixels);
+    view->native_pixels = NULL;
+    view->native_valid = 0;
+
+    size_t bpp = colormap_pixel_bytes(view->native_format);
+    if (bpp == 0 || view->display_nx == 0 || view->display_ny == 0) return 0;
+
+    view->native_pixels = view_alloc_pixels(view, view->display_nx * view->display_ny * bpp);
+    if (!view->native_pixels) {
+        fprintf(stderr, "Failed to allocate native pixel buffer\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Build the source index of every data cell in display row order (north
+ * up), with PIXEL_SRC_NONE for cells out of range. Only nearest-neighbour
+ * regrids can be fused; others leave pixel_src NULL.
+ */
+static int view_build_pixel_src(USView *view) {
+    free(view->pixel_src);
+    view->pixel_src = NULL;
+    view->pixel_src_regrid = NULL;
+    view->rgb_stale = 0;
+    view->regrid_stale = 0;
+
+    const USRegrid *regrid = view->regrid;
+    if (view->native_format == PIXEL_FORMAT_NONE || !regrid ||
+        regrid->method != REGRID_NEAREST) return 0;
+
+    size_t nx = view->data_nx, ny = view->data_ny;
+    RegridIndex *pixel_src = malloc(nx * ny * sizeof(RegridIndex));
+    if (!pixel_src) {
+        fprintf(stderr, "Failed to allocate fused source index table\n");
+        return -1;
+    }
+
+    for (size_t y = 0; y < ny; y++) {
+        size_t src_row = ny - 1 - y;  /* Flip: top of screen = north = last data row */
+        for (size_t x = 0; x < nx; x++) {
+            size_t idx = src_row * nx + x;
+            RegridIndex s = PIXEL_SRC_NONE;
+            if (regrid_cell_valid(regrid, idx)) {
+                s = regrid->nn_indices[idx];
+                if (s == PIXEL_SRC_NONE) {
+                    /* Real index collides with the marker; stay on the RGB path */
+                    free(pixel_src);
+                    return 0;
+                }
+            }
+            pixel_src[y * nx + x] = s;
+        }
+    }
+
+    view->pixel_src = pixel_src;
+    view->pixel_src_regrid = regrid;
+    return 0;
+}
+
+/* Whether view_update() can render the current frame through the fused path */
+static int view_fused_active(const USView *view) {
+    return view->native_pixels && view->pixel_src &&
+           view->pixel_src_regrid == view->regrid &&
+           view->render_mode == RENDER_MODE_INTERPOLATE;
+}
+
+/* Signed move from one index to another, taking the shorter way around n */
+static int wrapped_step(size_t from, size_t to, size_t n) {
+    long long step = (long long)to - (long long)from;
+    if (n > 1) {
+        if (step > (long long)n / 2) step -= (long long)n;
+        if (step < -(long long)n / 2) step += (long long)n;
+    }
+    return (int)step;
+}
+
 int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid) {
     if (!view || !var || !mesh) return -1;
     /* regrid can be NULL in polygon-only mode */
@@ -64,6 +263,8 @@ int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid)
     view->n_depths = (var->depth_dim_id >= 0) ? var->dim_sizes[var->depth_dim_id] : 1;
     view->time_index = 0;
     view->depth_index = 0;
+    view->time_step = 1;  /* Expect playback forward in time */
+    view->depth_step = 0;
 
     /* Get target grid dimensions */
     size_t nx, ny;
@@ -91,10 +292,38 @@ int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid)
     view->raw_data_size = n_points;
 
     free(view->regridded_data);
+    free(view->color_pixels);
+    free(view->index_image);
+    view->index_valid = 0;
+    view->index_hist_valid = 0;
+    view->palette_valid = 0;
+    view->stats_valid = 0;
+    free(view->row_weight);
+    view->row_weight = NULL;
     if (regrid) {
         view->regridded_data = malloc(n_data * sizeof(float));
+        view->color_pixels = malloc(n_data * 3);  /* RGB */
+        view->index_image = malloc(n_data * sizeof(uint16_t));
+        if (!view->index_lut) view->index_lut = malloc(sizeof(USColorLUT));
+        if (!view->palette) view->palette = malloc(sizeof(USColorLUT));
+        if (!view->index_hist) {
+            view->index_hist = malloc((COLORMAP_LUT_SIZE + 1) * sizeof(uint32_t));
+        }
+        if (!view->frame_stats) view->frame_stats = malloc(sizeof(USFrameStats));
+        if (view->frame_stats) view->frame_stats->valid = 0;  /* Not a range hint for this variable */
+        view->row_weight = malloc(ny * sizeof(double));
+        /* Rows of the regular target grid share a latitude, so a cell's area is cos(lat) */
+        for (size_t y = 0; view->row_weight && y < ny; y++) {
+            double lat;
+            regrid_get_lonlat(regrid, 0, y, NULL, &lat);
+            view->row_weight[y] = cos(lat * DEG2RAD);
+            if (view->row_weight[y] < 0.0) view->row_weight[y] = 0.0;
+        }
     } else {
-        view->regridded_data = NULL;  /* Not needed in polygon-only mode */
+        /* Not needed in polygon-only mode */
+        view->regridded_data = NULL;
+        view->color_pixels = NULL;
+        view->index_image = NULL;
     }
 
     free(view->pixels);
@@ -104,13 +333,22 @@ int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid)
         fprintf(stderr, "Failed to allocate view buffers\n");
         return -1;
     }
-    if (regrid && !view->regridded_data) {
+    if (regrid && (!view->regridded_data || !view->color_pixels ||
+                   !view->index_image || !view->index_lut || !view->palette ||
+                   !view->index_hist || !view->frame_stats || !view->row_weight)) {
         fprintf(stderr, "Failed to allocate regridded data buffer\n");
         return -1;
     }
+    if (view_alloc_native(view) != 0 || view_build_pixel_src(view) != 0) {
+        return -1;
+    }
+
+    /* A cached exact range makes the estimate unnecessary */
+    view_start_range_scan(view, var);
 
     /* Estimate data range if not set */
     if (!var->range_set) {
+        prefetch_pause(view->prefetch);
 #ifdef HAVE_ZARR
         if (var->file && var->file->file_type == FILE_TYPE_ZARR) {
             zarr_estimate_range(var, &var->global_min, &var->global_max);
@@ -124,12 +362,16 @@ int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid)
         {
             netcdf_estimate_range(var, &var->global_min, &var->global_max);
         }
+        prefetch_resume(view->prefetch);
         var->user_min = var->global_min;
         var->user_max = var->global_max;
         var->range_set = 1;
     }
+    if (view->range_scan && !range_scan_done(view->range_scan)) {
+        prefetch_set_range_scan(view->prefetch, view->range_scan);
+    }
 
-    view->data_valid = 0;
+    view_invalidate(view, VIEW_DIRTY_ALL);
     return 0;
 }
 
@@ -137,8 +379,12 @@ int view_set_time(USView *view, size_t time_idx) {
     if (!view || !view->variable) return -1;
     if (time_idx >= view->n_times) time_idx = view->n_times - 1;
 
+    if (time_idx != view->time_index) {
+        view->time_step = wrapped_step(view->time_index, time_idx, view->n_times);
+        view->depth_step = 0;
+    }
     view->time_index = time_idx;
-    view->data_valid = 0;
+    view_invalidate(view, VIEW_DIRTY_DATA);
     return 0;
 }
 
@@ -146,8 +392,12 @@ int view_set_depth(USView *view, size_t depth_idx) {
     if (!view || !view->variable) return -1;
     if (depth_idx >= view->n_depths) depth_idx = view->n_depths - 1;
 
+    if (depth_idx != view->depth_index) {
+        view->depth_step = (int)((long long)depth_idx - (long long)view->depth_index);
+        view->time_step = 0;
+    }
     view->depth_index = depth_idx;
-    view->data_valid = 0;
+    view_invalidate(view, VIEW_DIRTY_DATA);
     return 0;
 }
 
@@ -165,7 +415,9 @@ int view_step_time(USView *view, int delta) {
     }
 
     view->time_index = new_idx;
-    view->data_valid = 0;
+    view->time_step = delta;
+    view->depth_step = 0;
+    view_invalidate(view, VIEW_DIRTY_DATA);
     return new_idx;
 }
 
@@ -190,8 +442,11 @@ int view_set_scale(USView *view, int scale) {
         fprintf(stderr, "Failed to reallocate pixel buffer\n");
         return -1;
     }
+    if (view_alloc_native(view) != 0) return -1;
 
-    view->data_valid = 0;
+    /* Polygons are rasterised at display size; the grid only needs expanding */
+    view_invalidate(view, view->render_mode == RENDER_MODE_POLYGON ?
+                          VIEW_DIRTY_COLOR : VIEW_DIRTY_SCALE);
     return 0;
 }
 
@@ -208,8 +463,11 @@ int view_set_render_mode(USView *view, RenderMode mode) {
         return -1;
     }
     
-    view->render_mode = mode;
-    view->data_valid = 0;
+    if (view->render_mode != mode) {
+        /* regridded_data is not kept up to date while drawing polygons */
+        view->render_mode = mode;
+        view_invalidate(view, VIEW_DIRTY_REGRID);
+    }
     return 0;
 }
 
@@ -219,274 +477,521 @@ int view_toggle_render_mode(USView *view) {
     if (view->render_mode == RENDER_MODE_INTERPOLATE) {
         if (view_polygon_available(view)) {
             view->render_mode = RENDER_MODE_POLYGON;
-            view->data_valid = 0;
+            view_invalidate(view, VIEW_DIRTY_REGRID);
             return (int)RENDER_MODE_POLYGON;
         }
         return -1;  /* Polygon mode not available */
     } else {
         view->render_mode = RENDER_MODE_INTERPOLATE;
-        view->data_valid = 0;
+        view_invalidate(view, VIEW_DIRTY_REGRID);
         return (int)RENDER_MODE_INTERPOLATE;
     }
 }
 
-/* Helper: convert lon/lat to pixel coordinates */
-static void lonlat_to_pixel(double lon, double lat, size_t width, size_t height,
-                            int *px, int *py) {
-    /* Simple equirectangular projection: lon [-180,180] -> [0,width], lat [-90,90] -> [height,0] */
-    *px = (int)((lon + 180.0) / 360.0 * (double)width);
-    *py = (int)((90.0 - lat) / 180.0 * (double)height);
+void view_set_color_norm(USView *view, const USColorNorm *norm) {
+    if (!view || !norm) return;
+    view->color_norm = *norm;
+    view_invalidate(view, VIEW_DIRTY_COLOR);
 }
 
-/* Helper: clamp value to range */
-static inline int clamp_int(int v, int lo, int hi) {
-    if (v < lo) return lo;
-    if (v > hi) return hi;
-    return v;
+const USFrameStats *view_get_stats(const USView *view) {
+    if (!view || !view->stats_valid || view->render_mode == RENDER_MODE_POLYGON) return NULL;
+    return view->frame_stats;
 }
 
-/* Fill a triangle using scanline algorithm */
-static void fill_triangle(unsigned char *pixels, size_t width, size_t height,
-                          int x0, int y0, int x1, int y1, int x2, int y2,
-                          unsigned char r, unsigned char g, unsigned char b) {
-    /* Sort vertices by y coordinate */
-    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; t = x0; x0 = x1; x1 = t; }
-    if (y0 > y2) { int t = y0; y0 = y2; y2 = t; t = x0; x0 = x2; x2 = t; }
-    if (y1 > y2) { int t = y1; y1 = y2; y2 = t; t = x1; x1 = x2; x2 = t; }
-    
-    /* Skip degenerate triangles */
-    if (y2 == y0) return;
-    
-    /* Clamp to image bounds */
-    int y_start = clamp_int(y0, 0, (int)height - 1);
-    int y_end = clamp_int(y2, 0, (int)height - 1);
-    
-    for (int y = y_start; y <= y_end; y++) {
-        int x_left, x_right;
-        
-        /* Calculate x intersections for this scanline */
-        if (y < y1) {
-            /* Upper part of triangle */
-            if (y1 != y0) {
-                x_left = x0 + (x1 - x0) * (y - y0) / (y1 - y0);
-            } else {
-                x_left = x0;
-            }
-        } else {
-            /* Lower part of triangle */
-            if (y2 != y1) {
-                x_left = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
-            } else {
-                x_left = x1;
-            }
-        }
-        
-        if (y2 != y0) {
-            x_right = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
-        } else {
-            x_right = x0;
-        }
-        
-        if (x_left > x_right) { int t = x_left; x_left = x_right; x_right = t; }
-        
-        x_left = clamp_int(x_left, 0, (int)width - 1);
-        x_right = clamp_int(x_right, 0, (int)width - 1);
-        
-        /* Fill scanline */
-        for (int x = x_left; x <= x_right; x++) {
-            size_t idx = ((size_t)y * width + (size_t)x) * 3;
-            pixels[idx + 0] = r;
-            pixels[idx + 1] = g;
-            pixels[idx + 2] = b;
-        }
+void view_get_stats_range(const USView *view, float *min_val, float *max_val) {
+    const USVar *var = view->variable;
+    if (view_get_depth_range(view, min_val, max_val) == 0 && *max_val > *min_val) return;
+    *min_val = var->global_min;
+    *max_val = var->global_max;
+    const USFrameStats *st = view->frame_stats;
+    if (st && st->valid) {
+        if (st->min < *min_val) *min_val = st->min;
+        if (st->max > *max_val) *max_val = st->max;
     }
 }
 
-/* Render polygons directly to pixel buffer */
+void view_set_autoscale(USView *view, int enabled) {
+    if (!view) return;
+    view->autoscale = enabled ? 1 : 0;
+    view_invalidate(view, VIEW_DIRTY_COLOR);
+}
+
+/* Whether colours follow view->palette rather than linear scaling */
+static int view_palette_active(const USView *view) {
+    return view->palette && view->palette_valid && view->render_mode != RENDER_MODE_POLYGON &&
+           view->color_norm.mode != COLOR_NORM_LINEAR;
+}
+
+float view_color_position(const USView *view, float value) {
+    if (!view || !view->variable) return -1.0f;
+    if (view_palette_active(view)) return colormap_lut_position(view->palette, value);
+
+    const USVar *var = view->variable;
+    if (fabsf(value) > INVALID_DATA_THRESHOLD || value != value ||
+        fabsf(value - var->fill_value) < 1e-6f * fabsf(var->fill_value)) return -1.0f;
+    float range = var->user_max - var->user_min;
+    float t = (range > 0.0f) ? (value - var->user_min) / range : 0.0f;
+    return (t < 0.0f) ? 0.0f : (t > 1.0f) ? 1.0f : t;
+}
+
+float view_color_value(const USView *view, float pos) {
+    if (!view || !view->variable) return 0.0f;
+    if (view_palette_active(view)) return colormap_lut_value_at(view->palette, pos);
+    const USVar *var = view->variable;
+    return var->user_min + pos * (var->user_max - var->user_min);
+}
+
+/* Render polygons through the cached pixel-to-element coverage map */
 static int view_render_polygons(USView *view) {
     if (!view || !view->mesh || !view->variable) return -1;
-    
+
     USMesh *mesh = view->mesh;
     if (!mesh->elem_nodes || mesh->n_elements == 0) return -1;
-    
+
+    /* The size hierarchy is per mesh; a coverage map built on the old one goes with it */
+    if (!poly_lod_matches(view->poly_lod, mesh)) {
+        poly_coverage_free(view->poly_coverage);
+        view->poly_coverage = NULL;
+        poly_lod_free(view->poly_lod);
+        view->poly_lod = poly_lod_build(mesh);
+    }
+
+    /* Scan conversion only happens for a new mesh, display size, LOD mode or shading */
     size_t width = view->display_nx;
     size_t height = view->display_ny;
-    
-    /* Clear to black */
-    memset(view->pixels, 0, width * height * 3);
-    
+    if (!poly_coverage_matches(view->poly_coverage, mesh, view->poly_lod,
+                               width, height, view->poly_lod_mode, view->poly_shading)) {
+        poly_coverage_free(view->poly_coverage);
+        view->poly_coverage = poly_coverage_build(mesh, view->poly_lod, width, height,
+                                                  view->poly_lod_mode, view->poly_shading);
+        if (!view->poly_coverage) return -1;
+    }
+
     /* Get colormap */
     USColormap *cmap = colormap_get_current();
     if (!cmap) return -1;
-    
-    float data_min = view->variable->user_min;
-    float data_max = view->variable->user_max;
-    float data_range = data_max - data_min;
-    if (data_range <= 0.0f) data_range = 1.0f;
-    
-    /* For each element, compute average value and render triangle */
-    for (size_t e = 0; e < mesh->n_elements; e++) {
-        int *nodes = &mesh->elem_nodes[e * mesh->n_vertices];
-        
-        /* Get vertex coordinates */
-        double lons[4], lats[4];
-        float values[4];
-        int valid = 1;
-        float sum_val = 0.0f;
-        int n_valid_vals = 0;
-        
-        for (int v = 0; v < mesh->n_vertices; v++) {
-            int node_idx = nodes[v];
-            if (node_idx < 0 || (size_t)node_idx >= mesh->n_points) {
-                valid = 0;
-                break;
-            }
-            lons[v] = mesh->lon[node_idx];
-            lats[v] = mesh->lat[node_idx];
-            values[v] = view->raw_data[node_idx];
-            
-            /* Check for fill value */
-            if (values[v] != view->variable->fill_value && 
-                fabsf(values[v]) < 1e30f) {
-                sum_val += values[v];
-                n_valid_vals++;
-            }
-        }
-        
-        if (!valid || n_valid_vals == 0) continue;
-        
-        /* Skip elements that span the dateline (lon difference > 180) */
-        double max_lon_diff = 0.0;
-        for (int v = 0; v < mesh->n_vertices; v++) {
-            for (int w = v + 1; w < mesh->n_vertices; w++) {
-                double diff = fabs(lons[v] - lons[w]);
-                if (diff > max_lon_diff) max_lon_diff = diff;
-            }
-        }
-        if (max_lon_diff > 180.0) continue;  /* Skip dateline-crossing elements */
-        
-        /* Compute average value and map to color */
-        float avg_val = sum_val / (float)n_valid_vals;
-        float t = (avg_val - data_min) / data_range;
-        if (t < 0.0f) t = 0.0f;
-        if (t > 1.0f) t = 1.0f;
-        
-        unsigned char r, g, b;
-        colormap_map_value(cmap, t, &r, &g, &b);
-        
-        /* Convert vertices to pixel coordinates */
-        int px[4], py[4];
-        for (int v = 0; v < mesh->n_vertices; v++) {
-            lonlat_to_pixel(lons[v], lats[v], width, height, &px[v], &py[v]);
-        }
-        
-        /* Render triangle(s) */
-        fill_triangle(view->pixels, width, height,
-                      px[0], py[0], px[1], py[1], px[2], py[2], r, g, b);
-        
-        /* If quad (4 vertices), render second triangle */
-        if (mesh->n_vertices == 4) {
-            fill_triangle(view->pixels, width, height,
-                          px[0], py[0], px[2], py[2], px[3], py[3], r, g, b);
-        }
-    }
-    
-    return 0;
+
+    return poly_coverage_render(view->poly_coverage, view->raw_data,
+                                view->variable->fill_value, cmap,
+                                view->variable->user_min, view->variable->user_max,
+                                view->pixels);
 }
 
-int view_update(USView *view) {
-    if (!view || !view->variable || !view->mesh) return -1;
-    
-    /* Polygon mode doesn't need regrid */
-    if (view->render_mode != RENDER_MODE_POLYGON && !view->regrid) return -1;
+int view_read_var_slice(USVar *var, USFileSet *fileset, size_t time_idx, size_t depth_idx,
+                        float *out) {
+    if (!var || !out) return -1;
 
-    /* Read data slice - dispatch based on file type */
+    /* Dispatch based on file type */
     int read_result;
 #ifdef HAVE_ZARR
-    if (view->fileset && view->fileset->files[0]->file_type == FILE_TYPE_ZARR) {
+    if (fileset && fileset->files[0]->file_type == FILE_TYPE_ZARR) {
         /* Zarr multi-file */
-        read_result = zarr_read_slice_fileset(view->fileset, view->variable,
-                                              view->time_index, view->depth_index,
-                                              view->raw_data);
-    } else if (view->variable->file && view->variable->file->file_type == FILE_TYPE_ZARR) {
+        read_result = zarr_read_slice_fileset(fileset, var, time_idx, depth_idx, out);
+    } else if (var->file && var->file->file_type == FILE_TYPE_ZARR) {
         /* Single zarr file */
-        read_result = zarr_read_slice(view->variable, view->time_index,
-                                      view->depth_index, view->raw_data);
+        read_result = zarr_read_slice(var, time_idx, depth_idx, out);
     } else
 #endif
 #ifdef HAVE_GRIB
-    if (view->fileset && view->fileset->files[0]->file_type == FILE_TYPE_GRIB) {
-        read_result = grib_read_slice_fileset(view->fileset, view->variable,
-                                              view->time_index, view->depth_index,
-                                              view->raw_data);
-    } else if (view->variable->file && view->variable->file->file_type == FILE_TYPE_GRIB) {
-        read_result = grib_read_slice(view->variable, view->time_index,
-                                      view->depth_index, view->raw_data);
+    if (fileset && fileset->files[0]->file_type == FILE_TYPE_GRIB) {
+        read_result = grib_read_slice_fileset(fileset, var, time_idx, depth_idx, out);
+    } else if (var->file && var->file->file_type == FILE_TYPE_GRIB) {
+        read_result = grib_read_slice(var, time_idx, depth_idx, out);
     } else
 #endif
-    if (view->fileset) {
-        read_result = netcdf_read_slice_fileset(view->fileset, view->variable,
-                                                 view->time_index, view->depth_index,
-                                                 view->raw_data);
+    if (fileset) {
+        read_result = netcdf_read_slice_fileset(fileset, var, time_idx, depth_idx, out);
     } else {
-        read_result = netcdf_read_slice(view->variable, view->time_index,
-                                        view->depth_index, view->raw_data);
+        read_result = netcdf_read_slice(var, time_idx, depth_idx, out);
     }
 
     if (read_result != 0) {
         fprintf(stderr, "Failed to read data slice\n");
         return -1;
     }
+    return 0;
+}
+
+int view_fetch_slice(const USView *view, size_t time_idx, size_t depth_idx, float *out) {
+    USSliceKey key = slice_key_make(view->variable, view->fileset, time_idx, depth_idx);
+    size_t n = view->raw_data_size;
+    if (anim_store_get(view->anim_store, &key, out, n) ||
+        slice_cache_get(view->slice_cache, &key, out, n)) {
+        return 0;
+    }
+
+    prefetch_pause(view->prefetch);
+    int rc = 0;
+    /* The prefetcher may have stored it while we waited */
+    if (!slice_cache_peek(view->slice_cache, &key, out, n)) {
+        rc = view_read_var_slice(view->variable, view->fileset, time_idx, depth_idx, out);
+        if (rc == 0) {
+            slice_cache_put(view->slice_cache, &key, out, n);
+        }
+    }
+    prefetch_resume(view->prefetch);
+    return rc;
+}
+
+int view_load_animation(USView *view, AnimStoreMode mode) {
+    if (!view || !view->variable || view->n_times == 0 || !view->raw_data) return -1;
+
+    USSliceKey key = slice_key_make(view->variable, view->fileset, 0, view->depth_index);
+    size_t n = view->raw_data_size;
+    USAnimStore *store = anim_store_create(&key, view->n_times, n, mode,
+                                           view->variable->fill_value);
+    float *slice = malloc(n * sizeof(float));
+    if (!store || !slice) {
+        anim_store_free(store);
+        free(slice);
+        return -1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    /* Cached slices are reused; the rest are read without filling the cache */
+    prefetch_pause(view->prefetch);
+    int rc = 0;
+    size_t report = (view->n_times + 9) / 10;
+    for (size_t t = 0; t < view->n_times && rc == 0; t++) {
+        key.time_index = t;
+        if (!anim_store_get(view->anim_store, &key, slice, n) &&
+            !slice_cache_peek(view->slice_cache, &key, slice, n)) {
+            rc = view_read_var_slice(view->variable, view->fileset, t, view->depth_index, slice);
+        }
+        if (rc == 0) rc = anim_store_put(store, t, slice);
+        if (rc == 0 && (t + 1) % report == 0) {
+            printf("Loading animation: %zu/%zu\n", t + 1, view->n_times);
+            fflush(stdout);
+        }
+    }
+    prefetch_resume(view->prefetch);
+    free(slice);
+
+    if (rc != 0) {
+        fprintf(stderr, "Failed to load animation\n");
+        anim_store_free(store);
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    USAnimStoreStats st;
+    anim_store_get_stats(store, &st);
+    printf("Animation loaded: %zu steps, %.1f MB -> %.1f MB (%.2fx) in %.1f s",
+           st.n_stored, st.raw_bytes / 1048576.0, st.stored_bytes / 1048576.0,
+           st.stored_bytes ? (double)st.raw_bytes / (double)st.stored_bytes : 0.0,
+           (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9);
+    if (mode == ANIM_STORE_U16) printf(", max error %.3g", st.max_error);
+    printf("\n");
+
+    anim_store_free(view->anim_store);
+    view->anim_store = store;
+    return 0;
+}
+
+/*
+ * Quantise the current frame into index_image (north up): fused frames
+ * gather source values through pixel_src, others read regridded_data.
+ * With count set, index_hist gets the entry counts in the same pass; the
+ * frame statistics are gathered row by row too unless already current.
+ * Without a lut only the statistics are gathered.
+ */
+static int view_quantise(USView *view, const USColorLUT *lut, int fused, int count) {
+    size_t nx = view->data_nx, ny = view->data_ny;
+    uint32_t *hist = count ? view->index_hist : NULL;
+    if (hist) memset(hist, 0, (COLORMAP_LUT_SIZE + 1) * sizeof(uint32_t));
+    USFrameStats *st = view->stats_valid ? NULL : view->frame_stats;
+    if (st) {
+        float lo, hi;
+        view_get_stats_range(view, &lo, &hi);
+        frame_stats_begin(st, lo, hi, view->variable->fill_value);
+    }
+
+    if (fused) {
+        float *values = malloc(nx * sizeof(float));
+        if (!values) return -1;
+        const float *raw = view->raw_data;
+        float fill_value = view->variable->fill_value;
+        for (size_t y = 0; y < ny; y++) {
+            const RegridIndex *src = view->pixel_src + y * nx;
+            for (size_t x = 0; x < nx; x++) {
+                values[x] = (src[x] == PIXEL_SRC_NONE) ? fill_value : raw[src[x]];
+            }
+            if (lut) colormap_lut_index_hist(lut, values, nx, view->index_image + y * nx, hist);
+            if (st) frame_stats_add_row(st, values, nx, view->row_weight[ny - 1 - y]);
+        }
+        free(values);
+    } else {
+        for (size_t y = 0; y < ny; y++) {
+            size_t src_row = ny - 1 - y;  /* Flip: top of screen = north = last data row */
+            if (lut) {
+                colormap_lut_index_hist(lut, view->regridded_data + src_row * nx, nx,
+                                        view->index_image + y * nx, hist);
+            }
+            if (st) frame_stats_add_row(st, view->regridded_data + src_row * nx, nx,
+                                        view->row_weight[src_row]);
+        }
+    }
+    if (st) {
+        frame_stats_finish(st);
+        view->stats_valid = 1;
+    }
+    if (!lut) return 0;
+
+    *view->index_lut = *lut;
+    view->index_valid = 1;
+    view->index_hist_valid = count;
+    return 0;
+}
+
+/* Set the user range to the frame's percentiles; kept if the frame is flat or empty */
+static void view_apply_autoscale(USView *view) {
+    float lo, hi;
+    if (!view->stats_valid ||
+        frame_stats_percentile(view->frame_stats, FRAME_STATS_LOW_PCT, &lo) != 0 ||
+        frame_stats_percentile(view->frame_stats, FRAME_STATS_HIGH_PCT, &hi) != 0 ||
+        !(hi > lo)) return;
+    view->variable->user_min = lo;
+    view->variable->user_max = hi;
+}
+
+/*
+ * Palette that paints index_image with the current colormap, range and
+ * norm in the given format. The image is quantised again only if the data
+ * changed or the range moved further than a palette remap can show; for
+ * histogram equalisation also if the entries have not been counted. With
+ * autoscale a new frame's statistics are gathered first, so it is
+ * quantised once for its percentile range.
+ */
+static int view_index_palette(USView *view, unsigned dirty, PixelFormat format, int fused,
+                              USColorLUT *palette) {
+    USVar *var = view->variable;
+    USColormap *cmap = colormap_get_current();
+    int fresh = view->index_valid && !(dirty & (VIEW_DIRTY_DATA | VIEW_DIRTY_REGRID));
+
+    if (view->autoscale) {
+        if (!view->stats_valid && view_quantise(view, NULL, fused, 0) != 0) return -1;
+        view_apply_autoscale(view);
+    }
+
+    USColorLUT target;
+    if (colormap_lut_build_norm(&target, cmap, format, var->user_min, var->user_max,
+                                var->fill_value, &view->color_norm) != 0) return -1;
+    if (target.norm.mode == COLOR_NORM_HISTEQ) {
+        if (!fresh || !view->index_hist_valid ||
+            !colormap_lut_same_quant(&target, view->index_lut)) {
+            if (view_quantise(view, &target, fused, 1) != 0) return -1;
+        }
+        colormap_lut_equalize(&target, cmap, view->index_hist);
+        *palette = target;
+    } else if (!fresh || colormap_lut_remap(palette, &target, view->index_lut) != 0) {
+        if (view_quantise(view, &target, fused, 0) != 0) return -1;
+        *palette = target;
+    }
+    *view->palette = *palette;
+    view->palette_valid = 1;
+    return 0;
+}
+
+/*
+ * Render the frame straight into native_pixels from the index image. For
+ * fused nearest-neighbour maps the image is quantised from raw_data and
+ * regridded_data is left behind; the RGB buffers are always left behind.
+ */
+static void view_render_native(USView *view, unsigned dirty) {
+    int fused = view_fused_active(view);
+    if (!fused && (view->regrid_stale || (dirty & VIEW_DIRTY_REGRID))) {
+        regrid_apply(view->regrid, view->raw_data, view->variable->fill_value,
+                     view->regridded_data);
+        view->regrid_stale = 0;
+    }
+
+    USColorLUT palette;
+    if (view_index_palette(view, dirty, view->native_format, fused, &palette) != 0) return;
+    if (fused && (dirty & VIEW_DIRTY_REGRID)) view->regrid_stale = 1;
+
+    colormap_paint_native(&palette, view->index_image, view->data_nx, view->data_ny,
+                          view->native_pixels, view->scale_factor);
+    view->native_valid = 1;
+    view->rgb_stale = 1;
+}
+
+/* Regrid, colormap, then expand to the display scale, from the first dirty stage */
+static void view_render_rgb(USView *view, unsigned dirty) {
+    if (dirty & VIEW_DIRTY_REGRID) {
+        regrid_apply(view->regrid, view->raw_data,
+                     view->variable->fill_value, view->regridded_data);
+        dirty |= VIEW_DIRTY_COLOR;
+    }
+
+    if (dirty & VIEW_DIRTY_COLOR) {
+        USColorLUT palette;
+        if (view_index_palette(view, dirty, PIXEL_FORMAT_XRGB8888, 0, &palette) == 0) {
+            colormap_paint_rgb(&palette, view->index_image, view->data_nx * view->data_ny,
+                               view->color_pixels);
+        }
+        dirty |= VIEW_DIRTY_SCALE;
+    }
+
+    if (dirty & VIEW_DIRTY_SCALE) {
+        colormap_expand_pixels(view->color_pixels, view->data_nx, view->data_ny,
+                               view->pixels, view->scale_factor);
+    }
+}
+
+/* Bring the RGB buffers up to date after native frames */
+static void view_sync_rgb(USView *view) {
+    if (!view->rgb_stale) return;
+    if (view->regrid_stale) {
+        regrid_apply(view->regrid, view->raw_data, view->variable->fill_value,
+                     view->regridded_data);
+        view->regrid_stale = 0;
+    }
+    /* The index image is current, so this only paints */
+    view_render_rgb(view, VIEW_DIRTY_COLOR);
+    view->rgb_stale = 0;
+}
+
+int view_update(USView *view) {
+    if (!view || !view->variable || !view->mesh) return -1;
+    
+    /* Polygon mode doesn't need regrid */
+    if (view->render_mode != RENDER_MODE_POLYGON && !view->regrid) return -1;
+
+    /* Each stage re-runs only if it or an earlier stage is dirty */
+    unsigned dirty = view->dirty;
+    if (dirty & (VIEW_DIRTY_DATA | VIEW_DIRTY_REGRID)) view->stats_valid = 0;
+
+    if (dirty & VIEW_DIRTY_DATA) {
+        if (view_fetch_slice(view, view->time_index, view->depth_index,
+                             view->raw_data) != 0) return -1;
+        dirty |= VIEW_DIRTY_ALL;
+        /* Start on the next slices while this one is rendered, unless all are in memory */
+        USSliceKey key = slice_key_make(view->variable, view->fileset,
+                                        view->time_index, view->depth_index);
+        if (!anim_store_covers(view->anim_store, &key)) {
+            prefetch_schedule(view->prefetch, view);
+        }
+    }
 
     /* Render based on mode */
     if (view->render_mode == RENDER_MODE_POLYGON) {
-        /* Direct polygon rendering */
+        /* Direct polygon rendering from the cached slice */
+        if (!dirty) {
+            view->data_valid = 1;
+            return 0;
+        }
         if (view_render_polygons(view) != 0) {
             fprintf(stderr, "Polygon rendering failed, falling back to interpolate\n");
             view->render_mode = RENDER_MODE_INTERPOLATE;
+            dirty |= VIEW_DIRTY_REGRID;
             /* Fall through to interpolate mode */
         } else {
+            view->native_valid = 0;
+            view->rgb_stale = 0;    /* pixels now hold the polygons */
+            view->dirty = 0;
             view->data_valid = 1;
             return 0;
         }
     }
-    
-    /* Interpolate mode: regrid and colormap */
-    regrid_apply(view->regrid, view->raw_data,
-                 view->variable->fill_value, view->regridded_data);
 
-    /* Convert to pixels with scaling */
-    USColormap *cmap = colormap_get_current();
-    if (cmap) {
-        colormap_apply_scaled(cmap, view->regridded_data,
-                              view->data_nx, view->data_ny,
-                              view->variable->user_min, view->variable->user_max,
-                              view->variable->fill_value,
-                              view->pixels,
-                              view->scale_factor);
+    if (view->native_pixels && view->render_mode == RENDER_MODE_INTERPOLATE) {
+        /* Colour and scale are a single pass into native pixels */
+        if (dirty) view_render_native(view, dirty);
+    } else {
+        view->native_valid = 0;
+        if (view->regrid_stale) dirty |= VIEW_DIRTY_REGRID;
+        else if (view->rgb_stale) dirty |= VIEW_DIRTY_COLOR;
+        view->rgb_stale = 0;
+        view->regrid_stale = 0;
+        view_render_rgb(view, dirty);
     }
 
+    view->dirty = 0;
     view->data_valid = 1;
     return 0;
 }
 
 unsigned char *view_get_pixels(USView *view, size_t *width, size_t *height) {
     if (!view) return NULL;
+    view_sync_rgb(view);
     if (width) *width = view->display_nx;
     if (height) *height = view->display_ny;
     return view->pixels;
 }
 
+int view_set_native_format(USView *view, PixelFormat format) {
+    if (!view) return -1;
+    if (colormap_pixel_bytes(format) == 0) format = PIXEL_FORMAT_NONE;
+    if (view->native_format == format) return 0;
+
+    /* Leave the RGB buffers current before the path changes */
+    view_sync_rgb(view);
+    view->native_format = format;
+
+    if (view_alloc_native(view) != 0 || view_build_pixel_src(view) != 0) {
+        view->native_format = PIXEL_FORMAT_NONE;
+        return -1;
+    }
+    return 0;
+}
+
+int view_set_pixel_allocator(USView *view, void *(*alloc)(size_t bytes),
+                              void (*release)(void *pixels)) {
+    if (!view || (!alloc) != (!release)) return -1;
+    view_sync_rgb(view);
+    view_free_pixels(view, view->native_pixels);
+    view->native_pixels = NULL;
+    view->pixel_alloc = alloc;
+    view->pixel_free = release;
+    return view_alloc_native(view);
+}
+
+const void *view_get_native_pixels(USView *view, size_t *width, size_t *height) {
+    if (!view || !view->native_valid) return NULL;
+    if (width) *width = view->display_nx;
+    if (height) *height = view->display_ny;
+    return view->native_pixels;
+}
+
+float view_get_value(const USView *view, size_t x, size_t y) {
+    if (view->regrid_stale) {
+        /* regridded_data is behind; read through the fused index table */
+        RegridIndex s = view->pixel_src[(view->data_ny - 1 - y) * view->data_nx + x];
+        if (s == PIXEL_SRC_NONE) return view->variable->fill_value;
+        /* Invalid sources become the fill value, as regrid_apply() makes them */
+        float value = view->raw_data[s];
+        return (fabsf(value) < INVALID_DATA_THRESHOLD) ? value : view->variable->fill_value;
+    }
+    return view->regridded_data[y * view->data_nx + x];
+}
+
 void view_free(USView *view) {
     if (!view) return;
     free(view->raw_data);
     free(view->regridded_data);
+    free(view->color_pixels);
+    free(view->index_image);
+    free(view->index_lut);
+    free(view->palette);
+    free(view->index_hist);
+    free(view->row_weight);
+    free(view->frame_stats);
     free(view->pixels);
+    view_free_pixels(view, view->native_pixels);
+    free(view->pixel_src);
+    poly_coverage_free(view->poly_coverage);
+    poly_lod_free(view->poly_lod);
+    anim_store_free(view->anim_store);
+    range_scan_free(view->range_scan);
     free(view);
 }
 
 int view_save_ppm(USView *view, const char *filename) {
     if (!view || !view->pixels || !filename) return -1;
+    view_sync_rgb(view);
 
     FILE *fp = fopen(filename, "wb");
     if (!fp) {
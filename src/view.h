@@ -23,6 +23,66 @@ int view_set_variable(USView *view, USVar *var, USMesh *mesh, USRegrid *regrid);
  */
 void view_set_fileset(USView *view, USFileSet *fileset);
 
+/*
+ * Serve slice reads from cache (NULL to always read from file).
+ * The cache is not owned by the view and may be shared.
+ */
+void view_set_slice_cache(USView *view, USSliceCache *cache);
+
+/*
+ * Read ahead along the direction of travel with pf after each update
+ * (NULL to disable). The prefetcher is not owned by the view.
+ */
+void view_set_prefetcher(USView *view, USPrefetcher *pf);
+
+/*
+ * Compute the exact range of each variable in the background, on the
+ * prefetcher's worker, after view_set_variable() has shown the sampled
+ * estimate. Finished scans are kept in cache_dir (NULL for none), which
+ * must outlive the view. Needs a prefetcher.
+ */
+void view_set_range_scan(USView *view, int enabled, const char *cache_dir);
+
+/*
+ * Fold the range scan's progress into the variable's global range, and
+ * its display range too while that still equals the global range.
+ * Returns 1 if the global range changed.
+ */
+int view_poll_range(USView *view);
+
+/*
+ * Exact range of the current variable at the current depth, once the scan
+ * has covered every time step there. Returns 0 on success, -1 otherwise.
+ */
+int view_get_depth_range(const USView *view, float *min_val, float *max_val);
+
+/*
+ * Read one slice of var (virtual time index if fileset is non-NULL) into
+ * out, bypassing the slice cache. Not synchronised: callers other than
+ * the view must hold prefetch_pause().
+ * Returns 0 on success, -1 on failure.
+ */
+int view_read_var_slice(USVar *var, USFileSet *fileset, size_t time_idx, size_t depth_idx,
+                        float *out);
+
+/*
+ * Read a slice of the current variable into out [raw_data_size], from the
+ * view's animation store or slice cache and in step with its prefetcher. Only the
+ * variable, fileset, store, cache and prefetcher are used, so other threads can
+ * pass a snapshot copy of the view.
+ * Returns 0 on success, -1 on failure.
+ */
+int view_fetch_slice(const USView *view, size_t time_idx, size_t depth_idx, float *out);
+
+/*
+ * Read every time step of the current variable at the current depth into
+ * a compressed in-memory store, so that stepping and animation no longer
+ * touch the files. Replaces any earlier store. Stop the animation
+ * pipeline first. Returns 0 on success, -1 on failure (the earlier store
+ * is kept).
+ */
+int view_load_animation(USView *view, AnimStoreMode mode);
+
 /*
  * Set time index and reload data.
  */
@@ -57,23 +117,98 @@ int view_set_render_mode(USView *view, RenderMode mode);
  */
 int view_toggle_render_mode(USView *view);
 
+/*
+ * Set how values are normalised onto the colormap. Interpolated frames
+ * follow it; polygon mode keeps linear scaling.
+ */
+void view_set_color_norm(USView *view, const USColorNorm *norm);
+
+/*
+ * Colormap position [0, 1] of value in the last painted frame (linear
+ * before the first), or -1 for missing data; and the value shown at a
+ * position, for colorbar labels.
+ */
+float view_color_position(const USView *view, float value);
+float view_color_value(const USView *view, float pos);
+
+/*
+ * Area-weighted statistics of the current interpolated frame, or NULL if
+ * there are none (polygon mode, or before the first frame).
+ */
+const USFrameStats *view_get_stats(const USView *view);
+
+/*
+ * Histogram range for the next frames' statistics: the exact range of the
+ * depth level if scanned, else the estimate widened by the last frame.
+ */
+void view_get_stats_range(const USView *view, float *min_val, float *max_val);
+
+/*
+ * Follow each frame's FRAME_STATS_LOW_PCT..FRAME_STATS_HIGH_PCT
+ * percentiles as the user range (on), or keep the range fixed (off).
+ */
+void view_set_autoscale(USView *view, int enabled);
+
 /*
  * Check if polygon rendering is available for current mesh.
  */
 int view_polygon_available(USView *view);
 
+/*
+ * Mark pipeline stages (VIEW_DIRTY_*) for recomputation by view_update().
+ * Use VIEW_DIRTY_COLOR after a colormap or range change.
+ */
+void view_invalidate(USView *view, unsigned stages);
+
 /*
  * Update display: read data, regrid, and convert to pixels.
+ * Only the stages marked dirty since the last update are re-run.
  */
 int view_update(USView *view);
 
 /*
- * Get current pixel buffer for display.
+ * Get current pixel buffer for display (RGB, 3 bytes per pixel). Brings
+ * the buffer up to date first if the last frame went through the native
+ * path.
  */
 unsigned char *view_get_pixels(USView *view, size_t *width, size_t *height);
 
 /*
- * Free view and all associated memory.
+ * Enable native rendering for interpolated mode: view_update() then maps
+ * values through a quantised colour LUT straight into display pixels of
+ * the given format, skipping the RGB buffers. Nearest-neighbour maps are
+ * fused, reading source values through a per-cell index table without the
+ * regridded buffer. PIXEL_FORMAT_NONE disables it. Call before
+ * view_set_variable(), or follow with view_invalidate().
+ */
+int view_set_native_format(USView *view, PixelFormat format);
+
+/*
+ * Allocate native pixel buffers (the view's and the animation frames')
+ * with alloc/release instead of malloc/free, so the display can hand out
+ * memory it shows without a copy. Both or neither must be set. Returns 0
+ * on success, -1 on bad arguments or allocation failure.
+ */
+int view_set_pixel_allocator(USView *view, void *(*alloc)(size_t bytes),
+                              void (*release)(void *pixels));
+void *view_alloc_pixels(const USView *view, size_t bytes);
+void view_free_pixels(const USView *view, void *pixels);
+
+/*
+ * Get the display-native pixels of the current frame, or NULL if the
+ * frame was not rendered by the native path (use view_get_pixels()).
+ */
+const void *view_get_native_pixels(USView *view, size_t *width, size_t *height);
+
+/*
+ * Value shown at data grid cell (x, y), y counted from the south.
+ * Works whichever path rendered the frame.
+ */
+float view_get_value(const USView *view, size_t x, size_t y);
+
+/*
+ * Free view and all associated memory. Free the prefetcher first, since
+ * its worker may still be running the view's range scan.
  */
 void view_free(USView *view);
 
@@ -0,0 +1,185 @@
+/*
+ * bench_regrid.c - Timing of regrid_create nearest-neighbor query strategies
+ *
+ * Builds the same regrid with each RegridQueryStrategy on a synthetic
+ * unstructured mesh and reports the best wall time of several builds,
+ * checking the results agree, then times regrid_apply with each supported kernel.
+ *
+ * Usage: bench_regrid [n_points] [resolution_deg] [radius_m]
+ */
+
+#include "../src/ushow.defines.h"
+#include "../src/mesh.h"
+#include "../src/regrid.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Builds per strategy; the fastest is reported */
+#define BENCH_BUILDS 3
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Points uniformly distributed on the sphere (fixed seed) */
+static USMesh *create_random_mesh(size_t n) {
+    double *lon = malloc(n * sizeof(double));
+    double *lat = malloc(n * sizeof(double));
+    if (!lon || !lat) {
+        free(lon);
+        free(lat);
+        return NULL;
+    }
+
+    srand(12345);
+    for (size_t i = 0; i < n; i++) {
+        double u = (double)rand() / RAND_MAX;
+        double v = (double)rand() / RAND_MAX;
+        lon[i] = -180.0 + 360.0 * u;
+        lat[i] = asin(2.0 * v - 1.0) * 180.0 / M_PI;
+    }
+
+    return mesh_create(lon, lat, n, COORD_TYPE_1D_UNSTRUCTURED);
+}
+
+/* Time regrid_apply per kernel (best of several frames) and check agreement */
+static int bench_apply(const USRegrid *regrid, size_t n_points) {
+    static const struct {
+        RegridApplyKernel kernel;
+        const char *name;
+    } kernels[] = {
+        { REGRID_APPLY_SCALAR, "scalar" },
+        { REGRID_APPLY_AVX2,   "avx2" },
+        { REGRID_APPLY_AVX512, "avx512" },
+    };
+    size_t n_target = regrid->target_nx * regrid->target_ny;
+    float *source = malloc(n_points * sizeof(float));
+    float *expect = malloc(n_target * sizeof(float));
+    float *out = malloc(n_target * sizeof(float));
+    int failed = 0;
+    if (!source || !expect || !out) {
+        free(source);
+        free(expect);
+        free(out);
+        return -1;
+    }
+    for (size_t i = 0; i < n_points; i++) {
+        source[i] = (i % 10 == 0) ? DEFAULT_FILL_VALUE : (float)i;
+    }
+
+    printf("regrid_apply (%zu target points):\n", n_target);
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (regrid_set_apply_kernel(kernels[k].kernel) != 0) continue;
+        double best = 1e30;
+        for (int rep = 0; rep < 10; rep++) {
+            double t0 = now_seconds();
+            regrid_apply(regrid, source, DEFAULT_FILL_VALUE, out);
+            double t = now_seconds() - t0;
+            if (t < best) best = t;
+        }
+        if (k == 0) {
+            memcpy(expect, out, n_target * sizeof(float));
+        } else if (memcmp(expect, out, n_target * sizeof(float)) != 0) {
+            fprintf(stderr, "regrid_apply differs: %s vs scalar\n", kernels[k].name);
+            failed = 1;
+        }
+        printf("  %-6s %8.2f ms\n", kernels[k].name, best * 1e3);
+    }
+    regrid_set_apply_kernel(REGRID_APPLY_AUTO);
+
+    free(source);
+    free(expect);
+    free(out);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    size_t n_points = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    double resolution = (argc > 2) ? atof(argv[2]) : 0.25;
+    double radius = (argc > 3) ? atof(argv[3]) : 200000.0;
+    if (n_points == 0 || resolution <= 0.0 || radius < 0.0) {
+        fprintf(stderr, "Usage: %s [n_points] [resolution_deg] [radius_m]\n", argv[0]);
+        return 1;
+    }
+
+    USMesh *mesh = create_random_mesh(n_points);
+    if (!mesh) {
+        fprintf(stderr, "Failed to create mesh\n");
+        return 1;
+    }
+
+    static const struct {
+        RegridQueryStrategy strategy;
+        const char *name;
+    } strategies[] = {
+        { REGRID_QUERY_BATCH, "batch" },
+        { REGRID_QUERY_WALK,  "walk" },
+        { REGRID_QUERY_COLD,  "cold" },
+    };
+    const int n_strategies = sizeof(strategies) / sizeof(strategies[0]);
+    double seconds[sizeof(strategies) / sizeof(strategies[0])];
+    USRegrid *reference = NULL;
+    int failed = 0;
+
+    /* Keep the per-band progress output out of the report */
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+
+    for (int s = 0; s < n_strategies && !failed; s++) {
+        regrid_set_query_strategy(strategies[s].strategy);
+        seconds[s] = 1e30;
+        for (int rep = 0; rep < BENCH_BUILDS && !failed; rep++) {
+            fflush(stdout);
+            if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+            double t0 = now_seconds();
+            USRegrid *regrid = regrid_create(mesh, resolution, radius);
+            double t = now_seconds() - t0;
+            fflush(stdout);
+            if (saved_stdout >= 0) dup2(saved_stdout, STDOUT_FILENO);
+            if (!regrid) {
+                fprintf(stderr, "regrid_create failed (%s)\n", strategies[s].name);
+                failed = 1;
+                break;
+            }
+            if (t < seconds[s]) seconds[s] = t;
+
+            if (!reference) {
+                reference = regrid;
+                continue;
+            }
+            size_t n_target = regrid->target_nx * regrid->target_ny;
+            if (memcmp(regrid->nn_indices, reference->nn_indices,
+                       n_target * sizeof(RegridIndex)) != 0 ||
+                memcmp(regrid->valid_bits, reference->valid_bits,
+                       REGRID_BIT_WORDS(n_target) * sizeof(uint64_t)) != 0) {
+                fprintf(stderr, "Results differ: %s vs %s\n", strategies[s].name,
+                        strategies[0].name);
+                failed = 1;
+            }
+            regrid_free(regrid);
+        }
+    }
+    regrid_set_query_strategy(REGRID_QUERY_WALK);
+    if (devnull >= 0) close(devnull);
+    if (saved_stdout >= 0) close(saved_stdout);
+
+    if (!failed) {
+        printf("%zu source points, %zu x %zu target grid, radius %.0f m\n",
+               n_points, reference->target_nx, reference->target_ny, radius);
+        for (int s = 0; s < n_strategies; s++) {
+            printf("  %-6s %8.3f s\n", strategies[s].name, seconds[s]);
+        }
+        if (bench_apply(reference, n_points) != 0) failed = 1;
+    }
+
+    regrid_free(reference);
+    mesh_free(mesh);
+    return failed;
+}
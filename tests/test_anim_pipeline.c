@@ -0,0 +1,246 @@
+/*
+ * test_anim_pipeline.c - Tests for pipelined animation over a preloaded store
+ *
+ * Frames come from an in-memory animation store, so the read stage never
+ * touches a file. Build the test_anim_pipeline_tsan variant to run the
+ * same cases under ThreadSanitizer.
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/anim_pipeline.h"
+#include "../src/anim_store.h"
+#include "../src/colormaps.h"
+#include "../src/frame_stats.h"
+#include "../src/mesh.h"
+#include "../src/prefetch.h"
+#include "../src/regrid.h"
+#include "../src/view.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define GRID_NX    36
+#define GRID_NY    18
+#define N_TIMES    5
+#define N_FRAMES   (3 * N_TIMES)
+#define FILL       (-999.0f)
+
+typedef struct {
+    USMesh      *mesh;
+    USRegrid    *regrid;
+    USVar        var;
+    USView      *view;
+    USPrefetcher *prefetch;
+} Fixture;
+
+/* Slice t: a ramp in longitude shifted by t, with fills and values beyond the range */
+static void fill_slice(float *data, size_t t) {
+    for (size_t i = 0; i < GRID_NX * GRID_NY; i++) {
+        if (i % 11 == 3) data[i] = FILL;
+        else if (i % 17 == 5) data[i] = 50.0f;
+        else data[i] = (float)t + (float)(i % GRID_NX) / GRID_NX;
+    }
+}
+
+/* A view over a 10-degree mesh whose time axis is all in its animation store */
+static int fixture_init(Fixture *fx, PixelFormat format) {
+    static int colormaps_ready = 0;
+    if (!colormaps_ready) {
+        colormaps_init();
+        colormaps_ready = 1;
+    }
+
+    size_t n = GRID_NX * GRID_NY;
+    double *lon = malloc(n * sizeof(double));
+    double *lat = malloc(n * sizeof(double));
+    if (!lon || !lat) return -1;
+    for (size_t i = 0; i < n; i++) {
+        lon[i] = -175.0 + 10.0 * (double)(i % GRID_NX);
+        lat[i] = -85.0 + 10.0 * (double)(i / GRID_NX);
+    }
+    fx->mesh = mesh_create(lon, lat, n, COORD_TYPE_1D_STRUCTURED);
+    fx->regrid = fx->mesh ? regrid_create(fx->mesh, 10.0, DEFAULT_INFLUENCE_RADIUS_M) : NULL;
+    if (!fx->regrid) return -1;
+
+    memset(&fx->var, 0, sizeof(fx->var));
+    strcpy(fx->var.name, "ramp");
+    fx->var.fill_value = FILL;
+    fx->var.time_dim_id = 0;
+    fx->var.depth_dim_id = -1;
+    fx->var.dim_sizes[0] = N_TIMES;
+    fx->var.global_min = fx->var.user_min = 0.0f;
+    fx->var.global_max = fx->var.user_max = (float)N_TIMES;
+    fx->var.range_set = 1;
+
+    fx->view = view_create();
+    if (!fx->view || view_set_variable(fx->view, &fx->var, fx->mesh, fx->regrid) != 0) return -1;
+    if (format != PIXEL_FORMAT_NONE && view_set_native_format(fx->view, format) != 0) return -1;
+
+    USSliceKey key = slice_key_make(&fx->var, NULL, 0, 0);
+    USAnimStore *store = anim_store_create(&key, N_TIMES, n, ANIM_STORE_LOSSLESS, FILL);
+    float *slice = malloc(n * sizeof(float));
+    if (!store || !slice) return -1;
+    for (size_t t = 0; t < N_TIMES; t++) {
+        fill_slice(slice, t);
+        anim_store_put(store, t, slice);
+    }
+    free(slice);
+    fx->view->anim_store = store;
+
+    /* Only for its file lock: there is nothing to read ahead */
+    fx->prefetch = prefetch_create(NULL, 0);
+    if (!fx->prefetch) return -1;
+    view_set_prefetcher(fx->view, fx->prefetch);
+    return view_update(fx->view);
+}
+
+static void fixture_free(Fixture *fx) {
+    prefetch_free(fx->prefetch);
+    view_free(fx->view);
+    regrid_free(fx->regrid);
+    mesh_free(fx->mesh);
+}
+
+/* Poll until a frame is shown; returns anim_pipeline_next()'s last result */
+static int next_frame(USAnimPipeline *anim, USView *view) {
+    struct timespec ts = { 0, 1000000L };
+    for (int i = 0; i < 10000; i++) {
+        int rc = anim_pipeline_next(anim, view);
+        if (rc != 0) return rc;
+        nanosleep(&ts, NULL);
+    }
+    return 0;
+}
+
+/* Frames arrive in order, wrap around, and match the view's own rendering */
+static int check_frames(PixelFormat format) {
+    Fixture fx;
+    ASSERT_EQ_INT(fixture_init(&fx, format), 0);
+    USView *view = fx.view;
+    size_t n_data = view->data_nx * view->data_ny;
+    size_t n_bytes = view->display_nx * view->display_ny *
+                     (format == PIXEL_FORMAT_NONE ? 3 : colormap_pixel_bytes(format));
+
+    float *data = malloc(N_FRAMES * n_data * sizeof(float));
+    unsigned char *pixels = malloc(N_FRAMES * n_bytes);
+    float *slice = malloc(GRID_NX * GRID_NY * sizeof(float));
+    float *expected = malloc(n_data * sizeof(float));
+    double means[N_FRAMES];
+    ASSERT_NOT_NULL(data);
+    ASSERT_NOT_NULL(pixels);
+    ASSERT_NOT_NULL(slice);
+    ASSERT_NOT_NULL(expected);
+
+    USAnimPipeline *anim = anim_pipeline_create(view, 3);
+    ASSERT_NOT_NULL(anim);
+    for (size_t f = 0; f < N_FRAMES; f++) {
+        ASSERT_EQ_INT(next_frame(anim, view), 1);
+        ASSERT_EQ_SIZET(view->time_index, (f + 1) % N_TIMES);
+        ASSERT_TRUE(view->data_valid);
+        const void *frame = (format == PIXEL_FORMAT_NONE) ? (const void *)view->pixels
+                                                          : view->native_pixels;
+        memcpy(data + f * n_data, view->regridded_data, n_data * sizeof(float));
+        memcpy(pixels + f * n_bytes, frame, n_bytes);
+        const USFrameStats *st = view_get_stats(view);
+        means[f] = st ? st->mean : 0.0;
+    }
+
+    AnimStats stats;
+    anim_pipeline_get_stats(anim, &stats);
+    ASSERT_EQ_SIZET(stats.frames_shown, N_FRAMES);
+    ASSERT_TRUE(stats.stage[ANIM_STAGE_READ].frames >= N_FRAMES);
+    anim_pipeline_free(anim);
+
+    /* The same steps regridded directly and rendered one at a time on this thread */
+    for (size_t f = 0; f < N_FRAMES; f++) {
+        size_t t = (f + 1) % N_TIMES;
+        fill_slice(slice, t);
+        regrid_apply(fx.regrid, slice, FILL, expected);
+        ASSERT_TRUE(memcmp(data + f * n_data, expected, n_data * sizeof(float)) == 0);
+
+        ASSERT_EQ_INT(view_set_time(view, t), 0);
+        ASSERT_EQ_INT(view_update(view), 0);
+        const void *frame = (format == PIXEL_FORMAT_NONE)
+                            ? (const void *)view_get_pixels(view, NULL, NULL)
+                            : view_get_native_pixels(view, NULL, NULL);
+        ASSERT_NOT_NULL(frame);
+        ASSERT_TRUE(memcmp(pixels + f * n_bytes, frame, n_bytes) == 0);
+        const USFrameStats *st = view_get_stats(view);
+        if (st && means[f] != 0.0) ASSERT_NEAR(means[f], st->mean, 1e-9);
+    }
+
+    free(data);
+    free(pixels);
+    free(slice);
+    free(expected);
+    fixture_free(&fx);
+    return 1;
+}
+
+/* Test RGB frames from the pipeline */
+TEST(anim_pipeline_rgb_frames) {
+    return check_frames(PIXEL_FORMAT_NONE);
+}
+
+/* Test display-native frames from the pipeline */
+TEST(anim_pipeline_native_frames) {
+    return check_frames(PIXEL_FORMAT_XRGB8888);
+}
+
+/* Test a changed view ends the pipeline, and stopping with frames in flight */
+TEST(anim_pipeline_stop) {
+    Fixture fx;
+    ASSERT_EQ_INT(fixture_init(&fx, PIXEL_FORMAT_XRGB8888), 0);
+    USView *view = fx.view;
+
+    USAnimPipeline *anim = anim_pipeline_create(view, ANIM_PIPELINE_FRAMES);
+    ASSERT_NOT_NULL(anim);
+    ASSERT_EQ_INT(next_frame(anim, view), 1);
+    view_invalidate(view, VIEW_DIRTY_COLOR);
+    ASSERT_EQ_INT(anim_pipeline_next(anim, view), -1);
+    anim_pipeline_free(anim);
+
+    /* Dirty views are refused; freeing straight away joins busy workers */
+    ASSERT_NULL(anim_pipeline_create(view, ANIM_PIPELINE_FRAMES));
+    ASSERT_EQ_INT(view_update(view), 0);
+    for (int i = 0; i < 20; i++) {
+        anim = anim_pipeline_create(view, ANIM_PIPELINE_FRAMES);
+        ASSERT_NOT_NULL(anim);
+        anim_pipeline_free(anim);
+    }
+
+    /* Without a prefetcher the read stage could race other file readers */
+    view_set_prefetcher(view, NULL);
+    ASSERT_NULL(anim_pipeline_create(view, ANIM_PIPELINE_FRAMES));
+    view_set_prefetcher(view, fx.prefetch);
+
+    /* Frames that depend on each other are not pipelined */
+    view_set_autoscale(view, 1);
+    ASSERT_EQ_INT(view_update(view), 0);
+    ASSERT_NULL(anim_pipeline_create(view, ANIM_PIPELINE_FRAMES));
+
+    fixture_free(&fx);
+    return 1;
+}
+
+/* Test the workers keep their own row weights while the view is set up again */
+TEST(anim_pipeline_variable_change) {
+    Fixture fx;
+    ASSERT_EQ_INT(fixture_init(&fx, PIXEL_FORMAT_XRGB8888), 0);
+    USView *view = fx.view;
+
+    for (int i = 0; i < 20; i++) {
+        USAnimPipeline *anim = anim_pipeline_create(view, ANIM_PIPELINE_FRAMES);
+        ASSERT_NOT_NULL(anim);
+        ASSERT_EQ_INT(view_set_variable(view, &fx.var, fx.mesh, fx.regrid), 0);
+        ASSERT_EQ_INT(anim_pipeline_next(anim, view), -1);
+        anim_pipeline_free(anim);
+        ASSERT_EQ_INT(view_update(view), 0);
+    }
+
+    fixture_free(&fx);
+    return 1;
+}
+
+RUN_TESTS("Anim Pipeline")
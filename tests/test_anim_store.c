@@ -0,0 +1,137 @@
+/*
+ * test_anim_store.c - Unit tests for the compressed animation store
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/anim_store.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define N_POINTS 5000
+#define N_TIMES  6
+#define FILL     (-999.0f)
+
+/* Smooth field with a masked (fill-valued) band, changing with t */
+static void fill_slice(float *data, size_t t) {
+    for (size_t i = 0; i < N_POINTS; i++) {
+        if (i % 1000 < 300) {
+            data[i] = FILL;
+        } else {
+            data[i] = 10.0f + 5.0f * sinf((float)i * 0.01f + (float)t * 0.3f);
+        }
+    }
+}
+
+static USSliceKey make_key(size_t t, size_t d) {
+    USSliceKey key = { (const void *)0x1000, (const USVar *)0x2000, t, d };
+    return key;
+}
+
+/* Test lossless mode returns every slice bit for bit, smaller than raw */
+TEST(anim_store_lossless_roundtrip) {
+    USSliceKey key = make_key(0, 1);
+    USAnimStore *store = anim_store_create(&key, N_TIMES, N_POINTS, ANIM_STORE_LOSSLESS, FILL);
+    ASSERT_NOT_NULL(store);
+
+    float *data = malloc(N_POINTS * sizeof(float));
+    float *out = malloc(N_POINTS * sizeof(float));
+    for (size_t t = 0; t < N_TIMES; t++) {
+        fill_slice(data, t);
+        data[7] = NAN;  /* Odd bit patterns survive too */
+        ASSERT_EQ_INT(anim_store_put(store, t, data), 0);
+    }
+    key = make_key(0, 1);
+    ASSERT_TRUE(anim_store_covers(store, &key));
+
+    for (size_t t = 0; t < N_TIMES; t++) {
+        fill_slice(data, t);
+        data[7] = NAN;
+        key = make_key(t, 1);
+        ASSERT_EQ_INT(anim_store_get(store, &key, out, N_POINTS), 1);
+        ASSERT_TRUE(memcmp(data, out, N_POINTS * sizeof(float)) == 0);
+    }
+
+    USAnimStoreStats st;
+    anim_store_get_stats(store, &st);
+    ASSERT_EQ_SIZET(st.n_stored, N_TIMES);
+    ASSERT_EQ_SIZET(st.raw_bytes, (size_t)N_TIMES * N_POINTS * sizeof(float));
+    ASSERT_TRUE(st.stored_bytes < st.raw_bytes);
+    ASSERT_TRUE(st.max_error == 0.0);
+
+    free(data);
+    free(out);
+    anim_store_free(store);
+    return 1;
+}
+
+/* Test 16-bit mode stays within its reported error and keeps fill values */
+TEST(anim_store_u16_error_bound) {
+    USSliceKey key = make_key(0, 0);
+    USAnimStore *store = anim_store_create(&key, N_TIMES, N_POINTS, ANIM_STORE_U16, FILL);
+    ASSERT_NOT_NULL(store);
+
+    float *data = malloc(N_POINTS * sizeof(float));
+    float *out = malloc(N_POINTS * sizeof(float));
+    for (size_t t = 0; t < N_TIMES; t++) {
+        fill_slice(data, t);
+        ASSERT_EQ_INT(anim_store_put(store, t, data), 0);
+    }
+
+    USAnimStoreStats st;
+    anim_store_get_stats(store, &st);
+    /* Range 10 over 65534 steps: half a step is about 7.6e-5 */
+    ASSERT_TRUE(st.max_error > 0.0 && st.max_error < 1e-4);
+    ASSERT_TRUE(st.stored_bytes * 2 < st.raw_bytes);
+
+    for (size_t t = 0; t < N_TIMES; t++) {
+        fill_slice(data, t);
+        key = make_key(t, 0);
+        ASSERT_EQ_INT(anim_store_get(store, &key, out, N_POINTS), 1);
+        for (size_t i = 0; i < N_POINTS; i++) {
+            if (data[i] == FILL) {
+                ASSERT_TRUE(out[i] == FILL);
+            } else {
+                ASSERT_TRUE(fabs((double)out[i] - (double)data[i]) <= st.max_error);
+            }
+        }
+    }
+
+    free(data);
+    free(out);
+    anim_store_free(store);
+    return 1;
+}
+
+/* Test lookups miss for other depths, sizes and steps not yet stored */
+TEST(anim_store_misses) {
+    USSliceKey key = make_key(0, 2);
+    USAnimStore *store = anim_store_create(&key, N_TIMES, N_POINTS, ANIM_STORE_LOSSLESS, FILL);
+    ASSERT_NOT_NULL(store);
+
+    float *data = malloc(N_POINTS * sizeof(float));
+    fill_slice(data, 0);
+    ASSERT_EQ_INT(anim_store_put(store, 0, data), 0);
+    ASSERT_EQ_INT(anim_store_put(store, N_TIMES, data), -1);
+
+    key = make_key(0, 2);
+    ASSERT_EQ_INT(anim_store_get(store, &key, data, N_POINTS), 1);
+    ASSERT_EQ_INT(anim_store_get(store, &key, data, N_POINTS - 1), 0);
+    ASSERT_FALSE(anim_store_covers(store, &key));
+    key = make_key(1, 2);
+    ASSERT_EQ_INT(anim_store_get(store, &key, data, N_POINTS), 0);
+    key = make_key(0, 3);
+    ASSERT_EQ_INT(anim_store_get(store, &key, data, N_POINTS), 0);
+
+    /* NULL store behaves as always-miss */
+    ASSERT_EQ_INT(anim_store_get(NULL, &key, data, N_POINTS), 0);
+    ASSERT_FALSE(anim_store_covers(NULL, &key));
+    anim_store_free(NULL);
+
+    free(data);
+    anim_store_free(store);
+    return 1;
+}
+
+RUN_TESTS("Animation Store")
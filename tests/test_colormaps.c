@@ -500,4 +500,374 @@ TEST(colormap_apply_zero_range) {
     return 1;
 }
 
+/* Test colormap_expand_pixels matches colormap_apply_scaled */
+TEST(colormap_expand_matches_scaled) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("viridis");
+    ASSERT_NOT_NULL(cmap);
+
+    /* 5x3 data with a fill value and a NaN */
+    float data[15];
+    for (int i = 0; i < 15; i++) data[i] = (float)i / 14.0f;
+    data[4] = 1e20f;
+    data[9] = NAN;
+
+    unsigned char base[15 * 3];
+    colormap_apply(cmap, data, 5, 3, 0.0f, 1.0f, 1e20f, base);
+
+    for (int scale = 1; scale <= 3; scale++) {
+        size_t n = 15 * 3 * (size_t)(scale * scale);
+        unsigned char expect[15 * 3 * 9];
+        unsigned char got[15 * 3 * 9];
+        colormap_apply_scaled(cmap, data, 5, 3, 0.0f, 1.0f, 1e20f, expect, scale);
+        colormap_expand_pixels(base, 5, 3, got, scale);
+        ASSERT_TRUE(memcmp(expect, got, n) == 0);
+    }
+
+    return 1;
+}
+
+/* Helper: Native pixels from the RGB reference path */
+static void pack_expected(const unsigned char *rgb, size_t n, PixelFormat format,
+                          uint32_t *out) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = colormap_pack_pixel(format, rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+    }
+}
+
+/* Test colormap_apply_native matches colormap_apply in both pixel formats */
+TEST(colormap_native_matches_apply) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("viridis");
+    ASSERT_NOT_NULL(cmap);
+
+    /* 40x25 ramp kept clear of colour boundaries, with missing and clamped values */
+    enum { NX = 40, NY = 25, N = NX * NY };
+    static float data[N];
+    for (int i = 0; i < N; i++) data[i] = -2.0f + 4.0f * ((float)i + 0.5f) / N;
+    data[3] = -999.0f;
+    data[100] = NAN;
+    data[200] = 1e31f;
+    data[N - 1] = 50.0f;
+
+    static unsigned char rgb[N * 3];
+    static unsigned char expanded[N * 9 * 3];
+    static uint32_t expect[N * 9];
+    static uint32_t got32[N * 9];
+    static uint16_t got16[N * 9];
+
+    USColorLUT lut;
+    for (int scale = 1; scale <= 3; scale++) {
+        size_t n = (size_t)N * scale * scale;
+        colormap_apply(cmap, data, NX, NY, -2.0f, 2.0f, -999.0f, rgb);
+        colormap_expand_pixels(rgb, NX, NY, expanded, scale);
+
+        ASSERT_EQ_INT(colormap_lut_build(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                         -2.0f, 2.0f, -999.0f), 0);
+        colormap_apply_native(&lut, data, NX, NY, got32, scale);
+        pack_expected(expanded, n, PIXEL_FORMAT_XRGB8888, expect);
+        ASSERT_TRUE(memcmp(expect, got32, n * sizeof(uint32_t)) == 0);
+
+        ASSERT_EQ_INT(colormap_lut_build(&lut, cmap, PIXEL_FORMAT_RGB565,
+                                         -2.0f, 2.0f, -999.0f), 0);
+        colormap_apply_native(&lut, data, NX, NY, got16, scale);
+        pack_expected(expanded, n, PIXEL_FORMAT_RGB565, expect);
+        for (size_t i = 0; i < n; i++) ASSERT_EQ_INT(got16[i], (int)expect[i]);
+    }
+
+    ASSERT_EQ_INT(colormap_lut_build(&lut, cmap, PIXEL_FORMAT_NONE, 0.0f, 1.0f, 0.0f), -1);
+    ASSERT_EQ_INT(colormap_lut_build(&lut, NULL, PIXEL_FORMAT_XRGB8888, 0.0f, 1.0f, 0.0f), -1);
+    return 1;
+}
+
+/* Test every supported LUT kernel gives the scalar kernel's output */
+TEST(colormap_lut_kernels_match) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("hot");
+    ASSERT_NOT_NULL(cmap);
+    USColorLUT lut;
+    ASSERT_EQ_INT(colormap_lut_build(&lut, cmap, PIXEL_FORMAT_XRGB8888, 0.0f, 1.0f, -0.1f), 0);
+
+    /* Exact colour boundaries, fill values, specials, and a ragged tail */
+    enum { N = 1037 };
+    static float values[N];
+    static uint32_t expect[N], got[N];
+    static uint16_t expect_index[N], index[N];
+    for (int i = 0; i < N; i++) values[i] = (float)(i % 300) / 255.0f - 0.1f;
+    values[5] = -0.1f;
+    values[6] = NAN;
+    values[7] = INFINITY;
+    values[8] = -INFINITY;
+    values[9] = 1.0f;
+    values[N - 1] = 2e30f;
+
+    ASSERT_EQ_INT(colormap_set_lut_kernel(COLORMAP_LUT_SCALAR), 0);
+    colormap_lut_map(&lut, values, N, expect);
+    colormap_lut_index(&lut, values, N, expect_index);
+    ASSERT_EQ_INT((int)expect[5], (int)lut.colors[COLORMAP_LUT_MISSING]);
+    ASSERT_EQ_INT((int)expect[9], (int)lut.colors[(int)lut.n_steps]);
+
+    const ColormapLutKernel kernels[] = { COLORMAP_LUT_AVX2, COLORMAP_LUT_AVX512 };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (colormap_set_lut_kernel(kernels[k]) != 0) continue;
+        for (size_t n = N - 16; n <= N; n++) {
+            memset(got, 0, sizeof(got));
+            colormap_lut_map(&lut, values, n, got);
+            ASSERT_TRUE(memcmp(expect, got, n * sizeof(uint32_t)) == 0);
+            colormap_lut_index(&lut, values, n, index);
+            ASSERT_TRUE(memcmp(expect_index, index, n * sizeof(uint16_t)) == 0);
+        }
+    }
+    ASSERT_EQ_INT(colormap_set_lut_kernel(COLORMAP_LUT_AUTO), 0);
+    return 1;
+}
+
+/* Test the index image halves reproduce the direct mapping in every layout */
+TEST(colormap_index_paint_matches_map) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("viridis");
+    ASSERT_NOT_NULL(cmap);
+
+    enum { NX = 37, NY = 11, N = NX * NY };
+    static float data[N];
+    for (int i = 0; i < N; i++) data[i] = -1.0f + 3.0f * ((float)i + 0.5f) / N;
+    data[0] = -999.0f;
+    data[50] = NAN;
+
+    USColorLUT lut;
+    ASSERT_EQ_INT(colormap_lut_build(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                     -1.0f, 2.0f, -999.0f), 0);
+
+    /* Index image north up, as a view keeps it */
+    static uint16_t index[N];
+    for (int y = 0; y < NY; y++) {
+        colormap_lut_index(&lut, data + (NY - 1 - y) * NX, NX, index + y * NX);
+    }
+    ASSERT_EQ_INT(index[(NY - 1) * NX], COLORMAP_LUT_MISSING);
+
+    static uint32_t expect[N * 4], got[N * 4];
+    for (int scale = 1; scale <= 2; scale++) {
+        size_t n = (size_t)N * scale * scale;
+        colormap_apply_native(&lut, data, NX, NY, expect, scale);
+        colormap_paint_native(&lut, index, NX, NY, got, scale);
+        ASSERT_TRUE(memcmp(expect, got, n * sizeof(uint32_t)) == 0);
+    }
+
+    /* RGB painting matches colormap_apply() */
+    static unsigned char rgb_expect[N * 3], rgb_got[N * 3];
+    colormap_apply(cmap, data, NX, NY, -1.0f, 2.0f, -999.0f, rgb_expect);
+    colormap_paint_rgb(&lut, index, N, rgb_got);
+    ASSERT_TRUE(memcmp(rgb_expect, rgb_got, sizeof(rgb_got)) == 0);
+    return 1;
+}
+
+/* Test palette remapping: exact for colormap changes, close for narrower ranges */
+TEST(colormap_lut_remap_ranges) {
+    ensure_colormaps_init();
+
+    USColormap *viridis = colormap_get_by_name("viridis");
+    USColormap *hot = colormap_get_by_name("hot");
+    ASSERT_NOT_NULL(viridis);
+    ASSERT_NOT_NULL(hot);
+
+    static USColorLUT indexed, target, palette;
+    ASSERT_EQ_INT(colormap_lut_build(&indexed, viridis, PIXEL_FORMAT_XRGB8888,
+                                     0.0f, 10.0f, -999.0f), 0);
+
+    enum { N = 5000 };
+    static float values[N];
+    static uint16_t index[N];
+    static uint32_t expect[N], got[N];
+    for (int i = 0; i < N; i++) values[i] = 10.0f * (float)i / (N - 1);
+    values[7] = -999.0f;
+    colormap_lut_index(&indexed, values, N, index);
+
+    /* Colormap switch, same range: the palette is the target itself */
+    ASSERT_EQ_INT(colormap_lut_build(&target, hot, PIXEL_FORMAT_XRGB8888,
+                                     0.0f, 10.0f, -999.0f), 0);
+    ASSERT_EQ_INT(colormap_lut_remap(&palette, &target, &indexed), 0);
+    colormap_lut_map(&target, values, N, expect);
+    colormap_lut_paint(&palette, index, N, got);
+    ASSERT_TRUE(memcmp(expect, got, sizeof(got)) == 0);
+
+    /* Narrower range inside: at most one colour step off, and rarely */
+    ASSERT_EQ_INT(colormap_lut_build(&target, hot, PIXEL_FORMAT_XRGB8888,
+                                     2.0f, 7.0f, -999.0f), 0);
+    ASSERT_EQ_INT(colormap_lut_remap(&palette, &target, &indexed), 0);
+    colormap_lut_map(&target, values, N, expect);
+    colormap_lut_paint(&palette, index, N, got);
+    int off = 0;
+    for (int i = 0; i < N; i++) {
+        if (expect[i] == got[i]) continue;
+        off++;
+        uint16_t k;
+        colormap_lut_index(&target, &values[i], 1, &k);
+        ASSERT_TRUE(got[i] == target.colors[k > 16 ? k - 16 : 0] ||
+                    got[i] == target.colors[k + 16 <= (int)target.n_steps ? k + 16 : k]);
+    }
+    ASSERT_TRUE(off * 20 < N);
+    ASSERT_EQ_INT((int)got[7], (int)target.colors[COLORMAP_LUT_MISSING]);
+
+    /* Wider, shifted, too narrow, or another fill value: quantise again */
+    ASSERT_EQ_INT(colormap_lut_build(&target, hot, PIXEL_FORMAT_XRGB8888,
+                                     -1.0f, 10.0f, -999.0f), 0);
+    ASSERT_EQ_INT(colormap_lut_remap(&palette, &target, &indexed), -1);
+    ASSERT_EQ_INT(colormap_lut_build(&target, hot, PIXEL_FORMAT_XRGB8888,
+                                     4.0f, 5.0f, -999.0f), 0);
+    ASSERT_EQ_INT(colormap_lut_remap(&palette, &target, &indexed), -1);
+    ASSERT_EQ_INT(colormap_lut_build(&target, hot, PIXEL_FORMAT_XRGB8888,
+                                     0.0f, 10.0f, 1e20f), 0);
+    ASSERT_EQ_INT(colormap_lut_remap(&palette, &target, &indexed), -1);
+    return 1;
+}
+
+/* Test log, symlog and gamma positions follow their formulas, without per-value maths */
+TEST(colormap_norm_positions) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("viridis");
+    ASSERT_NOT_NULL(cmap);
+    static USColorLUT lut, linear;
+
+    /* Log over six decades: within a fraction of one of 256 colours */
+    USColorNorm norm = { COLOR_NORM_LOG, 0.0f, 0.0f };
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          1e-3f, 1e3f, -999.0f, &norm), 0);
+    ASSERT_TRUE(lut.log_quant);
+    for (int i = 0; i <= 600; i++) {
+        float v = powf(10.0f, -3.0f + (float)i / 100.0f);
+        float expect = log10f(v / 1e-3f) / 6.0f;
+        ASSERT_NEAR(colormap_lut_position(&lut, v), expect, 1.0 / 512);
+    }
+    ASSERT_NEAR(colormap_lut_position(&lut, 0.0f), 0.0f, 1.0 / 512);
+    ASSERT_NEAR(colormap_lut_position(&lut, -5.0f), 0.0f, 1.0 / 512);
+    ASSERT_NEAR(colormap_lut_position(&lut, 1e4f), 1.0f, 1e-6);
+    ASSERT_NEAR(colormap_lut_position(&lut, -999.0f), -1.0f, 1e-6);
+
+    /* Symlog: linear near zero, logarithmic beyond linthresh */
+    norm.mode = COLOR_NORM_SYMLOG;
+    norm.linthresh = 1.0f;
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          -100.0f, 100.0f, -999.0f, &norm), 0);
+    float s1 = log1pf(100.0f);
+    for (int i = -400; i <= 400; i++) {
+        float v = copysignf(powf(10.0f, fabsf((float)i) / 200.0f) - 1.0f, (float)i);
+        float expect = 0.5f + 0.5f * copysignf(log1pf(fabsf(v)), v) / s1;
+        ASSERT_NEAR(colormap_lut_position(&lut, v), expect, 1.0 / 256);
+    }
+
+    /* Gamma 1 is linear; gamma 0.5 lifts the low end */
+    norm.mode = COLOR_NORM_POWER;
+    norm.gamma = 1.0f;
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          0.0f, 4.0f, -999.0f, &norm), 0);
+    ASSERT_EQ_INT(colormap_lut_build(&linear, cmap, PIXEL_FORMAT_XRGB8888,
+                                     0.0f, 4.0f, -999.0f), 0);
+    ASSERT_TRUE(memcmp(lut.colors, linear.colors, sizeof(lut.colors)) == 0);
+    norm.gamma = 0.5f;
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          0.0f, 4.0f, -999.0f, &norm), 0);
+    ASSERT_NEAR(colormap_lut_position(&lut, 1.0f), 0.5f, 1.0 / 256);
+
+    /* Log with nothing positive falls back to linear */
+    norm.mode = COLOR_NORM_LOG;
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          -4.0f, -1.0f, -999.0f, &norm), 0);
+    ASSERT_EQ_INT(lut.norm.mode, COLOR_NORM_LINEAR);
+
+    ColorNormMode mode;
+    ASSERT_EQ_INT(colormap_norm_parse("symlog", &mode), 0);
+    ASSERT_EQ_INT(mode, COLOR_NORM_SYMLOG);
+    ASSERT_STR_EQ(colormap_norm_name(COLOR_NORM_POWER), "gamma");
+    ASSERT_EQ_INT(colormap_norm_parse("sqrt", &mode), -1);
+    return 1;
+}
+
+/* Test every kernel quantises log offsets identically, across signs and specials */
+TEST(colormap_norm_kernels_match) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("balance");
+    ASSERT_NOT_NULL(cmap);
+    static USColorLUT lut;
+    USColorNorm norm = { COLOR_NORM_SYMLOG, 0.0f, 0.5f };
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_RGB565,
+                                          -3e4f, 2e2f, -999.0f, &norm), 0);
+    ASSERT_TRUE(lut.log_quant);
+
+    enum { N = 1043 };
+    static float values[N];
+    static uint16_t expect[N], got[N];
+    for (int i = 0; i < N; i++) {
+        values[i] = copysignf(powf(10.0f, (float)(i % 97) / 10.0f - 4.0f), (float)(i % 3) - 1.0f);
+    }
+    values[3] = -999.0f;
+    values[4] = 0.0f;
+    values[5] = -0.0f;
+    values[6] = NAN;
+    values[7] = 1e-42f;
+    values[8] = -3e4f;
+    values[9] = 2e2f;
+    values[10] = 5e29f;
+
+    ASSERT_EQ_INT(colormap_set_lut_kernel(COLORMAP_LUT_SCALAR), 0);
+    colormap_lut_index(&lut, values, N, expect);
+    ASSERT_EQ_INT(expect[3], COLORMAP_LUT_MISSING);
+    ASSERT_EQ_INT(expect[8], 0);
+    ASSERT_EQ_INT(expect[9], (int)lut.n_steps);
+    ASSERT_EQ_INT(expect[4], expect[5]);
+
+    const ColormapLutKernel kernels[] = { COLORMAP_LUT_AVX2, COLORMAP_LUT_AVX512 };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (colormap_set_lut_kernel(kernels[k]) != 0) continue;
+        for (size_t n = N - 16; n <= N; n++) {
+            memset(got, 0, sizeof(got));
+            colormap_lut_index(&lut, values, n, got);
+            ASSERT_TRUE(memcmp(expect, got, n * sizeof(uint16_t)) == 0);
+        }
+    }
+    ASSERT_EQ_INT(colormap_set_lut_kernel(COLORMAP_LUT_AUTO), 0);
+    return 1;
+}
+
+/* Test histogram equalisation spreads a skewed field evenly over the colormap */
+TEST(colormap_histeq_uniform) {
+    ensure_colormaps_init();
+
+    USColormap *cmap = colormap_get_by_name("viridis");
+    ASSERT_NOT_NULL(cmap);
+    static USColorLUT lut;
+    USColorNorm norm = { COLOR_NORM_HISTEQ, 0.0f, 0.0f };
+    ASSERT_EQ_INT(colormap_lut_build_norm(&lut, cmap, PIXEL_FORMAT_XRGB8888,
+                                          0.0f, 1.0f, -999.0f, &norm), 0);
+
+    /* Most values near zero: linear scaling would leave most colours unused */
+    enum { N = 20000 };
+    static float values[N];
+    static uint16_t index[N], plain[N];
+    static uint32_t hist[COLORMAP_LUT_SIZE + 1];
+    for (int i = 0; i < N; i++) {
+        float u = ((float)i + 0.5f) / N;
+        values[i] = u * u * u * u;
+    }
+    values[100] = -999.0f;
+    memset(hist, 0, sizeof(hist));
+    colormap_lut_index_hist(&lut, values, N, index, hist);
+    colormap_lut_index(&lut, values, N, plain);
+    ASSERT_TRUE(memcmp(index, plain, sizeof(index)) == 0);
+    ASSERT_EQ_INT((int)hist[COLORMAP_LUT_MISSING], 1);
+
+    ASSERT_EQ_INT(colormap_lut_equalize(&lut, cmap, hist), 0);
+    /* Above the log floor a value's position is close to its rank */
+    for (int i = N / 20; i < N; i += 37) {
+        if (i == 100) continue;
+        ASSERT_NEAR(colormap_lut_position(&lut, values[i]), ((float)i + 0.5f) / N, 0.01);
+    }
+    return 1;
+}
+
 RUN_TESTS("Colormaps")
@@ -0,0 +1,151 @@
+/*
+ * test_frame_stats.c - Unit tests for area-weighted frame statistics
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/frame_stats.h"
+#include <stdlib.h>
+#include <math.h>
+
+#define NX   1000
+#define NY   90
+#define FILL (-999.0f)
+
+static const FrameStatsKernel kernels[] = {
+    FRAME_STATS_SCALAR, FRAME_STATS_AVX2, FRAME_STATS_AVX512
+};
+
+/* Row y of a test field: a ramp in x plus a step in y, with fills and a NaN */
+static void fill_row(float *row, size_t y) {
+    for (size_t x = 0; x < NX; x++) {
+        row[x] = (x % 9 == 4) ? FILL : (float)x * 0.01f + (float)y;
+    }
+    row[y % NX] = NAN;
+}
+
+static double row_weight(size_t y) {
+    return cos((-89.0 + 2.0 * y) * DEG2RAD);
+}
+
+static void run_field(USFrameStats *st, float *row) {
+    frame_stats_begin(st, 0.0f, 100.0f, FILL);
+    for (size_t y = 0; y < NY; y++) {
+        fill_row(row, y);
+        frame_stats_add_row(st, row, NX, row_weight(y));
+    }
+    frame_stats_finish(st);
+}
+
+/* Test the weighted moments, range and valid fraction against a direct sum */
+TEST(frame_stats_moments) {
+    float *row = malloc(NX * sizeof(float));
+    USFrameStats *st = malloc(sizeof(USFrameStats));
+    ASSERT_NOT_NULL(row);
+    ASSERT_NOT_NULL(st);
+
+    double sw = 0.0, swv = 0.0, swv2 = 0.0, total = 0.0;
+    size_t n_valid = 0;
+    for (size_t y = 0; y < NY; y++) {
+        fill_row(row, y);
+        double w = row_weight(y);
+        for (size_t x = 0; x < NX; x++) {
+            total += w;
+            if (row[x] == FILL || row[x] != row[x]) continue;
+            sw += w;
+            swv += w * row[x];
+            swv2 += w * (double)row[x] * row[x];
+            n_valid++;
+        }
+    }
+    double mean = swv / sw;
+    double std = sqrt(swv2 / sw - mean * mean);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (frame_stats_set_kernel(kernels[k]) != 0) continue;
+        run_field(st, row);
+        ASSERT_TRUE(st->valid);
+        ASSERT_EQ_SIZET(st->n_valid, n_valid);
+        ASSERT_EQ_SIZET(st->n_cells, (size_t)NX * NY);
+        ASSERT_NEAR(st->mean, mean, 1e-6 * fabs(mean));
+        ASSERT_NEAR(st->std, std, 1e-6 * std);
+        ASSERT_NEAR(st->min, 0.01f, 1e-6);  /* Row 0 starts with the NaN */
+        ASSERT_NEAR(st->max, (NX - 1) * 0.01f + (NY - 1), 1e-4);
+        ASSERT_NEAR(st->valid_fraction, sw / total, 1e-12);
+    }
+    frame_stats_set_kernel(FRAME_STATS_AUTO);
+
+    free(row);
+    free(st);
+    return 1;
+}
+
+/* Test every kernel finds the same histogram */
+TEST(frame_stats_kernels_match) {
+    float *row = malloc(NX * sizeof(float));
+    USFrameStats *ref = malloc(sizeof(USFrameStats));
+    USFrameStats *st = malloc(sizeof(USFrameStats));
+    ASSERT_NOT_NULL(row);
+    ASSERT_NOT_NULL(ref);
+    ASSERT_NOT_NULL(st);
+
+    ASSERT_EQ_INT(frame_stats_set_kernel(FRAME_STATS_SCALAR), 0);
+    run_field(ref, row);
+    for (size_t k = 1; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (frame_stats_set_kernel(kernels[k]) != 0) continue;
+        run_field(st, row);
+        ASSERT_TRUE(st->min == ref->min && st->max == ref->max);
+        for (int b = 0; b < FRAME_STATS_BINS; b++) {
+            ASSERT_TRUE(st->hist[b] == ref->hist[b]);
+        }
+    }
+    frame_stats_set_kernel(FRAME_STATS_AUTO);
+
+    free(row);
+    free(ref);
+    free(st);
+    return 1;
+}
+
+/* Test percentiles of a uniform field, with weights and out-of-range values */
+TEST(frame_stats_percentiles) {
+    USFrameStats *st = malloc(sizeof(USFrameStats));
+    float *row = malloc(NX * sizeof(float));
+    ASSERT_NOT_NULL(st);
+    ASSERT_NOT_NULL(row);
+
+    /* Uniform on [0, 10) at weight 1; a heavier row of 20s; a row of fills */
+    for (size_t x = 0; x < NX; x++) row[x] = 10.0f * (float)x / NX;
+    frame_stats_begin(st, 0.0f, 10.0f, FILL);
+    frame_stats_add_row(st, row, NX, 1.0);
+    for (size_t x = 0; x < NX; x++) row[x] = 20.0f;
+    frame_stats_add_row(st, row, NX / 4, 0.4);
+    for (size_t x = 0; x < NX; x++) row[x] = FILL;
+    frame_stats_add_row(st, row, NX, 1.0);
+    frame_stats_finish(st);
+
+    /* Valid area: 1000 + 100 of 2100; the 20s sit above the 1000 / 1100 mark */
+    ASSERT_NEAR(st->valid_fraction, 1100.0 / 2100.0, 1e-6);
+    float p;
+    ASSERT_EQ_INT(frame_stats_percentile(st, 50.0, &p), 0);
+    ASSERT_NEAR(p, 5.5f, 0.02f);
+    ASSERT_EQ_INT(frame_stats_percentile(st, FRAME_STATS_LOW_PCT, &p), 0);
+    ASSERT_NEAR(p, 0.22f, 0.02f);
+    ASSERT_EQ_INT(frame_stats_percentile(st, 0.0, &p), 0);
+    ASSERT_NEAR(p, 0.0f, 1e-6);
+    ASSERT_EQ_INT(frame_stats_percentile(st, 100.0, &p), 0);
+    ASSERT_NEAR(p, 20.0f, 1e-6);
+
+    /* Nothing valid */
+    frame_stats_begin(st, 0.0f, 10.0f, FILL);
+    frame_stats_add_row(st, row, NX, 1.0);
+    frame_stats_finish(st);
+    ASSERT_FALSE(st->valid);
+    ASSERT_EQ_INT(frame_stats_percentile(st, 50.0, &p), -1);
+
+    free(st);
+    free(row);
+    return 1;
+}
+
+RUN_TESTS("Frame Stats")
@@ -5,7 +5,9 @@
 #include "test_framework.h"
 #include "../src/kdtree.h"
 #include <stdlib.h>
+#include <string.h>
 #include <float.h>
+#include <pthread.h>
 
 /* Test creating a simple tree with one point */
 TEST(kdtree_create_single_point) {
@@ -311,4 +313,482 @@ TEST(kdtree_duplicate_points) {
     return 1;
 }
 
+/* Brute-force nearest neighbor distance for reference */
+static double brute_force_nn_dist(const double *points, size_t n, const double *q) {
+    double best = DBL_MAX;
+    for (size_t i = 0; i < n; i++) {
+        double dx = points[i * 3 + 0] - q[0];
+        double dy = points[i * 3 + 1] - q[1];
+        double dz = points[i * 3 + 2] - q[2];
+        double d = dx*dx + dy*dy + dz*dz;
+        if (d < best) best = d;
+    }
+    return sqrt(best);
+}
+
+/* Test against brute force on random unit-sphere points */
+TEST(kdtree_matches_brute_force) {
+    size_t n = 5000;
+    double *points = malloc(n * 3 * sizeof(double));
+    ASSERT_NOT_NULL(points);
+
+    srand(12345);
+    for (size_t i = 0; i < n; i++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        points[i * 3 + 0] = cos(lat) * cos(lon);
+        points[i * 3 + 1] = cos(lat) * sin(lon);
+        points[i * 3 + 2] = sin(lat);
+    }
+
+    KDTree *tree = kdtree_create(points, n);
+    ASSERT_NOT_NULL(tree);
+
+    for (int q = 0; q < 500; q++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        double query[] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+        size_t nn_idx;
+        double nn_dist;
+
+        kdtree_query_nearest(tree, query, &nn_idx, &nn_dist);
+
+        ASSERT_LT(nn_idx, n);
+        ASSERT_NEAR(nn_dist, brute_force_nn_dist(points, n, query), 1e-12);
+    }
+
+    kdtree_free(tree);
+    free(points);
+    return 1;
+}
+
+/* Test tree sizes around the leaf bucket boundary */
+TEST(kdtree_leaf_bucket_sizes) {
+    double points[64 * 3];
+    for (size_t i = 0; i < 64; i++) {
+        points[i * 3 + 0] = (double)i;
+        points[i * 3 + 1] = (double)(i % 7);
+        points[i * 3 + 2] = (double)(i % 3);
+    }
+
+    for (size_t n = 1; n <= 64; n++) {
+        KDTree *tree = kdtree_create(points, n);
+        ASSERT_NOT_NULL(tree);
+        ASSERT_EQ_SIZET(kdtree_size(tree), n);
+
+        /* Every point must find itself */
+        for (size_t i = 0; i < n; i++) {
+            size_t nn_idx;
+            double nn_dist;
+            kdtree_query_nearest(tree, &points[i * 3], &nn_idx, &nn_dist);
+            ASSERT_EQ_SIZET(nn_idx, i);
+            ASSERT_NEAR(nn_dist, 0.0, 1e-12);
+        }
+
+        kdtree_free(tree);
+    }
+    return 1;
+}
+
+/* Test radius-bounded query agrees with the unbounded one */
+TEST(kdtree_query_within_radius) {
+    size_t n = 3000;
+    double *points = malloc(n * 3 * sizeof(double));
+    ASSERT_NOT_NULL(points);
+
+    /* Points confined to a cap around the north pole */
+    srand(4242);
+    for (size_t i = 0; i < n; i++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = M_PI / 3.0 + ((double)rand() / RAND_MAX) * M_PI / 6.0;
+        points[i * 3 + 0] = cos(lat) * cos(lon);
+        points[i * 3 + 1] = cos(lat) * sin(lon);
+        points[i * 3 + 2] = sin(lat);
+    }
+
+    KDTree *tree = kdtree_create(points, n);
+    ASSERT_NOT_NULL(tree);
+
+    const double radii[] = {0.0, 0.01, 0.05, 0.3, 2.5};
+    for (int q = 0; q < 400; q++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        double query[] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+        size_t ref_idx;
+        double ref_dist;
+        kdtree_query_nearest(tree, query, &ref_idx, &ref_dist);
+
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+            size_t nn_idx = 12345;
+            double nn_dist = -1.0;
+            int found = kdtree_query_nearest_within(tree, query, radii[r], &nn_idx, &nn_dist);
+            if (ref_dist <= radii[r]) {
+                ASSERT_TRUE(found);
+                ASSERT_EQ_SIZET(nn_idx, ref_idx);
+                ASSERT_NEAR(nn_dist, ref_dist, 1e-15);
+            } else {
+                ASSERT_FALSE(found);
+                ASSERT_EQ_SIZET(nn_idx, 12345);
+            }
+        }
+    }
+
+    /* A point exactly at the radius is included */
+    size_t nn_idx;
+    double nn_dist;
+    double query[] = {points[0], points[1], points[2] + 0.5};
+    double exact = 0.0;
+    kdtree_query_nearest(tree, query, &nn_idx, &exact);
+    ASSERT_TRUE(kdtree_query_nearest_within(tree, query, exact, &nn_idx, &nn_dist));
+    ASSERT_FALSE(kdtree_query_nearest_within(NULL, query, 1.0, &nn_idx, &nn_dist));
+    ASSERT_FALSE(kdtree_query_nearest_within(tree, query, -1.0, &nn_idx, &nn_dist));
+
+    kdtree_free(tree);
+    free(points);
+    return 1;
+}
+
+/* Test batch query reproduces single queries exactly, including ties */
+TEST(kdtree_batch_matches_single) {
+    /* Regular lon/lat mesh: lattice queries between nodes hit exact ties */
+    size_t nlon = 90, nlat = 45, n = nlon * nlat;
+    double *points = malloc(n * 3 * sizeof(double));
+    ASSERT_NOT_NULL(points);
+    for (size_t j = 0; j < nlat; j++) {
+        for (size_t i = 0; i < nlon; i++) {
+            double lon = (i + 0.5) * 2.0 * M_PI / nlon;
+            double lat = -M_PI / 2 + (j + 0.5) * M_PI / nlat;
+            size_t p = j * nlon + i;
+            points[p * 3 + 0] = cos(lat) * cos(lon);
+            points[p * 3 + 1] = cos(lat) * sin(lon);
+            points[p * 3 + 2] = sin(lat);
+        }
+    }
+
+    KDTree *tree = kdtree_create(points, n);
+    ASSERT_NOT_NULL(tree);
+
+    size_t nq = 180 * 90 + 1000;
+    double *queries = malloc(nq * 3 * sizeof(double));
+    size_t *batch_idx = malloc(nq * sizeof(size_t));
+    double *batch_dist = malloc(nq * sizeof(double));
+    ASSERT_NOT_NULL(queries);
+    ASSERT_NOT_NULL(batch_idx);
+    ASSERT_NOT_NULL(batch_dist);
+
+    size_t q = 0;
+    for (size_t j = 0; j < 90; j++) {
+        for (size_t i = 0; i < 180; i++, q++) {
+            double lon = i * 2.0 * M_PI / 180;
+            double lat = -M_PI / 2 + (j + 0.5) * M_PI / 90;
+            queries[q * 3 + 0] = cos(lat) * cos(lon);
+            queries[q * 3 + 1] = cos(lat) * sin(lon);
+            queries[q * 3 + 2] = sin(lat);
+        }
+    }
+    srand(99);
+    for (; q < nq; q++) {
+        for (int a = 0; a < 3; a++) {
+            queries[q * 3 + a] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+    }
+
+    const double radii[] = {INFINITY, 0.02, 0.0};
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        size_t found = kdtree_query_nearest_batch(tree, queries, nq, radii[r],
+                                                  batch_idx, batch_dist);
+        size_t expect_found = 0;
+        for (q = 0; q < nq; q++) {
+            size_t nn_idx;
+            double nn_dist;
+            if (kdtree_query_nearest_within(tree, &queries[q * 3], radii[r], &nn_idx, &nn_dist)) {
+                expect_found++;
+                ASSERT_EQ_SIZET(batch_idx[q], nn_idx);
+                ASSERT_TRUE(batch_dist[q] == nn_dist);
+            } else {
+                ASSERT_TRUE(batch_dist[q] == DBL_MAX);
+            }
+        }
+        ASSERT_EQ_SIZET(found, expect_found);
+    }
+
+    ASSERT_EQ_SIZET(kdtree_query_nearest_batch(NULL, queries, nq, 1.0, batch_idx, batch_dist), 0);
+
+    kdtree_free(tree);
+    free(points);
+    free(queries);
+    free(batch_idx);
+    free(batch_dist);
+    return 1;
+}
+
+/* Test seeded (walking) sweep gives the same answers as independent queries */
+TEST(kdtree_seeded_matches_within) {
+    /* Regular lon/lat mesh with lattice queries between nodes (exact ties) */
+    size_t nlon = 90, nlat = 45, n = nlon * nlat;
+    double *points = malloc(n * 3 * sizeof(double));
+    ASSERT_NOT_NULL(points);
+    for (size_t j = 0; j < nlat; j++) {
+        for (size_t i = 0; i < nlon; i++) {
+            double lon = (i + 0.5) * 2.0 * M_PI / nlon;
+            double lat = -M_PI / 2 + (j + 0.5) * M_PI / nlat;
+            size_t p = j * nlon + i;
+            points[p * 3 + 0] = cos(lat) * cos(lon);
+            points[p * 3 + 1] = cos(lat) * sin(lon);
+            points[p * 3 + 2] = sin(lat);
+        }
+    }
+
+    KDTree *tree = kdtree_create(points, n);
+    ASSERT_NOT_NULL(tree);
+
+    /* Lattice rows followed by random jumps away from the previous answer */
+    size_t nq = 180 * 90 + 1000;
+    double *queries = malloc(nq * 3 * sizeof(double));
+    ASSERT_NOT_NULL(queries);
+    size_t q = 0;
+    for (size_t j = 0; j < 90; j++) {
+        for (size_t i = 0; i < 180; i++, q++) {
+            double lon = i * 2.0 * M_PI / 180;
+            double lat = -M_PI / 2 + (j + 0.5) * M_PI / 90;
+            queries[q * 3 + 0] = cos(lat) * cos(lon);
+            queries[q * 3 + 1] = cos(lat) * sin(lon);
+            queries[q * 3 + 2] = sin(lat);
+        }
+    }
+    srand(7);
+    for (; q < nq; q++) {
+        for (int a = 0; a < 3; a++) {
+            queries[q * 3 + a] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+    }
+
+    const double radii[] = {INFINITY, 0.02, 0.0};
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        size_t hint = KDTREE_NO_HINT;
+        for (q = 0; q < nq; q++) {
+            size_t nn_idx, seeded_idx = 12345;
+            double nn_dist, seeded_dist = -1.0;
+            int expect = kdtree_query_nearest_within(tree, &queries[q * 3], radii[r],
+                                                     &nn_idx, &nn_dist);
+            int found = kdtree_query_nearest_seeded(tree, &queries[q * 3], radii[r], &hint,
+                                                    &seeded_idx, &seeded_dist);
+            ASSERT_EQ_INT(found, expect);
+            if (expect) {
+                ASSERT_EQ_SIZET(seeded_idx, nn_idx);
+                ASSERT_TRUE(seeded_dist == nn_dist);
+            } else {
+                ASSERT_EQ_SIZET(seeded_idx, 12345);
+            }
+        }
+    }
+
+    /* Out-of-range hints fall back to a cold search */
+    size_t hint = n + 5;
+    size_t nn_idx, seeded_idx;
+    double nn_dist, seeded_dist;
+    ASSERT_TRUE(kdtree_query_nearest_within(tree, queries, INFINITY, &nn_idx, &nn_dist));
+    ASSERT_TRUE(kdtree_query_nearest_seeded(tree, queries, INFINITY, &hint,
+                                            &seeded_idx, &seeded_dist));
+    ASSERT_EQ_SIZET(seeded_idx, nn_idx);
+    ASSERT_TRUE(hint < n);
+    ASSERT_FALSE(kdtree_query_nearest_seeded(tree, queries, INFINITY, NULL,
+                                             &seeded_idx, &seeded_dist));
+    ASSERT_FALSE(kdtree_query_nearest_seeded(NULL, queries, INFINITY, &hint,
+                                             &seeded_idx, &seeded_dist));
+
+    kdtree_free(tree);
+    free(points);
+    free(queries);
+    return 1;
+}
+
+/* Test k-nearest query against a brute-force sort */
+TEST(kdtree_knn_matches_brute_force) {
+    size_t n = 2000;
+    double *points = malloc(n * 3 * sizeof(double));
+    double *ref = malloc(n * sizeof(double));
+    ASSERT_NOT_NULL(points);
+    ASSERT_NOT_NULL(ref);
+
+    srand(777);
+    for (size_t i = 0; i < n; i++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        points[i * 3 + 0] = cos(lat) * cos(lon);
+        points[i * 3 + 1] = cos(lat) * sin(lon);
+        points[i * 3 + 2] = sin(lat);
+    }
+
+    KDTree *tree = kdtree_create(points, n);
+    ASSERT_NOT_NULL(tree);
+
+    for (int q = 0; q < 100; q++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        double query[] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+        size_t nn_idx[8];
+        double nn_dist[8];
+
+        size_t found = kdtree_query_knn(tree, query, 8, nn_idx, nn_dist);
+        ASSERT_EQ_SIZET(found, 8);
+
+        /* k-th smallest distance by partial selection sort */
+        for (size_t i = 0; i < n; i++) {
+            double dx = points[i * 3 + 0] - query[0];
+            double dy = points[i * 3 + 1] - query[1];
+            double dz = points[i * 3 + 2] - query[2];
+            ref[i] = sqrt(dx*dx + dy*dy + dz*dz);
+        }
+        for (size_t j = 0; j < 8; j++) {
+            size_t best = j;
+            for (size_t i = j + 1; i < n; i++) {
+                if (ref[i] < ref[best]) best = i;
+            }
+            double tmp = ref[j]; ref[j] = ref[best]; ref[best] = tmp;
+            ASSERT_NEAR(nn_dist[j], ref[j], 1e-12);
+            ASSERT_LT(nn_idx[j], n);
+        }
+    }
+
+    kdtree_free(tree);
+    free(points);
+    free(ref);
+    return 1;
+}
+
+/* Test k-nearest query with k larger than the tree and invalid input */
+TEST(kdtree_knn_edge_cases) {
+    double points[] = {
+        0.0, 0.0, 0.0,
+        1.0, 0.0, 0.0,
+        3.0, 0.0, 0.0
+    };
+    KDTree *tree = kdtree_create(points, 3);
+    ASSERT_NOT_NULL(tree);
+
+    double query[] = {0.9, 0.0, 0.0};
+    size_t nn_idx[5];
+    double nn_dist[5];
+
+    size_t found = kdtree_query_knn(tree, query, 5, nn_idx, nn_dist);
+    ASSERT_EQ_SIZET(found, 3);
+    ASSERT_EQ_SIZET(nn_idx[0], 1);
+    ASSERT_EQ_SIZET(nn_idx[1], 0);
+    ASSERT_EQ_SIZET(nn_idx[2], 2);
+    ASSERT_NEAR(nn_dist[0], 0.1, 1e-12);
+    ASSERT_NEAR(nn_dist[1], 0.9, 1e-12);
+    ASSERT_NEAR(nn_dist[2], 2.1, 1e-12);
+
+    ASSERT_EQ_SIZET(kdtree_query_knn(tree, query, 0, nn_idx, nn_dist), 0);
+    ASSERT_EQ_SIZET(kdtree_query_knn(NULL, query, 2, nn_idx, nn_dist), 0);
+
+    kdtree_free(tree);
+    return 1;
+}
+
+/* Four times KDTREE_PARALLEL_CUTOFF in kdtree.c, so up to four build threads split it */
+#define PARALLEL_POINTS (4 * 65536)
+
+/* Random points on the unit sphere */
+static double *random_sphere_points(size_t n, unsigned int seed) {
+    double *points = malloc(n * 3 * sizeof(double));
+    if (!points) return NULL;
+    srand(seed);
+    for (size_t i = 0; i < n; i++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        points[i * 3 + 0] = cos(lat) * cos(lon);
+        points[i * 3 + 1] = cos(lat) * sin(lon);
+        points[i * 3 + 2] = sin(lat);
+    }
+    return points;
+}
+
+/* Test a tree built by the work-stealing pool against brute force and a serial build */
+TEST(kdtree_parallel_build) {
+    double *points = random_sphere_points(PARALLEL_POINTS, 777);
+    ASSERT_NOT_NULL(points);
+
+    kdtree_set_num_threads(1);
+    KDTree *serial = kdtree_create(points, PARALLEL_POINTS);
+    kdtree_set_num_threads(4);
+    KDTree *tree = kdtree_create(points, PARALLEL_POINTS);
+    kdtree_set_num_threads(0);
+    ASSERT_NOT_NULL(serial);
+    ASSERT_NOT_NULL(tree);
+
+    /* Same layout whatever the thread count */
+    ASSERT_TRUE(memcmp(kdtree_point_order(serial), kdtree_point_order(tree),
+                       PARALLEL_POINTS * sizeof(size_t)) == 0);
+
+    srand(4242);
+    for (int q = 0; q < 200; q++) {
+        double lon = ((double)rand() / RAND_MAX) * 2.0 * M_PI;
+        double lat = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0);
+        double query[] = {cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)};
+        size_t nn_idx;
+        double nn_dist;
+
+        kdtree_query_nearest(tree, query, &nn_idx, &nn_dist);
+        ASSERT_LT(nn_idx, PARALLEL_POINTS);
+        ASSERT_NEAR(nn_dist, brute_force_nn_dist(points, PARALLEL_POINTS, query), 1e-12);
+    }
+
+    kdtree_free(serial);
+    kdtree_free(tree);
+    free(points);
+    return 1;
+}
+
+typedef struct {
+    const double *points;
+    KDTree       *tree;
+} BuildArg;
+
+static void *build_thread(void *arg) {
+    BuildArg *ba = arg;
+    ba->tree = kdtree_create(ba->points, PARALLEL_POINTS);
+    return NULL;
+}
+
+/* Test two parallel builds running at once do not disturb each other */
+TEST(kdtree_concurrent_builds) {
+    double *points = random_sphere_points(PARALLEL_POINTS, 99);
+    double *others = random_sphere_points(PARALLEL_POINTS, 100);
+    ASSERT_NOT_NULL(points);
+    ASSERT_NOT_NULL(others);
+
+    KDTree *ref = kdtree_create(points, PARALLEL_POINTS);
+    KDTree *ref_others = kdtree_create(others, PARALLEL_POINTS);
+    ASSERT_NOT_NULL(ref);
+    ASSERT_NOT_NULL(ref_others);
+
+    kdtree_set_num_threads(2);
+    BuildArg args[2] = { { points, NULL }, { others, NULL } };
+    pthread_t threads[2];
+    for (int t = 0; t < 2; t++) {
+        ASSERT_EQ_INT(pthread_create(&threads[t], NULL, build_thread, &args[t]), 0);
+    }
+    for (int t = 0; t < 2; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    kdtree_set_num_threads(0);
+
+    ASSERT_NOT_NULL(args[0].tree);
+    ASSERT_NOT_NULL(args[1].tree);
+    ASSERT_TRUE(memcmp(kdtree_point_order(args[0].tree), kdtree_point_order(ref),
+                       PARALLEL_POINTS * sizeof(size_t)) == 0);
+    ASSERT_TRUE(memcmp(kdtree_point_order(args[1].tree), kdtree_point_order(ref_others),
+                       PARALLEL_POINTS * sizeof(size_t)) == 0);
+
+    kdtree_free(args[0].tree);
+    kdtree_free(args[1].tree);
+    kdtree_free(ref);
+    kdtree_free(ref_others);
+    free(points);
+    free(others);
+    return 1;
+}
+
 RUN_TESTS("KDTree")
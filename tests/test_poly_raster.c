@@ -0,0 +1,396 @@
+/*
+ * test_poly_raster.c - Unit tests for polygon-mode coverage rendering
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/poly_raster.h"
+#include "../src/colormaps.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Mesh of n_points nodes and n_elements triangles, arrays owned by the test */
+static USMesh *make_mesh(size_t n_points, size_t n_elements) {
+    USMesh *mesh = calloc(1, sizeof(USMesh));
+    mesh->n_points = n_points;
+    mesh->lon = calloc(n_points, sizeof(double));
+    mesh->lat = calloc(n_points, sizeof(double));
+    mesh->n_elements = n_elements;
+    mesh->n_vertices = 3;
+    mesh->elem_nodes = calloc(n_elements * 3, sizeof(int));
+    return mesh;
+}
+
+static void free_mesh(USMesh *mesh) {
+    free(mesh->lon);
+    free(mesh->lat);
+    free(mesh->elem_nodes);
+    free(mesh);
+}
+
+static void set_node(USMesh *mesh, int i, double lon, double lat) {
+    mesh->lon[i] = lon;
+    mesh->lat[i] = lat;
+}
+
+static void set_elem(USMesh *mesh, size_t e, int a, int b, int c) {
+    mesh->elem_nodes[e * 3 + 0] = a;
+    mesh->elem_nodes[e * 3 + 1] = b;
+    mesh->elem_nodes[e * 3 + 2] = c;
+}
+
+static const unsigned char *pixel_at(const unsigned char *pixels, size_t width,
+                                     size_t x, size_t y) {
+    return &pixels[(y * width + x) * 3];
+}
+
+/* Test a triangle is coloured by its mean value and the rest stays black */
+TEST(poly_coverage_single_triangle) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+    ASSERT_NOT_NULL(cmap);
+
+    /* Covers the western half of a 36x18 image, roughly */
+    USMesh *mesh = make_mesh(3, 1);
+    set_node(mesh, 0, -170.0, -80.0);
+    set_node(mesh, 1, -10.0, -80.0);
+    set_node(mesh, 2, -90.0, 80.0);
+    set_elem(mesh, 0, 0, 1, 2);
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    ASSERT_EQ_SIZET(poly_coverage_visible(cov), 1);
+    ASSERT_TRUE(poly_coverage_matches(cov, mesh, NULL, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT));
+    ASSERT_FALSE(poly_coverage_matches(cov, mesh, NULL, 72, 36, POLY_LOD_MEAN, POLY_SHADE_FLAT));
+
+    float raw[3] = {0.0f, 1.0f, 2.0f};
+    unsigned char pixels[36 * 18 * 3];
+    ASSERT_EQ_INT(poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 2.0f, pixels), 0);
+
+    unsigned char r, g, b;
+    colormap_map_value(cmap, 0.5f, &r, &g, &b);
+    const unsigned char *inside = pixel_at(pixels, 36, 9, 12);
+    ASSERT_EQ_INT(inside[0], r);
+    ASSERT_EQ_INT(inside[1], g);
+    ASSERT_EQ_INT(inside[2], b);
+
+    const unsigned char *outside = pixel_at(pixels, 36, 30, 9);
+    ASSERT_EQ_INT(outside[0] | outside[1] | outside[2], 0);
+
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test overlapping elements: the later one wins, as when drawn in order */
+TEST(poly_coverage_later_element_wins) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    /* Two copies of the same triangle on separate nodes */
+    USMesh *mesh = make_mesh(6, 2);
+    for (int k = 0; k < 2; k++) {
+        set_node(mesh, 3 * k + 0, -80.0, -80.0);
+        set_node(mesh, 3 * k + 1, 80.0, -80.0);
+        set_node(mesh, 3 * k + 2, 0.0, 80.0);
+        set_elem(mesh, (size_t)k, 3 * k, 3 * k + 1, 3 * k + 2);
+    }
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    ASSERT_EQ_SIZET(poly_coverage_visible(cov), 1);
+
+    float raw[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    unsigned char pixels[36 * 18 * 3];
+    poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 1.0f, pixels);
+
+    unsigned char r, g, b;
+    colormap_map_value(cmap, 1.0f, &r, &g, &b);
+    const unsigned char *p = pixel_at(pixels, 36, 18, 14);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test elements with bad nodes or spanning the dateline are left out */
+TEST(poly_coverage_skips_undrawable) {
+    USMesh *mesh = make_mesh(4, 2);
+    set_node(mesh, 0, 170.0, 0.0);
+    set_node(mesh, 1, -170.0, 0.0);
+    set_node(mesh, 2, 175.0, 10.0);
+    set_node(mesh, 3, 0.0, 0.0);
+    set_elem(mesh, 0, 0, 1, 2);     /* Spans the dateline */
+    set_elem(mesh, 1, 3, 2, 7);     /* Node 7 does not exist */
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    ASSERT_EQ_SIZET(poly_coverage_visible(cov), 0);
+
+    USColormap *cmap = colormap_get_current();
+    float raw[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    unsigned char pixels[36 * 18 * 3];
+    memset(pixels, 0x55, sizeof(pixels));
+    ASSERT_EQ_INT(poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 1.0f, pixels), 0);
+    for (size_t i = 0; i < sizeof(pixels); i++) ASSERT_EQ_INT(pixels[i], 0);
+
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test fill-valued nodes are ignored and an all-fill element is black */
+TEST(poly_coverage_fill_values) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    USMesh *mesh = make_mesh(3, 1);
+    set_node(mesh, 0, -80.0, -80.0);
+    set_node(mesh, 1, 80.0, -80.0);
+    set_node(mesh, 2, 0.0, 80.0);
+    set_elem(mesh, 0, 0, 1, 2);
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+
+    unsigned char pixels[36 * 18 * 3];
+    float raw[3] = {1.0f, -999.0f, -999.0f};
+    poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 1.0f, pixels);
+    unsigned char r, g, b;
+    colormap_map_value(cmap, 1.0f, &r, &g, &b);
+    const unsigned char *p = pixel_at(pixels, 36, 18, 14);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+
+    float all_fill[3] = {-999.0f, -999.0f, -999.0f};
+    poly_coverage_render(cov, all_fill, -999.0f, cmap, 0.0f, 1.0f, pixels);
+    p = pixel_at(pixels, 36, 18, 14);
+    ASSERT_EQ_INT(p[0] | p[1] | p[2], 0);
+
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test the image does not depend on the number of render threads */
+TEST(poly_coverage_thread_count_invariant) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    /* Regular lat-lon lattice split into triangles */
+    const int nlon = 91, nlat = 46;
+    USMesh *mesh = make_mesh((size_t)nlon * nlat, (size_t)(nlon - 1) * (nlat - 1) * 2);
+    for (int j = 0; j < nlat; j++) {
+        for (int i = 0; i < nlon; i++) {
+            set_node(mesh, j * nlon + i, -180.0 + 4.0 * i, -90.0 + 4.0 * j);
+        }
+    }
+    size_t e = 0;
+    for (int j = 0; j < nlat - 1; j++) {
+        for (int i = 0; i < nlon - 1; i++) {
+            int n = j * nlon + i;
+            set_elem(mesh, e++, n, n + 1, n + nlon);
+            set_elem(mesh, e++, n + 1, n + nlon + 1, n + nlon);
+        }
+    }
+    float *raw = malloc(mesh->n_points * sizeof(float));
+    for (size_t k = 0; k < mesh->n_points; k++) raw[k] = (float)((k * 37) % 101);
+
+    const size_t w = 400, h = 200;
+    unsigned char *one = malloc(w * h * 3);
+    unsigned char *many = malloc(w * h * 3);
+    for (int smooth = 0; smooth <= 1; smooth++) {
+        poly_raster_set_num_threads(1);
+        USPolyCoverage *cov = poly_coverage_build(mesh, NULL, w, h, POLY_LOD_MEAN,
+                                                  smooth ? POLY_SHADE_SMOOTH : POLY_SHADE_FLAT);
+        ASSERT_NOT_NULL(cov);
+        poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 100.0f, one);
+        poly_coverage_free(cov);
+
+        /* Tiles rasterised and frames gathered on several threads */
+        poly_raster_set_num_threads(5);
+        cov = poly_coverage_build(mesh, NULL, w, h, POLY_LOD_MEAN,
+                                  smooth ? POLY_SHADE_SMOOTH : POLY_SHADE_FLAT);
+        ASSERT_NOT_NULL(cov);
+        poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 100.0f, many);
+        poly_coverage_free(cov);
+        poly_raster_set_num_threads(0);
+        ASSERT_TRUE(memcmp(one, many, w * h * 3) == 0);
+    }
+
+    free(one);
+    free(many);
+    free(raw);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test a conforming mesh with jittered nodes leaves no gaps along shared edges */
+TEST(poly_coverage_shared_edges_no_gaps) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    /* Lattice over lon [-90, 90], lat [-45, 45], interior nodes moved off-grid */
+    const int nlon = 19, nlat = 10;
+    USMesh *mesh = make_mesh((size_t)nlon * nlat, (size_t)(nlon - 1) * (nlat - 1) * 2);
+    for (int j = 0; j < nlat; j++) {
+        for (int i = 0; i < nlon; i++) {
+            int interior = (i > 0 && i < nlon - 1 && j > 0 && j < nlat - 1);
+            double jitter = interior ? 3.7 * (double)(((i * 7 + j * 13) % 5) - 2) / 2.0 : 0.0;
+            set_node(mesh, j * nlon + i, -90.0 + 10.0 * i + jitter, -45.0 + 10.0 * j - jitter);
+        }
+    }
+    size_t e = 0;
+    for (int j = 0; j < nlat - 1; j++) {
+        for (int i = 0; i < nlon - 1; i++) {
+            int n = j * nlon + i;
+            set_elem(mesh, e++, n, n + 1, n + nlon);
+            set_elem(mesh, e++, n + 1, n + nlon + 1, n + nlon);
+        }
+    }
+    float *raw = malloc(mesh->n_points * sizeof(float));
+    for (size_t k = 0; k < mesh->n_points; k++) raw[k] = 1.0f;
+
+    const size_t w = 360, h = 180;
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, w, h, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    unsigned char *pixels = malloc(w * h * 3);
+    poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 1.0f, pixels);
+
+    /* Every pixel centre inside the outer boundary is covered */
+    size_t gaps = 0;
+    for (size_t y = 46; y < 134; y++) {
+        for (size_t x = 91; x < 269; x++) {
+            const unsigned char *p = pixel_at(pixels, w, x, y);
+            if ((p[0] | p[1] | p[2]) == 0) gaps++;
+        }
+    }
+    ASSERT_EQ_SIZET(gaps, 0);
+
+    free(pixels);
+    free(raw);
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test smooth shading interpolates node values across a triangle */
+TEST(poly_coverage_smooth_shading) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    /* Node values make the field (lon + 80) / 160 */
+    USMesh *mesh = make_mesh(3, 1);
+    set_node(mesh, 0, -80.0, -80.0);
+    set_node(mesh, 1, 80.0, -80.0);
+    set_node(mesh, 2, 0.0, 80.0);
+    set_elem(mesh, 0, 0, 1, 2);
+    float raw[3] = {0.0f, 1.0f, 0.5f};
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, NULL, 36, 18, POLY_LOD_MEAN,
+                                              POLY_SHADE_SMOOTH);
+    ASSERT_NOT_NULL(cov);
+    ASSERT_TRUE(poly_coverage_matches(cov, mesh, NULL, 36, 18, POLY_LOD_MEAN,
+                                      POLY_SHADE_SMOOTH));
+    ASSERT_FALSE(poly_coverage_matches(cov, mesh, NULL, 36, 18, POLY_LOD_MEAN,
+                                       POLY_SHADE_FLAT));
+
+    unsigned char pixels[36 * 18 * 3];
+    poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 1.0f, pixels);
+
+    /* Pixel centres at lon -55 and 35, lat -55 */
+    unsigned char r, g, b;
+    colormap_map_value(cmap, 25.0f / 160.0f, &r, &g, &b);
+    const unsigned char *p = pixel_at(pixels, 36, 12, 14);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+    colormap_map_value(cmap, 115.0f / 160.0f, &r, &g, &b);
+    p = pixel_at(pixels, 36, 21, 14);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+
+    /* A fill-valued node falls back to the mean of the others */
+    float with_fill[3] = {0.0f, -999.0f, 0.5f};
+    poly_coverage_render(cov, with_fill, -999.0f, cmap, 0.0f, 1.0f, pixels);
+    colormap_map_value(cmap, 0.25f, &r, &g, &b);
+    p = pixel_at(pixels, 36, 21, 14);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+
+    poly_coverage_free(cov);
+    free_mesh(mesh);
+    return 1;
+}
+
+/* Test sub-pixel elements are binned into one pixel as a mean or the largest */
+TEST(poly_coverage_subpixel_aggregation) {
+    colormaps_init();
+    USColormap *cmap = colormap_get_current();
+
+    /* A large triangle and, inside pixel (18, 8) of 36x18, three tiny ones */
+    USMesh *mesh = make_mesh(12, 4);
+    set_node(mesh, 0, -170.0, -80.0);
+    set_node(mesh, 1, -10.0, -80.0);
+    set_node(mesh, 2, -90.0, 80.0);
+    set_elem(mesh, 0, 0, 1, 2);
+    const double size[3] = {1.0, 4.0, 2.0};
+    for (int k = 0; k < 3; k++) {
+        int n = 3 + 3 * k;
+        set_node(mesh, n + 0, 2.0, 2.0);
+        set_node(mesh, n + 1, 2.0 + size[k], 2.0);
+        set_node(mesh, n + 2, 2.0, 2.0 + size[k]);
+        set_elem(mesh, (size_t)k + 1, n, n + 1, n + 2);
+    }
+    float raw[12] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                     30.0f, 30.0f, 30.0f, 60.0f, 60.0f, 60.0f};
+
+    USPolyLod *lod = poly_lod_build(mesh);
+    ASSERT_NOT_NULL(lod);
+    ASSERT_TRUE(poly_lod_matches(lod, mesh));
+
+    unsigned char pixels[36 * 18 * 3];
+    unsigned char r, g, b;
+    const unsigned char *p = pixel_at(pixels, 36, 18, 8);
+
+    USPolyCoverage *cov = poly_coverage_build(mesh, lod, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    ASSERT_EQ_SIZET(poly_coverage_aggregated(cov), 3);
+    ASSERT_EQ_SIZET(poly_coverage_visible(cov), 2);
+    ASSERT_TRUE(poly_coverage_matches(cov, mesh, lod, 36, 18, POLY_LOD_MEAN, POLY_SHADE_FLAT));
+    ASSERT_FALSE(poly_coverage_matches(cov, mesh, lod, 36, 18, POLY_LOD_DOMINANT, POLY_SHADE_FLAT));
+    ASSERT_EQ_INT(poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 90.0f, pixels), 0);
+    colormap_map_value(cmap, 30.0f / 90.0f, &r, &g, &b);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+
+    /* Large triangle is still scan converted as before */
+    colormap_map_value(cmap, 0.0f, &r, &g, &b);
+    const unsigned char *big = pixel_at(pixels, 36, 9, 12);
+    ASSERT_EQ_INT(big[0], r);
+    ASSERT_EQ_INT(big[1], g);
+    ASSERT_EQ_INT(big[2], b);
+    poly_coverage_free(cov);
+
+    cov = poly_coverage_build(mesh, lod, 36, 18, POLY_LOD_DOMINANT, POLY_SHADE_FLAT);
+    ASSERT_NOT_NULL(cov);
+    poly_coverage_render(cov, raw, -999.0f, cmap, 0.0f, 90.0f, pixels);
+    colormap_map_value(cmap, 30.0f / 90.0f, &r, &g, &b);
+    ASSERT_EQ_INT(p[0], r);
+    ASSERT_EQ_INT(p[1], g);
+    ASSERT_EQ_INT(p[2], b);
+    poly_coverage_free(cov);
+
+    poly_lod_free(lod);
+    free_mesh(mesh);
+    return 1;
+}
+
+RUN_TESTS("Polygon Raster")
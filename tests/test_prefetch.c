@@ -0,0 +1,404 @@
+/*
+ * test_prefetch.c - Tests for the background read-ahead and range scan worker
+ *
+ * The prefetcher is linked against the scripted view_read_var_slice()
+ * below instead of the file readers, so each test knows exactly which
+ * slices the worker read, when, and whether a read overlapped a pause.
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/prefetch.h"
+#include "../src/range_scan.h"
+#include "../src/slice_cache.h"
+#include "../src/view.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define N_POINTS    1000
+#define N_TIMES     5
+#define N_DEPTHS    4
+#define SLICE_BYTES (N_POINTS * sizeof(float))
+#define FILL        (-999.0f)
+
+/* What the worker has read through the scripted reader */
+static struct {
+    pthread_mutex_t lock;
+    long            delay_ns;       /* Time each read takes */
+    int             in_read;        /* A read is in progress */
+    int             files_held;     /* The test holds the files (between pause and resume) */
+    int             overlaps;       /* Reads started while the test held the files */
+    size_t          n_reads;
+    int             reads[N_TIMES][N_DEPTHS];
+} reader = { PTHREAD_MUTEX_INITIALIZER, 0, 0, 0, 0, 0, {{0}} };
+
+/* Slice (t, d) spans [t + 10 d, t + 10 d + 1] */
+int view_read_var_slice(USVar *var, USFileSet *fileset, size_t time_idx, size_t depth_idx,
+                        float *out) {
+    (void)fileset;
+    if (!var || !out || time_idx >= N_TIMES || depth_idx >= N_DEPTHS) return -1;
+
+    pthread_mutex_lock(&reader.lock);
+    reader.in_read = 1;
+    if (reader.files_held) reader.overlaps++;
+    long delay_ns = reader.delay_ns;
+    pthread_mutex_unlock(&reader.lock);
+
+    if (delay_ns > 0) {
+        struct timespec ts = { 0, delay_ns };
+        nanosleep(&ts, NULL);
+    }
+    for (size_t i = 0; i < N_POINTS; i++) {
+        out[i] = (float)(time_idx + 10 * depth_idx) + (float)i / (N_POINTS - 1);
+    }
+
+    pthread_mutex_lock(&reader.lock);
+    reader.in_read = 0;
+    reader.n_reads++;
+    reader.reads[time_idx][depth_idx]++;
+    pthread_mutex_unlock(&reader.lock);
+    return 0;
+}
+
+static void reader_reset(long delay_ns) {
+    pthread_mutex_lock(&reader.lock);
+    reader.delay_ns = delay_ns;
+    reader.in_read = 0;
+    reader.files_held = 0;
+    reader.overlaps = 0;
+    reader.n_reads = 0;
+    memset(reader.reads, 0, sizeof(reader.reads));
+    pthread_mutex_unlock(&reader.lock);
+}
+
+static size_t reader_count(void) {
+    pthread_mutex_lock(&reader.lock);
+    size_t n = reader.n_reads;
+    pthread_mutex_unlock(&reader.lock);
+    return n;
+}
+
+static int reader_slice_count(size_t t, size_t d) {
+    pthread_mutex_lock(&reader.lock);
+    int n = reader.reads[t][d];
+    pthread_mutex_unlock(&reader.lock);
+    return n;
+}
+
+static int reader_busy(void) {
+    pthread_mutex_lock(&reader.lock);
+    int busy = reader.in_read;
+    pthread_mutex_unlock(&reader.lock);
+    return busy;
+}
+
+static void reader_hold_files(int held) {
+    pthread_mutex_lock(&reader.lock);
+    reader.files_held = held;
+    pthread_mutex_unlock(&reader.lock);
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/* Reads so far, after giving the worker time to start any more */
+static size_t settled_reads(void) {
+    sleep_ms(50);
+    return reader_count();
+}
+
+/* Wait up to 5 s for at least n reads, then check for extra ones */
+static size_t wait_for_reads(size_t n) {
+    for (int i = 0; i < 5000 && reader_count() < n; i++) sleep_ms(1);
+    return settled_reads();
+}
+
+/* Wait up to 5 s for a read to be in progress */
+static int wait_for_read_start(void) {
+    for (int i = 0; i < 5000; i++) {
+        if (reader_busy()) return 1;
+        sleep_ms(1);
+    }
+    return 0;
+}
+
+static void init_var(USVar *var) {
+    memset(var, 0, sizeof(*var));
+    strcpy(var->name, "temp");
+    var->fill_value = FILL;
+}
+
+/* A view at (t, d) stepping in time or depth; only what prefetch_schedule() reads */
+static void init_view(USView *view, USVar *var, size_t t, size_t d,
+                      int time_step, int depth_step) {
+    memset(view, 0, sizeof(*view));
+    view->variable = var;
+    view->raw_data_size = N_POINTS;
+    view->n_times = N_TIMES;
+    view->n_depths = N_DEPTHS;
+    view->time_index = t;
+    view->depth_index = d;
+    view->time_step = time_step;
+    view->depth_step = depth_step;
+}
+
+static int cached(USSliceCache *cache, USVar *var, size_t t, size_t d) {
+    USSliceKey key = slice_key_make(var, NULL, t, d);
+    return slice_cache_peek(cache, &key, NULL, N_POINTS);
+}
+
+/* Test time read-ahead wraps like the animation loop and stops short of the start */
+TEST(prefetch_time_wrap) {
+    USVar var;
+    USView view;
+    init_var(&var);
+    reader_reset(0);
+    USSliceCache *cache = slice_cache_create(64 * SLICE_BYTES);
+    USPrefetcher *pf = prefetch_create(cache, 8);
+    ASSERT_NOT_NULL(cache);
+    ASSERT_NOT_NULL(pf);
+
+    /* Forward from t=3: 4, 0, 1, 2 at the view's depth, never 3 itself */
+    init_view(&view, &var, 3, 1, 1, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(4), 4);
+    ASSERT_EQ_SIZET(prefetch_get_count(pf), 4);
+    for (size_t t = 0; t < N_TIMES; t++) {
+        ASSERT_EQ_INT(reader_slice_count(t, 1), t == 3 ? 0 : 1);
+        ASSERT_EQ_INT(cached(cache, &var, t, 1), t == 3 ? 0 : 1);
+    }
+
+    /* Backward from t=1 at another depth: 0, 4, 3, 2 */
+    init_view(&view, &var, 1, 2, -1, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(8), 8);
+    for (size_t t = 0; t < N_TIMES; t++) {
+        ASSERT_EQ_INT(reader_slice_count(t, 2), t == 1 ? 0 : 1);
+    }
+
+    /* Slices already cached are not read again */
+    init_view(&view, &var, 3, 1, 1, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(settled_reads(), 8);
+    ASSERT_EQ_SIZET(prefetch_get_count(pf), 8);
+
+    prefetch_free(pf);
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test depth read-ahead stops at the first and last level */
+TEST(prefetch_depth_ends) {
+    USVar var;
+    USView view;
+    init_var(&var);
+    reader_reset(0);
+    USSliceCache *cache = slice_cache_create(64 * SLICE_BYTES);
+    USPrefetcher *pf = prefetch_create(cache, 8);
+    ASSERT_NOT_NULL(cache);
+    ASSERT_NOT_NULL(pf);
+
+    /* Down from d=1 of 4: only 2 and 3 */
+    init_view(&view, &var, 0, 1, 0, 1);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(2), 2);
+    ASSERT_EQ_INT(reader_slice_count(0, 2), 1);
+    ASSERT_EQ_INT(reader_slice_count(0, 3), 1);
+    ASSERT_TRUE(cached(cache, &var, 0, 3));
+
+    /* Up from the first level: nothing */
+    init_view(&view, &var, 1, 0, 0, -1);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(settled_reads(), 2);
+
+    /* Up from d=2: 1 and 0, at the view's time */
+    init_view(&view, &var, 1, 2, 0, -1);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(4), 4);
+    ASSERT_EQ_INT(reader_slice_count(1, 1), 1);
+    ASSERT_EQ_INT(reader_slice_count(1, 0), 1);
+
+    /* Standing still: nothing */
+    init_view(&view, &var, 2, 2, 0, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(settled_reads(), 4);
+
+    prefetch_free(pf);
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test read-ahead leaves at least half the cache for slices already visited */
+TEST(prefetch_cache_budget) {
+    USVar var;
+    USView view;
+    init_var(&var);
+    reader_reset(0);
+
+    /* Room for 5 slices: at most 2 ahead, though 8 were asked for */
+    USSliceCache *cache = slice_cache_create(5 * SLICE_BYTES + 100);
+    USPrefetcher *pf = prefetch_create(cache, 8);
+    ASSERT_NOT_NULL(cache);
+    ASSERT_NOT_NULL(pf);
+    init_view(&view, &var, 0, 0, 1, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(2), 2);
+    ASSERT_EQ_INT(reader_slice_count(1, 0), 1);
+    ASSERT_EQ_INT(reader_slice_count(2, 0), 1);
+    ASSERT_TRUE(cached(cache, &var, 1, 0));
+    ASSERT_TRUE(cached(cache, &var, 2, 0));
+    prefetch_free(pf);
+    slice_cache_free(cache);
+
+    /* Less than two slices: no read-ahead at all */
+    reader_reset(0);
+    cache = slice_cache_create(SLICE_BYTES + SLICE_BYTES / 2);
+    pf = prefetch_create(cache, 8);
+    ASSERT_NOT_NULL(cache);
+    ASSERT_NOT_NULL(pf);
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(settled_reads(), 0);
+    ASSERT_EQ_SIZET(prefetch_get_count(pf), 0);
+    prefetch_free(pf);
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test a pause waits out the read in flight, keeps the worker off the files and drops queued work */
+TEST(prefetch_pause_handoff) {
+    USVar var;
+    USView view;
+    init_var(&var);
+    reader_reset(20000000L);
+    USSliceCache *cache = slice_cache_create(64 * SLICE_BYTES);
+    USPrefetcher *pf = prefetch_create(cache, 8);
+    ASSERT_NOT_NULL(cache);
+    ASSERT_NOT_NULL(pf);
+
+    init_view(&view, &var, 0, 0, 1, 0);
+    prefetch_schedule(pf, &view);
+    ASSERT_TRUE(wait_for_read_start());
+
+    prefetch_pause(pf);
+    ASSERT_FALSE(reader_busy());
+    reader_hold_files(1);
+    size_t n_paused = reader_count();
+    ASSERT_GE(n_paused, 1);
+    ASSERT_LT(n_paused, 4);
+    for (size_t t = 1; t <= n_paused; t++) {
+        ASSERT_TRUE(cached(cache, &var, t, 0));  /* Stored before the files were handed over */
+    }
+    sleep_ms(100);
+    ASSERT_EQ_SIZET(reader_count(), n_paused);
+    reader_hold_files(0);
+    prefetch_resume(pf);
+
+    /* The rest of the earlier prediction was dropped */
+    ASSERT_EQ_SIZET(settled_reads(), n_paused);
+
+    /* A new schedule reads what is left, each slice once */
+    prefetch_schedule(pf, &view);
+    ASSERT_EQ_SIZET(wait_for_reads(4), 4);
+    for (size_t t = 1; t < N_TIMES; t++) {
+        ASSERT_EQ_INT(reader_slice_count(t, 0), 1);
+    }
+    ASSERT_EQ_INT(reader.overlaps, 0);
+
+    /* NULL prefetcher: no-ops */
+    prefetch_pause(NULL);
+    prefetch_resume(NULL);
+
+    prefetch_free(pf);
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test an attached range scan runs to completion on the worker */
+TEST(prefetch_range_scan_complete) {
+    USVar var;
+    init_var(&var);
+    reader_reset(0);
+    USPrefetcher *pf = prefetch_create(NULL, 0);
+    USRangeScan *scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+    ASSERT_NOT_NULL(pf);
+    ASSERT_NOT_NULL(scan);
+
+    prefetch_set_range_scan(pf, scan);
+    for (int i = 0; i < 5000 && !range_scan_done(scan); i++) sleep_ms(1);
+    ASSERT_TRUE(range_scan_complete(scan));
+    ASSERT_EQ_SIZET(reader_count(), N_TIMES * N_DEPTHS);
+    USRangeScanStats st;
+    range_scan_get_stats(scan, &st);
+    ASSERT_TRUE(st.valid);
+    ASSERT_NEAR(st.min, 0.0, 1e-6);
+    ASSERT_NEAR(st.max, (N_TIMES - 1) + 10.0 * (N_DEPTHS - 1) + 1.0, 1e-5);
+
+    prefetch_set_range_scan(pf, NULL);
+    range_scan_free(scan);
+    prefetch_free(pf);
+    return 1;
+}
+
+/* Test detaching a scan returns only once the worker has let go of it */
+TEST(prefetch_range_scan_detach) {
+    USVar var;
+    init_var(&var);
+    USPrefetcher *pf = prefetch_create(NULL, 0);
+    ASSERT_NOT_NULL(pf);
+
+    for (int i = 0; i < 5; i++) {
+        reader_reset(10000000L);
+        USRangeScan *scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+        ASSERT_NOT_NULL(scan);
+        prefetch_set_range_scan(pf, scan);
+        ASSERT_TRUE(wait_for_read_start());
+
+        /* Detach with a slice of the scan in flight, then free it straight away */
+        prefetch_set_range_scan(pf, NULL);
+        ASSERT_FALSE(reader_busy());
+        size_t n = reader_count();
+        ASSERT_FALSE(range_scan_done(scan));
+        range_scan_free(scan);
+
+        sleep_ms(50);
+        ASSERT_EQ_SIZET(reader_count(), n);
+    }
+
+    /* Replacing a scan detaches the earlier one the same way */
+    reader_reset(10000000L);
+    USRangeScan *first = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+    USRangeScan *second = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+    ASSERT_NOT_NULL(first);
+    ASSERT_NOT_NULL(second);
+    prefetch_set_range_scan(pf, first);
+    ASSERT_TRUE(wait_for_read_start());
+    prefetch_set_range_scan(pf, second);
+    USRangeScanStats st;
+    range_scan_get_stats(first, &st);
+    size_t n_first = st.n_done;
+    range_scan_free(first);
+    for (int i = 0; i < 5000 && !range_scan_done(second); i++) sleep_ms(1);
+    ASSERT_TRUE(range_scan_complete(second));
+    ASSERT_EQ_SIZET(reader_count(), n_first + N_TIMES * N_DEPTHS);
+
+    prefetch_set_range_scan(pf, NULL);
+    range_scan_free(second);
+    prefetch_free(pf);
+    return 1;
+}
+
+/* Test bad arguments */
+TEST(prefetch_null_args) {
+    ASSERT_NULL(prefetch_create(NULL, -1));
+    ASSERT_EQ_SIZET(prefetch_get_count(NULL), 0);
+    prefetch_schedule(NULL, NULL);
+    prefetch_set_range_scan(NULL, NULL);
+    prefetch_free(NULL);
+    return 1;
+}
+
+RUN_TESTS("Prefetch")
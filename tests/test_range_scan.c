@@ -0,0 +1,178 @@
+/*
+ * test_range_scan.c - Unit tests for the exact range scan and its sidecar
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/range_scan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define N_POINTS 200
+#define N_TIMES  5
+#define N_DEPTHS 3
+#define FILL     (-999.0f)
+
+/* Slice whose range is [t + 10 d, t + 10 d + 1], with some fill values */
+static void fill_slice(float *data, size_t t, size_t d) {
+    for (size_t i = 0; i < N_POINTS; i++) {
+        data[i] = (i % 7 == 5) ? FILL : (float)(t + 10 * d) + (float)i / (N_POINTS - 1);
+    }
+}
+
+/* Feed every slice the scan asks for; returns the number fed */
+static size_t run_scan(USRangeScan *scan) {
+    float data[N_POINTS];
+    size_t t, d, n = 0;
+    while (range_scan_next(scan, &t, &d)) {
+        fill_slice(data, t, d);
+        if (range_scan_add(scan, t, d, data) != 0) break;
+        n++;
+    }
+    return n;
+}
+
+static void init_var(USVar *var, USFile *file) {
+    memset(var, 0, sizeof(*var));
+    strcpy(var->name, "temp");
+    var->fill_value = FILL;
+    var->file = file;
+}
+
+/* Test the scan visits every slice once, coarse to fine, and gets exact ranges */
+TEST(range_scan_exact) {
+    USVar var;
+    init_var(&var, NULL);
+    USRangeScan *scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+    ASSERT_NOT_NULL(scan);
+
+    /* First time, then the middle, with all depths of each */
+    size_t t, d;
+    int seen[N_TIMES][N_DEPTHS] = {{0}};
+    float data[N_POINTS];
+    size_t order[4][2] = {{0, 0}, {0, 1}, {0, 2}, {4, 0}};
+    for (size_t k = 0; range_scan_next(scan, &t, &d); k++) {
+        if (k < 4) {
+            ASSERT_EQ_SIZET(t, order[k][0]);
+            ASSERT_EQ_SIZET(d, order[k][1]);
+        }
+        ASSERT_EQ_INT(seen[t][d], 0);
+        seen[t][d] = 1;
+        fill_slice(data, t, d);
+        ASSERT_EQ_INT(range_scan_add(scan, t, d, data), 0);
+    }
+    for (t = 0; t < N_TIMES; t++) {
+        for (d = 0; d < N_DEPTHS; d++) ASSERT_EQ_INT(seen[t][d], 1);
+    }
+
+    ASSERT_TRUE(range_scan_done(scan));
+    ASSERT_TRUE(range_scan_complete(scan));
+    USRangeScanStats st;
+    range_scan_get_stats(scan, &st);
+    ASSERT_EQ_SIZET(st.n_done, (size_t)N_TIMES * N_DEPTHS);
+    ASSERT_TRUE(st.valid);
+    ASSERT_NEAR(st.min, 0.0f, 1e-6);
+    ASSERT_NEAR(st.max, (N_TIMES - 1) + 10.0f * (N_DEPTHS - 1) + 1.0f, 1e-5);
+
+    float dmin, dmax;
+    ASSERT_EQ_INT(range_scan_get_depth(scan, 1, &dmin, &dmax), 0);
+    ASSERT_NEAR(dmin, 10.0f, 1e-6);
+    ASSERT_NEAR(dmax, 10.0f + (N_TIMES - 1) + 1.0f, 1e-5);
+    ASSERT_EQ_INT(range_scan_get_depth(scan, N_DEPTHS, &dmin, &dmax), -1);
+
+    range_scan_free(scan);
+    return 1;
+}
+
+/* Test a finished scan is reused from its sidecar until the file changes */
+TEST(range_scan_sidecar) {
+    char dir[256], path[300];
+    snprintf(dir, sizeof(dir), "/tmp/test_ushow_cache_%d", getpid());
+    snprintf(path, sizeof(path), "%s/data.nc", dir);
+    mkdir(dir, 0755);
+    FILE *fp = fopen(path, "w");
+    ASSERT_NOT_NULL(fp);
+    fputs("data", fp);
+    fclose(fp);
+
+    USFile file;
+    memset(&file, 0, sizeof(file));
+    strcpy(file.filename, path);
+    USVar var;
+    init_var(&var, &file);
+
+    USRangeScan *scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, dir);
+    ASSERT_NOT_NULL(scan);
+    ASSERT_FALSE(range_scan_done(scan));
+    ASSERT_EQ_SIZET(run_scan(scan), (size_t)N_TIMES * N_DEPTHS);
+    USRangeScanStats first;
+    range_scan_get_stats(scan, &first);
+    range_scan_free(scan);
+
+    /* Same file: complete at once, bit-identical */
+    scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, dir);
+    ASSERT_NOT_NULL(scan);
+    ASSERT_TRUE(range_scan_complete(scan));
+    USRangeScanStats st;
+    range_scan_get_stats(scan, &st);
+    ASSERT_TRUE(st.valid);
+    ASSERT_TRUE(st.min == first.min && st.max == first.max);
+    float dmin, dmax;
+    ASSERT_EQ_INT(range_scan_get_depth(scan, 2, &dmin, &dmax), 0);
+    ASSERT_NEAR(dmin, 20.0f, 1e-6);
+    range_scan_free(scan);
+
+    /* Different shape: not reused */
+    scan = range_scan_create(&var, NULL, N_TIMES + 1, N_DEPTHS, N_POINTS, dir);
+    ASSERT_FALSE(range_scan_done(scan));
+    range_scan_free(scan);
+
+    /* Changed file: scanned again */
+    fp = fopen(path, "a");
+    ASSERT_NOT_NULL(fp);
+    fputs("more", fp);
+    fclose(fp);
+    scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, dir);
+    ASSERT_FALSE(range_scan_done(scan));
+    range_scan_free(scan);
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    ASSERT_EQ_INT(system(cmd), 0);
+    return 1;
+}
+
+/* Test out-of-order slices are refused and an aborted scan stays partial */
+TEST(range_scan_abort) {
+    USVar var;
+    init_var(&var, NULL);
+    USRangeScan *scan = range_scan_create(&var, NULL, N_TIMES, N_DEPTHS, N_POINTS, NULL);
+    ASSERT_NOT_NULL(scan);
+
+    float data[N_POINTS];
+    fill_slice(data, 1, 0);
+    ASSERT_EQ_INT(range_scan_add(scan, 1, 0, data), -1);
+    fill_slice(data, 0, 0);
+    ASSERT_EQ_INT(range_scan_add(scan, 0, 0, data), 0);
+
+    range_scan_abort(scan);
+    size_t t, d;
+    ASSERT_FALSE(range_scan_next(scan, &t, &d));
+    ASSERT_TRUE(range_scan_done(scan));
+    ASSERT_FALSE(range_scan_complete(scan));
+
+    USRangeScanStats st;
+    range_scan_get_stats(scan, &st);
+    ASSERT_EQ_SIZET(st.n_done, 1);
+    ASSERT_TRUE(st.valid);
+    float dmin, dmax;
+    ASSERT_EQ_INT(range_scan_get_depth(scan, 0, &dmin, &dmax), -1);
+
+    range_scan_free(scan);
+    ASSERT_NULL(range_scan_create(&var, NULL, 0, N_DEPTHS, N_POINTS, NULL));
+    return 1;
+}
+
+RUN_TESTS("Range Scan")
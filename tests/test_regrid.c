@@ -8,8 +8,12 @@
 #include "../src/ushow.defines.h"
 #include "../src/mesh.h"
 #include "../src/regrid.h"
+#include "../src/regrid_cache.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <float.h>
+#include <unistd.h>
+#include <dirent.h>
 
 /* Helper: Create a simple mesh with global coverage */
 static USMesh *create_test_mesh_global(size_t nx, size_t ny) {
@@ -491,4 +495,431 @@ TEST(regrid_identity) {
     return 1;
 }
 
+/* Test IDW regridding of a constant field */
+TEST(regrid_idw_uniform) {
+    USMesh *mesh = create_test_mesh_global(36, 18);
+    ASSERT_NOT_NULL(mesh);
+
+    USRegrid *regrid = regrid_create_idw(mesh, 10.0, 1000000.0, 4);
+    ASSERT_NOT_NULL(regrid);
+
+    float *source_data = malloc(mesh->n_points * sizeof(float));
+    ASSERT_NOT_NULL(source_data);
+    for (size_t i = 0; i < mesh->n_points; i++) {
+        source_data[i] = 42.0f;
+    }
+
+    size_t nx, ny;
+    regrid_get_target_dims(regrid, &nx, &ny);
+    float *target_data = malloc(nx * ny * sizeof(float));
+    ASSERT_NOT_NULL(target_data);
+
+    regrid_apply(regrid, source_data, 1e20f, target_data);
+
+    int has_valid = 0;
+    for (size_t i = 0; i < nx * ny; i++) {
+        if (target_data[i] < 1e10f) {
+            ASSERT_NEAR(target_data[i], 42.0f, 1e-4f);
+            has_valid = 1;
+        }
+    }
+    ASSERT_TRUE(has_valid);
+
+    free(source_data);
+    free(target_data);
+    regrid_free(regrid);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Test IDW output stays within the source range and matches NN coverage */
+TEST(regrid_idw_bounded) {
+    USMesh *mesh = create_test_mesh_local(0.0, 40.0, 0.0, 40.0, 40, 40);
+    ASSERT_NOT_NULL(mesh);
+
+    USRegrid *nn = regrid_create(mesh, 1.0, 200000.0);
+    USRegrid *idw = regrid_create_idw(mesh, 1.0, 200000.0, 6);
+    ASSERT_NOT_NULL(nn);
+    ASSERT_NOT_NULL(idw);
+
+    size_t nx, ny;
+    regrid_get_target_dims(idw, &nx, &ny);
+    for (size_t i = 0; i < nx * ny; i++) {
+        ASSERT_EQ(regrid_cell_valid(idw, i), regrid_cell_valid(nn, i));
+    }
+
+    float *source_data = malloc(mesh->n_points * sizeof(float));
+    ASSERT_NOT_NULL(source_data);
+    for (size_t i = 0; i < mesh->n_points; i++) {
+        source_data[i] = (float)mesh->lon[i];
+    }
+
+    float *target_data = malloc(nx * ny * sizeof(float));
+    ASSERT_NOT_NULL(target_data);
+    regrid_apply(idw, source_data, 1e20f, target_data);
+
+    for (size_t i = 0; i < nx * ny; i++) {
+        if (regrid_cell_valid(idw, i)) {
+            ASSERT_TRUE(target_data[i] >= 0.0f && target_data[i] <= 40.0f);
+        } else {
+            ASSERT_NEAR(target_data[i], 1e20f, 1e14f);
+        }
+    }
+
+    free(source_data);
+    free(target_data);
+    regrid_free(nn);
+    regrid_free(idw);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Test that every nearest-neighbor query strategy builds the same regrid */
+TEST(regrid_query_strategies_match) {
+    USMesh *mesh = create_test_mesh_global(72, 36);
+    ASSERT_NOT_NULL(mesh);
+
+    const RegridQueryStrategy strategies[] = {
+        REGRID_QUERY_BATCH, REGRID_QUERY_WALK, REGRID_QUERY_COLD
+    };
+    USRegrid *regrids[3];
+    regrid_set_store_distances(1);
+    for (int s = 0; s < 3; s++) {
+        regrid_set_query_strategy(strategies[s]);
+        regrids[s] = regrid_create(mesh, 1.0, 150000.0);
+        ASSERT_NOT_NULL(regrids[s]);
+    }
+    regrid_set_query_strategy(REGRID_QUERY_WALK);
+    regrid_set_store_distances(0);
+
+    size_t nx, ny;
+    regrid_get_target_dims(regrids[0], &nx, &ny);
+    size_t n_valid = 0;
+    for (size_t i = 0; i < nx * ny; i++) {
+        n_valid += regrid_cell_valid(regrids[0], i);
+        for (int s = 1; s < 3; s++) {
+            ASSERT_EQ_INT(regrid_cell_valid(regrids[s], i), regrid_cell_valid(regrids[0], i));
+            ASSERT_EQ_SIZET((size_t)regrids[s]->nn_indices[i], (size_t)regrids[0]->nn_indices[i]);
+            ASSERT_TRUE(regrids[s]->nn_distances[i] == regrids[0]->nn_distances[i]);
+        }
+    }
+    /* The radius is below the source spacing, so some cells stay empty */
+    ASSERT_TRUE(n_valid > 0 && n_valid < nx * ny);
+
+    for (int s = 0; s < 3; s++) regrid_free(regrids[s]);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Test that the build result does not depend on the number of threads */
+TEST(regrid_threads_bit_identical) {
+    USMesh *mesh = create_test_mesh_global(144, 72);
+    ASSERT_NOT_NULL(mesh);
+
+    regrid_set_store_distances(1);
+    regrid_set_num_threads(1);
+    USRegrid *serial = regrid_create_idw(mesh, 1.0, 300000.0, 4);
+    regrid_set_num_threads(5);
+    USRegrid *parallel = regrid_create_idw(mesh, 1.0, 300000.0, 4);
+    regrid_set_num_threads(0);
+    regrid_set_store_distances(0);
+    ASSERT_NOT_NULL(serial);
+    ASSERT_NOT_NULL(parallel);
+
+    size_t n = serial->target_nx * serial->target_ny;
+    size_t k = (size_t)serial->n_neighbors;
+    ASSERT_TRUE(memcmp(serial->nn_indices, parallel->nn_indices, n * sizeof(RegridIndex)) == 0);
+    ASSERT_TRUE(memcmp(serial->nn_distances, parallel->nn_distances, n * sizeof(float)) == 0);
+    ASSERT_TRUE(memcmp(serial->valid_bits, parallel->valid_bits,
+                       REGRID_BIT_WORDS(n) * sizeof(uint64_t)) == 0);
+    ASSERT_TRUE(memcmp(serial->idw_indices, parallel->idw_indices,
+                       n * k * sizeof(RegridIndex)) == 0);
+    ASSERT_TRUE(memcmp(serial->idw_weights, parallel->idw_weights, n * k * sizeof(float)) == 0);
+
+    regrid_free(serial);
+    regrid_free(parallel);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Helper: Remove a cache directory and the files in it */
+static void remove_cache_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *e;
+        char path[512];
+        while ((e = readdir(d)) != NULL) {
+            if (e->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/* Helper: Check that two regrids hold the same map */
+static int regrids_equal(const USRegrid *a, const USRegrid *b) {
+    if (a->target_nx != b->target_nx || a->target_ny != b->target_ny) return 0;
+    if (a->method != b->method || a->n_neighbors != b->n_neighbors) return 0;
+    if (a->target_dlon != b->target_dlon || a->target_dlat != b->target_dlat) return 0;
+    if (a->influence_radius_chord != b->influence_radius_chord) return 0;
+    size_t n = a->target_nx * a->target_ny;
+    if (memcmp(a->nn_indices, b->nn_indices, n * sizeof(RegridIndex)) != 0) return 0;
+    if (memcmp(a->valid_bits, b->valid_bits, REGRID_BIT_WORDS(n) * sizeof(uint64_t)) != 0) return 0;
+    if ((a->nn_distances == NULL) != (b->nn_distances == NULL)) return 0;
+    if (a->nn_distances && memcmp(a->nn_distances, b->nn_distances, n * sizeof(float)) != 0) {
+        return 0;
+    }
+    if (a->method == REGRID_IDW) {
+        size_t k = (size_t)a->n_neighbors;
+        if (memcmp(a->idw_indices, b->idw_indices, n * k * sizeof(RegridIndex)) != 0) return 0;
+        if (memcmp(a->idw_weights, b->idw_weights, n * k * sizeof(float)) != 0) return 0;
+    }
+    return 1;
+}
+
+/* Test regrid cache round trip and keying */
+TEST(regrid_cache_roundtrip) {
+    char dir[] = "/tmp/test_ushow_cache_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir));
+    char cache_dir[64];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/nested/ushow", dir);
+
+    USMesh *mesh = create_test_mesh_global(72, 36);
+    ASSERT_NOT_NULL(mesh);
+
+    /* Miss: builds and saves (creating the directory) */
+    ASSERT_NULL(regrid_cache_load(mesh, 2.0, 300000.0, 0, cache_dir));
+    USRegrid *built = regrid_create_cached(mesh, 2.0, 300000.0, 0, cache_dir);
+    ASSERT_NOT_NULL(built);
+    ASSERT_NOT_NULL(built->kdtree);
+    ASSERT_NULL(built->cache_map);
+
+    /* Hit: mapped from disk without a KDTree */
+    USRegrid *loaded = regrid_create_cached(mesh, 2.0, 300000.0, 0, cache_dir);
+    ASSERT_NOT_NULL(loaded);
+    ASSERT_NULL(loaded->kdtree);
+    ASSERT_NOT_NULL(loaded->cache_map);
+    ASSERT_TRUE(regrids_equal(built, loaded));
+
+    float *source = malloc(mesh->n_points * sizeof(float));
+    float *out_built = malloc(built->target_nx * built->target_ny * sizeof(float));
+    float *out_loaded = malloc(built->target_nx * built->target_ny * sizeof(float));
+    ASSERT_NOT_NULL(source);
+    ASSERT_NOT_NULL(out_built);
+    ASSERT_NOT_NULL(out_loaded);
+    for (size_t i = 0; i < mesh->n_points; i++) source[i] = (float)mesh->lat[i];
+    regrid_apply(built, source, 1e20f, out_built);
+    regrid_apply(loaded, source, 1e20f, out_loaded);
+    ASSERT_TRUE(memcmp(out_built, out_loaded,
+                       built->target_nx * built->target_ny * sizeof(float)) == 0);
+
+    /* Other parameters are separate entries */
+    ASSERT_NULL(regrid_cache_load(mesh, 2.0, 200000.0, 0, cache_dir));
+    ASSERT_NULL(regrid_cache_load(mesh, 1.0, 300000.0, 0, cache_dir));
+    ASSERT_NULL(regrid_cache_load(mesh, 2.0, 300000.0, 3, cache_dir));
+
+    USRegrid *idw = regrid_create_cached(mesh, 2.0, 300000.0, 3, cache_dir);
+    USRegrid *idw_loaded = regrid_cache_load(mesh, 2.0, 300000.0, 3, cache_dir);
+    ASSERT_NOT_NULL(idw);
+    ASSERT_NOT_NULL(idw_loaded);
+    ASSERT_TRUE(regrids_equal(idw, idw_loaded));
+
+    /* A moved mesh node changes the fingerprint */
+    uint64_t fingerprint = regrid_cache_mesh_fingerprint(mesh);
+    mesh->lon[100] += 1e-9;
+    ASSERT_TRUE(regrid_cache_mesh_fingerprint(mesh) != fingerprint);
+    ASSERT_NULL(regrid_cache_load(mesh, 2.0, 300000.0, 0, cache_dir));
+
+    /* No directory: build only */
+    USRegrid *uncached = regrid_create_cached(mesh, 2.0, 300000.0, 0, NULL);
+    ASSERT_NOT_NULL(uncached);
+    ASSERT_NULL(uncached->cache_map);
+
+    free(source);
+    free(out_built);
+    free(out_loaded);
+    regrid_free(built);
+    regrid_free(loaded);
+    regrid_free(idw);
+    regrid_free(idw_loaded);
+    regrid_free(uncached);
+    mesh_free(mesh);
+
+    remove_cache_dir(cache_dir);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/nested", dir);
+    rmdir(cache_dir);
+    rmdir(dir);
+    return 1;
+}
+
+/* Test that damaged cache files are ignored */
+TEST(regrid_cache_rejects_corrupt) {
+    char dir[] = "/tmp/test_ushow_cache_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir));
+
+    USMesh *mesh = create_test_mesh_global(36, 18);
+    ASSERT_NOT_NULL(mesh);
+    USRegrid *regrid = regrid_create(mesh, 5.0, 500000.0);
+    ASSERT_NOT_NULL(regrid);
+    ASSERT_EQ_INT(regrid_cache_save(regrid, mesh, 5.0, dir), 0);
+
+    USRegrid *loaded = regrid_cache_load(mesh, 5.0, 500000.0, 0, dir);
+    ASSERT_NOT_NULL(loaded);
+    regrid_free(loaded);
+
+    /* Truncate the cache file */
+    DIR *d = opendir(dir);
+    ASSERT_NOT_NULL(d);
+    struct dirent *e;
+    char path[512] = "";
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.') snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    }
+    closedir(d);
+    ASSERT_TRUE(path[0] != '\0');
+    ASSERT_EQ_INT(truncate(path, 100), 0);
+    ASSERT_NULL(regrid_cache_load(mesh, 5.0, 500000.0, 0, dir));
+
+    regrid_free(regrid);
+    mesh_free(mesh);
+    remove_cache_dir(dir);
+    return 1;
+}
+
+/* Test compact tables: bitset agrees with distances, distances only on request */
+TEST(regrid_compact_tables) {
+    USMesh *mesh = create_test_mesh_global(72, 36);
+    ASSERT_NOT_NULL(mesh);
+
+    /* 183 x 91 cells: rows do not start on bitset word boundaries */
+    USRegrid *plain = regrid_create(mesh, 360.0 / 183, 250000.0);
+    regrid_set_store_distances(1);
+    USRegrid *with_dist = regrid_create(mesh, 360.0 / 183, 250000.0);
+    regrid_set_store_distances(0);
+    ASSERT_NOT_NULL(plain);
+    ASSERT_NOT_NULL(with_dist);
+    ASSERT_NULL(plain->nn_distances);
+    ASSERT_NOT_NULL(with_dist->nn_distances);
+    ASSERT_EQ_SIZET(sizeof(plain->nn_indices[0]), sizeof(RegridIndex));
+
+    size_t n = plain->target_nx * plain->target_ny;
+    ASSERT_TRUE(n % 64 != 0);
+    ASSERT_TRUE(memcmp(plain->valid_bits, with_dist->valid_bits,
+                       REGRID_BIT_WORDS(n) * sizeof(uint64_t)) == 0);
+
+    size_t n_valid = 0;
+    for (size_t i = 0; i < n; i++) {
+        int valid = regrid_cell_valid(plain, i);
+        n_valid += valid;
+        ASSERT_EQ_SIZET((size_t)plain->nn_indices[i], (size_t)with_dist->nn_indices[i]);
+        ASSERT_TRUE(plain->nn_indices[i] < mesh->n_points);
+        if (valid) {
+            ASSERT_TRUE(with_dist->nn_distances[i] <= (float)plain->influence_radius_chord * 1.0001f);
+        } else {
+            ASSERT_TRUE(with_dist->nn_distances[i] == FLT_MAX);
+        }
+    }
+    ASSERT_TRUE(n_valid > 0 && n_valid < n);
+
+    /* Bits past the last cell stay clear */
+    if (n % 64) {
+        ASSERT_EQ_SIZET((size_t)(plain->valid_bits[n / 64] >> (n % 64)), 0);
+    }
+
+    regrid_free(plain);
+    regrid_free(with_dist);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Helper: Compare every supported apply kernel against the scalar one */
+static int check_apply_kernels(const USRegrid *regrid, const float *source, size_t offset) {
+    size_t n = regrid->target_nx * regrid->target_ny;
+    float *expect = malloc(n * sizeof(float));
+    float *buf = malloc((n + offset) * sizeof(float));
+    ASSERT_NOT_NULL(expect);
+    ASSERT_NOT_NULL(buf);
+    float *out = buf + offset;  /* offset 1: output not vector aligned */
+
+    ASSERT_EQ_INT(regrid_set_apply_kernel(REGRID_APPLY_SCALAR), 0);
+    regrid_apply(regrid, source, -999.0f, expect);
+
+    /* Scalar output follows the mask and fill rules */
+    const float fill = -999.0f;
+    size_t n_value = 0;
+    for (size_t i = 0; i < n; i++) {
+        float v = source[regrid->nn_indices[i]];
+        int ok = regrid_cell_valid(regrid, i) && fabsf(v) < INVALID_DATA_THRESHOLD;
+        ASSERT_TRUE(memcmp(&expect[i], ok ? &v : &fill, sizeof(float)) == 0);
+        n_value += ok;
+    }
+    ASSERT_TRUE(n_value > 0 && n_value < n);
+
+    const RegridApplyKernel kernels[] = {
+        REGRID_APPLY_AVX2, REGRID_APPLY_AVX512, REGRID_APPLY_AUTO
+    };
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (regrid_set_apply_kernel(kernels[k]) != 0) continue;
+        for (size_t i = 0; i < n; i++) out[i] = 12345.0f;
+        regrid_apply(regrid, source, fill, out);
+        ASSERT_TRUE(memcmp(out, expect, n * sizeof(float)) == 0);
+    }
+    ASSERT_EQ_INT(regrid_set_apply_kernel(REGRID_APPLY_AUTO), 0);
+
+    free(expect);
+    free(buf);
+    return 1;
+}
+
+/* Test that every regrid_apply kernel gives bit-identical output */
+TEST(regrid_apply_kernels_match) {
+    USMesh *mesh = create_test_mesh_global(144, 72);
+    ASSERT_NOT_NULL(mesh);
+
+    /* Source values with scattered fill values, huge negatives and NaN */
+    float *source = malloc(mesh->n_points * sizeof(float));
+    ASSERT_NOT_NULL(source);
+    for (size_t i = 0; i < mesh->n_points; i++) {
+        switch (i % 7) {
+            case 3:  source[i] = 1e20f; break;
+            case 5:  source[i] = -3e38f; break;
+            default: source[i] = (float)mesh->lat[i] * 0.5f + (float)i; break;
+        }
+    }
+    source[10] = NAN;
+
+    /*
+     * 1001 x 500: rows straddle SIMD blocks and bitset words, odd tail.
+     * 2400 x 1200: output large enough for streaming stores.
+     */
+    const double resolutions[] = { 360.0 / 1001, 0.15 };
+    for (size_t r = 0; r < 2; r++) {
+        USRegrid *regrid = regrid_create(mesh, resolutions[r], 150000.0);
+        ASSERT_NOT_NULL(regrid);
+        for (size_t offset = 0; offset < 2; offset++) {
+            ASSERT_TRUE(check_apply_kernels(regrid, source, offset));
+        }
+        regrid_free(regrid);
+    }
+
+    free(source);
+    mesh_free(mesh);
+    return 1;
+}
+
+/* Test IDW neighbor count validation */
+TEST(regrid_idw_invalid_neighbors) {
+    USMesh *mesh = create_test_mesh_global(36, 18);
+    ASSERT_NOT_NULL(mesh);
+
+    ASSERT_NULL(regrid_create_idw(mesh, 10.0, 1000000.0, 0));
+    ASSERT_NULL(regrid_create_idw(mesh, 10.0, 1000000.0, MAX_IDW_NEIGHBORS + 1));
+    ASSERT_NULL(regrid_create_idw(NULL, 10.0, 1000000.0, 4));
+
+    mesh_free(mesh);
+    return 1;
+}
+
 RUN_TESTS("Regrid")
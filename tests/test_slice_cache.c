@@ -0,0 +1,189 @@
+/*
+ * test_slice_cache.c - Unit tests for the decoded slice LRU cache
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/slice_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define N_VALUES 100
+
+/* Bytes one cached N_VALUES slice is charged, found by inserting one */
+static size_t slice_charge(void) {
+    static size_t charge = 0;
+    if (!charge) {
+        USSliceCache *cache = slice_cache_create(1 << 20);
+        float data[N_VALUES] = {0};
+        USSliceKey key = { NULL, NULL, 0, 0 };
+        USSliceCacheStats st;
+        slice_cache_put(cache, &key, data, N_VALUES);
+        slice_cache_get_stats(cache, &st);
+        charge = st.bytes_used;
+        slice_cache_free(cache);
+    }
+    return charge;
+}
+
+static void fill_slice(float *data, size_t t) {
+    for (size_t i = 0; i < N_VALUES; i++) data[i] = (float)(t * 1000 + i);
+}
+
+static USSliceKey make_key(const USVar *var, size_t t, size_t d) {
+    USSliceKey key = { (const void *)0x1000, var, t, d };
+    return key;
+}
+
+/* Test a zero budget disables the cache */
+TEST(slice_cache_zero_budget) {
+    ASSERT_NULL(slice_cache_create(0));
+
+    /* NULL cache behaves as always-miss */
+    float out[N_VALUES];
+    USSliceKey key = make_key(NULL, 0, 0);
+    ASSERT_EQ_INT(slice_cache_get(NULL, &key, out, N_VALUES), 0);
+    ASSERT_EQ_INT(slice_cache_put(NULL, &key, out, N_VALUES), -1);
+    slice_cache_free(NULL);
+    return 1;
+}
+
+/* Test put then get returns the same values and counts hits/misses */
+TEST(slice_cache_roundtrip) {
+    USSliceCache *cache = slice_cache_create(1 << 20);
+    ASSERT_NOT_NULL(cache);
+
+    USVar var;
+    float data[N_VALUES], out[N_VALUES];
+    fill_slice(data, 3);
+
+    USSliceKey key = make_key(&var, 3, 1);
+    ASSERT_EQ_INT(slice_cache_get(cache, &key, out, N_VALUES), 0);
+    ASSERT_EQ_INT(slice_cache_put(cache, &key, data, N_VALUES), 0);
+    ASSERT_EQ_INT(slice_cache_get(cache, &key, out, N_VALUES), 1);
+    ASSERT_TRUE(memcmp(data, out, sizeof(data)) == 0);
+
+    /* Each key field takes part in the lookup */
+    USSliceKey other = key;
+    other.depth_index = 2;
+    ASSERT_EQ_INT(slice_cache_get(cache, &other, out, N_VALUES), 0);
+    other = key;
+    other.time_index = 4;
+    ASSERT_EQ_INT(slice_cache_get(cache, &other, out, N_VALUES), 0);
+    other = key;
+    other.source = (const void *)0x2000;
+    ASSERT_EQ_INT(slice_cache_get(cache, &other, out, N_VALUES), 0);
+
+    /* A size mismatch is a miss */
+    ASSERT_EQ_INT(slice_cache_get(cache, &key, out, N_VALUES - 1), 0);
+
+    USSliceCacheStats st;
+    slice_cache_get_stats(cache, &st);
+    ASSERT_EQ_SIZET(st.hits, 1);
+    ASSERT_EQ_SIZET(st.misses, 5);
+    ASSERT_EQ_SIZET(st.n_entries, 1);
+
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test least recently used slices are evicted first */
+TEST(slice_cache_lru_eviction) {
+    USSliceCache *cache = slice_cache_create(3 * slice_charge());
+    ASSERT_NOT_NULL(cache);
+
+    USVar var;
+    float data[N_VALUES], out[N_VALUES];
+    for (size_t t = 0; t < 3; t++) {
+        USSliceKey key = make_key(&var, t, 0);
+        fill_slice(data, t);
+        ASSERT_EQ_INT(slice_cache_put(cache, &key, data, N_VALUES), 0);
+    }
+
+    /* Touch t=0 so t=1 becomes least recently used */
+    USSliceKey k0 = make_key(&var, 0, 0);
+    ASSERT_EQ_INT(slice_cache_get(cache, &k0, out, N_VALUES), 1);
+
+    USSliceKey k3 = make_key(&var, 3, 0);
+    fill_slice(data, 3);
+    ASSERT_EQ_INT(slice_cache_put(cache, &k3, data, N_VALUES), 0);
+
+    USSliceKey k1 = make_key(&var, 1, 0);
+    USSliceKey k2 = make_key(&var, 2, 0);
+    ASSERT_EQ_INT(slice_cache_get(cache, &k1, out, N_VALUES), 0);
+    ASSERT_EQ_INT(slice_cache_get(cache, &k0, out, N_VALUES), 1);
+    ASSERT_EQ_INT(slice_cache_get(cache, &k2, out, N_VALUES), 1);
+    ASSERT_EQ_INT(slice_cache_get(cache, &k3, out, N_VALUES), 1);
+    fill_slice(data, 3);
+    ASSERT_TRUE(memcmp(data, out, sizeof(data)) == 0);
+
+    USSliceCacheStats st;
+    slice_cache_get_stats(cache, &st);
+    ASSERT_EQ_SIZET(st.evictions, 1);
+    ASSERT_EQ_SIZET(st.n_entries, 3);
+    ASSERT_LE(st.bytes_used, st.budget_bytes);
+
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test a slice larger than the budget is not stored */
+TEST(slice_cache_oversize) {
+    USSliceCache *cache = slice_cache_create(slice_charge() - 1);
+    ASSERT_NOT_NULL(cache);
+
+    float data[N_VALUES] = {0};
+    USSliceKey key = make_key(NULL, 0, 0);
+    ASSERT_EQ_INT(slice_cache_put(cache, &key, data, N_VALUES), -1);
+
+    USSliceCacheStats st;
+    slice_cache_get_stats(cache, &st);
+    ASSERT_EQ_SIZET(st.n_entries, 0);
+    ASSERT_EQ_SIZET(st.bytes_used, 0);
+
+    slice_cache_free(cache);
+    return 1;
+}
+
+/* Test replacing a key and growing past the initial bucket count */
+TEST(slice_cache_replace_and_grow) {
+    USSliceCache *cache = slice_cache_create(1000 * slice_charge());
+    ASSERT_NOT_NULL(cache);
+
+    USVar var;
+    float data[N_VALUES], out[N_VALUES];
+    for (size_t t = 0; t < 500; t++) {
+        USSliceKey key = make_key(&var, t, t % 7);
+        fill_slice(data, t);
+        ASSERT_EQ_INT(slice_cache_put(cache, &key, data, N_VALUES), 0);
+    }
+
+    /* Overwrite one entry with new values */
+    USSliceKey key = make_key(&var, 42, 42 % 7);
+    fill_slice(data, 9999);
+    ASSERT_EQ_INT(slice_cache_put(cache, &key, data, N_VALUES), 0);
+
+    USSliceCacheStats st;
+    slice_cache_get_stats(cache, &st);
+    ASSERT_EQ_SIZET(st.n_entries, 500);
+    ASSERT_EQ_SIZET(st.evictions, 0);
+
+    ASSERT_EQ_INT(slice_cache_get(cache, &key, out, N_VALUES), 1);
+    ASSERT_TRUE(memcmp(data, out, sizeof(data)) == 0);
+    for (size_t t = 0; t < 500; t++) {
+        USSliceKey k = make_key(&var, t, t % 7);
+        ASSERT_EQ_INT(slice_cache_get(cache, &k, out, N_VALUES), 1);
+        if (t != 42) ASSERT_EQ(out[1], (float)(t * 1000 + 1));
+    }
+
+    slice_cache_clear(cache);
+    slice_cache_get_stats(cache, &st);
+    ASSERT_EQ_SIZET(st.n_entries, 0);
+    ASSERT_EQ_SIZET(st.bytes_used, 0);
+    ASSERT_EQ_INT(slice_cache_get(cache, &key, out, N_VALUES), 0);
+
+    slice_cache_free(cache);
+    return 1;
+}
+
+RUN_TESTS("Slice Cache")
@@ -0,0 +1,231 @@
+/*
+ * test_view.c - Tests for the view's fused nearest-neighbour rendering
+ *
+ * The fused path gathers source values through the per-row pixel_src
+ * table and colourises them straight into display pixels. Its frames must
+ * match the step-by-step path: regrid_apply, colormap_apply, expand, pack.
+ */
+
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/anim_store.h"
+#include "../src/colormaps.h"
+#include "../src/mesh.h"
+#include "../src/regrid.h"
+#include "../src/view.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define N_POINTS    20000
+#define RESOLUTION  2.0
+#define RADIUS_M    150000.0
+#define FILL        (-999.0f)
+#define RANGE_MIN   (-2.0f)
+#define RANGE_MAX   3.0f
+
+typedef struct {
+    USMesh      *mesh;
+    USRegrid    *regrid;
+    USVar        var;
+    USView      *view;
+    float       *values;
+} Fixture;
+
+/*
+ * Random points with a hole (so some cells have no source in range), and
+ * values spanning beyond the colour range with fills, NaNs and huge values.
+ */
+static int fixture_init(Fixture *fx, PixelFormat format) {
+    static int colormaps_ready = 0;
+    if (!colormaps_ready) {
+        colormaps_init();
+        colormaps_ready = 1;
+    }
+
+    double *lon = malloc(N_POINTS * sizeof(double));
+    double *lat = malloc(N_POINTS * sizeof(double));
+    fx->values = malloc(N_POINTS * sizeof(float));
+    if (!lon || !lat || !fx->values) return -1;
+    srand(2024);
+    for (size_t i = 0; i < N_POINTS; i++) {
+        do {
+            lon[i] = ((double)rand() / RAND_MAX) * 360.0 - 180.0;
+            lat[i] = asin(2.0 * ((double)rand() / RAND_MAX) - 1.0) / DEG2RAD;
+        } while (lon[i] > 0.0 && lon[i] < 40.0 && lat[i] > 0.0 && lat[i] < 30.0);
+
+        float v = RANGE_MIN - 1.0f + 7.0f * (float)rand() / (float)RAND_MAX;
+        if (i % 13 == 0) v = FILL;
+        else if (i % 29 == 0) v = NAN;
+        else if (i % 31 == 0) v = 1e35f;
+        fx->values[i] = v;
+    }
+    fx->mesh = mesh_create(lon, lat, N_POINTS, COORD_TYPE_1D_STRUCTURED);
+    fx->regrid = fx->mesh ? regrid_create(fx->mesh, RESOLUTION, RADIUS_M) : NULL;
+    if (!fx->regrid) return -1;
+
+    memset(&fx->var, 0, sizeof(fx->var));
+    strcpy(fx->var.name, "field");
+    fx->var.fill_value = FILL;
+    fx->var.time_dim_id = -1;
+    fx->var.depth_dim_id = -1;
+    fx->var.global_min = fx->var.user_min = RANGE_MIN;
+    fx->var.global_max = fx->var.user_max = RANGE_MAX;
+    fx->var.range_set = 1;
+
+    fx->view = view_create();
+    if (!fx->view || view_set_variable(fx->view, &fx->var, fx->mesh, fx->regrid) != 0) return -1;
+    if (view_set_native_format(fx->view, format) != 0) return -1;
+
+    USSliceKey key = slice_key_make(&fx->var, NULL, 0, 0);
+    USAnimStore *store = anim_store_create(&key, 1, N_POINTS, ANIM_STORE_LOSSLESS, FILL);
+    if (!store || anim_store_put(store, 0, fx->values) != 0) {
+        anim_store_free(store);
+        return -1;
+    }
+    fx->view->anim_store = store;
+    return 0;
+}
+
+static void fixture_free(Fixture *fx) {
+    view_free(fx->view);
+    regrid_free(fx->regrid);
+    mesh_free(fx->mesh);
+    free(fx->values);
+}
+
+/* Whether v lies within float rounding of a colour boundary (the LUT may pick either side) */
+static int near_colour_boundary(const USColormap *cmap, float v) {
+    if (!(fabsf(v) <= INVALID_DATA_THRESHOLD) || v == FILL) return 0;
+    float t = (v - RANGE_MIN) / (RANGE_MAX - RANGE_MIN);
+    if (t <= 0.0f || t >= 1.0f) return 0;
+    float pos = t * (float)(cmap->n_colors - 1);
+    return fabsf(pos - roundf(pos)) < 1e-3f;
+}
+
+/* Fused frames at scales 1-3 against regrid_apply -> colormap_apply -> expand -> pack */
+static int check_fused(PixelFormat format) {
+    Fixture fx;
+    ASSERT_EQ_INT(fixture_init(&fx, format), 0);
+    USView *view = fx.view;
+    USColormap *cmap = colormap_get_current();
+    ASSERT_NOT_NULL(cmap);
+    ASSERT_NOT_NULL(view->pixel_src);
+
+    size_t nx = view->data_nx, ny = view->data_ny;
+    size_t bpp = colormap_pixel_bytes(format);
+    float *regridded = malloc(nx * ny * sizeof(float));
+    unsigned char *rgb = malloc(nx * ny * 3);
+    unsigned char *expanded = malloc(nx * ny * 9 * 3);
+    ASSERT_NOT_NULL(regridded);
+    ASSERT_NOT_NULL(rgb);
+    ASSERT_NOT_NULL(expanded);
+
+    regrid_apply(fx.regrid, fx.values, FILL, regridded);
+    colormap_apply(cmap, regridded, nx, ny, RANGE_MIN, RANGE_MAX, FILL, rgb);
+
+    /* The field must exercise every case: in range, clamped, missing, out of reach */
+    size_t n_low = 0, n_high = 0, n_missing = 0, n_unreached = 0;
+    for (size_t i = 0; i < nx * ny; i++) {
+        float v = regridded[i];
+        if (!regrid_cell_valid(fx.regrid, i)) n_unreached++;
+        else if (v == FILL || v != v || fabsf(v) > INVALID_DATA_THRESHOLD) n_missing++;
+        else if (v < RANGE_MIN) n_low++;
+        else if (v > RANGE_MAX) n_high++;
+    }
+    ASSERT_GT(n_low, 0);
+    ASSERT_GT(n_high, 0);
+    ASSERT_GT(n_missing, 0);
+    ASSERT_GT(n_unreached, 0);
+
+    for (int scale = 1; scale <= 3; scale++) {
+        ASSERT_EQ_INT(view_set_scale(view, scale), 0);
+        ASSERT_EQ_INT(view_update(view), 0);
+        ASSERT_TRUE(view->regrid_stale);  /* Rendered without the regridded grid */
+        size_t width, height;
+        const unsigned char *native = view_get_native_pixels(view, &width, &height);
+        ASSERT_NOT_NULL(native);
+        ASSERT_EQ_SIZET(width, nx * scale);
+        ASSERT_EQ_SIZET(height, ny * scale);
+
+        colormap_expand_pixels(rgb, nx, ny, expanded, scale);
+        size_t n_ties = 0;
+        for (size_t py = 0; py < height; py++) {
+            for (size_t px = 0; px < width; px++) {
+                const unsigned char *c = expanded + (py * width + px) * 3;
+                uint32_t want = colormap_pack_pixel(format, c[0], c[1], c[2]);
+                uint32_t got = (bpp == 4) ? ((const uint32_t *)native)[py * width + px]
+                                          : ((const uint16_t *)native)[py * width + px];
+                if (got == want) continue;
+                float v = regridded[(ny - 1 - py / scale) * nx + px / scale];
+                ASSERT_TRUE(near_colour_boundary(cmap, v));
+                n_ties++;
+            }
+        }
+        ASSERT_LT(n_ties, width * height / 1000);
+
+        /* Hover values read through the index table while regridded_data is behind */
+        for (size_t i = 0; i < nx * ny; i += 7) {
+            ASSERT_TRUE(view_get_value(view, i % nx, i / nx) == regridded[i]);
+        }
+    }
+
+    free(regridded);
+    free(rgb);
+    free(expanded);
+    fixture_free(&fx);
+    return 1;
+}
+
+/* Test fused XRGB8888 frames */
+TEST(view_fused_xrgb8888) {
+    return check_fused(PIXEL_FORMAT_XRGB8888);
+}
+
+/* Test fused RGB565 frames */
+TEST(view_fused_rgb565) {
+    return check_fused(PIXEL_FORMAT_RGB565);
+}
+
+/* Test the RGB buffer is brought up to date after a fused frame */
+TEST(view_fused_rgb_sync) {
+    Fixture fx;
+    ASSERT_EQ_INT(fixture_init(&fx, PIXEL_FORMAT_XRGB8888), 0);
+    USView *view = fx.view;
+    size_t nx = view->data_nx, ny = view->data_ny;
+    float *regridded = malloc(nx * ny * sizeof(float));
+    unsigned char *rgb = malloc(nx * ny * 3);
+    ASSERT_NOT_NULL(regridded);
+    ASSERT_NOT_NULL(rgb);
+
+    ASSERT_EQ_INT(view_update(view), 0);
+    ASSERT_NOT_NULL(view_get_native_pixels(view, NULL, NULL));
+    size_t width, height;
+    unsigned char *pixels = view_get_pixels(view, &width, &height);
+    ASSERT_NOT_NULL(pixels);
+    ASSERT_EQ_SIZET(width, nx * view->scale_factor);
+
+    /* At scale 1 the RGB frame is colormap_apply() of the regridded field */
+    ASSERT_EQ_INT(view_set_scale(view, 1), 0);
+    ASSERT_EQ_INT(view_update(view), 0);
+    pixels = view_get_pixels(view, &width, &height);
+    ASSERT_NOT_NULL(pixels);
+    regrid_apply(fx.regrid, fx.values, FILL, regridded);
+    colormap_apply(colormap_get_current(), regridded, nx, ny, RANGE_MIN, RANGE_MAX, FILL, rgb);
+    size_t n_diff = 0;
+    for (size_t i = 0; i < nx * ny; i++) {
+        if (memcmp(pixels + 3 * i, rgb + 3 * i, 3) != 0) {
+            ASSERT_TRUE(near_colour_boundary(colormap_get_current(),
+                                             regridded[(ny - 1 - i / nx) * nx + i % nx]));
+            n_diff++;
+        }
+    }
+    ASSERT_LT(n_diff, nx * ny / 1000);
+
+    free(regridded);
+    free(rgb);
+    fixture_free(&fx);
+    return 1;
+}
+
+RUN_TESTS("View")
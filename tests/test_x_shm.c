@@ -0,0 +1,219 @@
+/*
+ * test_x_shm.c - Tests for showing frames through MIT-SHM shared memory
+ *
+ * Needs an X server (Xvfb will do): every test is skipped when no display
+ * can be opened. XShmAttach, XShmPutImage and XPutImage are wrapped here
+ * to count which path a frame took, and the attach can be made to fail
+ * the way it does on a display forwarded from another host.
+ */
+
+#define _GNU_SOURCE
+#include "test_framework.h"
+#include "../src/ushow.defines.h"
+#include "../src/colormaps.h"
+#include "../src/interface/x_interface.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#define IMAGE_NX 64
+#define IMAGE_NY 48
+
+static int n_attach = 0;
+static int n_shm_put = 0;
+static int n_put = 0;
+static int fail_attach = 0;     /* Hand the server a segment it cannot attach */
+static int last_shmid = -1;     /* Segment of the last attach that was let through */
+
+Bool XShmAttach(Display *dpy, XShmSegmentInfo *shminfo) {
+    static Bool (*real)(Display *, XShmSegmentInfo *) = NULL;
+    if (!real) real = (Bool (*)(Display *, XShmSegmentInfo *))dlsym(RTLD_NEXT, "XShmAttach");
+    n_attach++;
+    if (fail_attach) {
+        /* A server on another host cannot see our segment: it replies BadAccess */
+        XShmSegmentInfo bad = *shminfo;
+        bad.shmid = -1;
+        return real(dpy, &bad);
+    }
+    last_shmid = shminfo->shmid;
+    return real(dpy, shminfo);
+}
+
+Bool XShmPutImage(Display *dpy, Drawable d, GC gc, XImage *image, int src_x, int src_y,
+                  int dst_x, int dst_y, unsigned int width, unsigned int height,
+                  Bool send_event) {
+    static Bool (*real)(Display *, Drawable, GC, XImage *, int, int, int, int,
+                        unsigned int, unsigned int, Bool) = NULL;
+    if (!real) real = (Bool (*)(Display *, Drawable, GC, XImage *, int, int, int, int,
+                                unsigned int, unsigned int, Bool))dlsym(RTLD_NEXT, "XShmPutImage");
+    n_shm_put++;
+    return real(dpy, d, gc, image, src_x, src_y, dst_x, dst_y, width, height, send_event);
+}
+
+int XPutImage(Display *dpy, Drawable d, GC gc, XImage *image, int src_x, int src_y,
+              int dst_x, int dst_y, unsigned int width, unsigned int height) {
+    static int (*real)(Display *, Drawable, GC, XImage *, int, int, int, int,
+                       unsigned int, unsigned int) = NULL;
+    if (!real) real = (int (*)(Display *, Drawable, GC, XImage *, int, int, int, int,
+                               unsigned int, unsigned int))dlsym(RTLD_NEXT, "XPutImage");
+    n_put++;
+    return real(dpy, d, gc, image, src_x, src_y, dst_x, dst_y, width, height);
+}
+
+/* Open the interface once; 0 (and a note) when there is no display to test on */
+static int x_ready(void) {
+    static int state = 0;   /* 0: untried, 1: open, -1: no display */
+    if (state == 0) {
+        Display *probe = XOpenDisplay(NULL);
+        if (!probe) {
+            state = -1;
+        } else {
+            XCloseDisplay(probe);
+            colormaps_init();
+            int argc = 1;
+            char *argv[] = { "test_x_shm", NULL };
+            const char *var_names[] = { "field" };
+            state = (x_init(&argc, argv, var_names, 1, NULL, 0) == 0) ? 1 : -1;
+        }
+    }
+    if (state < 0) printf(COLOR_YELLOW "skipped (no X display) " COLOR_RESET);
+    return state > 0;
+}
+
+/* Number of processes attached to a segment, or -1 once it is gone */
+static int segment_attached(int shmid) {
+    struct shmid_ds ds;
+    if (shmid < 0 || shmctl(shmid, IPC_STAT, &ds) != 0) return -1;
+    return (int)ds.shm_nattch;
+}
+
+static size_t pixel_bytes(void) {
+    PixelFormat format = x_get_pixel_format();
+    return format == PIXEL_FORMAT_NONE ? 4 : colormap_pixel_bytes(format);
+}
+
+/* Test native frames in shared memory are sent as XShmPutImage requests */
+TEST(x_shm_native_frames) {
+    if (!x_ready()) return 1;
+    PixelFormat format = x_get_pixel_format();
+    size_t bytes = IMAGE_NX * IMAGE_NY * pixel_bytes();
+
+    /* Two buffers, as the animation pipeline alternates between frames */
+    int attach0 = n_attach;
+    unsigned char *frames[2];
+    int shmids[2];
+    for (int i = 0; i < 2; i++) {
+        frames[i] = x_alloc_pixels(bytes);
+        ASSERT_NOT_NULL(frames[i]);
+        ASSERT_EQ_INT(n_attach, attach0 + i + 1);
+        shmids[i] = last_shmid;
+        ASSERT_EQ_INT(segment_attached(shmids[i]), 2);  /* This client and the server */
+    }
+
+    if (format != PIXEL_FORMAT_NONE) {
+        int shm_put0 = n_shm_put, put0 = n_put;
+        for (int f = 0; f < 6; f++) {
+            memset(frames[f % 2], 0x10 * (f + 1), bytes);
+            x_update_image_native(frames[f % 2], format, IMAGE_NX, IMAGE_NY);
+        }
+        ASSERT_EQ_INT(n_shm_put, shm_put0 + 6);
+        ASSERT_EQ_INT(n_put, put0);
+    }
+
+    /* Freeing detaches both sides, and the segment is removed with the last one */
+    for (int i = 0; i < 2; i++) {
+        x_free_pixels(frames[i]);
+        ASSERT_EQ_INT(segment_attached(shmids[i]), -1);
+    }
+    return 1;
+}
+
+/* Test RGB frames are converted into a shared memory image too */
+TEST(x_shm_rgb_frames) {
+    if (!x_ready()) return 1;
+    unsigned char *rgb = malloc(2 * IMAGE_NX * 2 * IMAGE_NY * 3);
+    ASSERT_NOT_NULL(rgb);
+    for (size_t i = 0; i < 4 * IMAGE_NX * IMAGE_NY * 3; i++) rgb[i] = (unsigned char)i;
+
+    int shm_put0 = n_shm_put, put0 = n_put;
+    x_update_image(rgb, IMAGE_NX, IMAGE_NY);
+    x_update_image(rgb, IMAGE_NX, IMAGE_NY);
+    /* A new size replaces the segment */
+    x_update_image(rgb, 2 * IMAGE_NX, 2 * IMAGE_NY);
+    ASSERT_EQ_INT(n_shm_put, shm_put0 + 3);
+    ASSERT_EQ_INT(n_put, put0);
+
+    free(rgb);
+    return 1;
+}
+
+/* Test --no-shm: buffers come from malloc and frames go through XPutImage */
+TEST(x_shm_disabled) {
+    if (!x_ready()) return 1;
+    PixelFormat format = x_get_pixel_format();
+    size_t bytes = IMAGE_NX * IMAGE_NY * pixel_bytes();
+
+    x_set_shm(0);
+    int attach0 = n_attach, shm_put0 = n_shm_put, put0 = n_put;
+    unsigned char *frame = x_alloc_pixels(bytes);
+    ASSERT_NOT_NULL(frame);
+    ASSERT_EQ_INT(n_attach, attach0);
+    memset(frame, 0x40, bytes);
+    if (format != PIXEL_FORMAT_NONE) {
+        x_update_image_native(frame, format, IMAGE_NX, IMAGE_NY);
+        ASSERT_EQ_INT(n_put, put0 + 1);
+        ASSERT_EQ_INT(n_shm_put, shm_put0);
+    }
+    x_free_pixels(frame);
+
+    x_set_shm(1);
+    frame = x_alloc_pixels(bytes);
+    ASSERT_NOT_NULL(frame);
+    ASSERT_EQ_INT(n_attach, attach0 + 1);
+    x_free_pixels(frame);
+    return 1;
+}
+
+/* Test a failed attach is trapped and the session falls back to XPutImage */
+TEST(x_shm_attach_failure) {
+    if (!x_ready()) return 1;
+    PixelFormat format = x_get_pixel_format();
+    size_t bytes = IMAGE_NX * IMAGE_NY * pixel_bytes();
+
+    fail_attach = 1;
+    int attach0 = n_attach, shm_put0 = n_shm_put, put0 = n_put;
+    unsigned char *frame = x_alloc_pixels(bytes);
+    ASSERT_NOT_NULL(frame);
+    ASSERT_EQ_INT(n_attach, attach0 + 1);
+    memset(frame, 0x80, bytes);
+    if (format != PIXEL_FORMAT_NONE) {
+        x_update_image_native(frame, format, IMAGE_NX, IMAGE_NY);
+        ASSERT_EQ_INT(n_put, put0 + 1);
+        ASSERT_EQ_INT(n_shm_put, shm_put0);
+    }
+
+    /* Not tried again for later buffers */
+    unsigned char *other = x_alloc_pixels(bytes);
+    ASSERT_NOT_NULL(other);
+    ASSERT_EQ_INT(n_attach, attach0 + 1);
+    x_free_pixels(other);
+    x_free_pixels(frame);
+    fail_attach = 0;
+
+    /* Allowed again, shared memory works once more */
+    x_set_shm(1);
+    frame = x_alloc_pixels(bytes);
+    ASSERT_NOT_NULL(frame);
+    ASSERT_EQ_INT(n_attach, attach0 + 2);
+    ASSERT_EQ_INT(segment_attached(last_shmid), 2);
+    x_free_pixels(frame);
+
+    x_cleanup();
+    return 1;
+}
+
+RUN_TESTS("X MIT-SHM")